@@ -200,6 +200,34 @@ class SuricataSC:
                         else:
                             arguments = {}
                             arguments["variable"] = variable
+                    elif "rule-sample-top" in command:
+                        args = command.split(' ')
+                        if args[0] != "rule-sample-top" or len(args) > 3:
+                            print "Error: invalid command '%s'" % (command)
+                            continue
+                        cmd = args[0]
+                        arguments = {}
+                        if len(args) > 1:
+                            try:
+                                arguments["count"] = int(args[1])
+                            except:
+                                print "Error: count '%s' is not a number" % (args[1])
+                                continue
+                        if len(args) > 2:
+                            arguments["sort"] = args[2]
+                    elif "pcre-stats" in command:
+                        args = command.split(' ')
+                        if args[0] != "pcre-stats" or len(args) > 2:
+                            print "Error: invalid command '%s'" % (command)
+                            continue
+                        cmd = args[0]
+                        arguments = {}
+                        if len(args) > 1:
+                            try:
+                                arguments["count"] = int(args[1])
+                            except:
+                                print "Error: count '%s' is not a number" % (args[1])
+                                continue
                     else:
                         cmd = command
                 else:
@@ -305,6 +305,12 @@ error:
 
 static void HtpTxUserDataFree(HtpTxUserData *htud) {
     if (htud) {
+        int i;
+        for (i = 0; i < HTP_INSPECT_BUFFER_MAX; i++) {
+            if (htud->inspect_buffers[i].buffer != NULL)
+                HTPFree(htud->inspect_buffers[i].buffer,
+                        htud->inspect_buffers[i].buffer_size);
+        }
         HtpBodyFree(&htud->request_body);
         HtpBodyFree(&htud->response_body);
         bstr_free(htud->request_uri_normalized);
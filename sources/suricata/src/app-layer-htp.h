@@ -195,6 +195,23 @@ typedef struct HtpBody_ {
 #define HTP_RULE_NEED_TYPE          HTP_TX_HAS_TYPE
 #define HTP_RULE_NEED_FILECONTENT   HTP_TX_HAS_FILECONTENT
 
+/** A buffer the detection engine assembles from the tx, like the
+ *  normalized headers. It's built once and then used by the mpm and all
+ *  sigs until the tx data changes, which changes gen. */
+typedef struct HtpTxInspectBuffer_ {
+    uint8_t *buffer;
+    uint32_t buffer_len;
+    uint32_t buffer_size;
+    uint32_t gen;           /**< generation it was built for, 0 if unset */
+} HtpTxInspectBuffer;
+
+enum {
+    HTP_INSPECT_BUFFER_REQUEST_HEADERS = 0,
+    HTP_INSPECT_BUFFER_RESPONSE_HEADERS,
+
+    HTP_INSPECT_BUFFER_MAX,
+};
+
 /** Now the Body Chunks will be stored per transaction, at
   * the tx user data */
 typedef struct HtpTxUserData_ {
@@ -211,6 +228,8 @@ typedef struct HtpTxUserData_ {
     uint32_t request_headers_raw_len;
     uint32_t response_headers_raw_len;
 
+    HtpTxInspectBuffer inspect_buffers[HTP_INSPECT_BUFFER_MAX];
+
     AppLayerDecoderEvents *decoder_events;          /**< per tx events */
 
     /** Holds the boundary identificator string if any (used on
@@ -54,6 +54,8 @@
  * has been added to the mpm phase and requires no further inspection inside
  * the inspection phase */
 #define DETECT_CONTENT_NO_DOUBLE_INSPECTION_REQUIRED (1 << 16)
+/* content added as a fast pattern for a pcre, see DetectPcreSetupPrefilter */
+#define DETECT_CONTENT_PCRE_PREFILTER    (1 << 17)
 
 #define DETECT_CONTENT_IS_SINGLE(c) (!( ((c)->flags & DETECT_CONTENT_DISTANCE) || \
                                         ((c)->flags & DETECT_CONTENT_WITHIN) || \
@@ -177,7 +177,41 @@ int PacketAlertRemove(Packet *p, uint16_t pos)
     return match;
 }
 
-/** \brief append a signature match to a packet
+/** initial number of alerts the per thread queue holds, it grows on
+ *  demand so alert storms are not cut off before they are sorted */
+#define PACKET_ALERT_QUEUE_INITIAL_SIZE 64
+
+/**
+ * \brief Setup the per thread alert queue
+ *
+ * \retval 0 ok
+ * \retval -1 error
+ */
+int PacketAlertThreadInit(DetectEngineThreadCtx *det_ctx)
+{
+    det_ctx->alert_queue = SCMalloc(PACKET_ALERT_QUEUE_INITIAL_SIZE *
+                                    sizeof(PacketAlert));
+    if (det_ctx->alert_queue == NULL)
+        return -1;
+    det_ctx->alert_queue_size = PACKET_ALERT_QUEUE_INITIAL_SIZE;
+    det_ctx->alert_queue_cnt = 0;
+    det_ctx->alert_queue_unsorted = 0;
+    return 0;
+}
+
+void PacketAlertThreadDeinit(DetectEngineThreadCtx *det_ctx)
+{
+    if (det_ctx->alert_queue != NULL)
+        SCFree(det_ctx->alert_queue);
+    det_ctx->alert_queue = NULL;
+    det_ctx->alert_queue_size = 0;
+    det_ctx->alert_queue_cnt = 0;
+}
+
+/** \brief append a signature match to the thread's alert queue
+ *
+ *  The alerts are only sorted and moved to the packet by
+ *  PacketAlertFinalize, so appending is constant time.
  *
  *  \param det_ctx thread detection engine ctx
  *  \param s the signature that matched
@@ -187,64 +221,89 @@ int PacketAlertRemove(Packet *p, uint16_t pos)
  */
 int PacketAlertAppend(DetectEngineThreadCtx *det_ctx, Signature *s, Packet *p, uint64_t tx_id, uint8_t flags)
 {
-    int i = 0;
-
-    if (p->alerts.cnt == PACKET_ALERT_MAX)
-        return 0;
+    PacketAlert *pa;
 
     SCLogDebug("sid %"PRIu32"", s->id);
 
-    /* It should be usually the last, so check it before iterating */
-    if (p->alerts.cnt == 0 || (p->alerts.cnt > 0 &&
-                               p->alerts.alerts[p->alerts.cnt - 1].num < s->num)) {
-        /* We just add it */
-        p->alerts.alerts[p->alerts.cnt].num = s->num;
-        p->alerts.alerts[p->alerts.cnt].action = s->action;
-        p->alerts.alerts[p->alerts.cnt].flags = flags;
-        p->alerts.alerts[p->alerts.cnt].s = s;
-        p->alerts.alerts[p->alerts.cnt].tx_id = tx_id;
-    } else {
-        /* We need to make room for this s->num
-         (a bit ugly with memcpy but we are planning changes here)*/
-        for (i = p->alerts.cnt - 1; i >= 0 && p->alerts.alerts[i].num > s->num; i--) {
-            memcpy(&p->alerts.alerts[i + 1], &p->alerts.alerts[i], sizeof(PacketAlert));
+    if (det_ctx->alert_queue_cnt == det_ctx->alert_queue_size) {
+        uint32_t new_size = det_ctx->alert_queue_size * 2;
+        if (new_size == 0)
+            new_size = PACKET_ALERT_QUEUE_INITIAL_SIZE;
+
+        PacketAlert *ptmp = SCRealloc(det_ctx->alert_queue,
+                                      new_size * sizeof(PacketAlert));
+        if (ptmp == NULL) {
+            SCPerfCounterIncr(det_ctx->counter_alert_queue_overflow,
+                              det_ctx->tv->sc_perf_pca);
+            return 0;
         }
-
-        i++; /* The right place to store the alert */
-
-        p->alerts.alerts[i].num = s->num;
-        p->alerts.alerts[i].action = s->action;
-        p->alerts.alerts[i].flags = flags;
-        p->alerts.alerts[i].s = s;
-        p->alerts.alerts[i].tx_id = tx_id;
+        det_ctx->alert_queue = ptmp;
+        det_ctx->alert_queue_size = new_size;
     }
 
-    /* Update the count */
-    p->alerts.cnt++;
+    /* sigs are mostly inspected in num order, so only remember if
+     * we need to sort in PacketAlertFinalize */
+    if (det_ctx->alert_queue_cnt > 0 &&
+        det_ctx->alert_queue[det_ctx->alert_queue_cnt - 1].num > s->num)
+        det_ctx->alert_queue_unsorted = 1;
+
+    pa = &det_ctx->alert_queue[det_ctx->alert_queue_cnt];
+    pa->num = s->num;
+    pa->order_id = det_ctx->alert_queue_cnt;
+    pa->action = s->action;
+    pa->flags = flags;
+    pa->s = s;
+    pa->tx_id = tx_id;
+
+    det_ctx->alert_queue_cnt++;
+    return 0;
+}
 
+/** \internal
+ *  \brief sort by sig num, alerts of the same sig in the order they
+ *         were appended (order_id holds the queue position) */
+static int PacketAlertQueueCompare(const void *a, const void *b)
+{
+    const PacketAlert *pa0 = (const PacketAlert *)a;
+    const PacketAlert *pa1 = (const PacketAlert *)b;
+
+    if (pa0->num != pa1->num)
+        return pa0->num < pa1->num ? -1 : 1;
+    if (pa0->order_id != pa1->order_id)
+        return pa0->order_id < pa1->order_id ? -1 : 1;
     return 0;
 }
 
 /**
  * \brief Check the threshold of the sigs that match, set actions, break on pass action
- *        This function iterate the packet alerts array, removing those that didn't match
- *        the threshold, and those that match after a signature with the action "pass".
- *        The array is sorted by action priority/order
+ *        This function sorts the thread's alert queue by action priority/order
+ *        and moves the alerts that match the threshold to the packet, stopping
+ *        at a signature with the action "pass". Alerts that no longer fit in
+ *        the packet's array are counted as alert queue overflows, their
+ *        thresholds and actions are still applied.
  * \param de_ctx detection engine context
  * \param det_ctx detection engine thread context
  * \param p pointer to the packet
  */
 void PacketAlertFinalize(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx, Packet *p) {
     SCEnter();
-    int i = 0;
+    uint32_t i = 0;
     Signature *s = NULL;
     SigMatch *sm = NULL;
 
-    while (i < p->alerts.cnt) {
-        SCLogDebug("Sig->num: %"PRIu16, p->alerts.alerts[i].num);
-        s = de_ctx->sig_array[p->alerts.alerts[i].num];
+    if (det_ctx->alert_queue_unsorted) {
+        qsort(det_ctx->alert_queue, det_ctx->alert_queue_cnt,
+              sizeof(PacketAlert), PacketAlertQueueCompare);
+    }
+
+    p->alerts.cnt = 0;
+    for (i = 0; i < det_ctx->alert_queue_cnt; i++) {
+        PacketAlert *pa = &det_ctx->alert_queue[i];
+
+        SCLogDebug("Sig->num: %"PRIu16, pa->num);
+        s = de_ctx->sig_array[pa->num];
 
-        int res = PacketAlertHandle(de_ctx, det_ctx, s, p, i);
+        int res = PacketAlertHandle(de_ctx, det_ctx, s, p, p->alerts.cnt);
         if (res > 0) {
             /* Now, if we have an alert, we have to check if we want
              * to tag this session or src/dst host */
@@ -285,17 +344,16 @@ void PacketAlertFinalize(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx
             }
 
             /* set verdict on packet */
-            PACKET_UPDATE_ACTION(p, p->alerts.alerts[i].action);
+            PACKET_UPDATE_ACTION(p, pa->action);
 
             if (PACKET_TEST_ACTION(p, ACTION_PASS)) {
-                /* Ok, reset the alert cnt to end in the previous of pass
-                 * so we ignore the rest with less prio */
-                p->alerts.cnt = i;
+                /* Ok, the alerts before the pass are kept, the pass
+                 * itself and the rest with less prio are ignored */
                 break;
             /* if the signature wants to drop, check if the
              * PACKET_ALERT_FLAG_DROP_FLOW flag is set. */
             } else if ((PACKET_TEST_ACTION(p, ACTION_DROP)) &&
-                    ((p->alerts.alerts[i].flags & PACKET_ALERT_FLAG_DROP_FLOW) ||
+                    ((pa->flags & PACKET_ALERT_FLAG_DROP_FLOW) ||
                          (s->flags & SIG_FLAG_APPLAYER))
                        && p->flow != NULL)
             {
@@ -304,18 +362,24 @@ void PacketAlertFinalize(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx
                 p->flow->flags |= FLOW_ACTION_DROP;
                 FLOWLOCK_UNLOCK(p->flow);
             }
-        }
-
-        /* Thresholding removes this alert */
-        if (res == 0 || res == 2) {
-            PacketAlertRemove(p, i);
 
-            if (p->alerts.cnt == 0)
-                break;
-        } else {
-            i++;
+            /* Thresholding (res 2) removes this alert but keeps
+             * the actions. Once the packet's array is full the alert
+             * is only counted, its thresholds and actions still apply */
+            if (res == 1) {
+                if (p->alerts.cnt < PACKET_ALERT_MAX) {
+                    p->alerts.alerts[p->alerts.cnt++] = *pa;
+                } else {
+                    SCLogDebug("packet alert array full, dropping alert "
+                               "of sig %"PRIu32, s->id);
+                    SCPerfCounterIncr(det_ctx->counter_alert_queue_overflow,
+                                      det_ctx->tv->sc_perf_pca);
+                }
+            }
         }
     }
+    det_ctx->alert_queue_cnt = 0;
+    det_ctx->alert_queue_unsorted = 0;
 
     /* At this point, we should have all the new alerts. Now check the tag
      * keyword context for sessions and hosts */
@@ -32,6 +32,8 @@ void PacketAlertFinalize(DetectEngineCtx *, DetectEngineThreadCtx *, Packet *);
 int PacketAlertAppend(DetectEngineThreadCtx *, Signature *, Packet *, uint64_t tx_id, uint8_t);
 int PacketAlertCheck(Packet *, uint32_t);
 int PacketAlertRemove(Packet *, uint16_t);
+int PacketAlertThreadInit(DetectEngineThreadCtx *);
+void PacketAlertThreadDeinit(DetectEngineThreadCtx *);
 void PacketAlertTagInit(void);
 PacketAlert *PacketAlertGetTag(void);
 
@@ -464,6 +464,7 @@ void EngineAnalysisRules(Signature *s, char *line)
     uint32_t rule_pcre = 0;
     uint32_t rule_pcre_http = 0;
     uint32_t rule_content = 0;
+    uint32_t rule_pcre_prefilter = 0;
     uint32_t rule_flow = 0;
     uint32_t rule_flags = 0;
     uint32_t rule_flow_toserver = 0;
@@ -591,6 +592,11 @@ void EngineAnalysisRules(Signature *s, char *line)
                     rule_pcre += 1;
                 }
             }
+            else if (sm->type == DETECT_CONTENT &&
+                     (((DetectContentData *)sm->ctx)->flags & DETECT_CONTENT_PCRE_PREFILTER)) {
+                /* added by the engine, not a content option of the rule */
+                rule_pcre_prefilter += 1;
+            }
             else if (sm->type == DETECT_CONTENT) {
 
                 if (list_id == DETECT_SM_LIST_UMATCH
@@ -791,6 +797,10 @@ void EngineAnalysisRules(Signature *s, char *line)
             fprintf(rule_engine_analysis_FD, "    Rule contains %d content options, %d http content options, %d pcre options, and %d pcre options with http modifiers.\n", rule_content, rule_content_http, rule_pcre, rule_pcre_http);
         }
 
+        if (rule_pcre_prefilter) {
+            fprintf(rule_engine_analysis_FD, "    Rule has a prefilter extracted from its pcre.\n");
+        }
+
         /* print fast pattern info */
         EngineAnalysisRulesPrintFP(s);
 
@@ -0,0 +1,1004 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Candidate sig lists for building the match array from the mpm hits.
+ *
+ * The mask prefilter (detect-simd.c) walks all sigs of the sgh for every
+ * packet and drops the mpm sigs whose pattern wasn't found. With large
+ * sgh's where the mpm finds only a few patterns most of that walk is
+ * wasted.
+ *
+ * Per sgh we keep a sorted list of sgh local sig indexes for each pattern
+ * id and one for the sigs that are inspected without a pattern hit:
+ * non-mpm sigs and sigs with a negated fast pattern. For a packet the
+ * lists of the pattern ids in the pmq are merged with the "always" list
+ * and only the resulting sigs go through the mask and the other checks.
+ * As the lists are sorted the match array still comes out in sig num
+ * order, exactly as the full walk would build it.
+ *
+ * If the lists together hold too many sigs the full walk is used, it's
+ * cheaper then.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "detect-engine-siggroup.h"
+#include "detect-engine-candidates.h"
+
+#include "util-cpu.h"
+#include "util-debug.h"
+#include "util-mpm.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+#include <immintrin.h>
+#endif
+
+/** the SIMD merge stores whole vectors, so the merge buffers have room
+ *  for a vector past their end */
+#define DETECT_CANDIDATES_SLACK     8
+
+typedef uint32_t (*DetectCandidatesMergeFunc)(const SigIntId *, uint32_t,
+        const SigIntId *, uint32_t, SigIntId *);
+
+/**
+ *  \internal
+ *  \brief Does the sig need its pattern to be found to be inspected.
+ *
+ *  Mirrors the mpm check of SigMatchSignaturesBuildMatchArrayAddSignature()
+ */
+static int DetectCandidatesNeedsPattern(uint32_t flags)
+{
+    if (flags & SIG_FLAG_MPM_PACKET)
+        return !(flags & SIG_FLAG_MPM_PACKET_NEG);
+    else if (flags & SIG_FLAG_MPM_STREAM)
+        return !(flags & SIG_FLAG_MPM_STREAM_NEG);
+    else if (flags & SIG_FLAG_MPM_APPLAYER)
+        return !(flags & SIG_FLAG_MPM_APPLAYER_NEG);
+    return 0;
+}
+
+/**
+ *  \internal
+ *  \brief Merge two sorted lists into out, dropping duplicates.
+ *
+ *  Values equal to the last one already in out (out[k - 1]) are dropped
+ *  as well, so a merge can continue where another one stopped.
+ *
+ *  \param k number of values already in out
+ *
+ *  \retval k number of values in out after the merge
+ */
+static inline uint32_t DetectCandidatesUnion(const SigIntId *a, uint32_t a_cnt,
+        const SigIntId *b, uint32_t b_cnt, SigIntId *out, uint32_t k)
+{
+    uint32_t i = 0, j = 0;
+
+    while (i < a_cnt || j < b_cnt) {
+        SigIntId v;
+        if (j == b_cnt || (i < a_cnt && a[i] <= b[j]))
+            v = a[i++];
+        else
+            v = b[j++];
+
+        if (k == 0 || out[k - 1] != v)
+            out[k++] = v;
+    }
+    return k;
+}
+
+/**
+ *  \brief Merge two sorted lists, non-SIMD implementation, also used as
+ *         reference in the unittests.
+ *
+ *  \retval cnt number of values stored in out
+ */
+static uint32_t DetectCandidatesMergeScalar(const SigIntId *a, uint32_t a_cnt,
+        const SigIntId *b, uint32_t b_cnt, SigIntId *out)
+{
+    return DetectCandidatesUnion(a, a_cnt, b, b_cnt, out, 0);
+}
+
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+/** per 8 bit mask of the 16 bit lanes that equal their predecessor, the
+ *  byte shuffle that packs the other lanes to the front of the vector */
+static uint8_t detect_candidates_uniqshuf[256][16] __attribute__((aligned(16)));
+
+static void DetectCandidatesBuildShuffleTable(void)
+{
+    int m, lane;
+
+    for (m = 0; m < 256; m++) {
+        int k = 0;
+
+        memset(detect_candidates_uniqshuf[m], 0xff, 16);
+        for (lane = 0; lane < 8; lane++) {
+            if (m & (1 << lane))
+                continue;
+            detect_candidates_uniqshuf[m][k++] = (uint8_t)(lane * 2);
+            detect_candidates_uniqshuf[m][k++] = (uint8_t)(lane * 2 + 1);
+        }
+    }
+}
+
+/**
+ *  \internal
+ *  \brief Merge two sorted vectors of 8 values: vmin gets the lowest 8,
+ *         vmax the highest 8, both sorted.
+ *
+ *  The min vector is rotated by one lane between the min/max steps, after
+ *  8 steps every value has been compared with every other.
+ */
+__attribute__((target("sse4.1")))
+static inline void DetectCandidatesMerge8(__m128i a, __m128i b,
+        __m128i *vmin, __m128i *vmax)
+{
+    __m128i lo = _mm_min_epu16(a, b);
+    __m128i hi = _mm_max_epu16(a, b);
+    int i;
+
+    for (i = 0; i < 7; i++) {
+        __m128i t = _mm_alignr_epi8(lo, lo, 2);
+        lo = _mm_min_epu16(t, hi);
+        hi = _mm_max_epu16(t, hi);
+    }
+    *vmin = _mm_alignr_epi8(lo, lo, 2);
+    *vmax = hi;
+}
+
+/**
+ *  \internal
+ *  \brief Store the values of the sorted vector v that differ from their
+ *         predecessor. The predecessor of the first lane is the last lane
+ *         of prev.
+ *
+ *  Always writes 8 values to out.
+ *
+ *  \retval cnt number of values stored
+ */
+__attribute__((target("sse4.1")))
+static inline uint32_t DetectCandidatesStoreUnique(__m128i prev, __m128i v,
+        SigIntId *out)
+{
+    __m128i shifted = _mm_alignr_epi8(v, prev, 14);
+    int m = _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(shifted, v),
+                _mm_setzero_si128()));
+    __m128i key = _mm_load_si128((const __m128i *)detect_candidates_uniqshuf[m]);
+
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(v, key));
+    return 8 - (uint32_t)__builtin_popcount(m);
+}
+
+/**
+ *  \brief SSE4.1 implementation of the merge, 8 values per step.
+ *
+ *  Loads 8 values at a time from the list with the lowest next value and
+ *  merges them with the 8 highest values seen so far, storing the 8 lowest.
+ *  The values left when one of the lists runs out of whole vectors are
+ *  merged with the scalar code.
+ *
+ *  Needs SigIntId to be 16 bits and the 0xffff index to be unused.
+ */
+__attribute__((target("sse4.1")))
+static uint32_t DetectCandidatesMergeSSE41(const SigIntId *a, uint32_t a_cnt,
+        const SigIntId *b, uint32_t b_cnt, SigIntId *out)
+{
+    const uint32_t a_vecs = a_cnt / 8;
+    const uint32_t b_vecs = b_cnt / 8;
+    uint32_t ai = 1, bi = 1;
+    uint32_t k, t, r;
+    SigIntId tail[16], rest[16];
+    const SigIntId *sa, *la;
+    uint32_t sa_cnt, la_cnt;
+    __m128i v, vmin, vmax, prev;
+
+    if (a_vecs == 0 || b_vecs == 0)
+        return DetectCandidatesUnion(a, a_cnt, b, b_cnt, out, 0);
+
+    DetectCandidatesMerge8(_mm_loadu_si128((const __m128i *)a),
+            _mm_loadu_si128((const __m128i *)b), &vmin, &vmax);
+    prev = _mm_set1_epi16(-1);
+    k = DetectCandidatesStoreUnique(prev, vmin, out);
+    prev = vmin;
+
+    while (ai < a_vecs && bi < b_vecs) {
+        if (a[ai * 8] <= b[bi * 8]) {
+            v = _mm_loadu_si128((const __m128i *)&a[ai * 8]);
+            ai++;
+        } else {
+            v = _mm_loadu_si128((const __m128i *)&b[bi * 8]);
+            bi++;
+        }
+        DetectCandidatesMerge8(v, vmax, &vmin, &vmax);
+        k += DetectCandidatesStoreUnique(prev, vmin, out + k);
+        prev = vmin;
+    }
+
+    /* what's left: vmax, less than a vector of the list that ran out
+     * and the rest of the other list */
+    t = DetectCandidatesStoreUnique(prev, vmax, tail);
+    if (ai == a_vecs) {
+        sa = &a[ai * 8];
+        sa_cnt = a_cnt - ai * 8;
+        la = &b[bi * 8];
+        la_cnt = b_cnt - bi * 8;
+    } else {
+        sa = &b[bi * 8];
+        sa_cnt = b_cnt - bi * 8;
+        la = &a[ai * 8];
+        la_cnt = a_cnt - ai * 8;
+    }
+    r = DetectCandidatesUnion(tail, t, sa, sa_cnt, rest, 0);
+    return DetectCandidatesUnion(rest, r, la, la_cnt, out, k);
+}
+#endif /* DETECT_SIMD_RUNTIME_DISPATCH */
+
+typedef struct DetectCandidatesVariant_ {
+    const char *name;
+    /** UTIL_CPU_FEATURE_* flags the cpu needs for this variant */
+    uint32_t cpu_features;
+    DetectCandidatesMergeFunc Merge;
+} DetectCandidatesVariant;
+
+/** merge implementations, ordered from least to most preferred */
+static DetectCandidatesVariant detect_candidates_variants[] = {
+    { "scalar", 0, DetectCandidatesMergeScalar },
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+    { "sse4.1", UTIL_CPU_FEATURE_SSSE3|UTIL_CPU_FEATURE_SSE41,
+        DetectCandidatesMergeSSE41 },
+#endif
+};
+
+#define DETECT_CANDIDATES_VARIANTS \
+    (int)(sizeof(detect_candidates_variants) / sizeof(detect_candidates_variants[0]))
+
+static DetectCandidatesMergeFunc MergeFunc = DetectCandidatesMergeScalar;
+
+/**
+ *  \brief Select the merge implementation for this cpu.
+ *
+ *  Called once at startup, before the packet threads run.
+ */
+void DetectCandidatesSetup(void)
+{
+    uint32_t features = UtilCpuGetFeatures();
+    int i, selected = 0;
+
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+    DetectCandidatesBuildShuffleTable();
+#endif
+
+    for (i = 0; i < DETECT_CANDIDATES_VARIANTS; i++) {
+        if ((detect_candidates_variants[i].cpu_features & features) !=
+                detect_candidates_variants[i].cpu_features)
+            continue;
+        /* the SIMD variants work on 16 bit sig indexes */
+        if (i > 0 && sizeof(SigIntId) != sizeof(uint16_t))
+            continue;
+        selected = i;
+    }
+
+    MergeFunc = detect_candidates_variants[selected].Merge;
+    SCLogInfo("using %s candidate list merging",
+            detect_candidates_variants[selected].name);
+}
+
+typedef struct DetectCandidatesPair_ {
+    uint32_t pid;
+    SigIntId idx;
+} DetectCandidatesPair;
+
+static int DetectCandidatesPairCompare(const void *a, const void *b)
+{
+    const DetectCandidatesPair *pa = a;
+    const DetectCandidatesPair *pb = b;
+
+    if (pa->pid != pb->pid)
+        return pa->pid < pb->pid ? -1 : 1;
+    if (pa->idx != pb->idx)
+        return pa->idx < pb->idx ? -1 : 1;
+    return 0;
+}
+
+static void DetectCandidatesFree(DetectCandidates *c)
+{
+    if (c->always != NULL)
+        SCFree(c->always);
+    if (c->pids != NULL)
+        SCFree(c->pids);
+    if (c->offset != NULL)
+        SCFree(c->offset);
+    if (c->idx != NULL)
+        SCFree(c->idx);
+    SCFree(c);
+}
+
+/**
+ *  \brief Build the candidate lists of a sgh from its head array.
+ *
+ *  \retval 0 ok
+ *  \retval -1 error, the sgh is left without lists and uses the full walk
+ */
+int DetectCandidatesBuildSgh(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
+{
+    DetectCandidatesPair *pairs = NULL;
+    DetectCandidates *c = NULL;
+    uint32_t pairs_cnt = 0;
+    uint32_t u;
+
+    if (sgh == NULL || sgh->head_array == NULL || sgh->sig_cnt == 0)
+        return 0;
+
+    BUG_ON(sgh->candidates != NULL);
+
+    c = SCMalloc(sizeof(DetectCandidates));
+    if (unlikely(c == NULL))
+        goto error;
+    memset(c, 0, sizeof(DetectCandidates));
+
+    c->always = SCMalloc(sgh->sig_cnt * sizeof(SigIntId));
+    pairs = SCMalloc(sgh->sig_cnt * sizeof(DetectCandidatesPair));
+    if (c->always == NULL || pairs == NULL)
+        goto error;
+
+    for (u = 0; u < sgh->sig_cnt; u++) {
+        const SignatureHeader *s = &sgh->head_array[u];
+
+        if (DetectCandidatesNeedsPattern(s->flags)) {
+            pairs[pairs_cnt].pid = (uint32_t)s->mpm_pattern_id_div_8 * 8 +
+                (uint32_t)__builtin_ctz(s->mpm_pattern_id_mod_8);
+            pairs[pairs_cnt].idx = (SigIntId)u;
+            pairs_cnt++;
+        } else {
+            c->always[c->always_cnt++] = (SigIntId)u;
+        }
+    }
+
+    if (pairs_cnt > 0) {
+        qsort(pairs, pairs_cnt, sizeof(DetectCandidatesPair),
+                DetectCandidatesPairCompare);
+
+        c->pid_cnt = 1;
+        for (u = 1; u < pairs_cnt; u++) {
+            if (pairs[u].pid != pairs[u - 1].pid)
+                c->pid_cnt++;
+        }
+
+        c->pids = SCMalloc(c->pid_cnt * sizeof(uint32_t));
+        c->offset = SCMalloc((c->pid_cnt + 1) * sizeof(uint32_t));
+        c->idx = SCMalloc(pairs_cnt * sizeof(SigIntId));
+        if (c->pids == NULL || c->offset == NULL || c->idx == NULL)
+            goto error;
+
+        uint32_t p = 0;
+        for (u = 0; u < pairs_cnt; u++) {
+            if (u == 0 || pairs[u].pid != pairs[u - 1].pid) {
+                c->pids[p] = pairs[u].pid;
+                c->offset[p] = u;
+                p++;
+            }
+            c->idx[u] = pairs[u].idx;
+        }
+        c->offset[p] = pairs_cnt;
+    }
+
+    SCFree(pairs);
+    SCLogDebug("sgh %p: %u sigs, %u always, %u pattern ids", sgh,
+            sgh->sig_cnt, c->always_cnt, c->pid_cnt);
+    sgh->candidates = c;
+    return 0;
+
+error:
+    if (pairs != NULL)
+        SCFree(pairs);
+    if (c != NULL)
+        DetectCandidatesFree(c);
+    return -1;
+}
+
+void DetectCandidatesFreeSgh(SigGroupHead *sgh)
+{
+    if (sgh->candidates != NULL) {
+        DetectCandidatesFree(sgh->candidates);
+        sgh->candidates = NULL;
+    }
+}
+
+int DetectCandidatesThreadInit(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx)
+{
+    size_t size = (de_ctx->sig_array_len + DETECT_CANDIDATES_SLACK) * sizeof(SigIntId);
+    int b;
+
+    /* one list per pattern id plus the "always" list */
+    det_ctx->candidate_lists = SCMalloc((de_ctx->sig_array_len + 1) *
+                                        sizeof(DetectCandidatesList));
+    if (det_ctx->candidate_lists == NULL)
+        return -1;
+
+    for (b = 0; b < 2; b++) {
+        det_ctx->candidate_buf[b] = SCMalloc(size);
+        if (det_ctx->candidate_buf[b] == NULL)
+            return -1;
+    }
+    return 0;
+}
+
+void DetectCandidatesThreadDeinit(DetectEngineThreadCtx *det_ctx)
+{
+    int b;
+
+    if (det_ctx->candidate_lists != NULL) {
+        SCFree(det_ctx->candidate_lists);
+        det_ctx->candidate_lists = NULL;
+    }
+    for (b = 0; b < 2; b++) {
+        if (det_ctx->candidate_buf[b] != NULL) {
+            SCFree(det_ctx->candidate_buf[b]);
+            det_ctx->candidate_buf[b] = NULL;
+        }
+    }
+}
+
+/** \internal \brief index of pid in c->pids, -1 if the sgh doesn't use it */
+static inline int DetectCandidatesFindPid(const DetectCandidates *c, uint32_t pid)
+{
+    uint32_t lo = 0, hi = c->pid_cnt;
+
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (c->pids[mid] < pid)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < c->pid_cnt && c->pids[lo] == pid)
+        return (int)lo;
+    return -1;
+}
+
+/**
+ *  \brief build the match array from the candidate lists
+ *
+ *  \param det_ctx detection engine thread ctx -- array is stored here
+ *  \param p packet
+ *  \param mask Packets mask
+ *  \param alproto application layer protocol
+ *
+ *  \retval 1 match array built
+ *  \retval 0 too many candidates, caller should walk the whole sgh
+ */
+int DetectCandidatesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
+{
+    const SigGroupHead *sgh = det_ctx->sgh;
+    const DetectCandidates *c = sgh->candidates;
+    const PatternMatcherQueue *pmq = &det_ctx->pmq;
+    DetectCandidatesList *lists = det_ctx->candidate_lists;
+    const uint32_t max = sgh->sig_cnt / DETECT_CANDIDATES_RATIO;
+    uint32_t total, n = 0, u;
+    int b = 0;
+
+    if (c == NULL || lists == NULL || c->always_cnt > max ||
+        pmq->pattern_id_array_cnt > max)
+        return 0;
+
+    total = c->always_cnt;
+    if (c->always_cnt > 0) {
+        lists[n].idx = c->always;
+        lists[n].cnt = c->always_cnt;
+        n++;
+    }
+    for (u = 0; u < pmq->pattern_id_array_cnt; u++) {
+        int i = DetectCandidatesFindPid(c, pmq->pattern_id_array[u]);
+        if (i < 0)
+            continue;
+
+        lists[n].idx = &c->idx[c->offset[i]];
+        lists[n].cnt = c->offset[i + 1] - c->offset[i];
+        total += lists[n].cnt;
+        if (total > max)
+            return 0;
+        n++;
+    }
+
+    /* merge pairwise until one list is left. Every round writes to the
+     * buffer the previous round didn't write to. */
+    while (n > 1) {
+        SigIntId *out = det_ctx->candidate_buf[b];
+        uint32_t m = 0;
+
+        for (u = 0; u + 1 < n; u += 2) {
+            uint32_t cnt = MergeFunc(lists[u].idx, lists[u].cnt,
+                    lists[u + 1].idx, lists[u + 1].cnt, out);
+            lists[m].idx = out;
+            lists[m].cnt = cnt;
+            m++;
+            out += cnt;
+        }
+        /* odd one out: copy it, its buffer is overwritten next round */
+        if (u < n) {
+            memcpy(out, lists[u].idx, lists[u].cnt * sizeof(SigIntId));
+            lists[m].idx = out;
+            lists[m].cnt = lists[u].cnt;
+            m++;
+        }
+        n = m;
+        b ^= 1;
+    }
+
+    /* reset previous run */
+    det_ctx->match_array_cnt = 0;
+    if (n == 0)
+        return 1;
+
+    const SigIntId *idx = lists[0].idx;
+    for (u = 0; u < lists[0].cnt; u++) {
+        SignatureHeader *s = &sgh->head_array[idx[u]];
+        if ((mask & s->mask) == s->mask) {
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                /* okay, store it */
+                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
+                det_ctx->match_array_cnt++;
+            }
+        }
+    }
+    return 1;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+#include "conf.h"
+
+/** \internal \brief fill list with cnt random sorted unique values below range */
+static void DetectCandidatesTestList(SigIntId *list, uint32_t cnt, uint32_t range,
+        unsigned int *seed)
+{
+    uint32_t u, v = 0;
+
+    /* pick each value with probability cnt / range */
+    for (u = 0; u < cnt && v < range; v++) {
+        if ((uint32_t)rand_r(seed) % range < cnt)
+            list[u++] = (SigIntId)v;
+    }
+    for ( ; u < cnt; u++)
+        list[u] = (SigIntId)(range + u);
+}
+
+/**
+ *  \test all merge variants the cpu supports produce the same list as the
+ *        scalar one, with and without overlap between the lists
+ */
+static int DetectCandidatesTest01(void)
+{
+    uint32_t features = UtilCpuGetFeatures();
+    unsigned int seed = 2015;
+    SigIntId a[512], b[512], ref[1024 + DETECT_CANDIDATES_SLACK];
+    SigIntId out[1024 + DETECT_CANDIDATES_SLACK];
+    int i, v;
+
+    DetectCandidatesSetup();
+
+    for (i = 0; i < 2000; i++) {
+        uint32_t a_cnt = (uint32_t)rand_r(&seed) % 200;
+        uint32_t b_cnt = (uint32_t)rand_r(&seed) % 200;
+        /* small ranges give lots of duplicates */
+        uint32_t range = 200 + (uint32_t)rand_r(&seed) % 2000;
+
+        DetectCandidatesTestList(a, a_cnt, range, &seed);
+        DetectCandidatesTestList(b, b_cnt, range, &seed);
+        uint32_t ref_cnt = DetectCandidatesMergeScalar(a, a_cnt, b, b_cnt, ref);
+
+        uint32_t u;
+        for (u = 1; u < ref_cnt; u++) {
+            if (ref[u - 1] >= ref[u]) {
+                printf("scalar merge not sorted/unique at %u: ", u);
+                return 0;
+            }
+        }
+
+        for (v = 1; v < DETECT_CANDIDATES_VARIANTS; v++) {
+            if ((detect_candidates_variants[v].cpu_features & features) !=
+                    detect_candidates_variants[v].cpu_features)
+                continue;
+
+            uint32_t cnt = detect_candidates_variants[v].Merge(a, a_cnt, b, b_cnt, out);
+            if (cnt != ref_cnt || memcmp(out, ref, cnt * sizeof(SigIntId)) != 0) {
+                printf("%s: run %d (%u + %u values, range %u) got %u values, "
+                        "expected %u: ", detect_candidates_variants[v].name,
+                        i, a_cnt, b_cnt, range, cnt, ref_cnt);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ *  \test sigs alert the same through the candidate lists and through the
+ *        full walk used when the mpm finds many patterns
+ */
+static int DetectCandidatesTest02(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    Packet *p1 = NULL, *p2 = NULL;
+    char sig[128];
+    int result = 0;
+    int sid;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    for (sid = 1; sid <= 40; sid++) {
+        snprintf(sig, sizeof(sig), "alert tcp any any -> any any "
+                "(content:\"pat%02d\"; sid:%d;)", sid, sid);
+        if (DetectEngineAppendSig(de_ctx, sig) == NULL)
+            goto end;
+    }
+    if (DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(dsize:>5; sid:100;)") == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    /* 1 pattern: candidate lists */
+    uint8_t buf1[] = "xxpat07xx";
+    p1 = UTHBuildPacket(buf1, sizeof(buf1) - 1, IPPROTO_TCP);
+    /* 12 patterns, more than 41 / DETECT_CANDIDATES_RATIO: full walk */
+    uint8_t buf2[] = "pat01pat02pat03pat04pat05pat06pat07pat08"
+                     "pat09pat10pat11pat12";
+    p2 = UTHBuildPacket(buf2, sizeof(buf2) - 1, IPPROTO_TCP);
+    if (p1 == NULL || p2 == NULL)
+        goto end;
+
+    SigGroupHead *sgh = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p1);
+    if (sgh == NULL || sgh->candidates == NULL ||
+        sgh->candidates->always_cnt != 1 || sgh->candidates->pid_cnt != 40) {
+        printf("expected 1 always sig and 40 pattern ids: ");
+        goto end;
+    }
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p1);
+    for (sid = 1; sid <= 40; sid++) {
+        if (PacketAlertCheck(p1, sid) != (sid == 7)) {
+            printf("p1 sid %d: ", sid);
+            goto end;
+        }
+    }
+    if (!PacketAlertCheck(p1, 100)) {
+        printf("p1 sid 100 didn't alert: ");
+        goto end;
+    }
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p2);
+    for (sid = 1; sid <= 40; sid++) {
+        if (PacketAlertCheck(p2, sid) != (sid <= 12)) {
+            printf("p2 sid %d: ", sid);
+            goto end;
+        }
+    }
+    if (!PacketAlertCheck(p2, 100)) {
+        printf("p2 sid 100 didn't alert: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (p1 != NULL)
+        UTHFreePackets(&p1, 1);
+    if (p2 != NULL)
+        UTHFreePackets(&p2, 1);
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \brief set up a fake sgh of mpm sigs with random patterns and masks,
+ *         'always_pct' percent of the sigs don't need their pattern */
+static int DetectCandidatesTestSetup(DetectEngineCtx *de_ctx, SigGroupHead *sgh,
+        DetectEngineThreadCtx *det_ctx, Signature **sigs, uint32_t sig_cnt,
+        uint32_t pid_cnt, uint32_t always_pct, unsigned int *seed)
+{
+    uint32_t cnt = sig_cnt;
+    uint32_t u;
+
+    memset(de_ctx, 0, sizeof(*de_ctx));
+    memset(sgh, 0, sizeof(*sgh));
+    memset(det_ctx, 0, sizeof(*det_ctx));
+
+    if (cnt % 64 != 0)
+        cnt += (64 - (cnt % 64));
+
+    de_ctx->sig_array_len = sig_cnt;
+    *sigs = SCMalloc(sig_cnt * sizeof(Signature));
+    sgh->head_array = SCMalloc(sig_cnt * sizeof(SignatureHeader));
+    det_ctx->match_array = SCMalloc(sig_cnt * sizeof(Signature *));
+#ifdef DETECT_SIMD_MASK_ARRAY
+    sgh->mask_array = (SignatureMask *)SCMallocAligned((cnt * sizeof(SignatureMask)), 64);
+    if (sgh->mask_array == NULL)
+        return 0;
+    memset(sgh->mask_array, 0, (cnt * sizeof(SignatureMask)));
+#endif
+    if (*sigs == NULL || sgh->head_array == NULL || det_ctx->match_array == NULL)
+        return 0;
+    memset(sgh->head_array, 0, sig_cnt * sizeof(SignatureHeader));
+    if (PmqSetup(&det_ctx->pmq, pid_cnt) != 0)
+        return 0;
+    if (DetectCandidatesThreadInit(de_ctx, det_ctx) != 0)
+        return 0;
+
+    sgh->sig_cnt = sig_cnt;
+    for (u = 0; u < sig_cnt; u++) {
+        SignatureHeader *s = &sgh->head_array[u];
+        uint32_t pid = (uint32_t)rand_r(seed) % pid_cnt;
+        uint32_t r = (uint32_t)rand_r(seed) % 100;
+
+        if (r < always_pct / 2)
+            s->flags = 0;
+        else if (r < always_pct)
+            s->flags = SIG_FLAG_MPM_PACKET|SIG_FLAG_MPM_PACKET_NEG;
+        else if (r % 2)
+            s->flags = SIG_FLAG_MPM_PACKET;
+        else
+            s->flags = SIG_FLAG_MPM_STREAM;
+
+        s->mpm_pattern_id_div_8 = pid / 8;
+        s->mpm_pattern_id_mod_8 = 1 << (pid % 8);
+        s->mask = (SignatureMask)(rand_r(seed) & rand_r(seed));
+        s->num = u;
+        s->full_sig = &(*sigs)[u];
+#ifdef DETECT_SIMD_MASK_ARRAY
+        sgh->mask_array[u] = s->mask;
+#endif
+    }
+    det_ctx->sgh = sgh;
+
+    if (DetectCandidatesBuildSgh(de_ctx, sgh) != 0)
+        return 0;
+    return 1;
+}
+
+static void DetectCandidatesTestCleanup(SigGroupHead *sgh, DetectEngineThreadCtx *det_ctx,
+        Signature *sigs)
+{
+    DetectCandidatesFreeSgh(sgh);
+    DetectCandidatesThreadDeinit(det_ctx);
+    PmqFree(&det_ctx->pmq);
+#ifdef DETECT_SIMD_MASK_ARRAY
+    if (sgh->mask_array != NULL)
+        SCFreeAligned(sgh->mask_array);
+#endif
+    if (sgh->head_array != NULL)
+        SCFree(sgh->head_array);
+    if (det_ctx->match_array != NULL)
+        SCFree(det_ctx->match_array);
+    if (sigs != NULL)
+        SCFree(sigs);
+}
+
+/** \internal \brief let the mpm "find" hits random patterns */
+static void DetectCandidatesTestHits(PatternMatcherQueue *pmq, uint32_t hits,
+        uint32_t pid_cnt, unsigned int *seed)
+{
+    uint32_t h;
+
+    PmqReset(pmq);
+    for (h = 0; h < hits; h++) {
+        uint32_t pid = (uint32_t)rand_r(seed) % pid_cnt;
+        if (pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8)))
+            continue;
+        pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+        pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pid;
+    }
+}
+
+/**
+ *  \test the candidate lists give the same match array as walking the
+ *        whole sgh, for random sgh's, pattern hits and packet masks
+ */
+static int DetectCandidatesTest03(void)
+{
+    uint32_t sizes[] = { 10, 100, 1000, 5000 };
+    unsigned int seed = 77;
+    DetectEngineCtx de_ctx;
+    SigGroupHead sgh;
+    DetectEngineThreadCtx det_ctx;
+    Signature *sigs = NULL;
+    Signature **ref = NULL;
+    uint32_t used = 0;
+    int result = 0;
+    uint32_t i;
+    int run;
+
+    DetectCandidatesSetup();
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t pid_cnt = sizes[i] / 3 + 1;
+
+        if (DetectCandidatesTestSetup(&de_ctx, &sgh, &det_ctx, &sigs, sizes[i],
+                    pid_cnt, 5, &seed) == 0)
+            goto end;
+        ref = SCMalloc(sizes[i] * sizeof(Signature *));
+        if (ref == NULL)
+            goto end;
+
+        for (run = 0; run < 200; run++) {
+            SignatureMask mask = (SignatureMask)rand_r(&seed);
+            uint32_t u, ref_cnt = 0;
+
+            DetectCandidatesTestHits(&det_ctx.pmq, (uint32_t)rand_r(&seed) % 12,
+                    pid_cnt, &seed);
+
+            for (u = 0; u < sgh.sig_cnt; u++) {
+                SignatureHeader *s = &sgh.head_array[u];
+                if ((mask & s->mask) == s->mask &&
+                    SigMatchSignaturesBuildMatchArrayAddSignature(&det_ctx, NULL,
+                        s, ALPROTO_UNKNOWN) == 1)
+                    ref[ref_cnt++] = s->full_sig;
+            }
+
+            if (DetectCandidatesBuildMatchArray(&det_ctx, NULL, mask,
+                        ALPROTO_UNKNOWN) == 0)
+                continue;
+            used++;
+
+            if (det_ctx.match_array_cnt != ref_cnt ||
+                memcmp(ref, det_ctx.match_array, ref_cnt * sizeof(Signature *)) != 0) {
+                printf("%u sigs, run %d: got %u sigs, expected %u: ", sizes[i], run,
+                        det_ctx.match_array_cnt, ref_cnt);
+                goto end;
+            }
+        }
+
+        DetectCandidatesTestCleanup(&sgh, &det_ctx, sigs);
+        sigs = NULL;
+        SCFree(ref);
+        ref = NULL;
+    }
+
+    if (used == 0) {
+        printf("candidate lists never used: ");
+        return 0;
+    }
+    return 1;
+end:
+    DetectCandidatesTestCleanup(&sgh, &det_ctx, sigs);
+    if (ref != NULL)
+        SCFree(ref);
+    return result;
+}
+
+/** Comment out this if you want the candidate list benchmark
+ *  #define ENABLE_CANDIDATES_BENCH 1
+ */
+
+#ifdef ENABLE_CANDIDATES_BENCH
+/* candidate list benchmark
+ *
+ * Builds the match array for sgh's of 5k, 10k and 20k mpm sigs (2 per
+ * pattern, 1% without a pattern) by walking the whole sgh and through
+ * the candidate lists, and reports the cpu ticks per packet. Build with
+ * ENABLE_CANDIDATES_BENCH and run it using:
+ *
+ *   suricata -u -U DetectCandidatesBench
+ *
+ * The number of packets per run and pattern hits per packet can be set with:
+ *
+ *   --set unittests.candidates-bench.packets=<num> (default 1000)
+ *   --set unittests.candidates-bench.hits=<num> (default 4)
+ */
+
+#define CANDIDATES_BENCH_DEFAULT_PACKETS    1000
+#define CANDIDATES_BENCH_DEFAULT_HITS       4
+
+static int DetectCandidatesBench01(void)
+{
+    uint32_t sizes[] = { 5000, 10000, 20000 };
+    unsigned int seed = 4321;
+    DetectEngineCtx de_ctx;
+    SigGroupHead sgh;
+    DetectEngineThreadCtx det_ctx;
+    Signature *sigs = NULL;
+    intmax_t packets = 0, hits = 0;
+    int result = 0;
+    uint32_t i;
+    intmax_t n;
+
+    if (ConfGetInt("unittests.candidates-bench.packets", &packets) != 1 ||
+        packets <= 0)
+        packets = CANDIDATES_BENCH_DEFAULT_PACKETS;
+    if (ConfGetInt("unittests.candidates-bench.hits", &hits) != 1 ||
+        hits < 0)
+        hits = CANDIDATES_BENCH_DEFAULT_HITS;
+
+    DetectCandidatesSetup();
+
+    printf("\n");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint32_t pid_cnt = sizes[i] / 2;
+        uint64_t full_ticks, cand_ticks;
+        uint32_t used = 0;
+
+        if (DetectCandidatesTestSetup(&de_ctx, &sgh, &det_ctx, &sigs, sizes[i],
+                    pid_cnt, 1, &seed) == 0)
+            goto end;
+        DetectCandidatesTestHits(&det_ctx.pmq, (uint32_t)hits, pid_cnt, &seed);
+
+        DetectCandidates *c = sgh.candidates;
+        sgh.candidates = NULL;
+        uint64_t start = UtilCpuGetTicks();
+        for (n = 0; n < packets; n++) {
+            SigMatchSignaturesBuildMatchArray(&det_ctx, NULL,
+                    (SignatureMask)n, ALPROTO_UNKNOWN);
+        }
+        full_ticks = (UtilCpuGetTicks() - start) / (uint64_t)packets;
+        sgh.candidates = c;
+
+        start = UtilCpuGetTicks();
+        for (n = 0; n < packets; n++) {
+            used += DetectCandidatesBuildMatchArray(&det_ctx, NULL,
+                    (SignatureMask)n, ALPROTO_UNKNOWN);
+        }
+        cand_ticks = (UtilCpuGetTicks() - start) / (uint64_t)packets;
+
+        printf("%5u sigs %3d hits: full walk %8"PRIu64" ticks/packet, "
+                "candidates %8"PRIu64" ticks/packet%s\n", sizes[i], (int)hits,
+                full_ticks, cand_ticks, used ? "" : " (fell back to full walk)");
+
+        DetectCandidatesTestCleanup(&sgh, &det_ctx, sigs);
+        sigs = NULL;
+    }
+
+    return 1;
+end:
+    DetectCandidatesTestCleanup(&sgh, &det_ctx, sigs);
+    return result;
+}
+#endif /* ENABLE_CANDIDATES_BENCH */
+#endif /* UNITTESTS */
+
+void DetectCandidatesRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectCandidatesTest01", DetectCandidatesTest01, 1);
+    UtRegisterTest("DetectCandidatesTest02", DetectCandidatesTest02, 1);
+    UtRegisterTest("DetectCandidatesTest03", DetectCandidatesTest03, 1);
+#ifdef ENABLE_CANDIDATES_BENCH
+    UtRegisterTest("DetectCandidatesBench01", DetectCandidatesBench01, 1);
+#endif
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,66 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Candidate sig lists for building the match array from the mpm hits.
+ */
+
+#ifndef __DETECT_ENGINE_CANDIDATES_H__
+#define __DETECT_ENGINE_CANDIDATES_H__
+
+/** the candidate path is only used if the lists to merge hold at most
+ *  1/DETECT_CANDIDATES_RATIO of the sgh's sigs, otherwise scanning the
+ *  whole sgh is cheaper */
+#define DETECT_CANDIDATES_RATIO     4
+
+/** a sorted list of sgh local sig indexes */
+typedef struct DetectCandidatesList_ {
+    const SigIntId *idx;
+    uint32_t cnt;
+} DetectCandidatesList;
+
+/** per sgh candidate lists. All lists hold indexes in the sgh's
+ *  head_array, sorted, so merging them keeps the sig num order. */
+typedef struct DetectCandidates_ {
+    /** sigs that are inspected even if the mpm found nothing for them */
+    SigIntId *always;
+    uint32_t always_cnt;
+
+    /** sorted pattern ids of the sgh's mpm sigs. The sigs for pids[i]
+     *  are idx[offset[i]] up to idx[offset[i + 1]] */
+    uint32_t *pids;
+    uint32_t *offset;
+    uint32_t pid_cnt;
+    SigIntId *idx;
+} DetectCandidates;
+
+void DetectCandidatesSetup(void);
+
+int DetectCandidatesBuildSgh(DetectEngineCtx *, SigGroupHead *);
+void DetectCandidatesFreeSgh(SigGroupHead *);
+
+int DetectCandidatesThreadInit(DetectEngineCtx *, DetectEngineThreadCtx *);
+void DetectCandidatesThreadDeinit(DetectEngineThreadCtx *);
+
+int DetectCandidatesBuildMatchArray(DetectEngineThreadCtx *, Packet *,
+        SignatureMask, AppProto);
+
+void DetectCandidatesRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_CANDIDATES_H__ */
@@ -54,9 +54,153 @@
 #include "util-unittest-helper.h"
 #include "util-profiling.h"
 
+static inline int DetectEngineInspectIsdataat(const DetectIsdataatData *id,
+        uint32_t buffer_offset, uint32_t buffer_len)
+{
+    if (id->flags & ISDATAAT_RELATIVE) {
+        if (buffer_offset + id->dataat > buffer_len) {
+            SCLogDebug("det_ctx->buffer_offset + id->dataat %"PRIu32" > %"PRIu32, buffer_offset + id->dataat, buffer_len);
+            return (id->flags & ISDATAAT_NEGATED) ? 1 : 0;
+        } else {
+            SCLogDebug("relative isdataat match");
+            return (id->flags & ISDATAAT_NEGATED) ? 0 : 1;
+        }
+    } else {
+        if (id->dataat < buffer_len) {
+            SCLogDebug("absolute isdataat match");
+            return (id->flags & ISDATAAT_NEGATED) ? 0 : 1;
+        } else {
+            SCLogDebug("absolute isdataat mismatch, id->isdataat %"PRIu32", buffer_len %"PRIu32"", id->dataat, buffer_len);
+            return (id->flags & ISDATAAT_NEGATED) ? 1 : 0;
+        }
+    }
+}
+
+static inline int DetectEngineInspectBytetest(DetectEngineThreadCtx *det_ctx,
+        Signature *s, SigMatch *sm, uint8_t *buffer, uint32_t buffer_len, void *data)
+{
+    DetectBytetestData *btd = (DetectBytetestData *)sm->ctx;
+    uint8_t flags = btd->flags;
+    int32_t offset = btd->offset;
+    uint64_t value = btd->value;
+    if (flags & DETECT_BYTETEST_OFFSET_BE) {
+        offset = det_ctx->bj_values[offset];
+    }
+    if (flags & DETECT_BYTETEST_VALUE_BE) {
+        value = det_ctx->bj_values[value];
+    }
+
+    /* if we have dce enabled we will have to use the endianness
+     * specified by the dce header */
+    if (flags & DETECT_BYTETEST_DCE) {
+        DCERPCState *dcerpc_state = (DCERPCState *)data;
+        /* enable the endianness flag temporarily.  once we are done
+         * processing we reset the flags to the original value*/
+        flags |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] & 0x10) ?
+                  DETECT_BYTETEST_LITTLE: 0);
+    }
+
+    return (DetectBytetestDoMatch(det_ctx, s, sm, buffer, buffer_len, flags,
+                                  offset, value) == 1);
+}
+
+static inline int DetectEngineInspectBytejump(DetectEngineThreadCtx *det_ctx,
+        Signature *s, SigMatch *sm, uint8_t *buffer, uint32_t buffer_len, void *data)
+{
+    DetectBytejumpData *bjd = (DetectBytejumpData *)sm->ctx;
+    uint8_t flags = bjd->flags;
+    int32_t offset = bjd->offset;
+
+    if (flags & DETECT_BYTEJUMP_OFFSET_BE) {
+        offset = det_ctx->bj_values[offset];
+    }
+
+    /* if we have dce enabled we will have to use the endianness
+     * specified by the dce header */
+    if (flags & DETECT_BYTEJUMP_DCE) {
+        DCERPCState *dcerpc_state = (DCERPCState *)data;
+        /* enable the endianness flag temporarily.  once we are done
+         * processing we reset the flags to the original value*/
+        flags |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] & 0x10) ?
+                  DETECT_BYTEJUMP_LITTLE: 0);
+    }
+
+    return (DetectBytejumpDoMatch(det_ctx, s, sm, buffer, buffer_len,
+                                  flags, offset) == 1);
+}
+
+static inline int DetectEngineInspectByteExtract(DetectEngineThreadCtx *det_ctx,
+        Signature *s, SigMatch *sm, uint8_t *buffer, uint32_t buffer_len, void *data)
+{
+    DetectByteExtractData *bed = (DetectByteExtractData *)sm->ctx;
+    uint8_t endian = bed->endian;
+
+    /* if we have dce enabled we will have to use the endianness
+     * specified by the dce header */
+    if ((bed->flags & DETECT_BYTE_EXTRACT_FLAG_ENDIAN) &&
+        endian == DETECT_BYTE_EXTRACT_ENDIAN_DCE) {
+
+        DCERPCState *dcerpc_state = (DCERPCState *)data;
+        /* enable the endianness flag temporarily.  once we are done
+         * processing we reset the flags to the original value*/
+        endian |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] == 0x10) ?
+                   DETECT_BYTE_EXTRACT_ENDIAN_LITTLE : DETECT_BYTE_EXTRACT_ENDIAN_BIG);
+    }
+
+    return (DetectByteExtractDoMatch(det_ctx, sm, s, buffer,
+                                     buffer_len,
+                                     &det_ctx->bj_values[bed->local_id],
+                                     endian) == 1);
+}
+
+static inline int DetectEngineInspectUrilen(const DetectUrilenData *urilend,
+        uint32_t buffer_len)
+{
+    switch (urilend->mode) {
+        case DETECT_URILEN_EQ:
+            return (buffer_len == urilend->urilen1);
+        case DETECT_URILEN_LT:
+            return (buffer_len < urilend->urilen1);
+        case DETECT_URILEN_GT:
+            return (buffer_len > urilend->urilen1);
+        case DETECT_URILEN_RA:
+            return (buffer_len > urilend->urilen1 &&
+                    buffer_len < urilend->urilen2);
+    }
+    return 0;
+}
+
+#ifdef HAVE_LUA
+static inline int DetectEngineInspectLuajit(DetectEngineThreadCtx *det_ctx,
+        Signature *s, SigMatch *sm, Flow *f, uint8_t *buffer, uint32_t buffer_len,
+        uint8_t inspection_mode)
+{
+    /* for flowvar gets and sets we need to know the flow's lock status */
+    int need_flow_lock = 0;
+    if (inspection_mode <= DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM)
+        need_flow_lock = 1;
+
+    return (DetectLuajitMatchBuffer(det_ctx, s, sm, buffer, buffer_len,
+                det_ctx->buffer_offset, f, need_flow_lock) == 1);
+}
+#endif /* HAVE_LUA */
+
+static void DetectEngineInspectionLimitReached(DetectEngineThreadCtx *det_ctx)
+{
+    det_ctx->discontinue_matching = 1;
+    if (det_ctx->tv != NULL && det_ctx->counter_inspection_limit != 0) {
+        SCPerfCounterIncr(det_ctx->counter_inspection_limit,
+                det_ctx->tv->sc_perf_pca);
+    }
+}
+
 /**
  * \brief Run the actual payload match functions
  *
+ * Walks the sm list recursively. Lists compiled by
+ * DetectEngineContentInspectionBuildSig() are run by
+ * DetectEngineContentInspectionRun() instead.
+ *
  * The following keywords are inspected:
  * - content, including all the http and dce modified contents
  * - isdaatat
@@ -93,12 +237,10 @@
  *  \retval 0 no match
  *  \retval 1 match
  */
-int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx,
-                                  Signature *s, SigMatch *sm,
-                                  Flow *f,
-                                  uint8_t *buffer, uint32_t buffer_len,
-                                  uint32_t stream_start_offset,
-                                  uint8_t inspection_mode, void *data)
+static int DetectEngineContentInspectionWalk(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Signature *s, SigMatch *sm, Flow *f,
+        uint8_t *buffer, uint32_t buffer_len, uint32_t stream_start_offset,
+        uint8_t inspection_mode, void *data)
 {
     SCEnter();
     KEYWORD_PROFILING_START;
@@ -106,7 +248,7 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
     det_ctx->inspection_recursion_counter++;
 
     if (det_ctx->inspection_recursion_counter == de_ctx->inspection_recursion_limit) {
-        det_ctx->discontinue_matching = 1;
+        DetectEngineInspectionLimitReached(det_ctx);
         KEYWORD_PROFILING_END(det_ctx, sm->type, 0);
         SCReturnInt(0);
     }
@@ -273,10 +415,8 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
              * greater than sbuffer_len found is anyways NULL */
 
             /* do the actual search */
-            if (cd->flags & DETECT_CONTENT_NOCASE)
-                found = BoyerMooreNocase(cd->content, cd->content_len, sbuffer, sbuffer_len, cd->bm_ctx->bmGs, cd->bm_ctx->bmBc);
-            else
-                found = BoyerMoore(cd->content, cd->content_len, sbuffer, sbuffer_len, cd->bm_ctx->bmGs, cd->bm_ctx->bmBc);
+            found = SpmBmCtxSearch(sbuffer, sbuffer_len, cd->content, cd->content_len,
+                    cd->bm_ctx, cd->flags & DETECT_CONTENT_NOCASE);
 
             /* next we evaluate the result in combination with the
              * negation flag. */
@@ -325,7 +465,7 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
                 /* see if the next buffer keywords match. If not, we will
                  * search for another occurence of this content and see
                  * if the others match then until we run out of matches */
-                int r = DetectEngineContentInspection(de_ctx, det_ctx, s, sm->next, f, buffer, buffer_len, stream_start_offset, inspection_mode, data);
+                int r = DetectEngineContentInspectionWalk(de_ctx, det_ctx, s, sm->next, f, buffer, buffer_len, stream_start_offset, inspection_mode, data);
                 if (r == 1) {
                     SCReturnInt(1);
                 }
@@ -343,33 +483,13 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
     } else if (sm->type == DETECT_ISDATAAT) {
         SCLogDebug("inspecting isdataat");
 
-        DetectIsdataatData *id = (DetectIsdataatData *)sm->ctx;
-        if (id->flags & ISDATAAT_RELATIVE) {
-            if (det_ctx->buffer_offset + id->dataat > buffer_len) {
-                SCLogDebug("det_ctx->buffer_offset + id->dataat %"PRIu32" > %"PRIu32, det_ctx->buffer_offset + id->dataat, buffer_len);
-                if (id->flags & ISDATAAT_NEGATED)
-                    goto match;
-                goto no_match;
-            } else {
-                SCLogDebug("relative isdataat match");
-                if (id->flags & ISDATAAT_NEGATED)
-                    goto no_match;
-                goto match;
-            }
-        } else {
-            if (id->dataat < buffer_len) {
-                SCLogDebug("absolute isdataat match");
-                if (id->flags & ISDATAAT_NEGATED)
-                    goto no_match;
-                goto match;
-            } else {
-                SCLogDebug("absolute isdataat mismatch, id->isdataat %"PRIu32", buffer_len %"PRIu32"", id->dataat, buffer_len);
-                if (id->flags & ISDATAAT_NEGATED)
-                    goto match;
-                goto no_match;
-            }
+        if (DetectEngineInspectIsdataat((DetectIsdataatData *)sm->ctx,
+                    det_ctx->buffer_offset, buffer_len) != 1) {
+            goto no_match;
         }
 
+        goto match;
+
     } else if (sm->type == DETECT_PCRE) {
         SCLogDebug("inspecting pcre");
         DetectPcreData *pe = (DetectPcreData *)sm->ctx;
@@ -400,7 +520,7 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
             /* see if the next payload keywords match. If not, we will
              * search for another occurence of this pcre and see
              * if the others match, until we run out of matches */
-            r = DetectEngineContentInspection(de_ctx, det_ctx, s, sm->next,
+            r = DetectEngineContentInspectionWalk(de_ctx, det_ctx, s, sm->next,
                                               f, buffer, buffer_len, stream_start_offset, inspection_mode, data);
             if (r == 1) {
                 SCReturnInt(1);
@@ -414,81 +534,24 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
         } while (1);
 
     } else if (sm->type == DETECT_BYTETEST) {
-        DetectBytetestData *btd = (DetectBytetestData *)sm->ctx;
-        uint8_t flags = btd->flags;
-        int32_t offset = btd->offset;
-        uint64_t value = btd->value;
-        if (flags & DETECT_BYTETEST_OFFSET_BE) {
-            offset = det_ctx->bj_values[offset];
-        }
-        if (flags & DETECT_BYTETEST_VALUE_BE) {
-            value = det_ctx->bj_values[value];
-        }
-
-        /* if we have dce enabled we will have to use the endianness
-         * specified by the dce header */
-        if (flags & DETECT_BYTETEST_DCE) {
-            DCERPCState *dcerpc_state = (DCERPCState *)data;
-            /* enable the endianness flag temporarily.  once we are done
-             * processing we reset the flags to the original value*/
-            flags |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] & 0x10) ?
-                      DETECT_BYTETEST_LITTLE: 0);
-        }
-
-        if (DetectBytetestDoMatch(det_ctx, s, sm, buffer, buffer_len, flags,
-                                  offset, value) != 1) {
+        if (DetectEngineInspectBytetest(det_ctx, s, sm, buffer, buffer_len,
+                    data) != 1) {
             goto no_match;
         }
 
         goto match;
 
     } else if (sm->type == DETECT_BYTEJUMP) {
-        DetectBytejumpData *bjd = (DetectBytejumpData *)sm->ctx;
-        uint8_t flags = bjd->flags;
-        int32_t offset = bjd->offset;
-
-        if (flags & DETECT_BYTEJUMP_OFFSET_BE) {
-            offset = det_ctx->bj_values[offset];
-        }
-
-        /* if we have dce enabled we will have to use the endianness
-         * specified by the dce header */
-        if (flags & DETECT_BYTEJUMP_DCE) {
-            DCERPCState *dcerpc_state = (DCERPCState *)data;
-            /* enable the endianness flag temporarily.  once we are done
-             * processing we reset the flags to the original value*/
-            flags |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] & 0x10) ?
-                      DETECT_BYTEJUMP_LITTLE: 0);
-        }
-
-        if (DetectBytejumpDoMatch(det_ctx, s, sm, buffer, buffer_len,
-                                  flags, offset) != 1) {
+        if (DetectEngineInspectBytejump(det_ctx, s, sm, buffer, buffer_len,
+                    data) != 1) {
             goto no_match;
         }
 
         goto match;
 
     } else if (sm->type == DETECT_BYTE_EXTRACT) {
-
-        DetectByteExtractData *bed = (DetectByteExtractData *)sm->ctx;
-        uint8_t endian = bed->endian;
-
-        /* if we have dce enabled we will have to use the endianness
-         * specified by the dce header */
-        if ((bed->flags & DETECT_BYTE_EXTRACT_FLAG_ENDIAN) &&
-            endian == DETECT_BYTE_EXTRACT_ENDIAN_DCE) {
-
-            DCERPCState *dcerpc_state = (DCERPCState *)data;
-            /* enable the endianness flag temporarily.  once we are done
-             * processing we reset the flags to the original value*/
-            endian |= ((dcerpc_state->dcerpc.dcerpchdr.packed_drep[0] == 0x10) ?
-                       DETECT_BYTE_EXTRACT_ENDIAN_LITTLE : DETECT_BYTE_EXTRACT_ENDIAN_BIG);
-        }
-
-        if (DetectByteExtractDoMatch(det_ctx, sm, s, buffer,
-                                     buffer_len,
-                                     &det_ctx->bj_values[bed->local_id],
-                                     endian) != 1) {
+        if (DetectEngineInspectByteExtract(det_ctx, s, sm, buffer, buffer_len,
+                    data) != 1) {
             goto no_match;
         }
 
@@ -498,31 +561,7 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
     } else if (sm->type == DETECT_AL_URILEN) {
         SCLogDebug("inspecting uri len");
 
-        int r = 0;
-        DetectUrilenData *urilend = (DetectUrilenData *) sm->ctx;
-
-        switch (urilend->mode) {
-            case DETECT_URILEN_EQ:
-                if (buffer_len == urilend->urilen1)
-                    r = 1;
-                break;
-            case DETECT_URILEN_LT:
-                if (buffer_len < urilend->urilen1)
-                    r = 1;
-                break;
-            case DETECT_URILEN_GT:
-                if (buffer_len > urilend->urilen1)
-                    r = 1;
-                break;
-            case DETECT_URILEN_RA:
-                if (buffer_len > urilend->urilen1 &&
-                    buffer_len < urilend->urilen2) {
-                    r = 1;
-                }
-                break;
-        }
-
-        if (r == 1) {
+        if (DetectEngineInspectUrilen((DetectUrilenData *)sm->ctx, buffer_len) == 1) {
             goto match;
         }
 
@@ -533,13 +572,9 @@ int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx
     }
     else if (sm->type == DETECT_LUAJIT) {
         SCLogDebug("lua starting");
-        /* for flowvar gets and sets we need to know the flow's lock status */
-        int need_flow_lock = 0;
-        if (inspection_mode <= DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM)
-            need_flow_lock = 1;
 
-        if (DetectLuajitMatchBuffer(det_ctx, s, sm, buffer, buffer_len,
-                    det_ctx->buffer_offset, f, need_flow_lock) != 1)
+        if (DetectEngineInspectLuajit(det_ctx, s, sm, f, buffer, buffer_len,
+                    inspection_mode) != 1)
         {
             SCLogDebug("lua no_match");
             goto no_match;
@@ -563,10 +598,784 @@ match:
      * the buffer portion of the signature matched. */
     if (sm->next != NULL) {
         KEYWORD_PROFILING_END(det_ctx, sm->type, 1);
-        int r = DetectEngineContentInspection(de_ctx, det_ctx, s, sm->next, f, buffer, buffer_len, stream_start_offset, inspection_mode, data);
+        int r = DetectEngineContentInspectionWalk(de_ctx, det_ctx, s, sm->next, f, buffer, buffer_len, stream_start_offset, inspection_mode, data);
         SCReturnInt(r);
     } else {
         KEYWORD_PROFILING_END(det_ctx, sm->type, 1);
         SCReturnInt(1);
     }
 }
+
+/** lists that are inspected by DetectEngineContentInspection() */
+static const int detect_ci_lists[] = {
+    DETECT_SM_LIST_PMATCH,
+    DETECT_SM_LIST_UMATCH,
+    DETECT_SM_LIST_HRUDMATCH,
+    DETECT_SM_LIST_HCBDMATCH,
+    DETECT_SM_LIST_HSBDMATCH,
+    DETECT_SM_LIST_HHDMATCH,
+    DETECT_SM_LIST_HRHDMATCH,
+    DETECT_SM_LIST_HSMDMATCH,
+    DETECT_SM_LIST_HSCDMATCH,
+    DETECT_SM_LIST_HHHDMATCH,
+    DETECT_SM_LIST_HRHHDMATCH,
+    DETECT_SM_LIST_HMDMATCH,
+    DETECT_SM_LIST_HCDMATCH,
+    DETECT_SM_LIST_HUADMATCH,
+    DETECT_SM_LIST_DMATCH,
+    DETECT_SM_LIST_DNSQUERY_MATCH,
+};
+
+static int DetectEngineContentInsnSetup(DetectEngineContentInsn *insn, SigMatch *sm)
+{
+    memset(insn, 0, sizeof(*insn));
+    insn->sm = sm;
+    insn->type = sm->type;
+
+    switch (sm->type) {
+        case DETECT_CONTENT:
+        {
+            DetectContentData *cd = (DetectContentData *)sm->ctx;
+
+            insn->op = DETECT_CI_OP_CONTENT;
+            insn->offset = cd->offset;
+            insn->depth = cd->depth;
+            insn->distance = cd->distance;
+            insn->within = cd->within;
+
+            if (cd->flags & DETECT_CONTENT_NEGATED)
+                insn->flags |= DETECT_CI_CONTENT_NEGATED;
+            if (cd->flags & DETECT_CONTENT_NOCASE)
+                insn->flags |= DETECT_CI_CONTENT_NOCASE;
+            if (cd->flags & (DETECT_CONTENT_DISTANCE|DETECT_CONTENT_WITHIN))
+                insn->flags |= DETECT_CI_CONTENT_RELATIVE;
+            if (cd->flags & DETECT_CONTENT_DISTANCE)
+                insn->flags |= DETECT_CI_CONTENT_DISTANCE;
+            if (cd->flags & DETECT_CONTENT_WITHIN)
+                insn->flags |= DETECT_CI_CONTENT_WITHIN;
+            if ((cd->flags & DETECT_CONTENT_DEPTH_BE) || cd->depth != 0)
+                insn->flags |= DETECT_CI_CONTENT_DEPTH;
+            if (cd->flags & DETECT_CONTENT_DEPTH)
+                insn->flags |= DETECT_CI_CONTENT_STREAM_DEPTH;
+            if (cd->flags & (DETECT_CONTENT_OFFSET_BE|DETECT_CONTENT_DEPTH_BE|
+                             DETECT_CONTENT_DISTANCE_BE|DETECT_CONTENT_WITHIN_BE))
+                insn->flags |= DETECT_CI_CONTENT_VARS;
+            if (DETECT_CONTENT_IS_SINGLE(cd))
+                insn->flags |= DETECT_CI_CONTENT_SINGLE;
+            if (cd->flags & DETECT_CONTENT_REPLACE)
+                insn->flags |= DETECT_CI_CONTENT_REPLACE;
+            if (cd->flags & DETECT_CONTENT_RELATIVE_NEXT)
+                insn->flags |= DETECT_CI_RELATIVE_NEXT;
+            return 0;
+        }
+        case DETECT_ISDATAAT:
+            insn->op = DETECT_CI_OP_ISDATAAT;
+            return 0;
+        case DETECT_PCRE:
+            insn->op = DETECT_CI_OP_PCRE;
+            if (((DetectPcreData *)sm->ctx)->flags & DETECT_PCRE_RELATIVE_NEXT)
+                insn->flags |= DETECT_CI_RELATIVE_NEXT;
+            return 0;
+        case DETECT_BYTETEST:
+            insn->op = DETECT_CI_OP_BYTETEST;
+            return 0;
+        case DETECT_BYTEJUMP:
+            insn->op = DETECT_CI_OP_BYTEJUMP;
+            return 0;
+        case DETECT_BYTE_EXTRACT:
+            insn->op = DETECT_CI_OP_BYTE_EXTRACT;
+            return 0;
+        case DETECT_AL_URILEN:
+            insn->op = DETECT_CI_OP_URILEN;
+            return 0;
+#ifdef HAVE_LUA
+        case DETECT_LUAJIT:
+            insn->op = DETECT_CI_OP_LUAJIT;
+            return 0;
+#endif
+    }
+    return -1;
+}
+
+/**
+ *  \brief Get the shortest buffer a program can match.
+ *
+ *  Every instruction has to match for the program to match, so a non
+ *  negated content needs its offset plus its length. Programs that can
+ *  set vars before failing get no minimum, skipping them would change
+ *  what is set.
+ */
+static uint32_t DetectEngineContentProgMinLen(const DetectEngineContentProg *prog)
+{
+    uint32_t min_len = 1;
+    uint16_t i;
+
+    for (i = 0; i < prog->len; i++) {
+        const DetectEngineContentInsn *insn = &prog->insns[i];
+
+        if (insn->op == DETECT_CI_OP_PCRE) {
+            DetectPcreData *pe = (DetectPcreData *)insn->sm->ctx;
+            if (pe->flags & (DETECT_PCRE_CAPTURE_PKT|DETECT_PCRE_CAPTURE_FLOW))
+                return 1;
+        } else if (insn->op == DETECT_CI_OP_LUAJIT) {
+            return 1;
+        }
+    }
+
+    for (i = 0; i < prog->len; i++) {
+        const DetectEngineContentInsn *insn = &prog->insns[i];
+
+        if (insn->op == DETECT_CI_OP_CONTENT &&
+            !(insn->flags & (DETECT_CI_CONTENT_NEGATED|DETECT_CI_CONTENT_VARS))) {
+            DetectContentData *cd = (DetectContentData *)insn->sm->ctx;
+            if (insn->offset + cd->content_len > min_len)
+                min_len = insn->offset + cd->content_len;
+        } else if (insn->op == DETECT_CI_OP_ISDATAAT) {
+            DetectIsdataatData *id = (DetectIsdataatData *)insn->sm->ctx;
+            if (!(id->flags & (ISDATAAT_RELATIVE|ISDATAAT_NEGATED)) &&
+                (uint32_t)id->dataat + 1 > min_len)
+                min_len = id->dataat + 1;
+        }
+    }
+    return min_len;
+}
+
+void DetectEngineContentInspectionFreeSig(Signature *s)
+{
+    uint16_t i;
+
+    if (s->ci_progs == NULL)
+        return;
+
+    for (i = 0; i < s->ci_prog_cnt; i++) {
+        if (s->ci_progs[i].insns != NULL)
+            SCFree(s->ci_progs[i].insns);
+    }
+    SCFree(s->ci_progs);
+    s->ci_progs = NULL;
+    s->ci_prog_cnt = 0;
+}
+
+/**
+ *  \brief Compile the content inspection lists of a signature.
+ *
+ *  Lists with keywords the inspection doesn't know, or longer than
+ *  DETECT_CI_PROG_MAX_LEN, are left to the recursive walk.
+ *
+ *  \retval 0 ok
+ *  \retval -1 out of memory
+ */
+int DetectEngineContentInspectionBuildSig(Signature *s)
+{
+    DetectEngineContentProg progs[sizeof(detect_ci_lists) / sizeof(detect_ci_lists[0])];
+    uint16_t cnt = 0;
+    uint32_t l;
+
+    DetectEngineContentInspectionFreeSig(s);
+
+    for (l = 0; l < sizeof(detect_ci_lists) / sizeof(detect_ci_lists[0]); l++) {
+        SigMatch *head = s->sm_lists[detect_ci_lists[l]];
+        SigMatch *sm;
+        uint16_t len = 0;
+
+        if (head == NULL)
+            continue;
+        for (sm = head; sm != NULL && len <= DETECT_CI_PROG_MAX_LEN; sm = sm->next)
+            len++;
+        if (len > DETECT_CI_PROG_MAX_LEN)
+            continue;
+
+        DetectEngineContentInsn *insns = SCMalloc(len * sizeof(DetectEngineContentInsn));
+        if (unlikely(insns == NULL))
+            goto error;
+
+        len = 0;
+        for (sm = head; sm != NULL; sm = sm->next) {
+            if (DetectEngineContentInsnSetup(&insns[len], sm) != 0)
+                break;
+            len++;
+        }
+        if (sm != NULL) {
+            SCLogDebug("sig %"PRIu32" list %d has sm type %u, not compiled",
+                    s->id, detect_ci_lists[l], sm->type);
+            SCFree(insns);
+            continue;
+        }
+
+        progs[cnt].head = head;
+        progs[cnt].insns = insns;
+        progs[cnt].len = len;
+        progs[cnt].min_buffer_len = DetectEngineContentProgMinLen(&progs[cnt]);
+        cnt++;
+    }
+
+    if (cnt == 0)
+        return 0;
+
+    s->ci_progs = SCMalloc(cnt * sizeof(DetectEngineContentProg));
+    if (unlikely(s->ci_progs == NULL))
+        goto error;
+    memcpy(s->ci_progs, progs, cnt * sizeof(DetectEngineContentProg));
+    s->ci_prog_cnt = cnt;
+    return 0;
+
+error:
+    while (cnt > 0)
+        SCFree(progs[--cnt].insns);
+    return -1;
+}
+
+/**
+ *  \brief Compile the content inspection lists of all signatures.
+ */
+int DetectEngineContentInspectionBuild(DetectEngineCtx *de_ctx)
+{
+    Signature *s;
+    uint32_t progs = 0;
+
+    for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+        if (DetectEngineContentInspectionBuildSig(s) != 0) {
+            SCLogError(SC_ERR_MEM_ALLOC, "compiling the content inspection "
+                    "of sig %"PRIu32" failed", s->id);
+            return -1;
+        }
+        progs += s->ci_prog_cnt;
+    }
+    SCLogDebug("%"PRIu32" content inspection programs", progs);
+    return 0;
+}
+
+/**
+ *  \brief Get the window of a content instruction, same as the
+ *         window the walk computes from the DetectContentData.
+ *
+ *  \retval 0 the content can't match, the window is before the stream chunk
+ *  \retval 1 ok, window in *r_offset and *r_depth
+ */
+static inline int DetectEngineContentInsnWindow(const DetectEngineThreadCtx *det_ctx,
+        const DetectEngineContentInsn *insn, uint32_t buffer_len,
+        uint32_t stream_start_offset, uint32_t prev_buffer_offset,
+        uint32_t *r_offset, uint32_t *r_depth)
+{
+    uint64_t c_offset = insn->offset;
+    uint64_t c_depth = insn->depth;
+    int32_t distance = insn->distance;
+    int32_t within = insn->within;
+    uint32_t offset;
+    uint32_t depth = buffer_len;
+
+    if (unlikely(insn->flags & DETECT_CI_CONTENT_VARS)) {
+        const DetectContentData *cd = (DetectContentData *)insn->sm->ctx;
+        if (cd->flags & DETECT_CONTENT_OFFSET_BE)
+            c_offset = det_ctx->bj_values[cd->offset];
+        if (cd->flags & DETECT_CONTENT_DEPTH_BE)
+            c_depth = det_ctx->bj_values[cd->depth];
+        if ((cd->flags & DETECT_CONTENT_DISTANCE) && (cd->flags & DETECT_CONTENT_DISTANCE_BE))
+            distance = det_ctx->bj_values[cd->distance];
+        if ((cd->flags & DETECT_CONTENT_WITHIN) && (cd->flags & DETECT_CONTENT_WITHIN_BE))
+            within = det_ctx->bj_values[cd->within];
+    }
+
+    if (insn->flags & DETECT_CI_CONTENT_RELATIVE) {
+        offset = prev_buffer_offset;
+
+        if (insn->flags & DETECT_CI_CONTENT_DISTANCE) {
+            if (distance < 0 && (uint32_t)(abs(distance)) > offset)
+                offset = 0;
+            else
+                offset += distance;
+        }
+
+        if (insn->flags & DETECT_CI_CONTENT_WITHIN) {
+            if ((int32_t)depth > (int32_t)(prev_buffer_offset + within + distance)) {
+                depth = prev_buffer_offset + within + distance;
+            }
+
+            if (stream_start_offset != 0 && prev_buffer_offset == 0) {
+                if (depth <= stream_start_offset) {
+                    return 0;
+                } else if (depth >= (stream_start_offset + buffer_len)) {
+                    ;
+                } else {
+                    depth = depth - stream_start_offset;
+                }
+            }
+        }
+
+        if (insn->flags & DETECT_CI_CONTENT_DEPTH) {
+            if ((c_depth + prev_buffer_offset) < depth) {
+                depth = prev_buffer_offset + c_depth;
+            }
+        }
+
+        if (c_offset > offset)
+            offset = c_offset;
+    } else {
+        if (insn->flags & DETECT_CI_CONTENT_DEPTH)
+            depth = c_depth;
+
+        if (stream_start_offset != 0 && (insn->flags & DETECT_CI_CONTENT_STREAM_DEPTH)) {
+            if (depth <= stream_start_offset) {
+                return 0;
+            } else if (depth >= (stream_start_offset + buffer_len)) {
+                ;
+            } else {
+                depth = depth - stream_start_offset;
+            }
+        }
+
+        offset = c_offset;
+    }
+
+    *r_offset = offset;
+    *r_depth = depth;
+    return 1;
+}
+
+/** backtracking point: a content or pcre that matched and that is
+ *  searched again from prev_offset if the relative keywords after it fail */
+typedef struct DetectEngineContentFrame_ {
+    uint16_t pc;
+    uint32_t prev_offset;
+    uint32_t prev_buffer_offset;
+} DetectEngineContentFrame;
+
+/**
+ *  \brief Run a compiled program. Gives the same results as the recursive
+ *         walk of the sm list, with the same use of the inspection
+ *         recursion limit.
+ */
+static int DetectEngineContentInspectionRun(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, Signature *s,
+        const DetectEngineContentProg *prog, Flow *f,
+        uint8_t *buffer, uint32_t buffer_len, uint32_t stream_start_offset,
+        uint8_t inspection_mode, void *data)
+{
+    DetectEngineContentFrame stack[DETECT_CI_PROG_MAX_LEN];
+    uint32_t sp = 0;
+    uint16_t pc = 0;
+    uint32_t prev_buffer_offset = det_ctx->buffer_offset;
+    uint32_t prev_offset = 0;
+
+    det_ctx->inspection_recursion_counter++;
+    if (det_ctx->inspection_recursion_counter == de_ctx->inspection_recursion_limit) {
+        DetectEngineInspectionLimitReached(det_ctx);
+        return 0;
+    }
+    if (buffer_len < prog->min_buffer_len)
+        return 0;
+
+    while (1) {
+        const DetectEngineContentInsn *insn = &prog->insns[pc];
+        SigMatch *sm = insn->sm;
+        int match = 0;
+
+        KEYWORD_PROFILING_START;
+
+        switch (insn->op) {
+            case DETECT_CI_OP_CONTENT:
+            {
+                DetectContentData *cd = (DetectContentData *)sm->ctx;
+                uint32_t offset, depth;
+                uint8_t *found;
+
+                if (DetectEngineContentInsnWindow(det_ctx, insn, buffer_len,
+                            stream_start_offset, prev_buffer_offset,
+                            &offset, &depth) == 0)
+                    break;
+
+                /* searching again after the previous occurence */
+                if (prev_offset != 0)
+                    offset = prev_offset;
+                if (depth > buffer_len)
+                    depth = buffer_len;
+
+                if (offset > depth || depth == 0) {
+                    match = (insn->flags & DETECT_CI_CONTENT_NEGATED) ? 1 : 0;
+                    break;
+                }
+
+                found = SpmBmCtxSearch(buffer + offset, depth - offset, cd->content,
+                        cd->content_len, cd->bm_ctx, insn->flags & DETECT_CI_CONTENT_NOCASE);
+
+                if (found == NULL) {
+                    match = (insn->flags & DETECT_CI_CONTENT_NEGATED) ? 1 : 0;
+                    break;
+                }
+                if (insn->flags & DETECT_CI_CONTENT_NEGATED) {
+                    /* don't bother carrying recursive matches now, for
+                     * preceding relative keywords */
+                    if (insn->flags & DETECT_CI_CONTENT_SINGLE)
+                        det_ctx->discontinue_matching = 1;
+                    break;
+                }
+
+                uint32_t match_offset = (uint32_t)((found - buffer) + cd->content_len);
+                det_ctx->buffer_offset = match_offset;
+
+                if (insn->flags & DETECT_CI_CONTENT_REPLACE) {
+                    if (inspection_mode == DETECT_ENGINE_CONTENT_INSPECTION_MODE_PAYLOAD) {
+                        /* we will need to replace content if match is confirmed */
+                        det_ctx->replist = DetectReplaceAddToList(det_ctx->replist, found, cd);
+                    } else {
+                        SCLogWarning(SC_ERR_INVALID_VALUE, "Can't modify payload without packet");
+                    }
+                }
+
+                if (insn->flags & DETECT_CI_RELATIVE_NEXT) {
+                    if (pc + 1 == prog->len)
+                        break;
+                    stack[sp].pc = pc;
+                    stack[sp].prev_offset = match_offset - (cd->content_len - 1);
+                    stack[sp].prev_buffer_offset = prev_buffer_offset;
+                    sp++;
+                }
+                match = 1;
+                break;
+            }
+            case DETECT_CI_OP_ISDATAAT:
+                match = DetectEngineInspectIsdataat((DetectIsdataatData *)sm->ctx,
+                        det_ctx->buffer_offset, buffer_len);
+                break;
+            case DETECT_CI_OP_PCRE:
+            {
+                Packet *p = NULL;
+                if (inspection_mode == DETECT_ENGINE_CONTENT_INSPECTION_MODE_PAYLOAD)
+                    p = (Packet *)data;
+
+                det_ctx->buffer_offset = prev_buffer_offset;
+                det_ctx->pcre_match_start_offset = prev_offset;
+                if (DetectPcrePayloadMatch(det_ctx, s, sm, p, f, buffer, buffer_len) == 0)
+                    break;
+
+                if (insn->flags & DETECT_CI_RELATIVE_NEXT) {
+                    stack[sp].pc = pc;
+                    stack[sp].prev_offset = det_ctx->pcre_match_start_offset;
+                    stack[sp].prev_buffer_offset = prev_buffer_offset;
+                    sp++;
+                }
+                match = 1;
+                break;
+            }
+            case DETECT_CI_OP_BYTETEST:
+                match = DetectEngineInspectBytetest(det_ctx, s, sm, buffer,
+                        buffer_len, data);
+                break;
+            case DETECT_CI_OP_BYTEJUMP:
+                match = DetectEngineInspectBytejump(det_ctx, s, sm, buffer,
+                        buffer_len, data);
+                break;
+            case DETECT_CI_OP_BYTE_EXTRACT:
+                match = DetectEngineInspectByteExtract(det_ctx, s, sm, buffer,
+                        buffer_len, data);
+                break;
+            case DETECT_CI_OP_URILEN:
+                match = DetectEngineInspectUrilen((DetectUrilenData *)sm->ctx,
+                        buffer_len);
+                if (match == 0)
+                    det_ctx->discontinue_matching = 0;
+                break;
+#ifdef HAVE_LUA
+            case DETECT_CI_OP_LUAJIT:
+                match = DetectEngineInspectLuajit(det_ctx, s, sm, f, buffer,
+                        buffer_len, inspection_mode);
+                break;
+#endif
+        }
+
+        KEYWORD_PROFILING_END(det_ctx, insn->type, match);
+
+        if (match) {
+            if (++pc == prog->len)
+                return 1;
+
+            det_ctx->inspection_recursion_counter++;
+            if (det_ctx->inspection_recursion_counter == de_ctx->inspection_recursion_limit) {
+                DetectEngineInspectionLimitReached(det_ctx);
+                return 0;
+            }
+            prev_buffer_offset = det_ctx->buffer_offset;
+            prev_offset = 0;
+            continue;
+        }
+
+        /* backtrack to the last content or pcre that can match again */
+        if (det_ctx->discontinue_matching || sp == 0)
+            return 0;
+        sp--;
+        pc = stack[sp].pc;
+        prev_offset = stack[sp].prev_offset;
+        prev_buffer_offset = stack[sp].prev_buffer_offset;
+    }
+}
+
+/**
+ * \brief Inspect a buffer with a sm list of a signature.
+ *
+ * Uses the program the list was compiled to at load time, or walks the
+ * list if it wasn't compiled. Parameters and return values are the same as
+ * of DetectEngineContentInspectionWalk().
+ */
+int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx,
+                                  Signature *s, SigMatch *sm,
+                                  Flow *f,
+                                  uint8_t *buffer, uint32_t buffer_len,
+                                  uint32_t stream_start_offset,
+                                  uint8_t inspection_mode, void *data)
+{
+    uint16_t i;
+
+    for (i = 0; i < s->ci_prog_cnt; i++) {
+        if (s->ci_progs[i].head == sm) {
+            return DetectEngineContentInspectionRun(de_ctx, det_ctx, s,
+                    &s->ci_progs[i], f, buffer, buffer_len,
+                    stream_start_offset, inspection_mode, data);
+        }
+    }
+
+    return DetectEngineContentInspectionWalk(de_ctx, det_ctx, s, sm, f,
+            buffer, buffer_len, stream_start_offset, inspection_mode, data);
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+static void DetectEngineContentInspectionTestReset(DetectEngineThreadCtx *det_ctx)
+{
+    det_ctx->buffer_offset = 0;
+    det_ctx->discontinue_matching = 0;
+    det_ctx->inspection_recursion_counter = 0;
+    det_ctx->pcre_match_start_offset = 0;
+}
+
+/** \test the compiled programs give the same results as the walk, on
+ *        random buffers with and without hitting the recursion limit */
+static int DetectEngineContentInspectionTest01(void)
+{
+    const char *sigs[] = {
+        "alert tcp any any -> any any (content:\"ab\"; content:\"ba\"; distance:0; within:4; sid:1;)",
+        "alert tcp any any -> any any (content:\"a\"; content:\"b\"; distance:1; "
+            "content:\"a\"; distance:0; within:2; sid:2;)",
+        "alert tcp any any -> any any (content:\"ab\"; offset:2; depth:8; "
+            "content:!\"bb\"; distance:0; sid:3;)",
+        "alert tcp any any -> any any (content:\"aa\"; nocase; isdataat:2,relative; "
+            "content:\"b\"; distance:1; sid:4;)",
+        "alert tcp any any -> any any (content:\"b\"; byte_extract:1,0,off,relative; "
+            "content:\"a\"; offset:off; sid:5;)",
+        "alert tcp any any -> any any (pcre:\"/a.b/\"; content:\"b\"; distance:0; sid:6;)",
+        "alert tcp any any -> any any (content:\"a\"; pcre:\"/^b+a/R\"; "
+            "isdataat:!1,relative; sid:7;)",
+        "alert tcp any any -> any any (content:\"ab\"; byte_test:1,>,0x61,0,relative; sid:8;)",
+        "alert tcp any any -> any any (content:\"b\"; content:\"a\"; distance:-2; within:1; sid:9;)",
+        "alert tcp any any -> any any (content:!\"abab\"; content:\"aa\"; depth:6; sid:10;)",
+        "alert tcp any any -> any any (content:\"a\"; content:\"a\"; distance:0; "
+            "content:\"a\"; distance:0; content:\"c\"; distance:0; within:3; sid:11;)",
+        NULL,
+    };
+    const uint8_t alphabet[] = "abAc";
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    uint8_t buf[48];
+    uint32_t seed = 12345;
+    int result = 0;
+    int i, n;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    for (i = 0; sigs[i] != NULL; i++) {
+        if (DetectEngineAppendSig(de_ctx, (char *)sigs[i]) == NULL) {
+            printf("sig %d failed to parse: ", i + 1);
+            goto end;
+        }
+    }
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+    if (det_ctx == NULL)
+        goto end;
+
+    for (n = 0; n < 4000; n++) {
+        uint32_t len, stream_start_offset = (n & 1) ? 4 : 0;
+        Signature *s;
+
+        seed = seed * 1103515245 + 12345;
+        len = (seed >> 16) % sizeof(buf);
+        for (i = 0; i < (int)len; i++) {
+            seed = seed * 1103515245 + 12345;
+            buf[i] = alphabet[(seed >> 16) % 4];
+        }
+        /* every 4th round with a limit that cuts off the backtracking */
+        de_ctx->inspection_recursion_limit = (n & 2) ? 6 : 3000;
+
+        for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+            SigMatch *sm = s->sm_lists[DETECT_SM_LIST_PMATCH];
+
+            if (s->ci_prog_cnt != 1 || s->ci_progs[0].head != sm) {
+                printf("sig %"PRIu32" not compiled: ", s->id);
+                goto end;
+            }
+
+            DetectEngineContentInspectionTestReset(det_ctx);
+            int r1 = DetectEngineContentInspectionWalk(de_ctx, det_ctx, s, sm,
+                    NULL, buf, len, stream_start_offset,
+                    DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM, NULL);
+            uint32_t offset1 = det_ctx->buffer_offset;
+            uint16_t discontinue1 = det_ctx->discontinue_matching;
+
+            DetectEngineContentInspectionTestReset(det_ctx);
+            int r2 = DetectEngineContentInspection(de_ctx, det_ctx, s, sm,
+                    NULL, buf, len, stream_start_offset,
+                    DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM, NULL);
+
+            if (r1 != r2 || (r1 == 1 && offset1 != det_ctx->buffer_offset) ||
+                discontinue1 != det_ctx->discontinue_matching) {
+                printf("sig %"PRIu32" round %d: walk %d offset %"PRIu32
+                        " discontinue %u, program %d offset %"PRIu32
+                        " discontinue %u: ", s->id, n, r1, offset1, discontinue1,
+                        r2, det_ctx->buffer_offset, det_ctx->discontinue_matching);
+                goto end;
+            }
+        }
+    }
+
+    result = 1;
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \test shortest buffer of a program, and programs that set vars have none */
+static int DetectEngineContentInspectionTest02(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    Signature *s1, *s2;
+    int result = 0;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"abc\"; offset:10; content:!\"abcdefgh\"; content:\"x\"; "
+            "isdataat:20; sid:1;)");
+    s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"abc\"; offset:10; pcre:\"/(?P<pkt_x>a)/\"; sid:2;)");
+    if (s1 == NULL || s2 == NULL)
+        goto end;
+    if (DetectEngineContentInspectionBuild(de_ctx) != 0)
+        goto end;
+
+    if (s1->ci_prog_cnt != 1 || s1->ci_progs[0].len != 4 ||
+        s1->ci_progs[0].min_buffer_len != 21) {
+        printf("s1: ");
+        goto end;
+    }
+    if (s2->ci_prog_cnt != 1 || s2->ci_progs[0].min_buffer_len != 1) {
+        printf("s2: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (de_ctx != NULL)
+        DetectEngineCtxFree(de_ctx);
+    return result;
+}
+
+/** \test a content chain backtracking over a long buffer stops at the
+ *        recursion limit and counts it */
+static int DetectEngineContentInspectionTest03(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    Signature *s;
+    uint8_t buf[64];
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(buf, 'a', sizeof(buf));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    s = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"a\"; content:\"a\"; distance:0; content:\"b\"; distance:0; sid:1;)");
+    if (s == NULL)
+        goto end;
+    SigGroupBuild(de_ctx);
+    th_v.name = "detect_test";
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+    if (det_ctx == NULL)
+        goto end;
+    th_v.sc_perf_pca = SCPerfGetAllCountersArray(&th_v.sc_perf_pctx);
+
+    de_ctx->inspection_recursion_limit = 50;
+    DetectEngineContentInspectionTestReset(det_ctx);
+    if (DetectEngineContentInspection(de_ctx, det_ctx, s,
+                s->sm_lists[DETECT_SM_LIST_PMATCH], NULL, buf, sizeof(buf), 0,
+                DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM, NULL) != 0) {
+        goto end;
+    }
+    if (det_ctx->discontinue_matching != 1 || det_ctx->inspection_recursion_counter != 50) {
+        printf("discontinue %u counter %d: ", det_ctx->discontinue_matching,
+                det_ctx->inspection_recursion_counter);
+        goto end;
+    }
+    if (SCPerfGetLocalCounterValue(det_ctx->counter_inspection_limit, th_v.sc_perf_pca) != 1) {
+        printf("limit not counted: ");
+        goto end;
+    }
+
+    /* without the limit the whole buffer is searched */
+    de_ctx->inspection_recursion_limit = -1;
+    DetectEngineContentInspectionTestReset(det_ctx);
+    if (DetectEngineContentInspection(de_ctx, det_ctx, s,
+                s->sm_lists[DETECT_SM_LIST_PMATCH], NULL, buf, sizeof(buf), 0,
+                DETECT_ENGINE_CONTENT_INSPECTION_MODE_STREAM, NULL) != 0 ||
+        det_ctx->discontinue_matching != 0 ||
+        det_ctx->inspection_recursion_counter <= 50) {
+        printf("counter %d: ", det_ctx->inspection_recursion_counter);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (th_v.sc_perf_pca != NULL)
+        SCPerfReleasePCA(th_v.sc_perf_pca);
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void DetectEngineContentInspectionRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectEngineContentInspectionTest01",
+            DetectEngineContentInspectionTest01, 1);
+    UtRegisterTest("DetectEngineContentInspectionTest02",
+            DetectEngineContentInspectionTest02, 1);
+    UtRegisterTest("DetectEngineContentInspectionTest03",
+            DetectEngineContentInspectionTest03, 1);
+#endif /* UNITTESTS */
+}
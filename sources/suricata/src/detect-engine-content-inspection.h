@@ -50,6 +50,70 @@ enum {
     DETECT_ENGINE_CONTENT_INSPECTION_MODE_DNSQUERY,
 };
 
+/** sm lists longer than this aren't compiled, they are walked */
+#define DETECT_CI_PROG_MAX_LEN      64
+
+/** compiled instruction ops */
+enum {
+    DETECT_CI_OP_CONTENT = 0,
+    DETECT_CI_OP_ISDATAAT,
+    DETECT_CI_OP_PCRE,
+    DETECT_CI_OP_BYTETEST,
+    DETECT_CI_OP_BYTEJUMP,
+    DETECT_CI_OP_BYTE_EXTRACT,
+    DETECT_CI_OP_URILEN,
+    DETECT_CI_OP_LUAJIT,
+};
+
+/* content instruction flags */
+#define DETECT_CI_CONTENT_NEGATED       0x0001
+#define DETECT_CI_CONTENT_NOCASE        0x0002
+/** distance or within, the window is relative to the previous match */
+#define DETECT_CI_CONTENT_RELATIVE      0x0004
+#define DETECT_CI_CONTENT_DISTANCE      0x0008
+#define DETECT_CI_CONTENT_WITHIN        0x0010
+/** depth limits the window (depth keyword or a byte_extract var) */
+#define DETECT_CI_CONTENT_DEPTH         0x0020
+/** depth keyword, the window is adjusted to the stream chunk */
+#define DETECT_CI_CONTENT_STREAM_DEPTH  0x0040
+/** window uses byte_extract vars, resolved at match time */
+#define DETECT_CI_CONTENT_VARS          0x0080
+#define DETECT_CI_CONTENT_SINGLE        0x0100
+#define DETECT_CI_CONTENT_REPLACE       0x0200
+/** next instruction is relative to this one, retry on the next
+ *  occurence if it fails (content and pcre) */
+#define DETECT_CI_RELATIVE_NEXT         0x0400
+
+/** a sm of a content inspection list, with the content window
+ *  precomputed at load time */
+typedef struct DetectEngineContentInsn_ {
+    uint8_t op;
+    uint16_t flags;
+    /** sm type, for keyword profiling */
+    uint16_t type;
+    uint32_t offset;
+    uint32_t depth;
+    int32_t distance;
+    int32_t within;
+    SigMatch *sm;
+} DetectEngineContentInsn;
+
+/** a content inspection sm list compiled to a flat array of instructions,
+ *  evaluated in a loop with an explicit backtracking stack */
+typedef struct DetectEngineContentProg_ {
+    /** the sm list the program was compiled from */
+    const SigMatch *head;
+    DetectEngineContentInsn *insns;
+    uint16_t len;
+    /** buffers shorter than this can't match */
+    uint32_t min_buffer_len;
+} DetectEngineContentProg;
+
+int DetectEngineContentInspectionBuild(DetectEngineCtx *de_ctx);
+int DetectEngineContentInspectionBuildSig(Signature *s);
+void DetectEngineContentInspectionFreeSig(Signature *s);
+void DetectEngineContentInspectionRegisterTests(void);
+
 int DetectEngineContentInspection(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx,
                                   Signature *s, SigMatch *sm,
                                   Flow *f,
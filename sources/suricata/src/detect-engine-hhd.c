@@ -46,6 +46,7 @@
 #include "util-debug.h"
 #include "util-print.h"
 #include "util-memcmp.h"
+#include "util-spm.h"
 #include "flow.h"
 
 #include "stream-tcp.h"
@@ -56,101 +57,62 @@
 #include "util-unittest-helper.h"
 #include "app-layer.h"
 #include "app-layer-htp.h"
+#include "app-layer-htp-mem.h"
 #include "app-layer-protos.h"
 
-#define BUFFER_STEP 50
-
-static inline int HHDCreateSpace(DetectEngineThreadCtx *det_ctx, uint16_t size) {
-    void *ptmp;
-    if (size > det_ctx->hhd_buffers_size) {
-        ptmp = SCRealloc(det_ctx->hhd_buffers,
-                         (det_ctx->hhd_buffers_size + BUFFER_STEP) * sizeof(uint8_t *));
-        if (ptmp == NULL) {
-            SCFree(det_ctx->hhd_buffers);
-            det_ctx->hhd_buffers = NULL;
-            det_ctx->hhd_buffers_size = 0;
-            det_ctx->hhd_buffers_list_len = 0;
-            return -1;
-        }
-        det_ctx->hhd_buffers = ptmp;
-
-        memset(det_ctx->hhd_buffers + det_ctx->hhd_buffers_size, 0, BUFFER_STEP * sizeof(uint8_t *));
-        ptmp = SCRealloc(det_ctx->hhd_buffers_len,
-                         (det_ctx->hhd_buffers_size + BUFFER_STEP) * sizeof(uint32_t));
-        if (ptmp == NULL) {
-            SCFree(det_ctx->hhd_buffers_len);
-            det_ctx->hhd_buffers_len = NULL;
-            det_ctx->hhd_buffers_size = 0;
-            det_ctx->hhd_buffers_list_len = 0;
-            return -1;
-        }
-        det_ctx->hhd_buffers_len = ptmp;
-
-        memset(det_ctx->hhd_buffers_len + det_ctx->hhd_buffers_size, 0, BUFFER_STEP * sizeof(uint32_t));
-        det_ctx->hhd_buffers_size += BUFFER_STEP;
-    }
-    memset(det_ctx->hhd_buffers_len + det_ctx->hhd_buffers_list_len, 0, (size - det_ctx->hhd_buffers_list_len) * sizeof(uint32_t));
+/** generation of a header buffer. The headers only change while the tx
+ *  progresses, e.g. when the trailers are parsed, count them too. */
+#define HHD_BUFFER_GEN(progress, cnt) \
+    ((((uint32_t)(progress) & 0xff) << 24) | ((uint32_t)(cnt) & 0x00ffffff))
 
-    return 0;
-}
-
-static uint8_t *DetectEngineHHDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
-                                              DetectEngineCtx *de_ctx,
-                                              DetectEngineThreadCtx *det_ctx,
-                                              Flow *f, HtpState *htp_state,
-                                              uint8_t flags,
+/**
+ *  \brief Get the normalized headers of a tx, without the cookies.
+ *
+ *  The buffer is kept in the tx user data and only built again when the
+ *  headers change, so all packets of the tx, the mpm and all sigs use
+ *  the same one.
+ */
+static uint8_t *DetectEngineHHDGetBufferForTX(htp_tx_t *tx, uint8_t flags,
                                               uint32_t *buffer_len)
 {
-    uint8_t *headers_buffer = NULL;
-    int index = 0;
+    HtpTxInspectBuffer *ib;
+    htp_table_t *headers;
+    int progress;
     *buffer_len = 0;
 
-    if (det_ctx->hhd_buffers_list_len == 0) {
-        if (HHDCreateSpace(det_ctx, 1) < 0)
-            goto end;
-        index = 0;
+    /* only NULL if the htp callbacks ran out of memory */
+    HtpTxUserData *htud = (HtpTxUserData *)htp_tx_get_user_data(tx);
+    if (htud == NULL)
+        return NULL;
 
-        if (det_ctx->hhd_buffers_list_len == 0) {
-            det_ctx->hhd_start_tx_id = tx_id;
-        }
-        det_ctx->hhd_buffers_list_len++;
-    } else {
-        if ((tx_id - det_ctx->hhd_start_tx_id) < det_ctx->hhd_buffers_list_len) {
-            if (det_ctx->hhd_buffers_len[(tx_id - det_ctx->hhd_start_tx_id)] != 0) {
-                *buffer_len = det_ctx->hhd_buffers_len[(tx_id - det_ctx->hhd_start_tx_id)];
-                return det_ctx->hhd_buffers[(tx_id - det_ctx->hhd_start_tx_id)];
-            }
-        } else {
-            if (HHDCreateSpace(det_ctx, (tx_id - det_ctx->hhd_start_tx_id) + 1) < 0)
-                goto end;
-
-            if (det_ctx->hhd_buffers_list_len == 0) {
-                det_ctx->hhd_start_tx_id = tx_id;
-            }
-            det_ctx->hhd_buffers_list_len++;
-        }
-        index = (tx_id - det_ctx->hhd_start_tx_id);
-    }
-
-    htp_table_t *headers;
     if (flags & STREAM_TOSERVER) {
-        if (AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOSERVER) <= HTP_REQUEST_HEADERS)
-            goto end;
+        progress = AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOSERVER);
+        if (progress <= HTP_REQUEST_HEADERS)
+            return NULL;
         headers = tx->request_headers;
+        ib = &htud->inspect_buffers[HTP_INSPECT_BUFFER_REQUEST_HEADERS];
     } else {
-        if (AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOCLIENT) <= HTP_RESPONSE_HEADERS)
-            goto end;
+        progress = AppLayerParserGetStateProgress(IPPROTO_TCP, ALPROTO_HTTP, tx, STREAM_TOCLIENT);
+        if (progress <= HTP_RESPONSE_HEADERS)
+            return NULL;
         headers = tx->response_headers;
+        ib = &htud->inspect_buffers[HTP_INSPECT_BUFFER_RESPONSE_HEADERS];
     }
     if (headers == NULL)
-        goto end;
+        return NULL;
+
+    size_t no_of_headers = htp_table_size(headers);
+    uint32_t gen = HHD_BUFFER_GEN(progress, no_of_headers);
+    if (ib->gen == gen) {
+        *buffer_len = ib->buffer_len;
+        return ib->buffer;
+    }
+
+    ib->gen = 0;
+    ib->buffer_len = 0;
 
     htp_header_t *h = NULL;
-    headers_buffer = det_ctx->hhd_buffers[index];
-    size_t headers_buffer_len = 0;
     size_t i = 0;
-
-    size_t no_of_headers = htp_table_size(headers);
     for (; i < no_of_headers; i++) {
         h = htp_table_get_index(headers, i, NULL);
         size_t size1 = bstr_size(h->name);
@@ -169,17 +131,24 @@ static uint8_t *DetectEngineHHDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         }
 
         /* the extra 4 bytes if for ": " and "\r\n" */
-        uint8_t *new_headers_buffer = SCRealloc(headers_buffer, headers_buffer_len + size1 + size2 + 4);
-        if (unlikely(new_headers_buffer == NULL)) {
-            if (headers_buffer != NULL) {
-                SCFree(headers_buffer);
-                headers_buffer = NULL;
+        size_t needed = ib->buffer_len + size1 + size2 + 4;
+        if (needed > ib->buffer_size) {
+            size_t new_size = needed + (needed / 2);
+            uint8_t *new_buffer = HTPRealloc(ib->buffer, ib->buffer_size, new_size);
+            if (unlikely(new_buffer == NULL)) {
+                if (ib->buffer != NULL)
+                    HTPFree(ib->buffer, ib->buffer_size);
+                ib->buffer = NULL;
+                ib->buffer_size = 0;
+                ib->buffer_len = 0;
+                return NULL;
             }
-            det_ctx->hhd_buffers[index] = NULL;
-            det_ctx->hhd_buffers_len[index] = 0;
-            goto end;
+            ib->buffer = new_buffer;
+            ib->buffer_size = (uint32_t)new_size;
         }
-        headers_buffer = new_headers_buffer;
+
+        uint8_t *headers_buffer = ib->buffer;
+        uint32_t headers_buffer_len = ib->buffer_len;
 
         memcpy(headers_buffer + headers_buffer_len, bstr_ptr(h->name), size1);
         headers_buffer_len += size1;
@@ -192,15 +161,15 @@ static uint8_t *DetectEngineHHDGetBufferForTX(htp_tx_t *tx, uint64_t tx_id,
         headers_buffer[headers_buffer_len - 2] = '\r';
         /* \n */
         headers_buffer[headers_buffer_len - 1] = '\n';
+
+        ib->buffer_len = headers_buffer_len;
     }
 
-    /* store the buffers.  We will need it for further inspection */
-    det_ctx->hhd_buffers[index] = headers_buffer;
-    det_ctx->hhd_buffers_len[index] = headers_buffer_len;
+    /* store the generation. We will reuse it for further inspection */
+    ib->gen = gen;
 
-    *buffer_len = (uint32_t)headers_buffer_len;
- end:
-    return headers_buffer;
+    *buffer_len = ib->buffer_len;
+    return ib->buffer;
 }
 
 int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
@@ -209,11 +178,7 @@ int DetectEngineRunHttpHeaderMpm(DetectEngineThreadCtx *det_ctx, Flow *f,
 {
     uint32_t cnt = 0;
     uint32_t buffer_len = 0;
-    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, idx,
-                                                    NULL, det_ctx,
-                                                    f, htp_state,
-                                                    flags,
-                                                    &buffer_len);
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, flags, &buffer_len);
     if (buffer_len == 0)
         goto end;
 
@@ -230,13 +195,8 @@ int DetectEngineInspectHttpHeader(ThreadVars *tv,
                                   void *alstate,
                                   void *tx, uint64_t tx_id)
 {
-    HtpState *htp_state = (HtpState *)alstate;
     uint32_t buffer_len = 0;
-    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, tx_id,
-                                                    de_ctx, det_ctx,
-                                                    f, htp_state,
-                                                    flags,
-                                                    &buffer_len);
+    uint8_t *buffer = DetectEngineHHDGetBufferForTX(tx, flags, &buffer_len);
     if (buffer_len == 0)
         goto end;
 
@@ -263,20 +223,6 @@ int DetectEngineInspectHttpHeader(ThreadVars *tv,
     return DETECT_ENGINE_INSPECT_SIG_NO_MATCH;
 }
 
-void DetectEngineCleanHHDBuffers(DetectEngineThreadCtx *det_ctx)
-{
-    if (det_ctx->hhd_buffers_list_len != 0) {
-        int i;
-        for (i = 0; i < det_ctx->hhd_buffers_list_len; i++) {
-            det_ctx->hhd_buffers_len[i] = 0;
-        }
-        det_ctx->hhd_buffers_list_len = 0;
-    }
-    det_ctx->hhd_start_tx_id = 0;
-
-    return;
-}
-
 /***********************************Unittests**********************************/
 
 #ifdef UNITTESTS
@@ -3810,6 +3756,105 @@ end:
     return result;
 }
 
+/**
+ *\test Test that the header buffer is kept in the tx and only built
+ *      again when the headers change.
+ */
+static int DetectEngineHttpHeaderTest34(void)
+{
+    TcpSession ssn;
+    Flow f;
+    uint8_t http_buf1[] =
+        "POST /index.html HTTP/1.1\r\n"
+        "Host: www.openinfosecfoundation.org\r\n"
+        "Cookie: dontinspect\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n"
+        "5\r\nabcde\r\n";
+    uint32_t http_len1 = sizeof(http_buf1) - 1;
+    uint8_t http_buf2[] =
+        "0\r\n"
+        "X-Trailer: yes\r\n\r\n";
+    uint32_t http_len2 = sizeof(http_buf2) - 1;
+    uint8_t *buffer, *buffer2;
+    uint32_t buffer_len = 0, buffer_len2 = 0;
+    int result = 0;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    SCMutexLock(&f.m);
+    int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf1, http_len1);
+    SCMutexUnlock(&f.m);
+    if (r != 0 || f.alstate == NULL) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    htp_tx_t *tx = AppLayerParserGetTx(IPPROTO_TCP, ALPROTO_HTTP, f.alstate, 0);
+    if (tx == NULL)
+        goto end;
+
+    buffer = DetectEngineHHDGetBufferForTX(tx, STREAM_TOSERVER, &buffer_len);
+    if (buffer == NULL || buffer_len == 0) {
+        printf("no header buffer: ");
+        goto end;
+    }
+    if (BasicSearch(buffer, buffer_len, (uint8_t *)"Host: www.openinfosecfoundation.org\r\n", 37) == NULL ||
+        BasicSearch(buffer, buffer_len, (uint8_t *)"dontinspect", 11) != NULL) {
+        printf("unexpected header buffer: ");
+        goto end;
+    }
+
+    /* same headers, so the same buffer */
+    buffer2 = DetectEngineHHDGetBufferForTX(tx, STREAM_TOSERVER, &buffer_len2);
+    if (buffer2 != buffer || buffer_len2 != buffer_len) {
+        printf("buffer built again: ");
+        goto end;
+    }
+
+    HtpTxUserData *htud = (HtpTxUserData *)htp_tx_get_user_data(tx);
+    uint32_t gen = htud->inspect_buffers[HTP_INSPECT_BUFFER_REQUEST_HEADERS].gen;
+    if (gen == 0)
+        goto end;
+
+    SCMutexLock(&f.m);
+    r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, http_buf2, http_len2);
+    SCMutexUnlock(&f.m);
+    if (r != 0) {
+        printf("toserver chunk 2 returned %" PRId32 ", expected 0: ", r);
+        goto end;
+    }
+
+    /* the tx progressed and got a trailer */
+    buffer2 = DetectEngineHHDGetBufferForTX(tx, STREAM_TOSERVER, &buffer_len2);
+    if (htud->inspect_buffers[HTP_INSPECT_BUFFER_REQUEST_HEADERS].gen == gen) {
+        printf("buffer not built again: ");
+        goto end;
+    }
+    if (buffer2 == NULL ||
+        BasicSearch(buffer2, buffer_len2, (uint8_t *)"X-Trailer: yes\r\n", 16) == NULL) {
+        printf("trailer not in the header buffer: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void DetectEngineHttpHeaderRegisterTests(void)
@@ -3886,6 +3931,8 @@ void DetectEngineHttpHeaderRegisterTests(void)
                    DetectEngineHttpHeaderTest32, 1);
     UtRegisterTest("DetectEngineHttpHeaderTest33",
                    DetectEngineHttpHeaderTest33, 1);
+    UtRegisterTest("DetectEngineHttpHeaderTest34",
+                   DetectEngineHttpHeaderTest34, 1);
 
 #endif /* UNITTESTS */
 
@@ -24,7 +24,8 @@
  * Signatures that only inspect IP addresses are processed here
  * We use radix trees for src dst ipv4 and ipv6 adresses
  * This radix trees hold information for subnets and hosts in a
- * hierarchical distribution
+ * hierarchical distribution. Once built they are flattened into sorted
+ * address ranges that packets are looked up in
  */
 
 #include "suricata-common.h"
@@ -54,6 +55,8 @@
 #include "util-unittest-helper.h"
 #include "util-print.h"
 #include "util-profiling.h"
+#include "util-cpu.h"
+#include "conf.h"
 
 #ifdef OS_WIN32
 #include <winsock.h>
@@ -822,6 +825,378 @@ error:
     return -1;
 }
 
+/** boundaries of the ranges of a compiled lookup, words per address */
+typedef struct IPOnlyLookupBounds_ {
+    uint32_t *b;
+    uint32_t cnt;
+    uint32_t size;
+    uint32_t words;
+} IPOnlyLookupBounds;
+
+static int IPOnlyLookupBoundAdd(IPOnlyLookupBounds *bounds, const uint32_t *ip)
+{
+    if (bounds->cnt == bounds->size) {
+        uint32_t size = bounds->size ? bounds->size * 2 : 64;
+        uint32_t *b = SCRealloc(bounds->b, size * bounds->words * sizeof(uint32_t));
+        if (unlikely(b == NULL))
+            return -1;
+        bounds->b = b;
+        bounds->size = size;
+    }
+    memcpy(&bounds->b[bounds->cnt * bounds->words], ip,
+            bounds->words * sizeof(uint32_t));
+    bounds->cnt++;
+    return 0;
+}
+
+/**
+ * \brief Add the first address of each netblock in the tree below node and
+ *        the address after its last one. Between two of these addresses
+ *        the best match of the tree doesn't change.
+ */
+static int IPOnlyLookupCollectBounds(SCRadixNode *node, IPOnlyLookupBounds *bounds)
+{
+    if (node == NULL)
+        return 0;
+
+    if (node->prefix != NULL && node->prefix->stream != NULL) {
+        SCRadixUserData *ud = node->prefix->user_data;
+
+        for ( ; ud != NULL; ud = ud->next) {
+            uint32_t start[4], end[4];
+            int bits = ud->netmask;
+            int carry = 1;
+            int i;
+
+            for (i = 0; i < (int)bounds->words; i++) {
+                uint32_t w, mask;
+
+                memcpy(&w, node->prefix->stream + i * 4, sizeof(w));
+                w = ntohl(w);
+                if (bits >= 32)
+                    mask = 0xffffffff;
+                else if (bits <= 0)
+                    mask = 0;
+                else
+                    mask = ~(0xffffffff >> bits);
+                bits -= 32;
+
+                start[i] = w & mask;
+                end[i] = start[i] | ~mask;
+            }
+            if (IPOnlyLookupBoundAdd(bounds, start) < 0)
+                return -1;
+
+            /* end + 1, unless the netblock ends the address space */
+            for (i = (int)bounds->words - 1; i >= 0 && carry; i--) {
+                end[i]++;
+                carry = (end[i] == 0);
+            }
+            if (!carry && IPOnlyLookupBoundAdd(bounds, end) < 0)
+                return -1;
+        }
+    }
+
+    if (IPOnlyLookupCollectBounds(node->left, bounds) < 0)
+        return -1;
+    return IPOnlyLookupCollectBounds(node->right, bounds);
+}
+
+static int IPOnlyLookupBoundCompare4(const void *a, const void *b)
+{
+    uint32_t ia = *(const uint32_t *)a;
+    uint32_t ib = *(const uint32_t *)b;
+
+    if (ia != ib)
+        return ia < ib ? -1 : 1;
+    return 0;
+}
+
+static int IPOnlyLookupBoundCompare6(const void *a, const void *b)
+{
+    return IPv6HostOrderCmp((const uint32_t *)a, (const uint32_t *)b);
+}
+
+/**
+ * \brief Collect and sort the boundaries of a tree, without duplicates.
+ *        The first one is always the first address.
+ */
+static int IPOnlyLookupGetBounds(SCRadixTree *tree, uint32_t words,
+                                 IPOnlyLookupBounds *bounds)
+{
+    static const uint32_t zero[4] = { 0, 0, 0, 0 };
+    int (*Compare)(const void *, const void *) =
+        (words == 1) ? IPOnlyLookupBoundCompare4 : IPOnlyLookupBoundCompare6;
+    uint32_t i, u = 0;
+
+    memset(bounds, 0, sizeof(*bounds));
+    bounds->words = words;
+
+    if (IPOnlyLookupBoundAdd(bounds, zero) < 0 ||
+        IPOnlyLookupCollectBounds(tree->head, bounds) < 0) {
+        if (bounds->b != NULL)
+            SCFree(bounds->b);
+        return -1;
+    }
+
+    qsort(bounds->b, bounds->cnt, words * sizeof(uint32_t), Compare);
+    for (i = 1; i < bounds->cnt; i++) {
+        if (Compare(&bounds->b[i * words], &bounds->b[u * words]) != 0) {
+            u++;
+            memmove(&bounds->b[u * words], &bounds->b[i * words],
+                    words * sizeof(uint32_t));
+        }
+    }
+    bounds->cnt = u + 1;
+    return 0;
+}
+
+static uint32_t IPOnlyLookupSnaHash(HashListTable *ht, void *data, uint16_t datalen)
+{
+    SigNumArray *sna = (SigNumArray *)data;
+    uint32_t hash = sna->size;
+    uint32_t u;
+
+    for (u = 0; u < sna->size; u++)
+        hash = hash * 31 + sna->array[u];
+    return hash % ht->array_size;
+}
+
+static char IPOnlyLookupSnaCompare(void *data1, uint16_t len1, void *data2, uint16_t len2)
+{
+    SigNumArray *sna1 = (SigNumArray *)data1;
+    SigNumArray *sna2 = (SigNumArray *)data2;
+
+    return (sna1->size == sna2->size &&
+            memcmp(sna1->array, sna2->array, sna1->size) == 0);
+}
+
+/**
+ * \brief Get the SigNumArray the lookups use for the sigs of sna: the first
+ *        one with the same sigs, or NULL if there are none.
+ */
+static SigNumArray *IPOnlyLookupUniqSna(HashListTable *ht, SigNumArray *sna)
+{
+    uint32_t u;
+
+    if (sna == NULL)
+        return NULL;
+
+    for (u = 0; u < sna->size; u++) {
+        if (sna->array[u] != 0)
+            break;
+    }
+    if (u == sna->size)
+        return NULL;
+
+    SigNumArray *uniq = HashListTableLookup(ht, sna, sizeof(*sna));
+    if (uniq != NULL)
+        return uniq;
+
+    /* if it can't be added it's just not shared */
+    (void)HashListTableAdd(ht, sna, sizeof(*sna));
+    return sna;
+}
+
+static void IPOnlyLookup4Free(IPOnlyLookup4 *l)
+{
+    if (l == NULL)
+        return;
+
+    if (l->lo != NULL)
+        SCFree(l->lo);
+    if (l->sna != NULL)
+        SCFree(l->sna);
+    if (l->dir16 != NULL)
+        SCFree(l->dir16);
+    SCFree(l);
+}
+
+static void IPOnlyLookup6Free(IPOnlyLookup6 *l)
+{
+    if (l == NULL)
+        return;
+
+    if (l->lo != NULL)
+        SCFree(l->lo);
+    if (l->sna != NULL)
+        SCFree(l->sna);
+    SCFree(l);
+}
+
+/**
+ * \brief Compile an ipv4 tree into a range lookup.
+ *
+ * \retval l the lookup, NULL on error
+ */
+static IPOnlyLookup4 *IPOnlyLookup4Build(SCRadixTree *tree, HashListTable *ht)
+{
+    IPOnlyLookupBounds bounds;
+    IPOnlyLookup4 *l = NULL;
+    uint32_t i;
+
+    if (IPOnlyLookupGetBounds(tree, 1, &bounds) < 0)
+        return NULL;
+
+    l = SCMalloc(sizeof(*l));
+    if (unlikely(l == NULL))
+        goto error;
+    memset(l, 0, sizeof(*l));
+
+    l->lo = SCMalloc(bounds.cnt * sizeof(uint32_t));
+    l->sna = SCMalloc(bounds.cnt * sizeof(SigNumArray *));
+    if (l->lo == NULL || l->sna == NULL)
+        goto error;
+
+    for (i = 0; i < bounds.cnt; i++) {
+        uint32_t key = htonl(bounds.b[i]);
+        void *user_data = NULL;
+
+        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&key, tree, &user_data);
+        SigNumArray *sna = IPOnlyLookupUniqSna(ht, (SigNumArray *)user_data);
+
+        /* merge with the previous range if the sigs are the same */
+        if (l->cnt > 0 && l->sna[l->cnt - 1] == sna)
+            continue;
+        l->lo[l->cnt] = bounds.b[i];
+        l->sna[l->cnt] = sna;
+        l->cnt++;
+    }
+
+    if (l->cnt >= IPONLY_LOOKUP_DIR16_MIN) {
+        uint32_t r = 0;
+
+        l->dir16 = SCMalloc(65537 * sizeof(uint32_t));
+        if (l->dir16 == NULL)
+            goto error;
+
+        for (i = 0; i < 65536; i++) {
+            while (r + 1 < l->cnt && l->lo[r + 1] <= (i << 16))
+                r++;
+            l->dir16[i] = r;
+        }
+        l->dir16[65536] = l->cnt - 1;
+    }
+
+    SCFree(bounds.b);
+    return l;
+
+error:
+    SCFree(bounds.b);
+    IPOnlyLookup4Free(l);
+    return NULL;
+}
+
+/**
+ * \brief Compile an ipv6 tree into a range lookup.
+ *
+ * \retval l the lookup, NULL on error
+ */
+static IPOnlyLookup6 *IPOnlyLookup6Build(SCRadixTree *tree, HashListTable *ht)
+{
+    IPOnlyLookupBounds bounds;
+    IPOnlyLookup6 *l = NULL;
+    uint32_t i;
+
+    if (IPOnlyLookupGetBounds(tree, 4, &bounds) < 0)
+        return NULL;
+
+    l = SCMalloc(sizeof(*l));
+    if (unlikely(l == NULL))
+        goto error;
+    memset(l, 0, sizeof(*l));
+
+    l->lo = SCMalloc(bounds.cnt * 4 * sizeof(uint32_t));
+    l->sna = SCMalloc(bounds.cnt * sizeof(SigNumArray *));
+    if (l->lo == NULL || l->sna == NULL)
+        goto error;
+
+    for (i = 0; i < bounds.cnt; i++) {
+        uint32_t *b = &bounds.b[i * 4];
+        uint32_t key[4] = { htonl(b[0]), htonl(b[1]), htonl(b[2]), htonl(b[3]) };
+        void *user_data = NULL;
+
+        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)key, tree, &user_data);
+        SigNumArray *sna = IPOnlyLookupUniqSna(ht, (SigNumArray *)user_data);
+
+        if (l->cnt > 0 && l->sna[l->cnt - 1] == sna)
+            continue;
+        memcpy(&l->lo[l->cnt * 4], b, 4 * sizeof(uint32_t));
+        l->sna[l->cnt] = sna;
+        l->cnt++;
+    }
+
+    SCFree(bounds.b);
+    return l;
+
+error:
+    SCFree(bounds.b);
+    IPOnlyLookup6Free(l);
+    return NULL;
+}
+
+/**
+ * \brief Compile the radix trees into range lookups. Lookups that fail to
+ *        build are left NULL and the tree is used instead.
+ */
+static void IPOnlyLookupBuild(DetectEngineCtx *de_ctx, DetectEngineIPOnlyCtx *io_ctx)
+{
+    /* only used while building: the ranges point into the trees */
+    HashListTable *ht = HashListTableInit(4096, IPOnlyLookupSnaHash,
+            IPOnlyLookupSnaCompare, NULL);
+    if (ht == NULL)
+        return;
+
+    io_ctx->lookup_ipv4src = IPOnlyLookup4Build(io_ctx->tree_ipv4src, ht);
+    io_ctx->lookup_ipv4dst = IPOnlyLookup4Build(io_ctx->tree_ipv4dst, ht);
+    io_ctx->lookup_ipv6src = IPOnlyLookup6Build(io_ctx->tree_ipv6src, ht);
+    io_ctx->lookup_ipv6dst = IPOnlyLookup6Build(io_ctx->tree_ipv6dst, ht);
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        uint32_t uniq = 0;
+        HashListTableBucket *hb = HashListTableGetListHead(ht);
+        for ( ; hb != NULL; hb = HashListTableGetListNext(hb))
+            uniq++;
+
+        SCLogInfo("ip-only lookup: ipv4 %"PRIu32"/%"PRIu32" and ipv6 %"PRIu32
+                "/%"PRIu32" src/dst ranges, %"PRIu32" unique sig sets",
+                io_ctx->lookup_ipv4src ? io_ctx->lookup_ipv4src->cnt : 0,
+                io_ctx->lookup_ipv4dst ? io_ctx->lookup_ipv4dst->cnt : 0,
+                io_ctx->lookup_ipv6src ? io_ctx->lookup_ipv6src->cnt : 0,
+                io_ctx->lookup_ipv6dst ? io_ctx->lookup_ipv6dst->cnt : 0,
+                uniq);
+    }
+
+    HashListTableFree(ht);
+}
+
+/**
+ * \brief Find the sigs of an address, in the compiled lookup if there is
+ *        one or else in the tree.
+ */
+static inline SigNumArray *IPOnlyLookupAddress(const IPOnlyLookup4 *l4,
+        const IPOnlyLookup6 *l6, SCRadixTree *tree4, SCRadixTree *tree6,
+        Address *a)
+{
+    void *user_data = NULL;
+
+    if (a->family == AF_INET) {
+        if (l4 != NULL)
+            return IPOnlyLookup4Find(l4, ntohl(a->addr_data32[0]));
+        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&a->addr_data32[0],
+                                          tree4, &user_data);
+    } else if (a->family == AF_INET6) {
+        if (l6 != NULL) {
+            uint32_t ip[4] = { ntohl(a->addr_data32[0]), ntohl(a->addr_data32[1]),
+                               ntohl(a->addr_data32[2]), ntohl(a->addr_data32[3]) };
+            return IPOnlyLookup6Find(l6, ip);
+        }
+        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&a->addr_data32[0],
+                                          tree6, &user_data);
+    }
+    return (SigNumArray *)user_data;
+}
+
 /**
  * \brief Setup the IP Only detection engine context
  *
@@ -887,6 +1262,15 @@ void IPOnlyDeinit(DetectEngineCtx *de_ctx, DetectEngineIPOnlyCtx *io_ctx) {
     if (io_ctx == NULL)
         return;
 
+    IPOnlyLookup4Free(io_ctx->lookup_ipv4src);
+    io_ctx->lookup_ipv4src = NULL;
+    IPOnlyLookup4Free(io_ctx->lookup_ipv4dst);
+    io_ctx->lookup_ipv4dst = NULL;
+    IPOnlyLookup6Free(io_ctx->lookup_ipv6src);
+    io_ctx->lookup_ipv6src = NULL;
+    IPOnlyLookup6Free(io_ctx->lookup_ipv6dst);
+    io_ctx->lookup_ipv6dst = NULL;
+
     if (io_ctx->tree_ipv4src != NULL)
         SCRadixReleaseRadixTree(io_ctx->tree_ipv4src);
     io_ctx->tree_ipv4src = NULL;
@@ -955,28 +1339,15 @@ void IPOnlyMatchPacket(ThreadVars *tv,
                        DetectEngineIPOnlyCtx *io_ctx,
                        DetectEngineIPOnlyThreadCtx *io_tctx, Packet *p)
 {
-    SigNumArray *src = NULL;
-    SigNumArray *dst = NULL;
-    void *user_data_src = NULL, *user_data_dst = NULL;
-
-    if (p->src.family == AF_INET) {
-        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_SRC_ADDR_U32(p),
-                                              io_ctx->tree_ipv4src, &user_data_src);
-    } else if (p->src.family == AF_INET6) {
-        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_SRC_ADDR(p),
-                                              io_ctx->tree_ipv6src, &user_data_src);
-    }
-
-    if (p->dst.family == AF_INET) {
-        (void)SCRadixFindKeyIPV4BestMatch((uint8_t *)&GET_IPV4_DST_ADDR_U32(p),
-                                              io_ctx->tree_ipv4dst, &user_data_dst);
-    } else if (p->dst.family == AF_INET6) {
-        (void)SCRadixFindKeyIPV6BestMatch((uint8_t *)&GET_IPV6_DST_ADDR(p),
-                                              io_ctx->tree_ipv6dst, &user_data_dst);
-    }
+    SigNumArray *src = IPOnlyLookupAddress(io_ctx->lookup_ipv4src,
+            io_ctx->lookup_ipv6src, io_ctx->tree_ipv4src, io_ctx->tree_ipv6src,
+            &p->src);
+    if (src == NULL)
+        return;
 
-    src = user_data_src;
-    dst = user_data_dst;
+    SigNumArray *dst = IPOnlyLookupAddress(io_ctx->lookup_ipv4dst,
+            io_ctx->lookup_ipv6dst, io_ctx->tree_ipv4dst, io_ctx->tree_ipv6dst,
+            &p->dst);
 
     if (src == NULL || dst == NULL)
         return;
@@ -1079,7 +1450,8 @@ void IPOnlyMatchPacket(ThreadVars *tv,
  * \brief Build the radix trees from the lists of parsed adresses in CIDR format
  *        the result should be 4 radix trees: src/dst ipv4 and src/dst ipv6
  *        holding SigNumArrays, each of them with a hierarchical relation
- *        of subnets and hosts
+ *        of subnets and hosts. The trees are then compiled into sorted
+ *        range lookups for matching packets.
  *
  * \param de_ctx Pointer to the current detection engine
  */
@@ -1491,6 +1863,8 @@ void IPOnlyPrepare(DetectEngineCtx *de_ctx) {
     SCRadixPrintTree((de_ctx->io_ctx).tree_ipv6dst);
     SCLogDebug("__________________");
     */
+
+    IPOnlyLookupBuild(de_ctx, &de_ctx->io_ctx);
 }
 
 /**
@@ -2243,6 +2617,393 @@ int IPOnlyTestSig17(void)
     return result;
 }
 
+
+/** the sigs of two lookups are the same, NULL being no sigs */
+static int IPOnlyLookupTestSameSigs(SigNumArray *a, SigNumArray *b)
+{
+    uint32_t u, size = a ? a->size : (b ? b->size : 0);
+
+    for (u = 0; u < size; u++) {
+        uint8_t va = a ? a->array[u] : 0;
+        uint8_t vb = b ? b->array[u] : 0;
+        if (va != vb)
+            return 0;
+    }
+    return 1;
+}
+
+static int IPOnlyLookupTestHasSig(SigNumArray *sna, Signature *s)
+{
+    return (sna != NULL && (sna->array[s->num / 8] & (1 << (s->num % 8))));
+}
+
+/** compare the compiled lookup of an address with the tree's */
+static int IPOnlyLookupTestCheck(DetectEngineIPOnlyCtx *io_ctx, Address *a)
+{
+    SigNumArray *tree, *lookup;
+
+    tree = IPOnlyLookupAddress(NULL, NULL, io_ctx->tree_ipv4src,
+                               io_ctx->tree_ipv6src, a);
+    lookup = IPOnlyLookupAddress(io_ctx->lookup_ipv4src, io_ctx->lookup_ipv6src,
+                                 io_ctx->tree_ipv4src, io_ctx->tree_ipv6src, a);
+    if (!IPOnlyLookupTestSameSigs(tree, lookup))
+        return 0;
+
+    tree = IPOnlyLookupAddress(NULL, NULL, io_ctx->tree_ipv4dst,
+                               io_ctx->tree_ipv6dst, a);
+    lookup = IPOnlyLookupAddress(io_ctx->lookup_ipv4dst, io_ctx->lookup_ipv6dst,
+                                 io_ctx->tree_ipv4dst, io_ctx->tree_ipv6dst, a);
+    return IPOnlyLookupTestSameSigs(tree, lookup);
+}
+
+static void IPOnlyLookupTestAddr(Address *a, const char *str)
+{
+    memset(a, 0, sizeof(*a));
+    if (strchr(str, ':') != NULL) {
+        a->family = AF_INET6;
+        (void)inet_pton(AF_INET6, str, &a->addr_data32[0]);
+    } else {
+        a->family = AF_INET;
+        (void)inet_pton(AF_INET, str, &a->addr_data32[0]);
+    }
+}
+
+/**
+ * \test the compiled lookups return the sigs of the longest matching
+ *       prefix and share the SigNumArrays of ranges with the same sigs
+ */
+static int IPOnlyTestLookup01(void)
+{
+    char *sigs[] = {
+        "alert ip 10.0.0.0/8 any -> any any (sid:1;)",
+        "alert ip 10.1.0.0/16 any -> any any (sid:2;)",
+        "alert ip 10.1.2.0/24 any -> any any (sid:3;)",
+        "alert ip [172.16.0.0/16,172.18.0.0/16] any -> 255.255.255.255 any (sid:4;)",
+        "alert ip 2001:db8::/32 any -> any any (sid:5;)",
+        "alert ip 2001:db8:1::/48 any -> any any (sid:6;)",
+    };
+    const char *addrs[] = {
+        "0.0.0.0", "9.255.255.255", "10.0.0.0", "10.1.2.3", "10.1.3.3",
+        "10.255.255.255", "11.0.0.0", "172.16.1.1", "172.17.1.1",
+        "172.18.1.1", "255.255.255.255", "::", "2001:db8::1",
+        "2001:db8:1::1", "2001:db8:2::1", "2001:db9::",
+        "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff",
+    };
+    Signature *s[6];
+    DetectEngineIPOnlyCtx *io_ctx;
+    Address a;
+    uint32_t i;
+    int result = 0;
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        return 0;
+    de_ctx->flags |= DE_QUIET;
+
+    for (i = 0; i < 6; i++) {
+        s[i] = DetectEngineAppendSig(de_ctx, sigs[i]);
+        if (s[i] == NULL) {
+            printf("sig %"PRIu32" failed to parse: ", i + 1);
+            goto end;
+        }
+    }
+    SigGroupBuild(de_ctx);
+
+    io_ctx = &de_ctx->io_ctx;
+    if (io_ctx->lookup_ipv4src == NULL || io_ctx->lookup_ipv4dst == NULL ||
+        io_ctx->lookup_ipv6src == NULL || io_ctx->lookup_ipv6dst == NULL) {
+        printf("lookups not built: ");
+        goto end;
+    }
+
+    for (i = 0; i < sizeof(addrs) / sizeof(addrs[0]); i++) {
+        IPOnlyLookupTestAddr(&a, addrs[i]);
+        if (!IPOnlyLookupTestCheck(io_ctx, &a)) {
+            printf("lookup and tree disagree on %s: ", addrs[i]);
+            goto end;
+        }
+    }
+
+    IPOnlyLookupTestAddr(&a, "10.1.2.3");
+    SigNumArray *sna = IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0]));
+    if (!IPOnlyLookupTestHasSig(sna, s[0]) || !IPOnlyLookupTestHasSig(sna, s[1]) ||
+        !IPOnlyLookupTestHasSig(sna, s[2])) {
+        printf("wrong sigs for 10.1.2.3: ");
+        goto end;
+    }
+    IPOnlyLookupTestAddr(&a, "10.1.3.3");
+    sna = IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0]));
+    if (!IPOnlyLookupTestHasSig(sna, s[1]) || IPOnlyLookupTestHasSig(sna, s[2])) {
+        printf("wrong sigs for 10.1.3.3: ");
+        goto end;
+    }
+    IPOnlyLookupTestAddr(&a, "11.0.0.0");
+    if (IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0])) != NULL) {
+        printf("sigs for 11.0.0.0: ");
+        goto end;
+    }
+    IPOnlyLookupTestAddr(&a, "2001:db8:2::1");
+    uint32_t ip6[4] = { ntohl(a.addr_data32[0]), ntohl(a.addr_data32[1]),
+                        ntohl(a.addr_data32[2]), ntohl(a.addr_data32[3]) };
+    sna = IPOnlyLookup6Find(io_ctx->lookup_ipv6src, ip6);
+    if (!IPOnlyLookupTestHasSig(sna, s[4]) || IPOnlyLookupTestHasSig(sna, s[5])) {
+        printf("wrong sigs for 2001:db8:2::1: ");
+        goto end;
+    }
+
+    /* both netblocks of sid 4 use the same array, the gap between them
+     * has no sigs */
+    IPOnlyLookupTestAddr(&a, "172.16.1.1");
+    sna = IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0]));
+    IPOnlyLookupTestAddr(&a, "172.18.1.1");
+    if (sna == NULL || !IPOnlyLookupTestHasSig(sna, s[3]) ||
+        IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0])) != sna) {
+        printf("sid 4 arrays not shared: ");
+        goto end;
+    }
+    IPOnlyLookupTestAddr(&a, "172.17.1.1");
+    if (IPOnlyLookup4Find(io_ctx->lookup_ipv4src, ntohl(a.addr_data32[0])) != NULL) {
+        printf("sigs for 172.17.1.1: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    DetectEngineCtxFree(de_ctx);
+    return result;
+}
+
+/**
+ * \test the compiled lookups agree with the trees on many random
+ *       overlapping netblocks, at the range boundaries and in between
+ */
+static int IPOnlyTestLookup02(void)
+{
+    unsigned int seed = 1234;
+    DetectEngineIPOnlyCtx *io_ctx;
+    IPOnlyLookup4 *l4;
+    IPOnlyLookup6 *l6;
+    Address a;
+    char sig[256];
+    uint32_t i;
+    int result = 0;
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        return 0;
+    de_ctx->flags |= DE_QUIET;
+
+    for (i = 0; i < 600; i++) {
+        uint32_t r = (uint32_t)rand_r(&seed);
+        uint32_t r2 = (uint32_t)rand_r(&seed);
+
+        if (i % 4 == 3) {
+            snprintf(sig, sizeof(sig), "alert ip [2001:db8:%x::/%u,2001:db8:%x:%x::/64] "
+                    "any -> 2001:db8:%x::/48 any (sid:%u;)", r & 0x7, 32 + (r >> 3) % 17,
+                    r & 0x7, (r >> 8) & 0xf, r2 & 0xf, i + 1);
+        } else {
+            snprintf(sig, sizeof(sig), "alert ip [10.%u.%u.0/%u,10.%u.%u.%u] any -> "
+                    "192.168.%u.0/%u any (sid:%u;)", r & 0xf, (r >> 4) & 0xff,
+                    8 + (r >> 12) % 17, r & 0xf, (r >> 4) & 0xff, (r >> 20) & 0xff,
+                    r2 & 0xff, 16 + (r2 >> 8) % 17, i + 1);
+        }
+        if (DetectEngineAppendSig(de_ctx, sig) == NULL) {
+            printf("sig \"%s\" failed to parse: ", sig);
+            goto end;
+        }
+    }
+    SigGroupBuild(de_ctx);
+
+    io_ctx = &de_ctx->io_ctx;
+    l4 = io_ctx->lookup_ipv4src;
+    l6 = io_ctx->lookup_ipv6src;
+    if (l4 == NULL || l6 == NULL || io_ctx->lookup_ipv4dst == NULL ||
+        io_ctx->lookup_ipv6dst == NULL) {
+        printf("lookups not built: ");
+        goto end;
+    }
+    if (l4->dir16 == NULL) {
+        printf("no /16 index for %"PRIu32" ranges: ", l4->cnt);
+        goto end;
+    }
+
+    /* the first and last address of each range */
+    memset(&a, 0, sizeof(a));
+    a.family = AF_INET;
+    for (i = 0; i < l4->cnt; i++) {
+        a.addr_data32[0] = htonl(l4->lo[i]);
+        if (!IPOnlyLookupTestCheck(io_ctx, &a))
+            goto fail;
+        a.addr_data32[0] = htonl(l4->lo[i] - 1);
+        if (!IPOnlyLookupTestCheck(io_ctx, &a))
+            goto fail;
+    }
+    a.family = AF_INET6;
+    for (i = 0; i < l6->cnt; i++) {
+        int w;
+        for (w = 0; w < 4; w++)
+            a.addr_data32[w] = htonl(l6->lo[i * 4 + w]);
+        if (!IPOnlyLookupTestCheck(io_ctx, &a))
+            goto fail;
+    }
+
+    /* random addresses, mostly in the netblocks of the sigs */
+    for (i = 0; i < 100000; i++) {
+        uint32_t r = (uint32_t)rand_r(&seed) ^ ((uint32_t)rand_r(&seed) << 16);
+
+        memset(&a, 0, sizeof(a));
+        switch (i % 4) {
+            case 0:
+                a.family = AF_INET;
+                a.addr_data32[0] = htonl(0x0a000000 | (r & 0x0fffffff));
+                break;
+            case 1:
+                a.family = AF_INET;
+                a.addr_data32[0] = htonl(r % 2 ? (0xc0a80000 | (r >> 16)) : r);
+                break;
+            default:
+                a.family = AF_INET6;
+                a.addr_data32[0] = htonl(0x20010db8);
+                a.addr_data32[1] = htonl(r & 0x000fffff);
+                a.addr_data32[2] = htonl(r * 2654435761U);
+                a.addr_data32[3] = htonl(r);
+                break;
+        }
+        if (!IPOnlyLookupTestCheck(io_ctx, &a))
+            goto fail;
+    }
+
+    result = 1;
+end:
+    DetectEngineCtxFree(de_ctx);
+    return result;
+fail:
+    {
+        char str[64];
+        PrintInet(a.family, &a.addr_data32[0], str, sizeof(str));
+        printf("lookup and tree disagree on %s: ", str);
+    }
+    goto end;
+}
+
+/** Comment out this if you want the ip-only lookup benchmark
+ *  #define ENABLE_IPONLY_LOOKUP_BENCH 1
+ */
+
+#ifdef ENABLE_IPONLY_LOOKUP_BENCH
+/* ip-only lookup benchmark
+ *
+ * Benches the compiled lookups against the radix trees on rulesets of
+ * 100, 1000 and 2000 sigs with many netblocks. Build with
+ * ENABLE_IPONLY_LOOKUP_BENCH and run it using:
+ *
+ *   suricata -u -U IPOnlyLookupBench
+ *
+ * The number of packets per run can be set with:
+ *
+ *   --set unittests.iponly-lookup-bench.packets=<num> (default 1000000)
+ */
+
+#define IPONLY_LOOKUP_BENCH_DEFAULT_PACKETS     1000000
+
+static int IPOnlyLookupBench01(void)
+{
+    uint32_t sigs[] = { 100, 1000, 2000 };
+    uint32_t blocks[] = { 10, 10, 20 };
+    unsigned int seed = 4321;
+    intmax_t packets = 0;
+    uint32_t i;
+    intmax_t n;
+    int result = 0;
+
+    if (ConfGetInt("unittests.iponly-lookup-bench.packets", &packets) != 1 ||
+        packets <= 0)
+        packets = IPONLY_LOOKUP_BENCH_DEFAULT_PACKETS;
+
+    printf("\n");
+    for (i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i++) {
+        DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+        DetectEngineIPOnlyCtx *io_ctx;
+        uint64_t tree_ticks, lookup_ticks, start;
+        uint64_t sum = 0;
+        uint32_t s, b;
+        char sig[2048];
+        Address src, dst;
+
+        if (de_ctx == NULL)
+            goto end;
+        de_ctx->flags |= DE_QUIET;
+
+        for (s = 0; s < sigs[i]; s++) {
+            int len = snprintf(sig, sizeof(sig), "alert ip [");
+            for (b = 0; b < blocks[i]; b++) {
+                uint32_t r = (uint32_t)rand_r(&seed);
+                len += snprintf(sig + len, sizeof(sig) - len, "%s%u.%u.%u.0/%u",
+                        b ? "," : "", 1 + r % 223, (r >> 8) & 0xff, (r >> 16) & 0xff,
+                        16 + (r >> 24) % 9);
+            }
+            snprintf(sig + len, sizeof(sig) - len, "] any -> any any (sid:%u;)", s + 1);
+            if (DetectEngineAppendSig(de_ctx, sig) == NULL) {
+                DetectEngineCtxFree(de_ctx);
+                goto end;
+            }
+        }
+        SigGroupBuild(de_ctx);
+        io_ctx = &de_ctx->io_ctx;
+
+        memset(&src, 0, sizeof(src));
+        memset(&dst, 0, sizeof(dst));
+        src.family = dst.family = AF_INET;
+
+        unsigned int seed_start = seed;
+        start = UtilCpuGetTicks();
+        for (n = 0; n < packets; n++) {
+            uint32_t r = (uint32_t)rand_r(&seed);
+            src.addr_data32[0] = htonl(r * 2654435761U);
+            dst.addr_data32[0] = htonl(r);
+            SigNumArray *ssna = IPOnlyLookupAddress(NULL, NULL,
+                    io_ctx->tree_ipv4src, io_ctx->tree_ipv6src, &src);
+            SigNumArray *dsna = IPOnlyLookupAddress(NULL, NULL,
+                    io_ctx->tree_ipv4dst, io_ctx->tree_ipv6dst, &dst);
+            sum += (ssna ? ssna->array[r % ssna->size] : 0) + (dsna ? dsna->array[0] : 0);
+        }
+        tree_ticks = (UtilCpuGetTicks() - start) / (uint64_t)packets;
+
+        seed = seed_start;
+        start = UtilCpuGetTicks();
+        for (n = 0; n < packets; n++) {
+            uint32_t r = (uint32_t)rand_r(&seed);
+            src.addr_data32[0] = htonl(r * 2654435761U);
+            dst.addr_data32[0] = htonl(r);
+            SigNumArray *ssna = IPOnlyLookupAddress(io_ctx->lookup_ipv4src,
+                    io_ctx->lookup_ipv6src, io_ctx->tree_ipv4src,
+                    io_ctx->tree_ipv6src, &src);
+            SigNumArray *dsna = IPOnlyLookupAddress(io_ctx->lookup_ipv4dst,
+                    io_ctx->lookup_ipv6dst, io_ctx->tree_ipv4dst,
+                    io_ctx->tree_ipv6dst, &dst);
+            sum -= (ssna ? ssna->array[r % ssna->size] : 0) + (dsna ? dsna->array[0] : 0);
+        }
+        lookup_ticks = (UtilCpuGetTicks() - start) / (uint64_t)packets;
+
+        printf("%5u sigs x %3u netblocks: radix tree %5"PRIu64" ticks/packet, "
+                "compiled lookup %5"PRIu64" ticks/packet (%"PRIu32" ranges)\n",
+                sigs[i], blocks[i], tree_ticks, lookup_ticks,
+                io_ctx->lookup_ipv4src ? io_ctx->lookup_ipv4src->cnt : 0);
+
+        DetectEngineCtxFree(de_ctx);
+
+        /* both loops saw the same addresses, so found the same sigs */
+        if (sum != 0) {
+            printf("lookup and tree disagree: ");
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    return result;
+}
+#endif /* ENABLE_IPONLY_LOOKUP_BENCH */
 #endif /* UNITTESTS */
 
 void IPOnlyRegisterTests(void) {
@@ -2277,6 +3038,11 @@ void IPOnlyRegisterTests(void) {
     UtRegisterTest("IPOnlyTestSig16", IPOnlyTestSig16, 1);
 
     UtRegisterTest("IPOnlyTestSig17", IPOnlyTestSig17, 1);
+    UtRegisterTest("IPOnlyTestLookup01", IPOnlyTestLookup01, 1);
+    UtRegisterTest("IPOnlyTestLookup02", IPOnlyTestLookup02, 1);
+#ifdef ENABLE_IPONLY_LOOKUP_BENCH
+    UtRegisterTest("IPOnlyLookupBench01", IPOnlyLookupBench01, 1);
+#endif
 #endif
 
     return;
@@ -24,6 +24,8 @@
 #ifndef __DETECT_ENGINE_IPONLY_H__
 #define __DETECT_ENGINE_IPONLY_H__
 
+#include "util-ip.h"
+
 /**
  * SigNumArray is a bit array representing signatures
  * it can be used linked to src/dst address to indicate
@@ -35,6 +37,31 @@ typedef struct SigNumArray_ {
     uint32_t size;  /* size in bytes of the array */
 } SigNumArray;
 
+/** compiled ipv4 lookups with at least this many ranges get a /16 index */
+#define IPONLY_LOOKUP_DIR16_MIN     256
+
+/**
+ * Compiled form of an ipv4 radix tree. The tree's prefixes are flattened
+ * into ranges that cover the whole address space, so range i holds the
+ * addresses from lo[i] up to lo[i + 1] - 1. sna[i] is the SigNumArray the
+ * tree returns for them, deduplicated, or NULL if it holds no sig.
+ */
+typedef struct IPOnlyLookup4_ {
+    uint32_t cnt;
+    uint32_t *lo;       /**< host order */
+    SigNumArray **sna;
+    /** index of the range holding the first address of each /16, plus a
+     *  last entry of cnt - 1. NULL for short lookups. */
+    uint32_t *dir16;
+} IPOnlyLookup4;
+
+/** compiled form of an ipv6 radix tree, like IPOnlyLookup4 */
+typedef struct IPOnlyLookup6_ {
+    uint32_t cnt;
+    uint32_t *lo;       /**< 4 words per range, host order */
+    SigNumArray **sna;
+} IPOnlyLookup6;
+
 void IPOnlyCIDRListFree(IPOnlyCIDRItem *tmphead);
 int IPOnlySigParseAddress(Signature *, const char *, char);
 void IPOnlyMatchPacket(ThreadVars *tv, DetectEngineCtx *,
@@ -49,5 +76,50 @@ void DetectEngineIPOnlyThreadDeinit(DetectEngineIPOnlyThreadCtx *);
 void IPOnlyAddSignature(DetectEngineCtx *, DetectEngineIPOnlyCtx *, Signature *);
 void IPOnlyRegisterTests(void);
 
+/**
+ *  \brief Find the sigs of an ipv4 address in a compiled lookup.
+ *
+ *  \param ip address in host order
+ */
+static inline SigNumArray *IPOnlyLookup4Find(const IPOnlyLookup4 *l, uint32_t ip)
+{
+    uint32_t lo = 0, hi = l->cnt;
+
+    if (l->dir16 != NULL) {
+        lo = l->dir16[ip >> 16];
+        hi = l->dir16[(ip >> 16) + 1] + 1;
+    }
+
+    /* last range that starts at or before ip, the first range of the
+     * search always does */
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (l->lo[mid] <= ip)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return l->sna[lo - 1];
+}
+
+/**
+ *  \brief Find the sigs of an ipv6 address in a compiled lookup.
+ *
+ *  \param ip address in host order
+ */
+static inline SigNumArray *IPOnlyLookup6Find(const IPOnlyLookup6 *l, const uint32_t *ip)
+{
+    uint32_t lo = 0, hi = l->cnt;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (IPv6HostOrderCmp(&l->lo[mid * 4], ip) <= 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return l->sna[lo - 1];
+}
+
 #endif /* __DETECT_ENGINE_IPONLY_H__ */
 
@@ -55,6 +55,7 @@
 #include "util-debug.h"
 #include "util-print.h"
 #include "util-memcmp.h"
+#include "util-mpm-cache.h"
 #ifdef __SC_CUDA_SUPPORT__
 #include "util-mpm-ac.h"
 #endif
@@ -677,7 +678,105 @@ uint32_t DnsQueryPatternSearch(DetectEngineThreadCtx *det_ctx,
     SCReturnUInt(ret);
 }
 
+/** \internal
+ *  \brief get the offset in the smsg from where the mpm needs to scan
+ *
+ *  Data in the smsg up to win->scanned_seq was scanned already as part of
+ *  an earlier smsg. We go back maxlen - 1 bytes so patterns that cross the
+ *  boundary with the new data are still found.
+ *
+ *  \retval offset 0 if the full smsg needs to be scanned
+ */
+static uint16_t StreamMpmWindowGetOffset(DetectEngineThreadCtx *det_ctx,
+        StreamMpmWindow *win, MpmCtx *mpm_ctx, StreamMsg *smsg)
+{
+    uint32_t data_seq = smsg->seq - smsg->new_data_offset;
+
+    if (win->de_ctx_id != det_ctx->de_ctx->id || win->mpm_ctx != mpm_ctx) {
+        /* pattern ids or pattern set changed, start over */
+        win->de_ctx_id = det_ctx->de_ctx->id;
+        win->mpm_ctx = NULL;
+        win->hits_cnt = 0;
+        return 0;
+    }
+
+    if (SEQ_LEQ(win->scanned_seq, data_seq) ||
+        SEQ_GT(win->scanned_seq, data_seq + smsg->data_len))
+        return 0;
+
+    uint32_t scanned = win->scanned_seq - data_seq;
+    uint32_t lookback = mpm_ctx->maxlen > 0 ? mpm_ctx->maxlen - 1 : 0;
+    if (scanned <= lookback)
+        return 0;
+
+    return (uint16_t)(scanned - lookback);
+}
+
+/** \internal
+ *  \brief update the window with the results of scanning the smsg and add
+ *         the earlier matches that may still be in the smsg to the pmq
+ *
+ *  \param offset offset the scan started at
+ *
+ *  \retval cnt number of matches added to the pmq
+ */
+static uint32_t StreamMpmWindowUpdate(StreamMpmWindow *win, MpmCtx *mpm_ctx,
+        PatternMatcherQueue *pmq, StreamMsg *smsg, uint16_t offset)
+{
+    uint32_t data_seq = smsg->seq - smsg->new_data_offset;
+    uint32_t end_seq = data_seq + smsg->data_len;
+    uint32_t pmq_max = pmq->pattern_id_array_size / sizeof(uint32_t);
+    uint32_t fresh_cnt = pmq->pattern_id_array_cnt;
+    uint32_t added = 0;
+    uint32_t u;
+    uint16_t h, keep = 0;
+
+    /* drop the matches that were before the smsg and add the ones that
+     * may still be in it, but were in the part we didn't scan */
+    for (h = 0; h < win->hits_cnt; h++) {
+        StreamMpmWindowHit *hit = &win->hits[h];
+        if (SEQ_LEQ(hit->seq, data_seq))
+            continue;
+
+        if (offset > 0 && !(pmq->pattern_id_bitarray[hit->pid / 8] & (1 << (hit->pid % 8))) &&
+                pmq->pattern_id_array_cnt < pmq_max) {
+            pmq->pattern_id_bitarray[hit->pid / 8] |= (1 << (hit->pid % 8));
+            pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = hit->pid;
+            added++;
+        }
+        win->hits[keep++] = *hit;
+    }
+    win->hits_cnt = keep;
+
+    /* remember what we found in this scan */
+    for (u = 0; u < fresh_cnt; u++) {
+        uint32_t pid = pmq->pattern_id_array[u];
+
+        for (h = 0; h < win->hits_cnt; h++) {
+            if (win->hits[h].pid == pid)
+                break;
+        }
+        if (h == win->hits_cnt) {
+            if (win->hits_cnt == STREAM_MPM_WINDOW_HITS) {
+                /* can't track this, so scan the next smsg in full */
+                win->mpm_ctx = NULL;
+                win->hits_cnt = 0;
+                return added;
+            }
+            win->hits[win->hits_cnt++].pid = pid;
+        }
+        win->hits[h].seq = end_seq;
+    }
+
+    win->mpm_ctx = mpm_ctx;
+    win->scanned_seq = end_seq;
+    return added;
+}
+
 /** \brief Pattern match -- searches for only one pattern per signature.
+ *
+ *  In raw sliding window mode only the part of the smsgs that wasn't
+ *  scanned before is searched, see StreamMpmWindow.
  *
  *  \param det_ctx detection engine thread ctx
  *  \param p packet
@@ -693,42 +792,35 @@ uint32_t StreamPatternSearch(DetectEngineThreadCtx *det_ctx, Packet *p,
 
     uint32_t ret = 0;
     uint8_t cnt = 0;
+    StreamMpmWindow *win = det_ctx->smsg_mpm_window;
+    MpmCtx *mpm_ctx = (flags & STREAM_TOSERVER) ?
+        det_ctx->sgh->mpm_stream_ctx_ts : det_ctx->sgh->mpm_stream_ctx_tc;
 
     //PrintRawDataFp(stdout, smsg->data.data, smsg->data.data_len);
 
     uint32_t r;
-    if (flags & STREAM_TOSERVER) {
-        for ( ; smsg != NULL; smsg = smsg->next) {
-            r = mpm_table[det_ctx->sgh->mpm_stream_ctx_ts->mpm_type].
-                Search(det_ctx->sgh->mpm_stream_ctx_ts, &det_ctx->mtcs,
-                       &det_ctx->smsg_pmq[cnt], smsg->data, smsg->data_len);
-            if (r > 0) {
-                ret += r;
+    for ( ; smsg != NULL; smsg = smsg->next) {
+        uint16_t offset = 0;
+        if (win != NULL)
+            offset = StreamMpmWindowGetOffset(det_ctx, win, mpm_ctx, smsg);
 
-                SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
+        SCLogDebug("smsg %p scan from offset %u of %u", smsg, offset, smsg->data_len);
+        r = mpm_table[mpm_ctx->mpm_type].
+            Search(mpm_ctx, &det_ctx->mtcs, &det_ctx->smsg_pmq[cnt],
+                   smsg->data + offset, smsg->data_len - offset);
+        if (win != NULL)
+            r += StreamMpmWindowUpdate(win, mpm_ctx, &det_ctx->smsg_pmq[cnt],
+                                       smsg, offset);
+        if (r > 0) {
+            ret += r;
 
-                /* merge results with overall pmq */
-                PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
-            }
+            SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
 
-            cnt++;
+            /* merge results with overall pmq */
+            PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
         }
-    } else {
-        for ( ; smsg != NULL; smsg = smsg->next) {
-            r = mpm_table[det_ctx->sgh->mpm_stream_ctx_tc->mpm_type].
-                Search(det_ctx->sgh->mpm_stream_ctx_tc, &det_ctx->mtcs,
-                       &det_ctx->smsg_pmq[cnt], smsg->data, smsg->data_len);
-            if (r > 0) {
-                ret += r;
-
-                SCLogDebug("smsg match stored in det_ctx->smsg_pmq[%u]", cnt);
 
-                /* merge results with overall pmq */
-                PmqMerge(&det_ctx->smsg_pmq[cnt], &det_ctx->pmq);
-            }
-
-            cnt++;
-        }
+        cnt++;
     }
 
     SCReturnInt(ret);
@@ -2299,10 +2391,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_proto_tcp_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_proto_tcp_ctx_ts->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_tcp_ctx_ts->mpm_type].
-                             Prepare(sh->mpm_proto_tcp_ctx_ts);
-                     }
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_proto_tcp_ctx_ts);
                  }
              }
          }
@@ -2312,10 +2401,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_proto_tcp_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_proto_tcp_ctx_tc->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_tcp_ctx_tc->mpm_type].
-                             Prepare(sh->mpm_proto_tcp_ctx_tc);
-                     }
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_proto_tcp_ctx_tc);
                  }
              }
          }
@@ -2326,10 +2412,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_proto_udp_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_proto_udp_ctx_ts->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_udp_ctx_ts->mpm_type].
-                             Prepare(sh->mpm_proto_udp_ctx_ts);
-                     }
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_proto_udp_ctx_ts);
                  }
              }
          }
@@ -2339,10 +2422,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_proto_udp_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_proto_udp_ctx_tc->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_udp_ctx_tc->mpm_type].
-                             Prepare(sh->mpm_proto_udp_ctx_tc);
-                     }
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_proto_udp_ctx_tc);
                  }
              }
          }
@@ -2353,10 +2433,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_proto_other_ctx = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_proto_other_ctx->mpm_type].Prepare != NULL) {
-                         mpm_table[sh->mpm_proto_other_ctx->mpm_type].
-                             Prepare(sh->mpm_proto_other_ctx);
-                     }
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_proto_other_ctx);
                  }
              }
          }
@@ -2367,8 +2444,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_stream_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_stream_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_stream_ctx_ts->mpm_type].Prepare(sh->mpm_stream_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_stream_ctx_ts);
                  }
              }
          }
@@ -2378,8 +2454,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_stream_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_stream_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_stream_ctx_tc->mpm_type].Prepare(sh->mpm_stream_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_stream_ctx_tc);
                  }
              }
          }
@@ -2390,8 +2465,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_uri_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_uri_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_uri_ctx_ts->mpm_type].Prepare(sh->mpm_uri_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_uri_ctx_ts);
                  }
              }
          }
@@ -2402,8 +2476,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hcbd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hcbd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcbd_ctx_ts->mpm_type].Prepare(sh->mpm_hcbd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hcbd_ctx_ts);
                  }
              }
          }
@@ -2414,8 +2487,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hsbd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hsbd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hsbd_ctx_tc->mpm_type].Prepare(sh->mpm_hsbd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hsbd_ctx_tc);
                  }
              }
          }
@@ -2426,8 +2498,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hhd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhd_ctx_ts->mpm_type].Prepare(sh->mpm_hhd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hhd_ctx_ts);
                  }
              }
          }
@@ -2437,8 +2508,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hhd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hhd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhd_ctx_tc->mpm_type].Prepare(sh->mpm_hhd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hhd_ctx_tc);
                  }
              }
          }
@@ -2449,8 +2519,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hrhd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hrhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhd_ctx_ts->mpm_type].Prepare(sh->mpm_hrhd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hrhd_ctx_ts);
                  }
              }
          }
@@ -2460,8 +2529,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hrhd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hrhd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhd_ctx_tc->mpm_type].Prepare(sh->mpm_hrhd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hrhd_ctx_tc);
                  }
              }
          }
@@ -2472,8 +2540,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hmd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hmd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hmd_ctx_ts->mpm_type].Prepare(sh->mpm_hmd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hmd_ctx_ts);
                  }
              }
          }
@@ -2484,8 +2551,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hcd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hcd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcd_ctx_ts->mpm_type].Prepare(sh->mpm_hcd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hcd_ctx_ts);
                  }
              }
          }
@@ -2495,8 +2561,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hcd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hcd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hcd_ctx_tc->mpm_type].Prepare(sh->mpm_hcd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hcd_ctx_tc);
                  }
              }
          }
@@ -2507,8 +2572,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hrud_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hrud_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrud_ctx_ts->mpm_type].Prepare(sh->mpm_hrud_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hrud_ctx_ts);
                  }
              }
          }
@@ -2519,8 +2583,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hsmd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hsmd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hsmd_ctx_tc->mpm_type].Prepare(sh->mpm_hsmd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hsmd_ctx_tc);
                  }
              }
          }
@@ -2531,8 +2594,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hscd_ctx_tc = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hscd_ctx_tc->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hscd_ctx_tc->mpm_type].Prepare(sh->mpm_hscd_ctx_tc);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hscd_ctx_tc);
                  }
              }
          }
@@ -2543,8 +2605,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_huad_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_huad_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_huad_ctx_ts->mpm_type].Prepare(sh->mpm_huad_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_huad_ctx_ts);
                  }
              }
          }
@@ -2555,8 +2616,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hhhd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hhhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hhhd_ctx_ts->mpm_type].Prepare(sh->mpm_hhhd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hhhd_ctx_ts);
                  }
              }
          }
@@ -2567,8 +2627,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_hrhhd_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_hrhhd_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_hrhhd_ctx_ts->mpm_type].Prepare(sh->mpm_hrhhd_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_hrhhd_ctx_ts);
                  }
              }
          }
@@ -2579,8 +2638,7 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
                  sh->mpm_dnsquery_ctx_ts = NULL;
              } else {
                  if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL) {
-                     if (mpm_table[sh->mpm_dnsquery_ctx_ts->mpm_type].Prepare != NULL)
-                         mpm_table[sh->mpm_dnsquery_ctx_ts->mpm_type].Prepare(sh->mpm_dnsquery_ctx_ts);
+                     MpmStorePrepareCtx(de_ctx, &sh->mpm_dnsquery_ctx_ts);
                  }
              }
          }
@@ -2639,6 +2697,337 @@ int PatternMatchPrepareGroup(DetectEngineCtx *de_ctx, SigGroupHead *sh)
     return 0;
 }
 
+/** \brief Mpm store: content addressed storage of the per sgh mpm ctxs
+ *
+ *  With the "full" sgh-mpm-context profile every sgh gets its own ctxs,
+ *  but many sghs end up with the exact same patterns for a buffer. The
+ *  store is keyed on the sorted set of patterns a ctx was given, so only
+ *  the first ctx with a given set is prepared and the others use it.
+ */
+typedef struct MpmStore_ {
+    uint32_t hash;
+    uint16_t mpm_type;
+    /** sorted, unique pattern keys */
+    MpmPatternKeyList *keys;
+    /** the prepared ctx, owned by the store */
+    MpmCtx *mpm_ctx;
+    /** number of sgh ctxs that resolved to this entry */
+    uint32_t refs;
+} MpmStore;
+
+static uint32_t MpmStoreHashKeys(uint16_t mpm_type, MpmPatternKeyList *list)
+{
+    uint32_t hash = mpm_type;
+    uint32_t i;
+
+    for (i = 0; i < list->cnt; i++) {
+        hash = hash * 31 + list->keys[i].pid;
+        hash = hash * 31 + ((list->keys[i].patlen << 8) | list->keys[i].flags);
+    }
+    return hash;
+}
+
+static uint32_t MpmStoreHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    MpmStore *ms = (MpmStore *)data;
+    return ms->hash % ht->array_size;
+}
+
+static char MpmStoreCompareFunc(void *data1, uint16_t len1, void *data2,
+                                uint16_t len2)
+{
+    MpmStore *ms1 = (MpmStore *)data1;
+    MpmStore *ms2 = (MpmStore *)data2;
+    uint32_t i;
+
+    if (ms1->hash != ms2->hash || ms1->mpm_type != ms2->mpm_type ||
+        ms1->keys->cnt != ms2->keys->cnt)
+        return 0;
+
+    for (i = 0; i < ms1->keys->cnt; i++) {
+        if (MpmPatternKeyCompare(&ms1->keys->keys[i], &ms2->keys->keys[i]) != 0)
+            return 0;
+    }
+    return 1;
+}
+
+static void MpmStoreFreeFunc(void *data)
+{
+    MpmStore *ms = (MpmStore *)data;
+
+    if (ms->mpm_ctx != NULL) {
+        mpm_table[ms->mpm_ctx->mpm_type].DestroyCtx(ms->mpm_ctx);
+        SCFree(ms->mpm_ctx);
+    }
+    MpmPatternKeyListFree(ms->keys);
+    SCFree(ms);
+}
+
+/**
+ * \brief Initializes the mpm store of the detection engine context.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int MpmStoreInit(DetectEngineCtx *de_ctx)
+{
+    if (de_ctx->mpm_hash_table != NULL)
+        return 0;
+
+    de_ctx->mpm_hash_table = HashListTableInit(4096, MpmStoreHashFunc,
+                                               MpmStoreCompareFunc,
+                                               MpmStoreFreeFunc);
+    if (de_ctx->mpm_hash_table == NULL)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * \brief Frees the mpm store and all the ctxs it owns. The sghs using
+ *        them need to be freed before this.
+ */
+void MpmStoreFree(DetectEngineCtx *de_ctx)
+{
+    if (de_ctx->mpm_hash_table == NULL)
+        return;
+
+    HashListTableFree(de_ctx->mpm_hash_table);
+    de_ctx->mpm_hash_table = NULL;
+}
+
+static void MpmPrepareQueueAddKeys(DetectEngineCtx *, MpmCtx *, MpmPatternKeyList *);
+
+/**
+ * \brief Prepare a unique (per sgh) mpm ctx, or replace it by an already
+ *        prepared ctx that was given the same pattern set.
+ *
+ * \param de_ctx      Detection engine ctx.
+ * \param mpm_ctx_ptr Pointer to the sgh's ctx pointer, updated if the ctx
+ *                    is replaced by a shared one.
+ */
+void MpmStorePrepareCtx(DetectEngineCtx *de_ctx, MpmCtx **mpm_ctx_ptr)
+{
+    MpmCtx *mpm_ctx = *mpm_ctx_ptr;
+    MpmPatternKeyList *keys = mpm_ctx->init_keys;
+    mpm_ctx->init_keys = NULL;
+
+    if (de_ctx->mpm_hash_table == NULL || keys == NULL || keys->cnt == 0) {
+        MpmPatternKeyListFree(keys);
+        if (mpm_table[mpm_ctx->mpm_type].Prepare != NULL)
+            mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        return;
+    }
+
+    MpmPatternKeyListNormalize(keys);
+
+    MpmStore lookup;
+    memset(&lookup, 0, sizeof(lookup));
+    lookup.mpm_type = mpm_ctx->mpm_type;
+    lookup.keys = keys;
+    lookup.hash = MpmStoreHashKeys(lookup.mpm_type, keys);
+
+    MpmStore *ms = HashListTableLookup(de_ctx->mpm_hash_table, &lookup, 0);
+    if (ms != NULL) {
+        SCLogDebug("sharing mpm_ctx %p (%"PRIu32" patterns) instead of %p",
+                   ms->mpm_ctx, ms->mpm_ctx->pattern_cnt, mpm_ctx);
+        ms->refs++;
+        MpmPatternKeyListFree(keys);
+        mpm_table[mpm_ctx->mpm_type].DestroyCtx(mpm_ctx);
+        SCFree(mpm_ctx);
+        *mpm_ctx_ptr = ms->mpm_ctx;
+        return;
+    }
+
+    ms = SCMalloc(sizeof(MpmStore));
+    if (unlikely(ms == NULL)) {
+        /* sgh keeps ownership */
+        MpmPatternKeyListFree(keys);
+        if (mpm_table[mpm_ctx->mpm_type].Prepare != NULL)
+            mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        return;
+    }
+    *ms = lookup;
+    ms->mpm_ctx = mpm_ctx;
+    ms->refs = 1;
+
+    if (HashListTableAdd(de_ctx->mpm_hash_table, ms, 0) != 0) {
+        MpmPatternKeyListFree(keys);
+        SCFree(ms);
+        if (mpm_table[mpm_ctx->mpm_type].Prepare != NULL)
+            mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        return;
+    }
+    mpm_ctx->global = 1;
+
+    /* the store owns the ctx and its keys now, so both stay around until
+     * the queue is run even if the sgh is freed */
+    MpmPrepareQueueAddKeys(de_ctx, mpm_ctx, ms->keys);
+}
+
+static void MpmPrepareQueueAddKeys(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx,
+                                   MpmPatternKeyList *keys)
+{
+    if (mpm_table[mpm_ctx->mpm_type].Prepare == NULL)
+        return;
+
+    if (de_ctx->mpm_prepare_queue_cnt == de_ctx->mpm_prepare_queue_size) {
+        uint32_t size = de_ctx->mpm_prepare_queue_size ?
+            de_ctx->mpm_prepare_queue_size * 2 : 64;
+        MpmPrepareQueueItem *queue = SCRealloc(de_ctx->mpm_prepare_queue,
+                                               size * sizeof(MpmPrepareQueueItem));
+        if (unlikely(queue == NULL)) {
+            mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+            return;
+        }
+        de_ctx->mpm_prepare_queue = queue;
+        de_ctx->mpm_prepare_queue_size = size;
+    }
+
+    MpmPrepareQueueItem *item =
+        &de_ctx->mpm_prepare_queue[de_ctx->mpm_prepare_queue_cnt++];
+    item->mpm_ctx = mpm_ctx;
+    item->keys = keys;
+    item->cached = 0;
+}
+
+/**
+ * \brief Queue a ctx to be prepared by MpmPrepareQueueRun(). The ctx is
+ *        prepared right away if it can't be queued.
+ */
+void MpmPrepareQueueAdd(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx)
+{
+    MpmPrepareQueueAddKeys(de_ctx, mpm_ctx, mpm_ctx->init_keys);
+}
+
+/** \brief biggest ctxs first, so the threads finish at about the same time */
+static int MpmPrepareQueueCompare(const void *a, const void *b)
+{
+    const MpmCtx *c1 = ((const MpmPrepareQueueItem *)a)->mpm_ctx;
+    const MpmCtx *c2 = ((const MpmPrepareQueueItem *)b)->mpm_ctx;
+
+    if (c1->pattern_cnt != c2->pattern_cnt)
+        return c1->pattern_cnt > c2->pattern_cnt ? -1 : 1;
+    return 0;
+}
+
+/** \brief load the ctx from the mpm cache, or prepare it and add it to
+ *         the cache */
+static void MpmPrepareQueueItemPrepare(DetectEngineCtx *de_ctx,
+                                       MpmPrepareQueueItem *item)
+{
+    MpmCtx *mpm_ctx = item->mpm_ctx;
+
+    if (de_ctx->mpm_cache_dir != NULL && item->keys != NULL &&
+        mpm_table[mpm_ctx->mpm_type].CacheLoad != NULL)
+    {
+        if (MpmCacheLoad(de_ctx->mpm_cache_dir, mpm_ctx, item->keys) == 0) {
+            item->cached = 1;
+            return;
+        }
+        mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+        MpmCacheSave(de_ctx->mpm_cache_dir, mpm_ctx, item->keys);
+        return;
+    }
+
+    mpm_table[mpm_ctx->mpm_type].Prepare(mpm_ctx);
+}
+
+static void MpmPrepareQueueWorker(DetectEngineCtx *de_ctx, void *data, uint32_t idx)
+{
+    MpmPrepareQueueItem *item = &de_ctx->mpm_prepare_queue[idx];
+
+    if (mpm_table[item->mpm_ctx->mpm_type].flags & MPM_FLAG_PREPARE_NOT_THREADSAFE)
+        return;
+
+    MpmPrepareQueueItemPrepare(de_ctx, item);
+}
+
+/**
+ * \brief Prepare all queued ctxs, using the detection engine build threads.
+ *        Ctxs are independent, so the result doesn't depend on the number
+ *        of threads or on the order they are handled in. If a mpm cache
+ *        dir is configured, ctxs are loaded from it when possible.
+ *
+ * \retval cnt number of ctxs prepared
+ */
+uint32_t MpmPrepareQueueRun(DetectEngineCtx *de_ctx)
+{
+    uint32_t cnt = de_ctx->mpm_prepare_queue_cnt;
+    uint32_t cached = 0, cacheable = 0;
+    uint32_t i;
+
+    if (cnt == 0)
+        return 0;
+
+    qsort(de_ctx->mpm_prepare_queue, cnt, sizeof(MpmPrepareQueueItem),
+          MpmPrepareQueueCompare);
+
+    /* matchers that can't be prepared concurrently go first, on this thread */
+    for (i = 0; i < cnt; i++) {
+        MpmPrepareQueueItem *item = &de_ctx->mpm_prepare_queue[i];
+        if (mpm_table[item->mpm_ctx->mpm_type].flags & MPM_FLAG_PREPARE_NOT_THREADSAFE)
+            MpmPrepareQueueItemPrepare(de_ctx, item);
+    }
+
+    DetectEngineBuildRunParallel(de_ctx, cnt, MpmPrepareQueueWorker, NULL);
+
+    for (i = 0; i < cnt; i++) {
+        MpmPrepareQueueItem *item = &de_ctx->mpm_prepare_queue[i];
+
+        cached += item->cached;
+        if (item->keys != NULL && item->keys->cnt > 0 &&
+            mpm_table[item->mpm_ctx->mpm_type].CacheLoad != NULL)
+            cacheable++;
+        /* keys still owned by the ctx are of no use after this */
+        if (item->keys != NULL && item->keys == item->mpm_ctx->init_keys) {
+            MpmPatternKeyListFree(item->mpm_ctx->init_keys);
+            item->mpm_ctx->init_keys = NULL;
+        }
+    }
+    if (de_ctx->mpm_cache_dir != NULL) {
+        SCLogInfo("mpm cache: %"PRIu32" of %"PRIu32" mpm contexts loaded "
+                  "from %s", cached, cacheable, de_ctx->mpm_cache_dir);
+    }
+
+    SCFree(de_ctx->mpm_prepare_queue);
+    de_ctx->mpm_prepare_queue = NULL;
+    de_ctx->mpm_prepare_queue_cnt = 0;
+    de_ctx->mpm_prepare_queue_size = 0;
+    return cnt;
+}
+
+/**
+ * \brief Log how many sgh mpm ctxs were folded together by the store and
+ *        how much memory that saved.
+ */
+void MpmStoreReportStats(DetectEngineCtx *de_ctx)
+{
+    if (de_ctx->mpm_hash_table == NULL)
+        return;
+
+    uint32_t unique = 0, total = 0;
+    uint64_t mem_used = 0, mem_saved = 0;
+
+    HashListTableBucket *htb = HashListTableGetListHead(de_ctx->mpm_hash_table);
+    for ( ; htb != NULL; htb = HashListTableGetListNext(htb)) {
+        MpmStore *ms = (MpmStore *)HashListTableGetListData(htb);
+
+        unique++;
+        total += ms->refs;
+        mem_used += ms->mpm_ctx->memory_size;
+        mem_saved += (uint64_t)(ms->refs - 1) * ms->mpm_ctx->memory_size;
+    }
+
+    if (unique == 0)
+        return;
+
+    SCLogInfo("mpm store: %"PRIu32" sgh mpm contexts share %"PRIu32" unique "
+              "contexts (dedup ratio %.2f), using %"PRIu64" bytes, "
+              "%"PRIu64" bytes saved", total, unique,
+              (double)total / (double)unique, mem_used, mem_saved);
+}
+
 /** \brief Pattern ID Hash for sharing pattern id's
  *
  *  A per detection engine hash to make sure each pattern has a unique
@@ -32,6 +32,31 @@
 
 #include "stream.h"
 
+/** max number of pattern matches we remember per direction for the raw
+ *  stream sliding window. If more are needed, we fall back to scanning the
+ *  full smsg. */
+#define STREAM_MPM_WINDOW_HITS  64
+
+typedef struct StreamMpmWindowHit_ {
+    uint32_t pid;                   /**< pattern id */
+    uint32_t seq;                   /**< end seq of the data the pattern was found in */
+} StreamMpmWindowHit;
+
+/** \brief per direction raw stream mpm state for the sliding window mode
+ *
+ *  Tracks up to where the raw stream was scanned by the mpm so that data
+ *  of an smsg that was already scanned as part of an earlier smsg isn't
+ *  scanned again. Pattern matches found in earlier scans are remembered as
+ *  long as they may still be in the window, so signatures keep getting
+ *  inspected against the data. */
+typedef struct StreamMpmWindow_ {
+    uint32_t de_ctx_id;             /**< detect engine the pattern ids belong to */
+    MpmCtx *mpm_ctx;                /**< mpm ctx of the last scan, NULL if none */
+    uint32_t scanned_seq;           /**< raw data was scanned up to this seq */
+    uint16_t hits_cnt;
+    StreamMpmWindowHit hits[STREAM_MPM_WINDOW_HITS];
+} StreamMpmWindow;
+
 uint16_t PatternMatchDefaultMatcher(void);
 
 uint32_t PatternStrength(uint8_t *, uint16_t);
@@ -75,6 +100,14 @@ void DbgPrintSearchStats();
 MpmPatternIdStore *MpmPatternIdTableInitHash(void);
 void MpmPatternIdTableFreeHash(MpmPatternIdStore *);
 uint32_t MpmPatternIdStoreGetMaxId(MpmPatternIdStore *);
+
+int MpmStoreInit(DetectEngineCtx *);
+void MpmStoreFree(DetectEngineCtx *);
+void MpmStorePrepareCtx(DetectEngineCtx *, MpmCtx **);
+void MpmStoreReportStats(DetectEngineCtx *);
+
+void MpmPrepareQueueAdd(DetectEngineCtx *, MpmCtx *);
+uint32_t MpmPrepareQueueRun(DetectEngineCtx *);
 uint32_t DetectContentGetId(MpmPatternIdStore *, DetectContentData *);
 
 int SignatureHasPacketContent(Signature *);
@@ -0,0 +1,553 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Keyword prefilter engines for sigs without a fast pattern.
+ *
+ * Sigs with a fast pattern are only inspected if the mpm found their
+ * pattern. The others ("non-mpm" sigs) used to be inspected for every
+ * packet that passed their mask, walking their full match list.
+ *
+ * Keywords that inspect a single byte of the packet (tcp flags, ttl, icmp
+ * type and code) can register PrefilterGetValue and PrefilterMatchValue.
+ * Each non-mpm sig with such a keyword is assigned its most selective one.
+ * Per sgh and keyword an engine holds the list of candidate sigs for each
+ * of the 256 possible values. For a packet the engines look up the
+ * packet's value and flag the candidates in a bit array of sig nums, the
+ * same way the mpm flags the patterns it found. The prefilter stage then
+ * drops the assigned sigs that weren't flagged.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "detect-engine-siggroup.h"
+#include "detect-engine-prefilter.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+
+#define DETECT_PREFILTER_SIG_FLAG_MPM \
+    (SIG_FLAG_MPM_PACKET|SIG_FLAG_MPM_STREAM|SIG_FLAG_MPM_APPLAYER)
+
+/** \internal \brief number of the 256 values the keyword matches */
+static int DetectPrefilterValueCount(const SigMatch *sm)
+{
+    int cnt = 0;
+    int v;
+
+    for (v = 0; v < 256; v++) {
+        if (sigmatch_table[sm->type].PrefilterMatchValue(sm, (uint8_t)v))
+            cnt++;
+    }
+    return cnt;
+}
+
+/**
+ * \brief Assign a prefilter keyword to the sigs without a fast pattern.
+ *
+ *        Has to run after the mpm setup of all sgh's, as that's where the
+ *        SIG_FLAG_MPM_* flags are set, and before the sgh head arrays are
+ *        built, as those copy the flags.
+ */
+void DetectPrefilterSetupSignatures(DetectEngineCtx *de_ctx)
+{
+    uint32_t non_mpm = 0, prefiltered = 0;
+    Signature *s;
+
+    for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+        SigMatch *sm, *best = NULL;
+        int best_cnt = 256;
+
+        s->flags &= ~SIG_FLAG_PREFILTER;
+        s->prefilter_sm = NULL;
+
+        if (s->flags & (DETECT_PREFILTER_SIG_FLAG_MPM|SIG_FLAG_IPONLY))
+            continue;
+        non_mpm++;
+
+        for (sm = s->sm_lists[DETECT_SM_LIST_MATCH]; sm != NULL; sm = sm->next) {
+            if (sigmatch_table[sm->type].PrefilterMatchValue == NULL ||
+                sigmatch_table[sm->type].PrefilterGetValue == NULL)
+                continue;
+
+            /* a keyword matching every value still filters on the packet
+             * type, but the sgh's are per protocol already */
+            int cnt = DetectPrefilterValueCount(sm);
+            if (cnt < best_cnt) {
+                best = sm;
+                best_cnt = cnt;
+            }
+        }
+
+        if (best != NULL) {
+            s->flags |= SIG_FLAG_PREFILTER;
+            s->prefilter_sm = best;
+            prefiltered++;
+        }
+    }
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("%"PRIu32" signatures without a fast pattern, %"PRIu32" of "
+                  "them prefiltered on a keyword", non_mpm, prefiltered);
+    }
+}
+
+/** \internal \brief hash of a candidate list, to find identical lists */
+static uint32_t DetectPrefilterListHash(const SigIntId *sids, uint32_t cnt)
+{
+    uint32_t hash = 2166136261U;
+    uint32_t i;
+
+    for (i = 0; i < cnt; i++) {
+        hash ^= (uint32_t)sids[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * \internal
+ * \brief Build the engine for one keyword from the sgh's sigs that are
+ *        prefiltered on it.
+ *
+ * \param sigs the sigs, sig_cnt of them
+ *
+ * \retval engine or NULL on error
+ */
+static DetectPrefilterEngine *DetectPrefilterBuildEngine(uint8_t sm_type,
+        Signature **sigs, uint32_t sig_cnt)
+{
+    DetectPrefilterEngine *engine = NULL;
+    uint32_t hash[256];
+    uint32_t used = 0, size = 0;
+    uint32_t i;
+    int u, v;
+
+    engine = SCMalloc(sizeof(DetectPrefilterEngine));
+    if (unlikely(engine == NULL))
+        goto error;
+    memset(engine, 0, sizeof(DetectPrefilterEngine));
+    engine->sm_type = sm_type;
+
+    for (v = 0; v < 256; v++) {
+        /* make sure the list of this value fits after the used part */
+        if (used + sig_cnt > size) {
+            uint32_t nsize = (size * 2 > used + sig_cnt) ? size * 2 : used + sig_cnt;
+            SigIntId *ptmp = SCRealloc(engine->sids, nsize * sizeof(SigIntId));
+            if (unlikely(ptmp == NULL))
+                goto error;
+            engine->sids = ptmp;
+            size = nsize;
+        }
+
+        SigIntId *list = &engine->sids[used];
+        uint32_t cnt = 0;
+        for (i = 0; i < sig_cnt; i++) {
+            if (sigmatch_table[sm_type].PrefilterMatchValue(sigs[i]->prefilter_sm,
+                                                            (uint8_t)v))
+                list[cnt++] = sigs[i]->num;
+        }
+        engine->cnt[v] = cnt;
+        engine->offset[v] = used;
+
+        /* share the list of an earlier value with the same candidates */
+        hash[v] = DetectPrefilterListHash(list, cnt);
+        for (u = 0; u < v; u++) {
+            if (hash[u] == hash[v] && engine->cnt[u] == cnt &&
+                memcmp(&engine->sids[engine->offset[u]], list,
+                       cnt * sizeof(SigIntId)) == 0) {
+                engine->offset[v] = engine->offset[u];
+                break;
+            }
+        }
+        if (engine->offset[v] == used)
+            used += cnt;
+    }
+
+    /* give back what the shared lists didn't use */
+    if (used > 0 && used < size) {
+        SigIntId *ptmp = SCRealloc(engine->sids, used * sizeof(SigIntId));
+        if (ptmp != NULL)
+            engine->sids = ptmp;
+    }
+    return engine;
+
+error:
+    if (engine != NULL) {
+        if (engine->sids != NULL)
+            SCFree(engine->sids);
+        SCFree(engine);
+    }
+    return NULL;
+}
+
+/**
+ * \brief Build the prefilter engines for the sigs of a sgh that have a
+ *        prefilter keyword assigned.
+ *
+ * \retval 0 on success, -1 on error
+ */
+int DetectPrefilterBuildSgh(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
+{
+    Signature **sigs = NULL;
+    uint32_t sig_cnt, i;
+    int t;
+
+    if (sgh == NULL || sgh->match_array == NULL || sgh->prefilter_engines != NULL)
+        return 0;
+
+    sigs = SCMalloc(sgh->sig_cnt * sizeof(Signature *));
+    if (unlikely(sigs == NULL))
+        return -1;
+
+    for (t = 0; t < DETECT_TBLSIZE; t++) {
+        if (sigmatch_table[t].PrefilterMatchValue == NULL)
+            continue;
+
+        sig_cnt = 0;
+        for (i = 0; i < sgh->sig_cnt; i++) {
+            Signature *s = sgh->match_array[i];
+            if (s != NULL && (s->flags & SIG_FLAG_PREFILTER) &&
+                s->prefilter_sm->type == t)
+                sigs[sig_cnt++] = s;
+        }
+        if (sig_cnt == 0)
+            continue;
+
+        DetectPrefilterEngine *engine = DetectPrefilterBuildEngine((uint8_t)t,
+                sigs, sig_cnt);
+        if (engine == NULL) {
+            SCFree(sigs);
+            return -1;
+        }
+        engine->next = sgh->prefilter_engines;
+        sgh->prefilter_engines = engine;
+    }
+
+    SCFree(sigs);
+    return 0;
+}
+
+void DetectPrefilterFreeSgh(SigGroupHead *sgh)
+{
+    DetectPrefilterEngine *engine = sgh->prefilter_engines;
+
+    while (engine != NULL) {
+        DetectPrefilterEngine *next = engine->next;
+        if (engine->sids != NULL)
+            SCFree(engine->sids);
+        SCFree(engine);
+        engine = next;
+    }
+    sgh->prefilter_engines = NULL;
+}
+
+int DetectPrefilterThreadInit(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx)
+{
+    size_t size = (de_ctx->sig_array_len / 8) + 1;
+
+    det_ctx->prefilter_bitarray = SCMalloc(size);
+    if (det_ctx->prefilter_bitarray == NULL)
+        return -1;
+    memset(det_ctx->prefilter_bitarray, 0, size);
+    return 0;
+}
+
+void DetectPrefilterThreadDeinit(DetectEngineThreadCtx *det_ctx)
+{
+    if (det_ctx->prefilter_bitarray != NULL) {
+        SCFree(det_ctx->prefilter_bitarray);
+        det_ctx->prefilter_bitarray = NULL;
+    }
+}
+
+/**
+ * \brief Flag the candidates of the sgh's prefilter engines for a packet.
+ */
+void DetectPrefilterRun(DetectEngineThreadCtx *det_ctx, const Packet *p)
+{
+    const DetectPrefilterEngine *engine = det_ctx->sgh->prefilter_engines;
+    uint8_t *bitarray = det_ctx->prefilter_bitarray;
+
+    for ( ; engine != NULL; engine = engine->next) {
+        uint8_t value;
+
+        if (!sigmatch_table[engine->sm_type].PrefilterGetValue(p, &value))
+            continue;
+
+        const SigIntId *sids = &engine->sids[engine->offset[value]];
+        uint32_t i;
+        for (i = 0; i < engine->cnt[value]; i++)
+            bitarray[sids[i] / 8] |= (1 << (sids[i] % 8));
+    }
+}
+
+/**
+ * \brief Clear the candidates flagged by DetectPrefilterRun().
+ */
+void DetectPrefilterReset(DetectEngineThreadCtx *det_ctx, const Packet *p)
+{
+    const DetectPrefilterEngine *engine = det_ctx->sgh->prefilter_engines;
+    uint8_t *bitarray = det_ctx->prefilter_bitarray;
+
+    for ( ; engine != NULL; engine = engine->next) {
+        uint8_t value;
+
+        if (!sigmatch_table[engine->sm_type].PrefilterGetValue(p, &value))
+            continue;
+
+        const SigIntId *sids = &engine->sids[engine->offset[value]];
+        uint32_t i;
+        for (i = 0; i < engine->cnt[value]; i++)
+            bitarray[sids[i] / 8] = 0;
+    }
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/** \internal \brief run a tcp packet with the flags and ttl through the engine */
+static Packet *DetectPrefilterTestPacket(DetectEngineCtx *de_ctx,
+        DetectEngineThreadCtx *det_ctx, ThreadVars *tv, uint8_t proto,
+        uint8_t flags, uint8_t ttl)
+{
+    Packet *p = UTHBuildPacket((uint8_t *)"payload", 7, proto);
+    if (p == NULL)
+        return NULL;
+
+    p->ip4h->ip_ttl = ttl;
+    if (proto == IPPROTO_TCP)
+        p->tcph->th_flags = flags;
+    else if (proto == IPPROTO_ICMP)
+        p->icmpv4h->type = flags;
+    SigMatchSignatures(tv, de_ctx, det_ctx, p);
+    return p;
+}
+
+/** \test non-mpm sigs get the most selective prefilter keyword, mpm sigs
+ *        and sigs without a prefilter keyword don't get one */
+static int DetectPrefilterTest01(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    int result = 0;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(flags:S; sid:1;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(ttl:>3; flags:SA,12; sid:2;)");
+    Signature *s3 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"payload\"; flags:S; sid:3;)");
+    Signature *s4 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(dsize:7; sid:4;)");
+    if (s1 == NULL || s2 == NULL || s3 == NULL || s4 == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+
+    if (!(s1->flags & SIG_FLAG_PREFILTER) || s1->prefilter_sm == NULL ||
+        s1->prefilter_sm->type != DETECT_FLAGS) {
+        printf("sid 1 should be prefiltered on flags: ");
+        goto end;
+    }
+    /* flags:SA,12 matches 4 values, ttl:>3 252 */
+    if (!(s2->flags & SIG_FLAG_PREFILTER) || s2->prefilter_sm == NULL ||
+        s2->prefilter_sm->type != DETECT_FLAGS) {
+        printf("sid 2 should be prefiltered on flags: ");
+        goto end;
+    }
+    if (s3->flags & SIG_FLAG_PREFILTER) {
+        printf("sid 3 has a fast pattern: ");
+        goto end;
+    }
+    if (s4->flags & SIG_FLAG_PREFILTER) {
+        printf("sid 4 has no prefilter keyword: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \test the flags engine of a sgh has the right candidates per value and
+ *        the values with the same candidates share a list */
+static int DetectPrefilterTest02(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    Packet *p = NULL;
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(flags:S; sid:1;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(flags:+A; sid:2;)");
+    if (s1 == NULL || s2 == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    p = UTHBuildPacket((uint8_t *)"payload", 7, IPPROTO_TCP);
+    if (p == NULL)
+        goto end;
+    SigGroupHead *sgh = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p);
+    if (sgh == NULL || sgh->prefilter_engines == NULL ||
+        sgh->prefilter_engines->sm_type != DETECT_FLAGS ||
+        sgh->prefilter_engines->next != NULL) {
+        printf("expected one flags engine: ");
+        goto end;
+    }
+
+    DetectPrefilterEngine *engine = sgh->prefilter_engines;
+    if (engine->cnt[TH_SYN] != 1 || engine->sids[engine->offset[TH_SYN]] != s1->num ||
+        engine->cnt[TH_SYN|TH_ACK] != 1 ||
+        engine->sids[engine->offset[TH_SYN|TH_ACK]] != s2->num ||
+        engine->cnt[TH_ACK|TH_PUSH] != 1 || engine->cnt[TH_FIN] != 0) {
+        printf("wrong candidates: ");
+        goto end;
+    }
+    /* 128 values with ACK set share the same list */
+    if (engine->offset[TH_ACK] != engine->offset[TH_ACK|TH_PUSH] ||
+        engine->offset[TH_ACK] != engine->offset[TH_ACK|TH_FIN|TH_RST]) {
+        printf("identical lists not shared: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (p != NULL)
+        UTHFreePackets(&p, 1);
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \test prefiltered sigs alert exactly like before, also over consecutive
+ *        packets so the candidates of one packet don't leak into the next */
+static int DetectPrefilterTest03(void)
+{
+    struct {
+        uint8_t proto;
+        uint8_t flags;  /**< tcp flags or icmp type */
+        uint8_t ttl;
+        int alerts[5];
+    } tests[] = {
+        { IPPROTO_TCP, TH_SYN,         64, { 1, 0, 0, 1, 0 } },
+        { IPPROTO_TCP, TH_SYN|TH_ACK,  64, { 0, 1, 0, 0, 0 } },
+        { IPPROTO_TCP, TH_ACK,          2, { 0, 1, 1, 0, 0 } },
+        { IPPROTO_TCP, TH_SYN,          2, { 1, 0, 1, 0, 0 } },
+        { IPPROTO_TCP, TH_FIN,         64, { 0, 0, 0, 1, 0 } },
+        { IPPROTO_ICMP, 8,             64, { 0, 0, 0, 0, 1 } },
+        { IPPROTO_ICMP, 0,             64, { 0, 0, 0, 0, 0 } },
+    };
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    int result = 0;
+    uint32_t t;
+    int sid;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    if (DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(flags:S; sid:1;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(flags:+A; sid:2;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(ttl:<3; sid:3;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(flags:!A; ttl:>3; sid:4;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert icmp any any -> any any "
+                "(itype:8; icode:0; sid:5;)") == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    for (t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+        Packet *p = DetectPrefilterTestPacket(de_ctx, det_ctx, &th_v,
+                tests[t].proto, tests[t].flags, tests[t].ttl);
+        if (p == NULL)
+            goto end;
+        for (sid = 1; sid <= 5; sid++) {
+            if (PacketAlertCheck(p, sid) != tests[t].alerts[sid - 1]) {
+                printf("packet %"PRIu32" sid %d: expected %d: ", t, sid,
+                       tests[t].alerts[sid - 1]);
+                UTHFreePackets(&p, 1);
+                goto end;
+            }
+        }
+        UTHFreePackets(&p, 1);
+    }
+
+    result = 1;
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void DetectPrefilterRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectPrefilterTest01", DetectPrefilterTest01, 1);
+    UtRegisterTest("DetectPrefilterTest02", DetectPrefilterTest02, 1);
+    UtRegisterTest("DetectPrefilterTest03", DetectPrefilterTest03, 1);
+#endif /* UNITTESTS */
+}
@@ -0,0 +1,52 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Keyword prefilter engines for sigs without a fast pattern.
+ */
+
+#ifndef __DETECT_ENGINE_PREFILTER_H__
+#define __DETECT_ENGINE_PREFILTER_H__
+
+/** per sgh engine for one keyword: the candidate sigs for every value
+ *  of the packet field the keyword inspects */
+typedef struct DetectPrefilterEngine_ {
+    /** keyword, DETECT_* */
+    uint8_t sm_type;
+    /** per value the offset in sids of the candidate list and its size.
+     *  Values with the same candidates share a list. */
+    uint32_t offset[256];
+    uint32_t cnt[256];
+    SigIntId *sids;
+    struct DetectPrefilterEngine_ *next;
+} DetectPrefilterEngine;
+
+void DetectPrefilterSetupSignatures(DetectEngineCtx *);
+int DetectPrefilterBuildSgh(DetectEngineCtx *, SigGroupHead *);
+void DetectPrefilterFreeSgh(SigGroupHead *);
+
+int DetectPrefilterThreadInit(DetectEngineCtx *, DetectEngineThreadCtx *);
+void DetectPrefilterThreadDeinit(DetectEngineThreadCtx *);
+
+void DetectPrefilterRun(DetectEngineThreadCtx *, const Packet *);
+void DetectPrefilterReset(DetectEngineThreadCtx *, const Packet *);
+
+void DetectPrefilterRegisterTests(void);
+
+#endif /* __DETECT_ENGINE_PREFILTER_H__ */
@@ -0,0 +1,645 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sampling rule profiler.
+ *
+ * The rule profiling of util-profiling-rules.c needs a profiling build and
+ * dumps its data at exit. This one is always built. When enabled with
+ * detect-engine.rule-sampling, every detect thread times the rule
+ * inspection of 1 in sample-rate packets. The counters are per thread and
+ * only written by that thread, even a reset is done by the thread itself,
+ * so no locks or atomics are needed on the packet path. The time a check took goes into a log2 histogram to get
+ * percentiles.
+ *
+ * The threads register their counters in a list that the unix socket
+ * commands "rule-sample-top" and "rule-sample-reset" walk, so the costliest
+ * rules can be looked at while running.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+#include "conf.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "detect-engine-rule-sample.h"
+
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+
+/** registered thread ctxs, the lock protects the list, not the counters */
+static DetectRuleSampleThreadCtx *rule_sample_list = NULL;
+static SCMutex rule_sample_list_m = SCMUTEX_INITIALIZER;
+
+static void DetectRuleSampleThreadCtxFree(DetectRuleSampleThreadCtx *rs)
+{
+    if (rs->sigs != NULL)
+        SCFree(rs->sigs);
+    if (rs->counters != NULL)
+        SCFree(rs->counters);
+    SC_ATOMIC_DESTROY(rs->reset);
+    SCFree(rs);
+}
+
+int DetectRuleSampleThreadInit(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx)
+{
+    DetectRuleSampleThreadCtx *rs;
+    uint32_t u;
+
+    det_ctx->rule_sample = NULL;
+    det_ctx->rule_sample_active = 0;
+    if (de_ctx->rule_sample_rate == 0 || de_ctx->sig_array_len == 0)
+        return 0;
+
+    rs = SCMalloc(sizeof(DetectRuleSampleThreadCtx));
+    if (unlikely(rs == NULL))
+        return -1;
+    memset(rs, 0, sizeof(DetectRuleSampleThreadCtx));
+    SC_ATOMIC_INIT(rs->reset);
+
+    rs->rate = de_ctx->rule_sample_rate;
+    rs->countdown = rs->rate;
+    rs->sig_cnt = de_ctx->sig_array_len;
+    rs->sigs = SCMalloc(rs->sig_cnt * sizeof(DetectRuleSampleSig));
+    rs->counters = SCMalloc(rs->sig_cnt * sizeof(DetectRuleSampleCounters));
+    if (rs->sigs == NULL || rs->counters == NULL) {
+        DetectRuleSampleThreadCtxFree(rs);
+        return -1;
+    }
+    memset(rs->sigs, 0, rs->sig_cnt * sizeof(DetectRuleSampleSig));
+    memset(rs->counters, 0, rs->sig_cnt * sizeof(DetectRuleSampleCounters));
+
+    /* copy the ids, the sigs may be freed by a rule reload before the
+     * unix socket looks at the counters */
+    for (u = 0; u < rs->sig_cnt; u++) {
+        Signature *s = de_ctx->sig_array[u];
+        if (s == NULL)
+            continue;
+        rs->sigs[u].gid = s->gid;
+        rs->sigs[u].sid = s->id;
+        rs->sigs[u].rev = s->rev;
+    }
+
+    SCMutexLock(&rule_sample_list_m);
+    rs->next = rule_sample_list;
+    rule_sample_list = rs;
+    SCMutexUnlock(&rule_sample_list_m);
+
+    det_ctx->rule_sample = rs;
+    return 0;
+}
+
+void DetectRuleSampleThreadDeinit(DetectEngineThreadCtx *det_ctx)
+{
+    DetectRuleSampleThreadCtx *rs = det_ctx->rule_sample;
+    DetectRuleSampleThreadCtx **prev;
+
+    if (rs == NULL)
+        return;
+
+    SCMutexLock(&rule_sample_list_m);
+    for (prev = &rule_sample_list; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == rs) {
+            *prev = rs->next;
+            break;
+        }
+    }
+    SCMutexUnlock(&rule_sample_list_m);
+
+    DetectRuleSampleThreadCtxFree(rs);
+    det_ctx->rule_sample = NULL;
+}
+
+/**
+ *  \brief Ask all detect threads to clear their counters. Each thread does
+ *         so at its next sampled packet.
+ */
+void DetectRuleSampleReset(void)
+{
+    DetectRuleSampleThreadCtx *rs;
+
+    SCMutexLock(&rule_sample_list_m);
+    for (rs = rule_sample_list; rs != NULL; rs = rs->next) {
+        SC_ATOMIC_SET(rs->reset, 1);
+    }
+    SCMutexUnlock(&rule_sample_list_m);
+}
+
+/**
+ *  \brief Clear the counters of a thread, called by the detect thread
+ *         itself when it sees a reset.
+ */
+void DetectRuleSampleClear(DetectRuleSampleThreadCtx *rs)
+{
+    memset(rs->counters, 0, rs->sig_cnt * sizeof(DetectRuleSampleCounters));
+    rs->packets = 0;
+}
+
+/**
+ *  \brief Estimate a percentile of the ticks a check took.
+ *
+ *  Interpolates linearly within the histogram bucket the percentile falls
+ *  in, capped at the highest value seen.
+ *
+ *  \param q percentile, 0.0 to 1.0
+ */
+uint64_t DetectRuleSamplePercentile(const DetectRuleSampleCounters *c, double q)
+{
+    uint64_t total = 0, cum = 0;
+    uint32_t b;
+
+    for (b = 0; b < DETECT_RULE_SAMPLE_BUCKETS; b++)
+        total += c->hist[b];
+    if (total == 0)
+        return 0;
+
+    double rank = q * (double)total;
+    if (rank < 1.0)
+        rank = 1.0;
+
+    for (b = 0; b < DETECT_RULE_SAMPLE_BUCKETS; b++) {
+        if (c->hist[b] == 0)
+            continue;
+        if ((double)(cum + c->hist[b]) >= rank) {
+            double low = (b == 0) ? 0.0 : (double)((uint64_t)1 << b);
+            double high = (double)((uint64_t)1 << (b + 1));
+            uint64_t v = (uint64_t)(low + (high - low) *
+                    ((rank - (double)cum) / (double)c->hist[b]));
+            return (v > c->max) ? c->max : v;
+        }
+        cum += c->hist[b];
+    }
+    return c->max;
+}
+
+/** \internal \brief copy the counters of a running detect thread, each
+ *            counter is read once, aligned loads of these sizes aren't
+ *            torn */
+static void DetectRuleSampleCountersCopy(DetectRuleSampleCounters *dst,
+        const volatile DetectRuleSampleCounters *src)
+{
+    uint32_t b;
+
+    dst->checks = src->checks;
+    dst->matches = src->matches;
+    dst->ticks = src->ticks;
+    dst->max = src->max;
+    for (b = 0; b < DETECT_RULE_SAMPLE_BUCKETS; b++)
+        dst->hist[b] = src->hist[b];
+}
+
+static void DetectRuleSampleCountersAdd(DetectRuleSampleCounters *dst,
+        const DetectRuleSampleCounters *src)
+{
+    uint32_t b;
+
+    dst->checks += src->checks;
+    dst->matches += src->matches;
+    dst->ticks += src->ticks;
+    if (src->max > dst->max)
+        dst->max = src->max;
+    for (b = 0; b < DETECT_RULE_SAMPLE_BUCKETS; b++)
+        dst->hist[b] += src->hist[b];
+}
+
+static int DetectRuleSampleCompareSig(const void *a, const void *b)
+{
+    const DetectRuleSampleSummary *sa = a;
+    const DetectRuleSampleSummary *sb = b;
+
+    if (sa->sig.gid != sb->sig.gid)
+        return sa->sig.gid < sb->sig.gid ? -1 : 1;
+    if (sa->sig.sid != sb->sig.sid)
+        return sa->sig.sid < sb->sig.sid ? -1 : 1;
+    if (sa->sig.rev != sb->sig.rev)
+        return sa->sig.rev < sb->sig.rev ? -1 : 1;
+    return 0;
+}
+
+static uint64_t DetectRuleSampleSortValue(const DetectRuleSampleSummary *s, int sort)
+{
+    switch (sort) {
+        case DETECT_RULE_SAMPLE_SORT_BY_AVG_TICKS:
+            return s->c.checks ? s->c.ticks / s->c.checks : 0;
+        case DETECT_RULE_SAMPLE_SORT_BY_CHECKS:
+            return s->c.checks;
+        case DETECT_RULE_SAMPLE_SORT_BY_MATCHES:
+            return s->c.matches;
+        case DETECT_RULE_SAMPLE_SORT_BY_MAX_TICKS:
+            return s->c.max;
+        default:
+            return s->c.ticks;
+    }
+}
+
+/** a rule with its value for the requested sort order, so the compare
+ *  function doesn't need to know the order */
+typedef struct DetectRuleSampleSortItem_ {
+    uint64_t value;
+    const DetectRuleSampleSummary *s;
+} DetectRuleSampleSortItem;
+
+static int DetectRuleSampleCompareValue(const void *a, const void *b)
+{
+    const DetectRuleSampleSortItem *ia = a;
+    const DetectRuleSampleSortItem *ib = b;
+
+    if (ia->value != ib->value)
+        return ia->value > ib->value ? -1 : 1;
+    return DetectRuleSampleCompareSig(ia->s, ib->s);
+}
+
+/**
+ *  \brief Get the costliest rules, with their counters summed over the
+ *         detect threads.
+ *
+ *  \param sort DETECT_RULE_SAMPLE_SORT_BY_*
+ *  \param limit max number of rules to return
+ *  \param out array of rules, to be freed by the caller
+ *  \param out_cnt number of rules in out
+ *  \param packets sampled packets of all threads
+ *
+ *  \retval 0 ok
+ *  \retval -1 sampling disabled or out of memory
+ */
+int DetectRuleSampleTop(int sort, uint32_t limit, DetectRuleSampleSummary **out,
+        uint32_t *out_cnt, uint64_t *packets)
+{
+    DetectRuleSampleSummary *list = NULL, *top = NULL;
+    DetectRuleSampleSortItem *items = NULL;
+    DetectRuleSampleThreadCtx *rs;
+    DetectRuleSampleCounters c;
+    uint32_t cnt = 0, size = 0, u, n;
+
+    *out = NULL;
+    *out_cnt = 0;
+    *packets = 0;
+
+    SCMutexLock(&rule_sample_list_m);
+    if (rule_sample_list == NULL) {
+        SCMutexUnlock(&rule_sample_list_m);
+        return -1;
+    }
+
+    /* collect the rules that were checked, a thread's counters may be
+     * updated while we copy them */
+    for (rs = rule_sample_list; rs != NULL; rs = rs->next) {
+        if (SC_ATOMIC_GET(rs->reset))
+            continue;
+
+        *packets += *(volatile uint64_t *)&rs->packets;
+        for (u = 0; u < rs->sig_cnt; u++) {
+            DetectRuleSampleCountersCopy(&c, &rs->counters[u]);
+            if (c.checks == 0)
+                continue;
+
+            if (cnt == size) {
+                uint32_t nsize = size ? size * 2 : 256;
+                DetectRuleSampleSummary *ptmp = SCRealloc(list,
+                        nsize * sizeof(DetectRuleSampleSummary));
+                if (ptmp == NULL) {
+                    SCMutexUnlock(&rule_sample_list_m);
+                    if (list != NULL)
+                        SCFree(list);
+                    return -1;
+                }
+                list = ptmp;
+                size = nsize;
+            }
+            list[cnt].sig = rs->sigs[u];
+            list[cnt].c = c;
+            cnt++;
+        }
+    }
+    SCMutexUnlock(&rule_sample_list_m);
+
+    if (cnt == 0)
+        return 0;
+
+    /* sum up the counters of the same rule in different threads */
+    qsort(list, cnt, sizeof(DetectRuleSampleSummary), DetectRuleSampleCompareSig);
+    n = 0;
+    for (u = 0; u < cnt; u++) {
+        if (n > 0 && DetectRuleSampleCompareSig(&list[n - 1], &list[u]) == 0) {
+            DetectRuleSampleCountersAdd(&list[n - 1].c, &list[u].c);
+        } else {
+            if (n != u)
+                list[n] = list[u];
+            n++;
+        }
+    }
+
+    /* sort references that carry the value for the requested order */
+    items = SCMalloc(n * sizeof(DetectRuleSampleSortItem));
+    if (items == NULL) {
+        SCFree(list);
+        return -1;
+    }
+    for (u = 0; u < n; u++) {
+        items[u].value = DetectRuleSampleSortValue(&list[u], sort);
+        items[u].s = &list[u];
+    }
+    qsort(items, n, sizeof(DetectRuleSampleSortItem), DetectRuleSampleCompareValue);
+
+    if (n > limit)
+        n = limit;
+    if (n > 0) {
+        top = SCMalloc(n * sizeof(DetectRuleSampleSummary));
+        if (top == NULL) {
+            SCFree(items);
+            SCFree(list);
+            return -1;
+        }
+        for (u = 0; u < n; u++)
+            top[u] = *items[u].s;
+    }
+    SCFree(items);
+    SCFree(list);
+
+    *out = top;
+    *out_cnt = n;
+    return 0;
+}
+
+#ifdef BUILD_UNIX_SOCKET
+/** \brief unix socket command "rule-sample-top"
+ *
+ *  Arguments: "count", number of rules (default 20), "sort", one of
+ *  "ticks" (default), "avgticks", "checks", "matches" and "maxticks".
+ */
+TmEcode DetectRuleSampleTopCommand(json_t *cmd, json_t *answer, void *data)
+{
+    DetectRuleSampleSummary *list = NULL;
+    uint32_t cnt = 0, u;
+    uint64_t packets = 0;
+    int sort = DETECT_RULE_SAMPLE_SORT_BY_TICKS;
+    uint32_t limit = 20;
+
+    json_t *jarg = json_object_get(cmd, "count");
+    if (jarg != NULL) {
+        if (!json_is_integer(jarg) || json_integer_value(jarg) <= 0) {
+            json_object_set_new(answer, "message",
+                    json_string("count is not a positive integer"));
+            return TM_ECODE_FAILED;
+        }
+        limit = (uint32_t)json_integer_value(jarg);
+    }
+
+    jarg = json_object_get(cmd, "sort");
+    if (jarg != NULL) {
+        const char *val = json_string_value(jarg);
+        if (val == NULL) {
+            json_object_set_new(answer, "message", json_string("sort is not a string"));
+            return TM_ECODE_FAILED;
+        }
+        if (strcmp(val, "ticks") == 0)
+            sort = DETECT_RULE_SAMPLE_SORT_BY_TICKS;
+        else if (strcmp(val, "avgticks") == 0)
+            sort = DETECT_RULE_SAMPLE_SORT_BY_AVG_TICKS;
+        else if (strcmp(val, "checks") == 0)
+            sort = DETECT_RULE_SAMPLE_SORT_BY_CHECKS;
+        else if (strcmp(val, "matches") == 0)
+            sort = DETECT_RULE_SAMPLE_SORT_BY_MATCHES;
+        else if (strcmp(val, "maxticks") == 0)
+            sort = DETECT_RULE_SAMPLE_SORT_BY_MAX_TICKS;
+        else {
+            json_object_set_new(answer, "message", json_string("unknown sort order"));
+            return TM_ECODE_FAILED;
+        }
+    }
+
+    if (DetectRuleSampleTop(sort, limit, &list, &cnt, &packets) != 0) {
+        json_object_set_new(answer, "message",
+                json_string("rule sampling is not enabled"));
+        return TM_ECODE_FAILED;
+    }
+
+    json_t *jdata = json_object();
+    json_t *jarray = json_array();
+    if (jdata == NULL || jarray == NULL) {
+        if (jdata != NULL)
+            json_decref(jdata);
+        if (jarray != NULL)
+            json_decref(jarray);
+        if (list != NULL)
+            SCFree(list);
+        json_object_set_new(answer, "message",
+                json_string("internal error at json object creation"));
+        return TM_ECODE_FAILED;
+    }
+
+    for (u = 0; u < cnt; u++) {
+        const DetectRuleSampleSummary *s = &list[u];
+        json_t *jrule = json_object();
+        if (jrule == NULL)
+            continue;
+
+        json_object_set_new(jrule, "gid", json_integer(s->sig.gid));
+        json_object_set_new(jrule, "signature_id", json_integer(s->sig.sid));
+        json_object_set_new(jrule, "rev", json_integer(s->sig.rev));
+        json_object_set_new(jrule, "checks", json_integer(s->c.checks));
+        json_object_set_new(jrule, "matches", json_integer(s->c.matches));
+        json_object_set_new(jrule, "match_ratio",
+                json_real((double)s->c.matches / (double)s->c.checks));
+        json_object_set_new(jrule, "ticks_total", json_integer(s->c.ticks));
+        json_object_set_new(jrule, "ticks_avg",
+                json_integer(s->c.ticks / s->c.checks));
+        json_object_set_new(jrule, "ticks_p50",
+                json_integer(DetectRuleSamplePercentile(&s->c, 0.50)));
+        json_object_set_new(jrule, "ticks_p90",
+                json_integer(DetectRuleSamplePercentile(&s->c, 0.90)));
+        json_object_set_new(jrule, "ticks_p99",
+                json_integer(DetectRuleSamplePercentile(&s->c, 0.99)));
+        json_object_set_new(jrule, "ticks_max", json_integer(s->c.max));
+        json_array_append_new(jarray, jrule);
+    }
+    if (list != NULL)
+        SCFree(list);
+
+    json_object_set_new(jdata, "sampled_packets", json_integer(packets));
+    json_object_set_new(jdata, "rules", jarray);
+    json_object_set_new(answer, "message", jdata);
+    return TM_ECODE_OK;
+}
+
+/** \brief unix socket command "rule-sample-reset" */
+TmEcode DetectRuleSampleResetCommand(json_t *cmd, json_t *answer, void *data)
+{
+    DetectRuleSampleReset();
+    json_object_set_new(answer, "message", json_string("rule sample counters reset"));
+    return TM_ECODE_OK;
+}
+#endif /* BUILD_UNIX_SOCKET */
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/** \test percentiles are interpolated within their bucket and capped at
+ *        the max */
+static int DetectRuleSampleTest01(void)
+{
+    DetectRuleSampleThreadCtx rs;
+    DetectRuleSampleCounters c;
+    int i;
+
+    memset(&rs, 0, sizeof(rs));
+    memset(&c, 0, sizeof(c));
+    rs.counters = &c;
+    rs.sig_cnt = 1;
+
+    /* 90 checks of 100 ticks (bucket 64-127), 10 of 5000 (4096-8191) */
+    for (i = 0; i < 90; i++)
+        DetectRuleSampleUpdate(&rs, 0, 100, 0);
+    for (i = 0; i < 10; i++)
+        DetectRuleSampleUpdate(&rs, 0, 5000, 1);
+
+    if (c.checks != 100 || c.matches != 10 || c.max != 5000 ||
+        c.ticks != 90 * 100 + 10 * 5000 || c.hist[6] != 90 || c.hist[12] != 10) {
+        printf("wrong counters: ");
+        return 0;
+    }
+
+    uint64_t p50 = DetectRuleSamplePercentile(&c, 0.50);
+    uint64_t p90 = DetectRuleSamplePercentile(&c, 0.90);
+    uint64_t p99 = DetectRuleSamplePercentile(&c, 0.99);
+    if (p50 < 64 || p50 > 128 || p90 < 64 || p90 > 128 ||
+        p99 < 4096 || p99 > 5000) {
+        printf("p50 %"PRIu64" p90 %"PRIu64" p99 %"PRIu64": ", p50, p90, p99);
+        return 0;
+    }
+    if (DetectRuleSamplePercentile(&c, 1.0) != 5000) {
+        printf("p100 should be the max: ");
+        return 0;
+    }
+    return 1;
+}
+
+/** \test sampled packets time the rules of 1 in rate packets, the top
+ *        list sums the threads and sorts, reset clears the counters */
+static int DetectRuleSampleTest02(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    DetectEngineThreadCtx *det_ctx1 = NULL, *det_ctx2 = NULL;
+    DetectRuleSampleSummary *list = NULL;
+    ThreadVars th_v;
+    Packet *p = NULL;
+    uint32_t cnt = 0;
+    uint64_t packets = 0;
+    int result = 0;
+    int i;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+    de_ctx->rule_sample_rate = 2;
+
+    if (DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(content:\"payload\"; sid:1;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(dsize:>100; sid:2;)") == NULL ||
+        DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+                "(content:\"nomatch\"; sid:3;)") == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx1);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx2);
+    if (det_ctx1 == NULL || det_ctx2 == NULL || det_ctx1->rule_sample == NULL)
+        goto end;
+
+    p = UTHBuildPacket((uint8_t *)"payload", 7, IPPROTO_TCP);
+    if (p == NULL)
+        goto end;
+
+    /* 10 packets per thread, so 5 sampled each */
+    for (i = 0; i < 10; i++) {
+        SigMatchSignatures(&th_v, de_ctx, det_ctx1, p);
+        SigMatchSignatures(&th_v, de_ctx, det_ctx2, p);
+    }
+
+    if (DetectRuleSampleTop(DETECT_RULE_SAMPLE_SORT_BY_CHECKS, 10, &list,
+                &cnt, &packets) != 0)
+        goto end;
+
+    /* sid 2 fails the dsize check and sid 3 has no pattern match before
+     * the rules are inspected, so only sid 1 is checked */
+    if (packets != 10 || cnt != 1 || list[0].sig.sid != 1 ||
+        list[0].c.checks != 10 || list[0].c.matches != 10) {
+        printf("packets %"PRIu64" cnt %u: ", packets, cnt);
+        goto end;
+    }
+    SCFree(list);
+    list = NULL;
+
+    DetectRuleSampleReset();
+    if (DetectRuleSampleTop(DETECT_RULE_SAMPLE_SORT_BY_TICKS, 10, &list,
+                &cnt, &packets) != 0 || cnt != 0 || packets != 0) {
+        printf("counters of reset threads shouldn't be reported: ");
+        goto end;
+    }
+    if (list != NULL) {
+        SCFree(list);
+        list = NULL;
+    }
+
+    /* two more packets: thread 1 samples one of them and clears first */
+    SigMatchSignatures(&th_v, de_ctx, det_ctx1, p);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx1, p);
+    uint64_t checks = 0;
+    for (i = 0; i < (int)det_ctx1->rule_sample->sig_cnt; i++)
+        checks += det_ctx1->rule_sample->counters[i].checks;
+    if (det_ctx1->rule_sample->packets != 1 || checks != 1) {
+        printf("reset not applied: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (list != NULL)
+        SCFree(list);
+    if (p != NULL)
+        UTHFreePackets(&p, 1);
+    if (det_ctx1 != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx1);
+    if (det_ctx2 != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx2);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void DetectRuleSampleRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectRuleSampleTest01", DetectRuleSampleTest01, 1);
+    UtRegisterTest("DetectRuleSampleTest02", DetectRuleSampleTest02, 1);
+#endif /* UNITTESTS */
+}
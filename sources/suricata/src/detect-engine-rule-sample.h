@@ -0,0 +1,160 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Sampling rule profiler, available without a profiling build.
+ */
+
+#ifndef __DETECT_ENGINE_RULE_SAMPLE_H__
+#define __DETECT_ENGINE_RULE_SAMPLE_H__
+
+#include "util-atomic.h"
+#include "util-cpu.h"
+
+#ifdef BUILD_UNIX_SOCKET
+#include <jansson.h>
+#endif
+
+/** sample 1 in this many packets if no sample-rate is configured */
+#define DETECT_RULE_SAMPLE_DEFAULT_RATE     1000
+
+/** histogram buckets, bucket b counts the checks that took 2^b up to
+ *  2^(b+1) ticks, the last one everything above */
+#define DETECT_RULE_SAMPLE_BUCKETS          32
+
+/** sort orders of DetectRuleSampleTop(), same names as the profiling.rules
+ *  sort option */
+enum {
+    DETECT_RULE_SAMPLE_SORT_BY_TICKS = 0,
+    DETECT_RULE_SAMPLE_SORT_BY_AVG_TICKS,
+    DETECT_RULE_SAMPLE_SORT_BY_CHECKS,
+    DETECT_RULE_SAMPLE_SORT_BY_MATCHES,
+    DETECT_RULE_SAMPLE_SORT_BY_MAX_TICKS,
+};
+
+typedef struct DetectRuleSampleCounters_ {
+    uint64_t checks;
+    uint64_t matches;
+    uint64_t ticks;
+    uint64_t max;
+    uint32_t hist[DETECT_RULE_SAMPLE_BUCKETS];
+} DetectRuleSampleCounters;
+
+typedef struct DetectRuleSampleSig_ {
+    uint32_t gid;
+    uint32_t sid;
+    uint32_t rev;
+} DetectRuleSampleSig;
+
+/** per detect thread counters. Only the detect thread writes them, the
+ *  unix socket thread only reads them while they are updated. */
+typedef struct DetectRuleSampleThreadCtx_ {
+    /** sample 1 in rate packets */
+    uint32_t rate;
+    uint32_t countdown;
+    /** sampled packets */
+    uint64_t packets;
+    /** set by DetectRuleSampleReset(), the detect thread clears its
+     *  counters when it sees it */
+    SC_ATOMIC_DECLARE(int, reset);
+
+    /** the sigs of the detect engine the thread runs, by sig num */
+    uint32_t sig_cnt;
+    DetectRuleSampleSig *sigs;
+    DetectRuleSampleCounters *counters;
+
+    struct DetectRuleSampleThreadCtx_ *next;
+} DetectRuleSampleThreadCtx;
+
+/** counters of a rule summed over the detect threads */
+typedef struct DetectRuleSampleSummary_ {
+    DetectRuleSampleSig sig;
+    DetectRuleSampleCounters c;
+} DetectRuleSampleSummary;
+
+int DetectRuleSampleThreadInit(DetectEngineCtx *, DetectEngineThreadCtx *);
+void DetectRuleSampleThreadDeinit(DetectEngineThreadCtx *);
+
+void DetectRuleSampleReset(void);
+void DetectRuleSampleClear(DetectRuleSampleThreadCtx *);
+int DetectRuleSampleTop(int, uint32_t, DetectRuleSampleSummary **, uint32_t *,
+        uint64_t *);
+uint64_t DetectRuleSamplePercentile(const DetectRuleSampleCounters *, double);
+
+#ifdef BUILD_UNIX_SOCKET
+TmEcode DetectRuleSampleTopCommand(json_t *, json_t *, void *);
+TmEcode DetectRuleSampleResetCommand(json_t *, json_t *, void *);
+#endif
+
+void DetectRuleSampleRegisterTests(void);
+
+/**
+ *  \brief Decide if the rules are timed for this packet.
+ */
+static inline void DetectRuleSamplePacket(DetectEngineThreadCtx *det_ctx)
+{
+    DetectRuleSampleThreadCtx *rs = det_ctx->rule_sample;
+
+    det_ctx->rule_sample_active = 0;
+    if (likely(rs == NULL) || --rs->countdown > 0)
+        return;
+
+    rs->countdown = rs->rate;
+    if (SC_ATOMIC_GET(rs->reset)) {
+        DetectRuleSampleClear(rs);
+        SC_ATOMIC_SET(rs->reset, 0);
+    }
+    rs->packets++;
+    det_ctx->rule_sample_active = 1;
+}
+
+static inline void DetectRuleSampleUpdate(DetectRuleSampleThreadCtx *rs,
+        SigIntId num, uint64_t ticks, int match)
+{
+    DetectRuleSampleCounters *c = &rs->counters[num];
+    uint32_t b = 0;
+
+    if (ticks > 0) {
+        b = 63 - __builtin_clzll(ticks);
+        if (b >= DETECT_RULE_SAMPLE_BUCKETS)
+            b = DETECT_RULE_SAMPLE_BUCKETS - 1;
+    }
+
+    c->checks++;
+    if (match)
+        c->matches++;
+    c->ticks += ticks;
+    if (ticks > c->max)
+        c->max = ticks;
+    c->hist[b]++;
+}
+
+#define RULE_SAMPLE_START(det_ctx) \
+    uint64_t rule_sample_start_ = 0; \
+    if (unlikely((det_ctx)->rule_sample_active)) { \
+        rule_sample_start_ = UtilCpuGetTicks(); \
+    }
+
+#define RULE_SAMPLE_END(det_ctx, s, m) \
+    if (unlikely((det_ctx)->rule_sample_active)) { \
+        DetectRuleSampleUpdate((det_ctx)->rule_sample, (s)->num, \
+                UtilCpuGetTicks() - rule_sample_start_, (m)); \
+    }
+
+#endif /* __DETECT_ENGINE_RULE_SAMPLE_H__ */
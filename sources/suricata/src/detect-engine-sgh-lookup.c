@@ -0,0 +1,676 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Compiled address and port lookup for finding the sgh of a packet.
+ *
+ * SigMatchSignaturesGetSgh() finds the sgh through four levels of
+ * groups: source address, destination address, source port and
+ * destination port. Each level is a linked list that was walked until a
+ * group matched, so with large rulesets every packet paid for a walk of
+ * hundreds of groups.
+ *
+ * At the end of SigGroupBuild() each of these lists is compiled into an
+ * array sorted by the start of the range, looked up with a binary
+ * search. Port lists with many groups also get a direct map of all 65536
+ * ports to their group. The groups of a list are disjoint after the
+ * grouping stages, so the group the search finds is the one the walk
+ * would have found. A list that still has overlapping groups isn't
+ * compiled and keeps being walked.
+ *
+ * Lists are shared between groups (see PORT_SIGGROUPHEAD_COPY), so the
+ * compiled lists are kept in a hash by list pointer and each list is
+ * compiled only once. The hash owns them.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+#include "decode.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "detect-engine-sgh-lookup.h"
+
+#include "conf.h"
+
+#include "util-debug.h"
+#include "util-hashlist.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+
+/** the lists of the four lookup levels */
+enum {
+    SGH_LOOKUP_SRC_ADDR = 0,
+    SGH_LOOKUP_DST_ADDR,
+    SGH_LOOKUP_SRC_PORT,
+    SGH_LOOKUP_DST_PORT,
+};
+
+typedef struct SghLookupHashData_ {
+    const void *list;   /**< DetectAddressHead or DetectPort list */
+    int type;
+    void *lookup;       /**< compiled list, NULL if it's walked */
+} SghLookupHashData;
+
+static uint32_t SghLookupHashFunc(HashListTable *ht, void *data, uint16_t datalen)
+{
+    SghLookupHashData *d = (SghLookupHashData *)data;
+    uintptr_t key = (uintptr_t)d->list >> 4;
+
+    return (uint32_t)((key ^ (key >> 16) ^ (uint32_t)d->type) % ht->array_size);
+}
+
+static char SghLookupHashCompareFunc(void *data1, uint16_t len1, void *data2,
+        uint16_t len2)
+{
+    SghLookupHashData *d1 = (SghLookupHashData *)data1;
+    SghLookupHashData *d2 = (SghLookupHashData *)data2;
+
+    return (d1->list == d2->list && d1->type == d2->type);
+}
+
+static void SghLookupAddrsFree(DetectSghLookupAddrs *la)
+{
+    if (la == NULL)
+        return;
+
+    if (la->v4 != NULL)
+        SCFree(la->v4);
+    if (la->v6 != NULL)
+        SCFree(la->v6);
+    SCFree(la);
+}
+
+static void SghLookupPortsFree(DetectSghLookupPorts *lp)
+{
+    if (lp == NULL)
+        return;
+
+    if (lp->map != NULL)
+        SCFree(lp->map);
+    if (lp->ports != NULL)
+        SCFree(lp->ports);
+    SCFree(lp);
+}
+
+static void SghLookupHashFreeFunc(void *data)
+{
+    SghLookupHashData *d = (SghLookupHashData *)data;
+
+    if (d->type == SGH_LOOKUP_SRC_ADDR || d->type == SGH_LOOKUP_DST_ADDR)
+        SghLookupAddrsFree((DetectSghLookupAddrs *)d->lookup);
+    else
+        SghLookupPortsFree((DetectSghLookupPorts *)d->lookup);
+    SCFree(d);
+}
+
+/**
+ *  \brief Find a list that was compiled before.
+ *
+ *  \retval 1 found, lookup is set (possibly to NULL)
+ *  \retval 0 not compiled yet
+ */
+static int SghLookupHashGet(DetectEngineCtx *de_ctx, const void *list,
+        int type, void **lookup)
+{
+    SghLookupHashData key = { list, type, NULL };
+    SghLookupHashData *d = HashListTableLookup(de_ctx->sgh_lookup_hash_table,
+            &key, sizeof(key));
+    if (d == NULL)
+        return 0;
+
+    *lookup = d->lookup;
+    return 1;
+}
+
+/**
+ *  \brief Store a compiled list in the hash, which takes ownership.
+ *
+ *  \retval lookup the list, or NULL if it couldn't be stored and was freed
+ */
+static void *SghLookupHashAdd(DetectEngineCtx *de_ctx, const void *list,
+        int type, void *lookup)
+{
+    SghLookupHashData *d = SCMalloc(sizeof(*d));
+    if (unlikely(d == NULL))
+        goto error;
+
+    d->list = list;
+    d->type = type;
+    d->lookup = lookup;
+    if (HashListTableAdd(de_ctx->sgh_lookup_hash_table, d, sizeof(*d)) != 0) {
+        SCFree(d);
+        goto error;
+    }
+    return lookup;
+
+error:
+    if (type == SGH_LOOKUP_SRC_ADDR || type == SGH_LOOKUP_DST_ADDR)
+        SghLookupAddrsFree((DetectSghLookupAddrs *)lookup);
+    else
+        SghLookupPortsFree((DetectSghLookupPorts *)lookup);
+    return NULL;
+}
+
+static int SghLookupPortCompare(const void *a, const void *b)
+{
+    const DetectSghLookupPort *pa = (const DetectSghLookupPort *)a;
+    const DetectSghLookupPort *pb = (const DetectSghLookupPort *)b;
+
+    if (pa->lo != pb->lo)
+        return pa->lo < pb->lo ? -1 : 1;
+    return 0;
+}
+
+static int SghLookupAddr4Compare(const void *a, const void *b)
+{
+    const DetectSghLookupAddr4 *aa = (const DetectSghLookupAddr4 *)a;
+    const DetectSghLookupAddr4 *ab = (const DetectSghLookupAddr4 *)b;
+
+    if (aa->lo != ab->lo)
+        return aa->lo < ab->lo ? -1 : 1;
+    return 0;
+}
+
+static int SghLookupAddr6Compare(const void *a, const void *b)
+{
+    const DetectSghLookupAddr6 *aa = (const DetectSghLookupAddr6 *)a;
+    const DetectSghLookupAddr6 *ab = (const DetectSghLookupAddr6 *)b;
+
+    return IPv6HostOrderCmp(aa->lo, ab->lo);
+}
+
+/**
+ *  \brief Compile a source or destination port list.
+ *
+ *  \retval lp compiled list or NULL if the list has to be walked
+ */
+static DetectSghLookupPorts *SghLookupBuildPorts(DetectEngineCtx *de_ctx,
+        DetectPort *head, int type)
+{
+    DetectSghLookupPorts *lp = NULL;
+    DetectPort *dp;
+    uint32_t cnt = 0, i;
+    void *found;
+
+    if (head == NULL)
+        return NULL;
+    if (SghLookupHashGet(de_ctx, head, type, &found))
+        return (DetectSghLookupPorts *)found;
+
+    for (dp = head; dp != NULL; dp = dp->next)
+        cnt++;
+
+    lp = SCMalloc(sizeof(*lp));
+    if (unlikely(lp == NULL))
+        goto walk;
+    memset(lp, 0, sizeof(*lp));
+
+    lp->ports = SCMalloc(cnt * sizeof(DetectSghLookupPort));
+    if (unlikely(lp->ports == NULL))
+        goto walk;
+
+    for (dp = head; dp != NULL; dp = dp->next, lp->cnt++) {
+        DetectSghLookupPort *e = &lp->ports[lp->cnt];
+
+        e->lo = dp->port;
+        e->hi = dp->port2;
+        e->dp = dp;
+        e->dst = NULL;
+        if (type == SGH_LOOKUP_SRC_PORT)
+            e->dst = SghLookupBuildPorts(de_ctx, dp->dst_ph, SGH_LOOKUP_DST_PORT);
+    }
+
+    qsort(lp->ports, lp->cnt, sizeof(DetectSghLookupPort), SghLookupPortCompare);
+    for (i = 0; i < lp->cnt; i++) {
+        if (lp->ports[i].lo > lp->ports[i].hi ||
+            (i > 0 && lp->ports[i].lo <= lp->ports[i - 1].hi))
+        {
+            SCLogDebug("port list %p has overlapping groups", head);
+            goto walk;
+        }
+    }
+
+    if (lp->cnt >= DETECT_SGH_LOOKUP_PORT_MAP_MIN && lp->cnt < 65536 &&
+        de_ctx->sgh_lookup_map_size + 65536 * sizeof(uint16_t) <=
+            DETECT_SGH_LOOKUP_PORT_MAP_MEMCAP)
+    {
+        lp->map = SCMalloc(65536 * sizeof(uint16_t));
+        if (lp->map != NULL) {
+            memset(lp->map, 0, 65536 * sizeof(uint16_t));
+            for (i = 0; i < lp->cnt; i++) {
+                uint32_t port;
+                for (port = lp->ports[i].lo; port <= lp->ports[i].hi; port++)
+                    lp->map[port] = (uint16_t)(i + 1);
+            }
+            de_ctx->sgh_lookup_map_size += 65536 * sizeof(uint16_t);
+        }
+    }
+
+    return SghLookupHashAdd(de_ctx, head, type, lp);
+
+walk:
+    SghLookupPortsFree(lp);
+    SghLookupHashAdd(de_ctx, head, type, NULL);
+    return NULL;
+}
+
+/**
+ *  \brief Compile a source or destination address head.
+ *
+ *  \retval la compiled head or NULL if the head has to be walked
+ */
+static DetectSghLookupAddrs *SghLookupBuildAddrs(DetectEngineCtx *de_ctx,
+        DetectAddressHead *gh, int type)
+{
+    DetectSghLookupAddrs *la = NULL;
+    DetectAddress *ag;
+    uint32_t cnt4 = 0, cnt6 = 0, i;
+    void *found;
+
+    if (gh == NULL)
+        return NULL;
+    if (SghLookupHashGet(de_ctx, gh, type, &found))
+        return (DetectSghLookupAddrs *)found;
+
+    for (ag = gh->ipv4_head; ag != NULL; ag = ag->next)
+        cnt4++;
+    for (ag = gh->ipv6_head; ag != NULL; ag = ag->next)
+        cnt6++;
+
+    la = SCMalloc(sizeof(*la));
+    if (unlikely(la == NULL))
+        goto walk;
+    memset(la, 0, sizeof(*la));
+
+    if (cnt4 > 0) {
+        la->v4 = SCMalloc(cnt4 * sizeof(DetectSghLookupAddr4));
+        if (unlikely(la->v4 == NULL))
+            goto walk;
+    }
+    if (cnt6 > 0) {
+        la->v6 = SCMalloc(cnt6 * sizeof(DetectSghLookupAddr6));
+        if (unlikely(la->v6 == NULL))
+            goto walk;
+    }
+
+    for (ag = gh->ipv4_head; ag != NULL; ag = ag->next, la->cnt4++) {
+        DetectSghLookupAddr4 *e = &la->v4[la->cnt4];
+
+        if (ag->ip.family != AF_INET)
+            goto walk;
+        e->lo = ntohl(ag->ip.addr_data32[0]);
+        e->hi = ntohl(ag->ip2.addr_data32[0]);
+        e->ag = ag;
+        if (type == SGH_LOOKUP_SRC_ADDR)
+            e->next = SghLookupBuildAddrs(de_ctx, ag->dst_gh, SGH_LOOKUP_DST_ADDR);
+        else
+            e->next = SghLookupBuildPorts(de_ctx, ag->port, SGH_LOOKUP_SRC_PORT);
+    }
+    for (ag = gh->ipv6_head; ag != NULL; ag = ag->next, la->cnt6++) {
+        DetectSghLookupAddr6 *e = &la->v6[la->cnt6];
+
+        if (ag->ip.family != AF_INET6)
+            goto walk;
+        for (i = 0; i < 4; i++) {
+            e->lo[i] = ntohl(ag->ip.addr_data32[i]);
+            e->hi[i] = ntohl(ag->ip2.addr_data32[i]);
+        }
+        e->ag = ag;
+        if (type == SGH_LOOKUP_SRC_ADDR)
+            e->next = SghLookupBuildAddrs(de_ctx, ag->dst_gh, SGH_LOOKUP_DST_ADDR);
+        else
+            e->next = SghLookupBuildPorts(de_ctx, ag->port, SGH_LOOKUP_SRC_PORT);
+    }
+
+    if (la->cnt4 > 0)
+        qsort(la->v4, la->cnt4, sizeof(DetectSghLookupAddr4), SghLookupAddr4Compare);
+    if (la->cnt6 > 0)
+        qsort(la->v6, la->cnt6, sizeof(DetectSghLookupAddr6), SghLookupAddr6Compare);
+
+    for (i = 0; i < la->cnt4; i++) {
+        if (la->v4[i].lo > la->v4[i].hi ||
+            (i > 0 && la->v4[i].lo <= la->v4[i - 1].hi))
+            goto overlap;
+    }
+    for (i = 0; i < la->cnt6; i++) {
+        if (IPv6HostOrderCmp(la->v6[i].lo, la->v6[i].hi) > 0 ||
+            (i > 0 && IPv6HostOrderCmp(la->v6[i].lo, la->v6[i - 1].hi) <= 0))
+            goto overlap;
+    }
+
+    return SghLookupHashAdd(de_ctx, gh, type, la);
+
+overlap:
+    SCLogDebug("address head %p has overlapping groups", gh);
+walk:
+    SghLookupAddrsFree(la);
+    SghLookupHashAdd(de_ctx, gh, type, NULL);
+    return NULL;
+}
+
+/**
+ *  \brief Compile the address and port lists of the flow_gh's.
+ *
+ *  Called at the end of SigGroupBuild(). On errors the lists that weren't
+ *  compiled are walked, so the lookup still works.
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+int DetectSghLookupBuild(DetectEngineCtx *de_ctx)
+{
+    int f, proto;
+    uint32_t heads = 0, compiled = 0;
+
+    de_ctx->sgh_lookup_hash_table = HashListTableInit(4096, SghLookupHashFunc,
+            SghLookupHashCompareFunc, SghLookupHashFreeFunc);
+    if (de_ctx->sgh_lookup_hash_table == NULL)
+        return -1;
+    de_ctx->sgh_lookup_map_size = 0;
+
+    for (f = 0; f < FLOW_STATES; f++) {
+        for (proto = 0; proto < 256; proto++) {
+            DetectAddressHead *gh = de_ctx->flow_gh[f].src_gh[proto];
+            if (gh == NULL)
+                continue;
+
+            de_ctx->flow_gh[f].src_lookup[proto] =
+                SghLookupBuildAddrs(de_ctx, gh, SGH_LOOKUP_SRC_ADDR);
+            heads++;
+            if (de_ctx->flow_gh[f].src_lookup[proto] != NULL)
+                compiled++;
+        }
+    }
+
+    if (!(de_ctx->flags & DE_QUIET)) {
+        SCLogInfo("sgh lookup: %"PRIu32" of %"PRIu32" source address heads "
+                "compiled, %"PRIu32" KiB of port maps", compiled, heads,
+                de_ctx->sgh_lookup_map_size / 1024);
+    }
+    return 0;
+}
+
+void DetectSghLookupFree(DetectEngineCtx *de_ctx)
+{
+    int f, proto;
+
+    for (f = 0; f < FLOW_STATES; f++) {
+        for (proto = 0; proto < 256; proto++) {
+            de_ctx->flow_gh[f].src_lookup[proto] = NULL;
+        }
+    }
+
+    if (de_ctx->sgh_lookup_hash_table != NULL) {
+        HashListTableFree(de_ctx->sgh_lookup_hash_table);
+        de_ctx->sgh_lookup_hash_table = NULL;
+    }
+    de_ctx->sgh_lookup_map_size = 0;
+}
+
+/********************************Unittests*************************************/
+
+#ifdef UNITTESTS
+
+/** the sgh lookup as it was done before: walk every level */
+static SigGroupHead *SghLookupTestWalk(DetectEngineCtx *de_ctx, Packet *p)
+{
+    int f = (p->flowflags & FLOW_PKT_TOCLIENT) ? 0 : 1;
+
+    DetectAddress *ag = DetectAddressLookupInHead(de_ctx->flow_gh[f].src_gh[IP_GET_IPPROTO(p)], &p->src);
+    if (ag == NULL)
+        return NULL;
+    ag = DetectAddressLookupInHead(ag->dst_gh, &p->dst);
+    if (ag == NULL)
+        return NULL;
+    if (ag->port == NULL)
+        return ag->sh;
+
+    DetectPort *sport = DetectPortLookupGroup(ag->port, p->sp);
+    if (sport == NULL)
+        return NULL;
+    DetectPort *dport = DetectPortLookupGroup(sport->dst_ph, p->dp);
+    if (dport == NULL)
+        return NULL;
+    return dport->sh;
+}
+
+/** raise the group limits like a custom profile does, the default
+ *  profiles merge most groups */
+static void SghLookupTestGroupLimits(DetectEngineCtx *de_ctx, uint16_t max)
+{
+    de_ctx->max_uniq_toclient_src_groups = max;
+    de_ctx->max_uniq_toclient_dst_groups = max;
+    de_ctx->max_uniq_toclient_sp_groups = max;
+    de_ctx->max_uniq_toclient_dp_groups = max;
+    de_ctx->max_uniq_toserver_src_groups = max;
+    de_ctx->max_uniq_toserver_dst_groups = max;
+    de_ctx->max_uniq_toserver_sp_groups = max;
+    de_ctx->max_uniq_toserver_dp_groups = max;
+}
+
+static const char *sgh_lookup_test_sigs[] = {
+    "alert tcp 10.0.0.0/8 any -> 192.168.0.0/16 80 (content:\"a\"; sid:1;)",
+    "alert tcp !10.1.0.0/16 1024: -> any [80,443,8000:8100] (content:\"b\"; sid:2;)",
+    "alert udp any 53 -> 10.0.0.0/24 any (content:\"c\"; sid:3;)",
+    "alert tcp [2001:db8::/32,10.5.5.5] any -> any ![22,23] (content:\"d\"; sid:4;)",
+    "alert tcp any any -> 2001:db8:1::/48 443 (content:\"e\"; sid:5;)",
+    "alert udp [172.16.0.0/12,!172.16.5.0/24] any -> any 1:1023 (content:\"f\"; sid:6;)",
+    "alert tcp any [1000:1499,1501:2000] -> 192.168.1.0/24 any (content:\"g\"; sid:7;)",
+    "alert ip 10.9.0.0/16 any -> any any (sid:9;)",
+    "alert tcp any any -> any any (content:\"abc\"; sid:8;)",
+    NULL,
+};
+
+/** interesting addresses: range boundaries and their neighbours */
+static const char *sgh_lookup_test_addrs4[] = {
+    "10.0.0.0", "9.255.255.255", "10.255.255.255", "11.0.0.0", "10.1.0.0",
+    "10.0.255.255", "10.1.255.255", "10.2.0.0", "192.168.0.0", "192.168.1.0",
+    "192.168.1.255", "192.168.2.0", "192.167.255.255", "10.0.0.255",
+    "10.0.1.0", "10.5.5.5", "10.5.5.4", "10.5.5.6", "172.16.0.0",
+    "172.16.5.0", "172.16.4.255", "172.16.6.0", "172.31.255.255",
+    "172.32.0.0", "0.0.0.0", "255.255.255.255", "1.2.3.4", NULL,
+};
+
+static const char *sgh_lookup_test_addrs6[] = {
+    "2001:db8::", "2001:db7:ffff:ffff:ffff:ffff:ffff:ffff",
+    "2001:db8:ffff:ffff:ffff:ffff:ffff:ffff", "2001:db9::", "2001:db8:1::",
+    "2001:db8:0:ffff:ffff:ffff:ffff:ffff", "2001:db8:1:ffff:ffff:ffff:ffff:ffff",
+    "2001:db8:2::", "::", "ffff:ffff:ffff:ffff:ffff:ffff:ffff:ffff", "::1",
+    "fe80::1", NULL,
+};
+
+static const uint16_t sgh_lookup_test_ports[] = {
+    0, 1, 21, 22, 23, 24, 52, 53, 54, 79, 80, 81, 442, 443, 444, 999, 1000,
+    1023, 1024, 1025, 1499, 1500, 1501, 2000, 2001, 7999, 8000, 8050, 8100,
+    8101, 65535,
+};
+
+static void SghLookupTestRandomAddress(Address *a, int family, unsigned int *seed)
+{
+    const char **set = (family == AF_INET) ? sgh_lookup_test_addrs4 :
+        sgh_lookup_test_addrs6;
+    int n = 0, i;
+
+    while (set[n] != NULL)
+        n++;
+
+    memset(a, 0, sizeof(*a));
+    a->family = family;
+    if (rand_r(seed) % 2) {
+        inet_pton(family, set[rand_r(seed) % n], a->addr_data8);
+    } else if (family == AF_INET) {
+        /* random address near the test ranges */
+        uint32_t ip = (rand_r(seed) % 2) ? 0x0a000000 : 0xac100000;
+        ip |= (uint32_t)rand_r(seed) & 0x00ffffff;
+        a->addr_data32[0] = htonl(ip);
+    } else {
+        inet_pton(family, set[rand_r(seed) % n], a->addr_data8);
+        for (i = 2; i < 4; i++)
+            a->addr_data32[i] ^= (uint32_t)rand_r(seed);
+    }
+}
+
+static uint16_t SghLookupTestRandomPort(unsigned int *seed)
+{
+    if (rand_r(seed) % 2)
+        return sgh_lookup_test_ports[rand_r(seed) %
+            (sizeof(sgh_lookup_test_ports) / sizeof(sgh_lookup_test_ports[0]))];
+    return (uint16_t)rand_r(seed);
+}
+
+/** \test compiled lookup returns the same sgh as the list walks */
+static int DetectSghLookupTest01(void)
+{
+    DetectEngineCtx *de_ctx = NULL;
+    Packet *p4 = NULL, *p6 = NULL;
+    unsigned int seed = 1234;
+    char sig[128];
+    int result = 0;
+    int i;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+    SghLookupTestGroupLimits(de_ctx, 1000);
+
+    for (i = 0; sgh_lookup_test_sigs[i] != NULL; i++) {
+        if (DetectEngineAppendSig(de_ctx, (char *)sgh_lookup_test_sigs[i]) == NULL) {
+            printf("sig %d failed to parse: ", i);
+            goto end;
+        }
+    }
+    /* enough dst ports to get port maps */
+    for (i = 0; i < 40; i++) {
+        snprintf(sig, sizeof(sig), "alert tcp any any -> any %d (content:\"x\"; sid:%d;)",
+                3000 + i * 7, 100 + i);
+        if (DetectEngineAppendSig(de_ctx, sig) == NULL)
+            goto end;
+    }
+    SigGroupBuild(de_ctx);
+
+    if (de_ctx->flow_gh[1].src_lookup[IPPROTO_TCP] == NULL ||
+        de_ctx->flow_gh[1].src_lookup[IPPROTO_UDP] == NULL) {
+        printf("lookup not compiled: ");
+        goto end;
+    }
+    if (de_ctx->sgh_lookup_map_size == 0) {
+        printf("no port maps: ");
+        goto end;
+    }
+
+    p4 = UTHBuildPacketReal(NULL, 0, IPPROTO_TCP, "1.2.3.4", "5.6.7.8", 1, 2);
+    p6 = UTHBuildPacketIPV6Real(NULL, 0, IPPROTO_TCP, "2001:db8::1", "::1", 1, 2);
+    if (p4 == NULL || p6 == NULL)
+        goto end;
+
+    for (i = 0; i < 200000; i++) {
+        Packet *p = (rand_r(&seed) % 3) ? p4 : p6;
+        int family = (p == p4) ? AF_INET : AF_INET6;
+
+        p->proto = (rand_r(&seed) % 4) ? IPPROTO_TCP : IPPROTO_UDP;
+        p->flowflags = (rand_r(&seed) % 2) ? FLOW_PKT_TOCLIENT : FLOW_PKT_TOSERVER;
+        SghLookupTestRandomAddress(&p->src, family, &seed);
+        SghLookupTestRandomAddress(&p->dst, family, &seed);
+        p->sp = SghLookupTestRandomPort(&seed);
+        p->dp = SghLookupTestRandomPort(&seed);
+
+        SigGroupHead *walk = SghLookupTestWalk(de_ctx, p);
+        SigGroupHead *sgh = SigMatchSignaturesGetSgh(de_ctx, NULL, p);
+        if (walk != sgh) {
+            printf("iteration %d: proto %u sp %u dp %u: walk %p lookup %p: ",
+                    i, p->proto, p->sp, p->dp, walk, sgh);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    if (p4 != NULL)
+        UTHFreePacket(p4);
+    if (p6 != NULL)
+        UTHFreePacket(p6);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
+/** \test overlapping groups aren't compiled, a long list gets a map */
+static int DetectSghLookupTest02(void)
+{
+    DetectEngineCtx de_ctx;
+    DetectPort ports[20];
+    DetectSghLookupPorts *lp;
+    const DetectSghLookupPorts *next;
+    int result = 0;
+    int i;
+
+    memset(&de_ctx, 0, sizeof(de_ctx));
+    memset(ports, 0, sizeof(ports));
+    de_ctx.sgh_lookup_hash_table = HashListTableInit(64, SghLookupHashFunc,
+            SghLookupHashCompareFunc, SghLookupHashFreeFunc);
+    if (de_ctx.sgh_lookup_hash_table == NULL)
+        return 0;
+
+    /* 1-10 and 5-20 overlap */
+    ports[0].port = 1;
+    ports[0].port2 = 10;
+    ports[0].next = &ports[1];
+    ports[1].port = 5;
+    ports[1].port2 = 20;
+    if (SghLookupBuildPorts(&de_ctx, &ports[0], SGH_LOOKUP_DST_PORT) != NULL)
+        goto end;
+
+    /* 20 single ports in reverse order */
+    for (i = 0; i < 20; i++) {
+        ports[i].port = ports[i].port2 = (uint16_t)(1000 - i * 10);
+        ports[i].next = (i < 19) ? &ports[i + 1] : NULL;
+    }
+    lp = SghLookupBuildPorts(&de_ctx, &ports[1], SGH_LOOKUP_DST_PORT);
+    if (lp == NULL || lp->map == NULL || lp->cnt != 19)
+        goto end;
+    /* compiled once */
+    if (SghLookupBuildPorts(&de_ctx, &ports[1], SGH_LOOKUP_DST_PORT) != lp)
+        goto end;
+
+    if (DetectSghLookupPortGroup(lp, &ports[1], 990, &next) != &ports[1] ||
+        DetectSghLookupPortGroup(lp, &ports[1], 810, &next) != &ports[19] ||
+        DetectSghLookupPortGroup(lp, &ports[1], 1000, &next) != NULL ||
+        DetectSghLookupPortGroup(lp, &ports[1], 995, &next) != NULL)
+        goto end;
+
+    result = 1;
+end:
+    HashListTableFree(de_ctx.sgh_lookup_hash_table);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void DetectSghLookupRegisterTests(void)
+{
+#ifdef UNITTESTS
+    UtRegisterTest("DetectSghLookupTest01", DetectSghLookupTest01, 1);
+    UtRegisterTest("DetectSghLookupTest02", DetectSghLookupTest02, 1);
+#endif /* UNITTESTS */
+}
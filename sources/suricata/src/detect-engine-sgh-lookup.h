@@ -0,0 +1,170 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Compiled address and port lookup for finding the sgh of a packet.
+ */
+
+#ifndef __DETECT_ENGINE_SGH_LOOKUP_H__
+#define __DETECT_ENGINE_SGH_LOOKUP_H__
+
+#include "detect-engine-address.h"
+#include "detect-engine-port.h"
+#include "util-ip.h"
+
+/** port lists with at least this many groups get a direct port map */
+#define DETECT_SGH_LOOKUP_PORT_MAP_MIN      16
+/** memory the direct port maps may use */
+#define DETECT_SGH_LOOKUP_PORT_MAP_MEMCAP   (16 * 1024 * 1024)
+
+/** an address group of an address head. next is the compiled lookup of
+ *  its dst_gh for source addresses, or of its port list for destination
+ *  addresses. NULL if that list wasn't compiled and has to be walked. */
+typedef struct DetectSghLookupAddr4_ {
+    uint32_t lo;    /**< host order */
+    uint32_t hi;
+    DetectAddress *ag;
+    void *next;
+} DetectSghLookupAddr4;
+
+typedef struct DetectSghLookupAddr6_ {
+    uint32_t lo[4]; /**< host order */
+    uint32_t hi[4];
+    DetectAddress *ag;
+    void *next;
+} DetectSghLookupAddr6;
+
+/** the address groups of an address head, sorted */
+typedef struct DetectSghLookupAddrs_ {
+    uint32_t cnt4;
+    uint32_t cnt6;
+    DetectSghLookupAddr4 *v4;
+    DetectSghLookupAddr6 *v6;
+} DetectSghLookupAddrs;
+
+/** a port group of a port list, dst is the compiled lookup of its
+ *  dst_ph for source ports */
+typedef struct DetectSghLookupPort_ {
+    uint16_t lo;
+    uint16_t hi;
+    DetectPort *dp;
+    struct DetectSghLookupPorts_ *dst;
+} DetectSghLookupPort;
+
+/** the port groups of a port list, sorted. Long lists also get a map of
+ *  each port to its group index + 1. */
+typedef struct DetectSghLookupPorts_ {
+    uint32_t cnt;
+    DetectSghLookupPort *ports;
+    uint16_t *map;
+} DetectSghLookupPorts;
+
+int DetectSghLookupBuild(DetectEngineCtx *);
+void DetectSghLookupFree(DetectEngineCtx *);
+void DetectSghLookupRegisterTests(void);
+
+/**
+ *  \brief Look up the address group of an address.
+ *
+ *  \param la compiled address head, or NULL to walk gh
+ *  \param next set to the compiled lookup of the next level, or NULL
+ */
+static inline DetectAddress *DetectSghLookupAddressGroup(const DetectSghLookupAddrs *la,
+        DetectAddressHead *gh, Address *a, const void **next)
+{
+    *next = NULL;
+
+    if (la != NULL && a->family == AF_INET) {
+        uint32_t ip = ntohl(a->addr_data32[0]);
+        uint32_t lo = 0, hi = la->cnt4;
+
+        /* last group that starts at or before ip */
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (la->v4[mid].lo <= ip)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == 0 || la->v4[lo - 1].hi < ip)
+            return NULL;
+        *next = la->v4[lo - 1].next;
+        return la->v4[lo - 1].ag;
+
+    } else if (la != NULL && a->family == AF_INET6) {
+        uint32_t ip[4] = { ntohl(a->addr_data32[0]), ntohl(a->addr_data32[1]),
+                           ntohl(a->addr_data32[2]), ntohl(a->addr_data32[3]) };
+        uint32_t lo = 0, hi = la->cnt6;
+
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (IPv6HostOrderCmp(la->v6[mid].lo, ip) <= 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == 0 || IPv6HostOrderCmp(la->v6[lo - 1].hi, ip) < 0)
+            return NULL;
+        *next = la->v6[lo - 1].next;
+        return la->v6[lo - 1].ag;
+    }
+
+    return DetectAddressLookupInHead(gh, a);
+}
+
+/**
+ *  \brief Look up the port group of a port.
+ *
+ *  \param lp compiled port list, or NULL to walk head
+ *  \param next set to the compiled lookup of the group's dst_ph, or NULL
+ */
+static inline DetectPort *DetectSghLookupPortGroup(const DetectSghLookupPorts *lp,
+        DetectPort *head, uint16_t port, const DetectSghLookupPorts **next)
+{
+    const DetectSghLookupPort *e;
+
+    *next = NULL;
+    if (lp == NULL)
+        return DetectPortLookupGroup(head, port);
+
+    if (lp->map != NULL) {
+        uint16_t idx = lp->map[port];
+        if (idx == 0)
+            return NULL;
+        e = &lp->ports[idx - 1];
+    } else {
+        uint32_t lo = 0, hi = lp->cnt;
+
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (lp->ports[mid].lo <= port)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (lo == 0 || lp->ports[lo - 1].hi < port)
+            return NULL;
+        e = &lp->ports[lo - 1];
+    }
+
+    *next = e->dst;
+    return e->dp;
+}
+
+#endif /* __DETECT_ENGINE_SGH_LOOKUP_H__ */
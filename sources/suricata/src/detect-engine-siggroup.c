@@ -36,6 +36,8 @@
 #include "detect-engine-address.h"
 #include "detect-engine-mpm.h"
 #include "detect-engine-siggroup.h"
+#include "detect-engine-prefilter.h"
+#include "detect-engine-candidates.h"
 
 #include "detect-content.h"
 #include "detect-uricontent.h"
@@ -62,9 +64,10 @@ static uint32_t detect_siggroup_head_initdata_free_cnt = 0;
 static uint32_t detect_siggroup_sigarray_memory = 0;
 static uint32_t detect_siggroup_sigarray_init_cnt = 0;
 static uint32_t detect_siggroup_sigarray_free_cnt = 0;
-static uint32_t detect_siggroup_matcharray_memory = 0;
-static uint32_t detect_siggroup_matcharray_init_cnt = 0;
-static uint32_t detect_siggroup_matcharray_free_cnt = 0;
+/* the match and head arrays are built by the parallel engine build */
+SC_ATOMIC_DECLARE(uint32_t, detect_siggroup_matcharray_memory);
+SC_ATOMIC_DECLARE(uint32_t, detect_siggroup_matcharray_init_cnt);
+SC_ATOMIC_DECLARE(uint32_t, detect_siggroup_matcharray_free_cnt);
 
 void SigGroupHeadInitDataFree(SigGroupHeadInitData *sghid) {
     if (sghid->content_array != NULL) {
@@ -181,7 +184,7 @@ void SigGroupHeadFree(SigGroupHead *sgh)
 
     PatternMatchDestroyGroup(sgh);
 
-#if defined(__SSE3__) || defined(__tile__)
+#ifdef DETECT_SIMD_MASK_ARRAY
     if (sgh->mask_array != NULL) {
         /* mask is aligned */
         SCFreeAligned(sgh->mask_array);
@@ -194,9 +197,13 @@ void SigGroupHeadFree(SigGroupHead *sgh)
         sgh->head_array = NULL;
     }
 
+    DetectPrefilterFreeSgh(sgh);
+    DetectCandidatesFreeSgh(sgh);
+
     if (sgh->match_array != NULL) {
-        detect_siggroup_matcharray_free_cnt++;
-        detect_siggroup_matcharray_memory -= (sgh->sig_cnt * sizeof(Signature *));
+        (void) SC_ATOMIC_ADD(detect_siggroup_matcharray_free_cnt, 1);
+        (void) SC_ATOMIC_SUB(detect_siggroup_matcharray_memory,
+                             (sgh->sig_cnt * sizeof(Signature *)));
         SCFree(sgh->match_array);
         sgh->match_array = NULL;
     }
@@ -1189,18 +1196,18 @@ void DetectSigGroupPrintMemory(void)
     SCLogDebug(" * Sig group sigarray memory stats done");
     SCLogDebug(" * Sig group matcharray memory stats:");
     SCLogDebug("  - detect_siggroup_matcharray_memory %" PRIu32,
-               detect_siggroup_matcharray_memory);
+               SC_ATOMIC_GET(detect_siggroup_matcharray_memory));
     SCLogDebug("  - detect_siggroup_matcharray_init_cnt %" PRIu32,
-               detect_siggroup_matcharray_init_cnt);
+               SC_ATOMIC_GET(detect_siggroup_matcharray_init_cnt));
     SCLogDebug("  - detect_siggroup_matcharray_free_cnt %" PRIu32,
-               detect_siggroup_matcharray_free_cnt);
+               SC_ATOMIC_GET(detect_siggroup_matcharray_free_cnt));
     SCLogDebug("  - outstanding sig group matcharrays %" PRIu32,
-               (detect_siggroup_matcharray_init_cnt -
-                detect_siggroup_matcharray_free_cnt));
+               (SC_ATOMIC_GET(detect_siggroup_matcharray_init_cnt) -
+                SC_ATOMIC_GET(detect_siggroup_matcharray_free_cnt)));
     SCLogDebug(" * Sig group sigarray memory stats done");
     SCLogDebug(" X Total %" PRIu32,
                (detect_siggroup_head_memory + detect_siggroup_sigarray_memory +
-                detect_siggroup_matcharray_memory));
+                SC_ATOMIC_GET(detect_siggroup_matcharray_memory)));
 
     return;
 }
@@ -1560,8 +1567,9 @@ int SigGroupHeadBuildMatchArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh,
 
     memset(sgh->match_array,0, sgh->sig_cnt * sizeof(Signature *));
 
-    detect_siggroup_matcharray_init_cnt++;
-    detect_siggroup_matcharray_memory += (sgh->sig_cnt * sizeof(Signature *));
+    (void) SC_ATOMIC_ADD(detect_siggroup_matcharray_init_cnt, 1);
+    (void) SC_ATOMIC_ADD(detect_siggroup_matcharray_memory,
+                         (sgh->sig_cnt * sizeof(Signature *)));
 
     for (sig = 0; sig < max_idx + 1; sig++) {
         if (!(sgh->init->sig_array[(sig / 8)] & (1 << (sig % 8))) )
@@ -1696,11 +1704,11 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
         return 0;
 
     BUG_ON(sgh->head_array != NULL);
-#if defined(__SSE3__) || defined(__tile__)
+#ifdef DETECT_SIMD_MASK_ARRAY
     BUG_ON(sgh->mask_array != NULL);
 
-    /* mask array is 16 byte aligned for SIMD checking, also we always
-     * alloc a multiple of 32/64 bytes */
+    /* mask array is 16 byte aligned for SIMD checking (64 for the
+     * AVX-512 path), also we always alloc a multiple of 32/64 bytes */
     int cnt = sgh->sig_cnt;
 #if __WORDSIZE == 32
     if (cnt % 32 != 0) {
@@ -1712,7 +1720,11 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
     }
 #endif /* __WORDSIZE */
 
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+    sgh->mask_array = (SignatureMask *)SCMallocAligned((cnt * sizeof(SignatureMask)), 64);
+#else
     sgh->mask_array = (SignatureMask *)SCMallocAligned((cnt * sizeof(SignatureMask)), 16);
+#endif
     if (sgh->mask_array == NULL)
         return -1;
 
@@ -1725,8 +1737,9 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
 
     memset(sgh->head_array, 0, sgh->sig_cnt * sizeof(SignatureHeader));
 
-    detect_siggroup_matcharray_init_cnt++;
-    detect_siggroup_matcharray_memory += (sgh->sig_cnt * sizeof(SignatureHeader *));
+    (void) SC_ATOMIC_ADD(detect_siggroup_matcharray_init_cnt, 1);
+    (void) SC_ATOMIC_ADD(detect_siggroup_matcharray_memory,
+                         (sgh->sig_cnt * sizeof(SignatureHeader *)));
 
     for (sig = 0; sig < sgh->sig_cnt; sig++) {
         s = sgh->match_array[sig];
@@ -1738,7 +1751,7 @@ int SigGroupHeadBuildHeadArray(DetectEngineCtx *de_ctx, SigGroupHead *sgh)
         sgh->head_array[idx].hdr_copy3 = s->hdr_copy3;
         sgh->head_array[idx].full_sig = s;
 
-#if defined(__SSE3__) || defined(__tile__)
+#ifdef DETECT_SIMD_MASK_ARRAY
         sgh->mask_array[idx] = s->mask;
 #endif
         idx++;
@@ -2369,6 +2382,92 @@ end:
     UTHFreePackets(&p, 1);
     return result;
 }
+
+/**
+ * \test sghs with the same patterns share a single mpm ctx.
+ */
+static int SigGroupHeadTest12(void)
+{
+    int result = 0;
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    Signature *s = NULL;
+    Packet *p1 = NULL, *p2 = NULL, *p3 = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    uint8_t *buf = (uint8_t *)"GET /abc HTTP/1.0";
+    uint16_t buflen = strlen((char *)buf);
+
+    memset(&th_v, 0, sizeof(ThreadVars));
+
+    p1 = UTHBuildPacketReal(buf, buflen, IPPROTO_TCP, "192.168.1.1", "1.2.3.4", 60000, 80);
+    p2 = UTHBuildPacketReal(buf, buflen, IPPROTO_TCP, "192.168.1.1", "1.2.3.4", 60000, 81);
+    p3 = UTHBuildPacketReal(buf, buflen, IPPROTO_TCP, "192.168.1.1", "1.2.3.4", 60000, 82);
+
+    if (de_ctx == NULL || p1 == NULL || p2 == NULL || p3 == NULL)
+        goto end;
+
+    de_ctx->sgh_mpm_context = ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL;
+
+    s = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any 80 (content:\"abc\"; sid:1;)");
+    if (s == NULL) {
+        goto end;
+    }
+    s = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any 81 (content:\"abc\"; sid:2;)");
+    if (s == NULL) {
+        goto end;
+    }
+    s = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any 82 (content:\"xyz\"; sid:3;)");
+    if (s == NULL) {
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    SigGroupHead *sgh1 = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p1);
+    SigGroupHead *sgh2 = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p2);
+    SigGroupHead *sgh3 = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p3);
+    if (sgh1 == NULL || sgh2 == NULL || sgh3 == NULL || sgh1 == sgh2) {
+        printf("unexpected sghs %p %p %p: ", sgh1, sgh2, sgh3);
+        goto end;
+    }
+
+    if (sgh1->mpm_stream_ctx_ts == NULL ||
+        sgh1->mpm_stream_ctx_ts != sgh2->mpm_stream_ctx_ts) {
+        printf("sgh1 and sgh2 don't share their mpm ctx: ");
+        goto end;
+    }
+    if (sgh3->mpm_stream_ctx_ts == NULL ||
+        sgh3->mpm_stream_ctx_ts == sgh1->mpm_stream_ctx_ts) {
+        printf("sgh3 should have its own mpm ctx: ");
+        goto end;
+    }
+
+    /* the shared ctx still only alerts on the sgh's own sigs */
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p1);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p2);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p3);
+    if (!PacketAlertCheck(p1, 1) || PacketAlertCheck(p1, 2) ||
+        !PacketAlertCheck(p2, 2) || PacketAlertCheck(p2, 1) ||
+        PacketAlertCheck(p3, 3)) {
+        printf("wrong alerts: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    UTHFreePackets(&p1, 1);
+    UTHFreePackets(&p2, 1);
+    UTHFreePackets(&p3, 1);
+    return result;
+}
 #endif
 
 void SigGroupHeadRegisterTests(void)
@@ -2385,5 +2484,6 @@ void SigGroupHeadRegisterTests(void)
     UtRegisterTest("SigGroupHeadTest09", SigGroupHeadTest09, 1);
     UtRegisterTest("SigGroupHeadTest10", SigGroupHeadTest10, 1);
     UtRegisterTest("SigGroupHeadTest11", SigGroupHeadTest11, 1);
+    UtRegisterTest("SigGroupHeadTest12", SigGroupHeadTest12, 1);
 #endif
 }
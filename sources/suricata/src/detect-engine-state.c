@@ -93,6 +93,131 @@ static DeStateStore *DeStateStoreAlloc(void)
     return d;
 }
 
+/**
+ *  \brief Grow one of the index arrays of a direction state.
+ *
+ *  \retval 0 ok
+ *  \retval -1 alloc failure or the array can't grow any further
+ */
+static int DeStateArrayGrow(void **array, SigIntId *size, size_t elem_size)
+{
+    SigIntId max = (SigIntId)~0;
+    uint32_t new_size = *size ? (uint32_t)*size * 2 : 16;
+
+    if (*size == max)
+        return -1;
+    if (new_size > max)
+        new_size = max;
+
+    void *ptmp = SCRealloc(*array, new_size * elem_size);
+    if (unlikely(ptmp == NULL))
+        return -1;
+
+    *array = ptmp;
+    *size = (SigIntId)new_size;
+    return 0;
+}
+
+/** \brief item needs no inspection until a new file resets it */
+static inline int DeStateItemIsDone(const DeStateStoreItem *item)
+{
+    return (item->flags & (DE_STATE_FLAG_FULL_INSPECT|DE_STATE_FLAG_SIG_CANT_MATCH)) ? 1 : 0;
+}
+
+static int DeStateActiveAdd(DetectEngineStateDirection *dir_state,
+                            DeStateStoreItem *item)
+{
+    if (dir_state->active_cnt == dir_state->active_size &&
+        DeStateArrayGrow((void **)&dir_state->active, &dir_state->active_size,
+                         sizeof(DeStateStoreItem *)) != 0)
+        return -1;
+
+    dir_state->active[dir_state->active_cnt++] = item;
+    return 0;
+}
+
+/** \brief remove one occurrence of a sig from the done set */
+static void DeStateDoneRemove(DetectEngineStateDirection *dir_state, SigIntId num)
+{
+    SigIntId i;
+
+    for (i = 0; i < dir_state->done_cnt; i++) {
+        if (dir_state->done[i] == num) {
+            memmove(&dir_state->done[i], &dir_state->done[i + 1],
+                    (dir_state->done_cnt - i - 1) * sizeof(SigIntId));
+            dir_state->done_cnt--;
+            return;
+        }
+    }
+}
+
+/**
+ *  \brief Add a done item to the done set, and to the file index if a
+ *         new file can reset it.
+ *
+ *  \retval 0 ok
+ *  \retval -1 alloc failure, the item was not added
+ */
+static int DeStateDoneAdd(DetectEngineStateDirection *dir_state,
+                          DeStateStoreItem *item)
+{
+    if (dir_state->done_cnt == dir_state->done_size &&
+        DeStateArrayGrow((void **)&dir_state->done, &dir_state->done_size,
+                         sizeof(SigIntId)) != 0)
+        return -1;
+
+    SigIntId i = dir_state->done_cnt;
+    while (i > 0 && dir_state->done[i - 1] > item->sid) {
+        dir_state->done[i] = dir_state->done[i - 1];
+        i--;
+    }
+    dir_state->done[i] = item->sid;
+    dir_state->done_cnt++;
+
+    if (item->flags & (DE_STATE_FLAG_FILE_TC_INSPECT|DE_STATE_FLAG_FILE_TS_INSPECT)) {
+        if (dir_state->file_done_cnt == dir_state->file_done_size &&
+            DeStateArrayGrow((void **)&dir_state->file_done, &dir_state->file_done_size,
+                             sizeof(DeStateStoreItem *)) != 0)
+        {
+            DeStateDoneRemove(dir_state, item->sid);
+            return -1;
+        }
+        dir_state->file_done[dir_state->file_done_cnt++] = item;
+    }
+
+    return 0;
+}
+
+/**
+ *  \brief A new file makes the done items that inspect files inspectable
+ *         again, move them back to the active list. The inspection loop
+ *         decides what the new file changes for them.
+ */
+static void DeStateReactivateFileItems(DetectEngineStateDirection *dir_state)
+{
+    SigIntId i, w = 0;
+
+    for (i = 0; i < dir_state->file_done_cnt; i++) {
+        DeStateStoreItem *item = dir_state->file_done[i];
+
+        if (DeStateActiveAdd(dir_state, item) != 0) {
+            dir_state->file_done[w++] = item;
+            continue;
+        }
+        DeStateDoneRemove(dir_state, item->sid);
+    }
+    dir_state->file_done_cnt = w;
+}
+
+/** \brief flag a sig as having no new state for the current packet */
+static inline void DeStateSigMarkNoNewState(DetectEngineThreadCtx *det_ctx, SigIntId num)
+{
+    if (det_ctx->de_state_sig_array[num] != DE_STATE_MATCH_NO_NEW_STATE) {
+        det_ctx->de_state_sig_array[num] = DE_STATE_MATCH_NO_NEW_STATE;
+        det_ctx->de_state_sig_marked[det_ctx->de_state_sig_marked_cnt++] = num;
+    }
+}
+
 static void DeStateSignatureAppend(DetectEngineState *state, Signature *s,
                                    SigMatch *sm, uint32_t inspect_flags,
                                    uint8_t direction)
@@ -126,9 +251,17 @@ static void DeStateSignatureAppend(DetectEngineState *state, Signature *s,
         return;
 
     SigIntId idx = dir_state->cnt++ % DE_STATE_CHUNK_SIZE;
-    store->store[idx].sid = s->num;
-    store->store[idx].flags = inspect_flags;
-    store->store[idx].nm = sm;
+    DeStateStoreItem *item = &store->store[idx];
+    item->sid = s->num;
+    item->flags = inspect_flags;
+    item->nm = sm;
+
+    if (DeStateItemIsDone(item) && DeStateDoneAdd(dir_state, item) == 0)
+        return;
+    if (DeStateActiveAdd(dir_state, item) != 0) {
+        /* can't track it, forget the item */
+        dir_state->cnt--;
+    }
 
     return;
 }
@@ -206,6 +339,12 @@ void DetectEngineStateFree(DetectEngineState *state)
             SCFree(store);
             store = store_next;
         }
+        if (state->dir_state[i].active != NULL)
+            SCFree(state->dir_state[i].active);
+        if (state->dir_state[i].done != NULL)
+            SCFree(state->dir_state[i].done);
+        if (state->dir_state[i].file_done != NULL)
+            SCFree(state->dir_state[i].file_done);
     }
     SCFree(state);
 
@@ -493,13 +632,12 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
     HtpState *htp_state = NULL;
     SMBState *smb_state = NULL;
 
-    SigIntId store_cnt = 0;
-    SigIntId state_cnt = 0;
+    SigIntId active_cnt = 0;
+    SigIntId i = 0, w = 0;
     int match = 0;
     uint8_t alert = 0;
 
     DetectEngineStateDirection *dir_state = &f->de_state->dir_state[flags & STREAM_TOSERVER ? 0 : 1];
-    DeStateStore *store = dir_state->head;
     void *inspect_tx = NULL;
     uint64_t inspect_tx_id = 0;
     uint64_t total_txs = 0;
@@ -537,208 +675,220 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
         alproto_supports_txs = 1;
     }
 
-    for (; store != NULL; store = store->next) {
-        for (store_cnt = 0;
-             store_cnt < DE_STATE_CHUNK_SIZE && state_cnt < dir_state->cnt;
-             store_cnt++, state_cnt++)
-        {
-            total_matches = 0;
-            DeStateStoreItem *item = &store->store[store_cnt];
-            Signature *s = de_ctx->sig_array[item->sid];
-
-            if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
-                if (item->flags & (DE_STATE_FLAG_FILE_TC_INSPECT |
-                                   DE_STATE_FLAG_FILE_TS_INSPECT)) {
-                    if ((flags & STREAM_TOCLIENT) &&
-                        (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
-                    {
-                        item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
-                        item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
-                    }
-
-                    if ((flags & STREAM_TOSERVER) &&
-                        (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
-                    {
-                        item->flags &= ~DE_STATE_FLAG_FILE_TS_INSPECT;
-                        item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
-                    }
-                }
-
-                if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
-                    if (alproto_supports_txs) {
-                        if ((total_txs - inspect_tx_id) <= 1)
-                            det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    } else {
-                        det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    }
-                    continue;
+    /* the done items have no new state, unless there are more txs to
+     * inspect. Let the sig filter look them up instead of marking them
+     * one by one. */
+    if (!alproto_supports_txs || (total_txs - inspect_tx_id) <= 1)
+        det_ctx->de_state_done = dir_state;
+
+    if (dir_state->flags & (DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW|DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
+        DeStateReactivateFileItems(dir_state);
+
+    /* only the active items are inspected. Items that are done after
+     * this round move to the done set, the rest is compacted in place. */
+    active_cnt = dir_state->active_cnt;
+    for (i = 0; i < active_cnt; i++) {
+        total_matches = 0;
+        DeStateStoreItem *item = dir_state->active[i];
+        Signature *s = de_ctx->sig_array[item->sid];
+
+        if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
+            if (item->flags & (DE_STATE_FLAG_FILE_TC_INSPECT |
+                               DE_STATE_FLAG_FILE_TS_INSPECT)) {
+                if ((flags & STREAM_TOCLIENT) &&
+                    (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
+                {
+                    item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
+                    item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
                 }
-            }
 
-            if (item->flags & DE_STATE_FLAG_SIG_CANT_MATCH) {
                 if ((flags & STREAM_TOSERVER) &&
-                    (item->flags & DE_STATE_FLAG_FILE_TS_INSPECT) &&
                     (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
                 {
                     item->flags &= ~DE_STATE_FLAG_FILE_TS_INSPECT;
-                    item->flags &= ~DE_STATE_FLAG_SIG_CANT_MATCH;
-                } else if ((flags & STREAM_TOCLIENT) &&
-                           (item->flags & DE_STATE_FLAG_FILE_TC_INSPECT) &&
-                           (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
-                {
-                    item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
-                    item->flags &= ~DE_STATE_FLAG_SIG_CANT_MATCH;
+                    item->flags &= ~DE_STATE_FLAG_FULL_INSPECT;
+                }
+            }
+
+            if (item->flags & DE_STATE_FLAG_FULL_INSPECT) {
+                if (alproto_supports_txs) {
+                    if ((total_txs - inspect_tx_id) <= 1)
+                        DeStateSigMarkNoNewState(det_ctx, item->sid);
                 } else {
-                    if (alproto_supports_txs) {
-                        if ((total_txs - inspect_tx_id) <= 1)
-                            det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    } else {
-                        det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
-                    }
-                    continue;
+                    DeStateSigMarkNoNewState(det_ctx, item->sid);
                 }
+                goto next;
             }
+        }
 
-            alert = 0;
-            inspect_flags = 0;
-            match = 0;
+        if (item->flags & DE_STATE_FLAG_SIG_CANT_MATCH) {
+            if ((flags & STREAM_TOSERVER) &&
+                (item->flags & DE_STATE_FLAG_FILE_TS_INSPECT) &&
+                (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TS_NEW))
+            {
+                item->flags &= ~DE_STATE_FLAG_FILE_TS_INSPECT;
+                item->flags &= ~DE_STATE_FLAG_SIG_CANT_MATCH;
+            } else if ((flags & STREAM_TOCLIENT) &&
+                       (item->flags & DE_STATE_FLAG_FILE_TC_INSPECT) &&
+                       (dir_state->flags & DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW))
+            {
+                item->flags &= ~DE_STATE_FLAG_FILE_TC_INSPECT;
+                item->flags &= ~DE_STATE_FLAG_SIG_CANT_MATCH;
+            } else {
+                if (alproto_supports_txs) {
+                    if ((total_txs - inspect_tx_id) <= 1)
+                        DeStateSigMarkNoNewState(det_ctx, item->sid);
+                } else {
+                    DeStateSigMarkNoNewState(det_ctx, item->sid);
+                }
+                goto next;
+            }
+        }
 
-            RULE_PROFILING_START(p);
+        alert = 0;
+        inspect_flags = 0;
+        match = 0;
 
-            if (alproto_supports_txs) {
-                FLOWLOCK_WRLOCK(f);
-                alstate = FlowGetAppState(f);
-                if (alstate == NULL) {
-                    FLOWLOCK_UNLOCK(f);
-                    RULE_PROFILING_END(det_ctx, s, match, p);
-                    goto end;
-                }
+        RULE_PROFILING_START(p);
 
-                if (alproto == ALPROTO_HTTP) {
-                    htp_state = (HtpState *)alstate;
-                    if (htp_state->conn == NULL) {
-                        FLOWLOCK_UNLOCK(f);
-                        RULE_PROFILING_END(det_ctx, s, match, p);
-                        goto end;
-                    }
-                }
+        if (alproto_supports_txs) {
+            FLOWLOCK_WRLOCK(f);
+            alstate = FlowGetAppState(f);
+            if (alstate == NULL) {
+                FLOWLOCK_UNLOCK(f);
+                RULE_PROFILING_END(det_ctx, s, match, p);
+                goto end;
+            }
 
-                engine = app_inspection_engine[FlowGetProtoMapping(f->proto)][alproto][(flags & STREAM_TOSERVER) ? 0 : 1];
-                inspect_tx = AppLayerParserGetTx(f->proto, alproto, alstate, inspect_tx_id);
-                if (inspect_tx == NULL) {
+            if (alproto == ALPROTO_HTTP) {
+                htp_state = (HtpState *)alstate;
+                if (htp_state->conn == NULL) {
                     FLOWLOCK_UNLOCK(f);
                     RULE_PROFILING_END(det_ctx, s, match, p);
                     goto end;
                 }
-                while (engine != NULL) {
-                    if (!(item->flags & engine->inspect_flags) &&
-                        s->sm_lists[engine->sm_list] != NULL)
-                    {
-                        KEYWORD_PROFILING_SET_LIST(det_ctx, engine->sm_list);
-                        match = engine->Callback(tv, de_ctx, det_ctx, s, f,
-                                                 flags, alstate, inspect_tx, inspect_tx_id);
-                        if (match == 1) {
-                            inspect_flags |= engine->inspect_flags;
-                            engine = engine->next;
-                            total_matches++;
-                            continue;
-                        } else if (match == 2) {
-                            inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
-                            inspect_flags |= engine->inspect_flags;
-                        } else if (match == 3) {
-                            inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
-                            inspect_flags |= engine->inspect_flags;
-                            file_no_match++;
-                        }
-                        break;
-                    }
-                    engine = engine->next;
-                }
-                if (total_matches > 0 && (engine == NULL || inspect_flags & DE_STATE_FLAG_SIG_CANT_MATCH)) {
-                    if (engine == NULL)
-                        alert = 1;
-                    inspect_flags |= DE_STATE_FLAG_FULL_INSPECT;
-                }
+            }
 
+            engine = app_inspection_engine[FlowGetProtoMapping(f->proto)][alproto][(flags & STREAM_TOSERVER) ? 0 : 1];
+            inspect_tx = AppLayerParserGetTx(f->proto, alproto, alstate, inspect_tx_id);
+            if (inspect_tx == NULL) {
                 FLOWLOCK_UNLOCK(f);
+                RULE_PROFILING_END(det_ctx, s, match, p);
+                goto end;
+            }
+            while (engine != NULL) {
+                if (!(item->flags & engine->inspect_flags) &&
+                    s->sm_lists[engine->sm_list] != NULL)
+                {
+                    KEYWORD_PROFILING_SET_LIST(det_ctx, engine->sm_list);
+                    match = engine->Callback(tv, de_ctx, det_ctx, s, f,
+                                             flags, alstate, inspect_tx, inspect_tx_id);
+                    if (match == 1) {
+                        inspect_flags |= engine->inspect_flags;
+                        engine = engine->next;
+                        total_matches++;
+                        continue;
+                    } else if (match == 2) {
+                        inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
+                        inspect_flags |= engine->inspect_flags;
+                    } else if (match == 3) {
+                        inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
+                        inspect_flags |= engine->inspect_flags;
+                        file_no_match++;
+                    }
+                    break;
+                }
+                engine = engine->next;
+            }
+            if (total_matches > 0 && (engine == NULL || inspect_flags & DE_STATE_FLAG_SIG_CANT_MATCH)) {
+                if (engine == NULL)
+                    alert = 1;
+                inspect_flags |= DE_STATE_FLAG_FULL_INSPECT;
             }
 
-            /* count AMATCH matches */
-            total_matches = 0;
+            FLOWLOCK_UNLOCK(f);
+        }
 
-            KEYWORD_PROFILING_SET_LIST(det_ctx, DETECT_SM_LIST_AMATCH);
-            if (item->nm != NULL) {
-                /* RDLOCK would be nicer, but at least tlsstore needs
-                 * write lock currently. */
-                FLOWLOCK_WRLOCK(f);
-                alstate = FlowGetAppState(f);
-                if (alstate == NULL) {
-                    FLOWLOCK_UNLOCK(f);
-                    RULE_PROFILING_END(det_ctx, s, 0 /* no match */, p);
-                    goto end;
-                }
+        /* count AMATCH matches */
+        total_matches = 0;
 
-                for (sm = item->nm; sm != NULL; sm = sm->next) {
-                    if (sigmatch_table[sm->type].AppLayerMatch != NULL)
-                    {
-                        if (alproto == ALPROTO_SMB || alproto == ALPROTO_SMB2) {
-                            smb_state = (SMBState *)alstate;
-                            if (smb_state->dcerpc_present) {
-                                KEYWORD_PROFILING_START;
-                                match = sigmatch_table[sm->type].
-                                    AppLayerMatch(tv, det_ctx, f, flags, &smb_state->dcerpc, s, sm);
-                                KEYWORD_PROFILING_END(det_ctx, sm->type, (match > 0));
-                            }
-                        } else {
+        KEYWORD_PROFILING_SET_LIST(det_ctx, DETECT_SM_LIST_AMATCH);
+        if (item->nm != NULL) {
+            /* RDLOCK would be nicer, but at least tlsstore needs
+             * write lock currently. */
+            FLOWLOCK_WRLOCK(f);
+            alstate = FlowGetAppState(f);
+            if (alstate == NULL) {
+                FLOWLOCK_UNLOCK(f);
+                RULE_PROFILING_END(det_ctx, s, 0 /* no match */, p);
+                goto end;
+            }
+
+            for (sm = item->nm; sm != NULL; sm = sm->next) {
+                if (sigmatch_table[sm->type].AppLayerMatch != NULL)
+                {
+                    if (alproto == ALPROTO_SMB || alproto == ALPROTO_SMB2) {
+                        smb_state = (SMBState *)alstate;
+                        if (smb_state->dcerpc_present) {
                             KEYWORD_PROFILING_START;
                             match = sigmatch_table[sm->type].
-                                AppLayerMatch(tv, det_ctx, f, flags, alstate, s, sm);
+                                AppLayerMatch(tv, det_ctx, f, flags, &smb_state->dcerpc, s, sm);
                             KEYWORD_PROFILING_END(det_ctx, sm->type, (match > 0));
                         }
-
-                        if (match == 0)
-                            break;
-                        else if (match == 2)
-                            inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
-                        else if (match == 1)
-                            total_matches++;
+                    } else {
+                        KEYWORD_PROFILING_START;
+                        match = sigmatch_table[sm->type].
+                            AppLayerMatch(tv, det_ctx, f, flags, alstate, s, sm);
+                        KEYWORD_PROFILING_END(det_ctx, sm->type, (match > 0));
                     }
+
+                    if (match == 0)
+                        break;
+                    else if (match == 2)
+                        inspect_flags |= DE_STATE_FLAG_SIG_CANT_MATCH;
+                    else if (match == 1)
+                        total_matches++;
                 }
-                FLOWLOCK_UNLOCK(f);
             }
-            RULE_PROFILING_END(det_ctx, s, match, p);
+            FLOWLOCK_UNLOCK(f);
+        }
+        RULE_PROFILING_END(det_ctx, s, match, p);
 
-            if (s->sm_lists[DETECT_SM_LIST_AMATCH] != NULL) {
-                if (total_matches > 0 && (sm == NULL || inspect_flags & DE_STATE_FLAG_SIG_CANT_MATCH)) {
-                    if (sm == NULL)
-                        alert = 1;
-                    inspect_flags |= DE_STATE_FLAG_FULL_INSPECT;
-                }
-                det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
+        if (s->sm_lists[DETECT_SM_LIST_AMATCH] != NULL) {
+            if (total_matches > 0 && (sm == NULL || inspect_flags & DE_STATE_FLAG_SIG_CANT_MATCH)) {
+                if (sm == NULL)
+                    alert = 1;
+                inspect_flags |= DE_STATE_FLAG_FULL_INSPECT;
             }
+            DeStateSigMarkNoNewState(det_ctx, item->sid);
+        }
 
-            item->flags |= inspect_flags;
-            item->nm = sm;
-            if ((total_txs - inspect_tx_id) <= 1)
-                det_ctx->de_state_sig_array[item->sid] = DE_STATE_MATCH_NO_NEW_STATE;
+        item->flags |= inspect_flags;
+        item->nm = sm;
+        if ((total_txs - inspect_tx_id) <= 1)
+            DeStateSigMarkNoNewState(det_ctx, item->sid);
 
-            if (alert) {
-                SigMatchSignaturesRunPostMatch(tv, de_ctx, det_ctx, p, s);
+        if (alert) {
+            SigMatchSignaturesRunPostMatch(tv, de_ctx, det_ctx, p, s);
 
-                if (!(s->flags & SIG_FLAG_NOALERT)) {
-                    if (alproto_supports_txs)
-                        PacketAlertAppend(det_ctx, s, p, inspect_tx_id,
-                                PACKET_ALERT_FLAG_STATE_MATCH|PACKET_ALERT_FLAG_TX);
-                    else
-                        PacketAlertAppend(det_ctx, s, p, 0,
-                                PACKET_ALERT_FLAG_STATE_MATCH);
-                } else {
-                    PACKET_UPDATE_ACTION(p, s->action);
-                }
+            if (!(s->flags & SIG_FLAG_NOALERT)) {
+                if (alproto_supports_txs)
+                    PacketAlertAppend(det_ctx, s, p, inspect_tx_id,
+                            PACKET_ALERT_FLAG_STATE_MATCH|PACKET_ALERT_FLAG_TX);
+                else
+                    PacketAlertAppend(det_ctx, s, p, 0,
+                            PACKET_ALERT_FLAG_STATE_MATCH);
+            } else {
+                PACKET_UPDATE_ACTION(p, s->action);
             }
-
-            DetectFlowvarProcessList(det_ctx, f);
         }
+
+        DetectFlowvarProcessList(det_ctx, f);
+    next:
+        if (DeStateItemIsDone(dir_state->active[i]) &&
+            DeStateDoneAdd(dir_state, dir_state->active[i]) == 0)
+            continue;
+        dir_state->active[w++] = dir_state->active[i];
     }
 
     DeStateStoreStateVersion(f->de_state, alversion, flags);
@@ -758,16 +908,41 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
     }
 
 end:
+    /* keep the items we didn't get to */
+    if (i < active_cnt) {
+        memmove(&dir_state->active[w], &dir_state->active[i],
+                (active_cnt - i) * sizeof(DeStateStoreItem *));
+        w += active_cnt - i;
+    }
+    dir_state->active_cnt = w;
+
     if (f->de_state != NULL)
         dir_state->flags &= ~DETECT_ENGINE_STATE_FLAG_FILE_TC_NEW;
 
-    if (reset_de_state)
+    if (reset_de_state) {
+        /* the done set goes away with the reset */
+        if (det_ctx->de_state_done == dir_state) {
+            for (i = 0; i < dir_state->done_cnt; i++)
+                DeStateSigMarkNoNewState(det_ctx, dir_state->done[i]);
+            det_ctx->de_state_done = NULL;
+        }
         DetectEngineStateReset(f->de_state, flags);
+    }
 
     SCMutexUnlock(&f->de_state_m);
     return;
 }
 
+/** \brief clear the sigs the last packet flagged in de_state_sig_array */
+void DeStateResetSigArray(DetectEngineThreadCtx *det_ctx)
+{
+    SigIntId i;
+
+    for (i = 0; i < det_ctx->de_state_sig_marked_cnt; i++)
+        det_ctx->de_state_sig_array[det_ctx->de_state_sig_marked[i]] = DE_STATE_MATCH_HAS_NEW_STATE;
+    det_ctx->de_state_sig_marked_cnt = 0;
+}
+
 /** \brief update flow's inspection id's
  *
  *  \note it is possible that f->alstate, f->alparser are NULL */
@@ -788,11 +963,17 @@ void DetectEngineStateReset(DetectEngineState *state, uint8_t direction)
     if (state != NULL) {
         if (direction & STREAM_TOSERVER) {
             state->dir_state[0].cnt = 0;
+            state->dir_state[0].active_cnt = 0;
+            state->dir_state[0].done_cnt = 0;
+            state->dir_state[0].file_done_cnt = 0;
             state->dir_state[0].filestore_cnt = 0;
             state->dir_state[0].flags = 0;
         }
         if (direction & STREAM_TOCLIENT) {
             state->dir_state[1].cnt = 0;
+            state->dir_state[1].active_cnt = 0;
+            state->dir_state[1].done_cnt = 0;
+            state->dir_state[1].file_done_cnt = 0;
             state->dir_state[1].filestore_cnt = 0;
             state->dir_state[1].flags = 0;
         }
@@ -959,6 +1140,85 @@ end:
     return result;
 }
 
+/** \test active list, done set and file index of a direction */
+static int DeStateTest04(void)
+{
+    int result = 0;
+
+    DetectEngineState *state = DetectEngineStateAlloc();
+    if (state == NULL) {
+        printf("d == NULL: ");
+        goto end;
+    }
+    DetectEngineStateDirection *dir_state = &state->dir_state[0];
+
+    Signature s;
+    memset(&s, 0x00, sizeof(s));
+
+    uint8_t direction = STREAM_TOSERVER;
+    SigIntId i;
+
+    /* 40 items, every 4th done, every 8th of those done on a file */
+    for (i = 0; i < 40; i++) {
+        uint32_t flags = 0;
+        if (i % 4 == 0)
+            flags |= DE_STATE_FLAG_FULL_INSPECT;
+        if (i % 8 == 0)
+            flags |= DE_STATE_FLAG_FILE_TS_INSPECT;
+        s.num = 100 - i;
+        DeStateSignatureAppend(state, &s, NULL, flags, direction);
+    }
+
+    if (dir_state->cnt != 40 || dir_state->active_cnt != 30 ||
+        dir_state->done_cnt != 10 || dir_state->file_done_cnt != 5) {
+        printf("cnt %u active %u done %u file_done %u: ", dir_state->cnt,
+                dir_state->active_cnt, dir_state->done_cnt, dir_state->file_done_cnt);
+        goto end;
+    }
+    for (i = 1; i < dir_state->done_cnt; i++) {
+        if (dir_state->done[i - 1] > dir_state->done[i]) {
+            printf("done set not sorted: ");
+            goto end;
+        }
+    }
+    if (!DeStateSigIsDone(dir_state, 100) || !DeStateSigIsDone(dir_state, 64) ||
+        DeStateSigIsDone(dir_state, 99) || DeStateSigIsDone(dir_state, 10)) {
+        printf("done lookup failed: ");
+        goto end;
+    }
+    if (dir_state->active[0]->sid != 99 || dir_state->active[29]->sid != 61) {
+        printf("active list out of order: ");
+        goto end;
+    }
+
+    /* a new file brings the file items back for inspection */
+    DeStateReactivateFileItems(dir_state);
+    if (dir_state->active_cnt != 35 || dir_state->done_cnt != 5 ||
+        dir_state->file_done_cnt != 0) {
+        printf("active %u done %u file_done %u after new file: ",
+                dir_state->active_cnt, dir_state->done_cnt, dir_state->file_done_cnt);
+        goto end;
+    }
+    if (DeStateSigIsDone(dir_state, 100) || !DeStateSigIsDone(dir_state, 96)) {
+        printf("done lookup after new file failed: ");
+        goto end;
+    }
+
+    DetectEngineStateReset(state, direction);
+    if (dir_state->cnt != 0 || dir_state->active_cnt != 0 ||
+        dir_state->done_cnt != 0 || DeStateSigIsDone(dir_state, 96)) {
+        printf("reset left state: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (state != NULL) {
+        DetectEngineStateFree(state);
+    }
+    return result;
+}
+
 static int DeStateSigTest01(void)
 {
     int result = 0;
@@ -1948,6 +2208,105 @@ end:
     return result;
 }
 
+/** \test a sig that is done for the tx is not inspected again while the
+ *        tx is still in progress */
+static int DeStateSigTest08(void)
+{
+    int result = 0;
+    Signature *s = NULL;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    ThreadVars th_v;
+    Flow f;
+    TcpSession ssn;
+    Packet *p = NULL;
+    uint8_t httpbuf1[] = "POST / HTTP/1.0\r\n";
+    uint8_t httpbuf2[] = "User-Agent: Mozilla/1.0\r\n";
+    uint8_t httpbuf3[] = "Cookie: dummy\r\n";
+    uint8_t *bufs[3] = { httpbuf1, httpbuf2, httpbuf3 };
+    uint32_t lens[3] = { sizeof(httpbuf1) - 1, sizeof(httpbuf2) - 1, sizeof(httpbuf3) - 1 };
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+    int i;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    p = UTHBuildPacket(NULL, 0, IPPROTO_TCP);
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+
+    p->flow = &f;
+    p->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+    p->flowflags |= FLOW_PKT_ESTABLISHED;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL) {
+        goto end;
+    }
+
+    de_ctx->flags |= DE_QUIET;
+
+    s = de_ctx->sig_list = SigInit(de_ctx, "alert tcp any any -> any any (content:\"POST\"; http_method; sid:1; rev:1;)");
+    if (s == NULL) {
+        printf("sig parse failed: ");
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    for (i = 0; i < 3; i++) {
+        SCMutexLock(&f.m);
+        int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, bufs[i], lens[i]);
+        if (r != 0) {
+            printf("toserver chunk %d returned %" PRId32 ", expected 0: ", i + 1, r);
+            SCMutexUnlock(&f.m);
+            goto end;
+        }
+        SCMutexUnlock(&f.m);
+        /* do detect */
+        SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+        if (i == 0 && !(PacketAlertCheck(p, 1))) {
+            printf("sig 1 didn't alert: ");
+            goto end;
+        } else if (i > 0 && PacketAlertCheck(p, 1)) {
+            printf("sig 1 alerted again on chunk %d: ", i + 1);
+            goto end;
+        }
+        p->alerts.cnt = 0;
+    }
+
+    if (f.de_state == NULL || f.de_state->dir_state[0].done_cnt != 1 ||
+        f.de_state->dir_state[0].active_cnt != 0) {
+        printf("sig 1 not in the done set: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    if (det_ctx != NULL) {
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    }
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    UTHFreePacket(p);
+    return result;
+}
+
 #endif
 
 void DeStateRegisterTests(void)
@@ -1956,6 +2315,7 @@ void DeStateRegisterTests(void)
     UtRegisterTest("DeStateTest01", DeStateTest01, 1);
     UtRegisterTest("DeStateTest02", DeStateTest02, 1);
     UtRegisterTest("DeStateTest03", DeStateTest03, 1);
+    UtRegisterTest("DeStateTest04", DeStateTest04, 1);
     UtRegisterTest("DeStateSigTest01", DeStateSigTest01, 1);
     UtRegisterTest("DeStateSigTest02", DeStateSigTest02, 1);
     UtRegisterTest("DeStateSigTest03", DeStateSigTest03, 1);
@@ -1963,6 +2323,7 @@ void DeStateRegisterTests(void)
     UtRegisterTest("DeStateSigTest05", DeStateSigTest05, 1);
     UtRegisterTest("DeStateSigTest06", DeStateSigTest06, 1);
     UtRegisterTest("DeStateSigTest07", DeStateSigTest07, 1);
+    UtRegisterTest("DeStateSigTest08", DeStateSigTest08, 1);
 #endif
 
     return;
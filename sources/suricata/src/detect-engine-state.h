@@ -120,6 +120,22 @@ typedef struct DetectEngineStateDirection_ {
     uint16_t filestore_cnt;
     uint8_t alversion;
     uint8_t flags;
+
+    /** the stored items that are still inspected, in store order */
+    DeStateStoreItem **active;
+    SigIntId active_cnt;
+    SigIntId active_size;
+
+    /** sorted sig nums of the stored items that are done: fully
+     *  inspected or can't match. A sig is in it once per done item. */
+    SigIntId *done;
+    SigIntId done_cnt;
+    SigIntId done_size;
+
+    /** the done items a new file can make inspectable again */
+    DeStateStoreItem **file_done;
+    SigIntId file_done_cnt;
+    SigIntId file_done_size;
 } DetectEngineStateDirection;
 
 typedef struct DetectEngineState_ {
@@ -188,6 +204,13 @@ void DeStateDetectContinueDetection(ThreadVars *tv, DetectEngineCtx *de_ctx,
                                     Packet *p, Flow *f, uint8_t flags,
                                     AppProto alproto, uint16_t alversion);
 
+/**
+ * \brief Reset the sigs the last packet flagged in de_state_sig_array.
+ *
+ * \param det_ctx DetectEngineThreadCtx instance.
+ */
+void DeStateResetSigArray(DetectEngineThreadCtx *det_ctx);
+
 /**
  *  \brief Update the inspect id.
  *
@@ -204,6 +227,30 @@ void DeStateUpdateInspectTransactionId(Flow *f, uint8_t direction);
  */
 void DetectEngineStateReset(DetectEngineState *state, uint8_t direction);
 
+/**
+ * \brief Check if a sig is done in the state the current packet continued.
+ *
+ * \param dir_state det_ctx->de_state_done
+ * \param num       Sig num.
+ *
+ * \retval 1 done, there is no new state for the sig.
+ * \retval 0 not done.
+ */
+static inline int DeStateSigIsDone(const DetectEngineStateDirection *dir_state,
+                                   SigIntId num)
+{
+    uint32_t lo = 0, hi = dir_state->done_cnt;
+
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (dir_state->done[mid] < num)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return (lo < dir_state->done_cnt && dir_state->done[lo] == num);
+}
+
 void DeStateRegisterTests(void);
 
 #endif /* __DETECT_ENGINE_STATE_H__ */
@@ -40,8 +40,7 @@
 #include "detect.h"
 #include "flow.h"
 
-#include "host.h"
-#include "host-storage.h"
+#include "conf.h"
 
 #include "detect-parse.h"
 #include "detect-engine-sigorder.h"
@@ -59,6 +58,9 @@
 #include "detect-uricontent.h"
 
 #include "util-hash.h"
+#include "util-hash-lookup3.h"
+#include "util-byte.h"
+#include "util-misc.h"
 #include "util-time.h"
 #include "util-error.h"
 #include "util-debug.h"
@@ -66,22 +68,18 @@
 #include "util-var-name.h"
 #include "tm-threads.h"
 
-static int threshold_id = -1; /**< host storage id for thresholds */
+/** threshold ctxs of the live detect engines, for ThresholdTimeoutHash() */
+static ThresholdCtx *threshold_ctx_list = NULL;
+static SCMutex threshold_ctx_list_m = SCMUTEX_INITIALIZER;
 
-int ThresholdHostStorageId(void) {
-    return threshold_id;
-}
-
-void ThresholdInit(void) {
-    threshold_id = HostStorageRegister("threshold", sizeof(void *), NULL, ThresholdListFree);
-    if (threshold_id == -1) {
-        SCLogError(SC_ERR_HOST_INIT, "Can't initiate host storage for thresholding");
-        exit(EXIT_FAILURE);
-    }
-}
+/** \brief hash an address and sig to its row in the threshold table */
+static inline uint32_t ThresholdHashAddr(const ThresholdCtx *ths, const Address *a,
+                                         uint32_t sid, uint32_t gid)
+{
+    uint32_t key[6] = { sid, gid, a->addr_data32[0], a->addr_data32[1],
+                        a->addr_data32[2], a->addr_data32[3] };
 
-int ThresholdHostHasThreshold(Host *host) {
-    return HostGetStorageById(host, threshold_id) ? 1 : 0;
+    return hashword(key, 6, (uint32_t)a->family) % ths->hash_size;
 }
 
 /**
@@ -128,51 +126,86 @@ DetectThresholdData *SigGetThresholdTypeIter(Signature *sig, Packet *p, SigMatch
 }
 
 /**
- * \brief Remove timeout threshold hash elements
+ * \brief Check if a time is less than secs seconds before now. A time
+ *        after now, from a packet of another thread that is ahead, is
+ *        recent too.
+ */
+static inline int ThresholdTimeRecent(uint32_t now, uint32_t t, uint32_t secs)
+{
+    return (t >= now || (now - t) <= secs);
+}
+
+/**
+ * \brief Remove the timed out entries of a threshold table row
  *
- * \param de_ctx Dectection Context
+ * \param ths threshold ctx
+ * \param row *LOCKED* row
+ * \param now current time in seconds
  *
+ * \retval cnt number of removed entries
  */
-
-int ThresholdTimeoutCheck(Host *host, struct timeval *tv)
+static uint32_t ThresholdHashRowTimeout(ThresholdCtx *ths, ThresholdHashRow *row, uint32_t now)
 {
-    DetectThresholdEntry *tde = NULL;
-    DetectThresholdEntry *tmp = NULL;
+    DetectThresholdEntry *tmp = row->head;
     DetectThresholdEntry *prev = NULL;
-    int retval = 1;
+    uint32_t cnt = 0;
 
-    tmp = HostGetStorageById(host, threshold_id);
-    if (tmp == NULL)
-         return 1;
-
-    prev = NULL;
     while (tmp != NULL) {
-        if ((tv->tv_sec - tmp->tv_sec1) <= tmp->seconds) {
+        if (ThresholdTimeRecent(now, tmp->tv_sec1, tmp->seconds) ||
+            (tmp->tv_timeout != 0 &&
+             ThresholdTimeRecent(now, tmp->tv_timeout, tmp->timeout))) {
             prev = tmp;
             tmp = tmp->next;
-            retval = 0;
             continue;
         }
 
         /* timed out */
+        DetectThresholdEntry *tde = tmp;
+        tmp = tde->next;
+        if (prev != NULL)
+            prev->next = tmp;
+        else
+            row->head = tmp;
+
+        SCFree(tde);
+        (void) SC_ATOMIC_SUB(ths->memuse, sizeof(DetectThresholdEntry));
+        cnt++;
+    }
 
-        if (prev != NULL) {
-            prev->next = tmp->next;
+    return cnt;
+}
+
+/**
+ *  \brief Time out the by_src/by_dst entries of all detect engines. Called
+ *         by the flow manager, so entries in rows no packet looks at any
+ *         more don't keep holding memcap.
+ *
+ *  \param ts timestamp
+ *
+ *  \retval cnt number of timed out entries
+ */
+uint32_t ThresholdTimeoutHash(struct timeval *ts)
+{
+    ThresholdCtx *ths;
+    uint32_t idx, cnt = 0;
 
-            tde = tmp;
-            tmp = tde->next;
+    SCMutexLock(&threshold_ctx_list_m);
+    for (ths = threshold_ctx_list; ths != NULL; ths = ths->next) {
+        for (idx = 0; idx < ths->hash_size; idx++) {
+            ThresholdHashRow *row = &ths->hash[idx];
 
-            SCFree(tde);
-        } else {
-            HostSetStorageById(host, threshold_id, tmp->next);
-            tde = tmp;
-            tmp = tde->next;
+            /* a busy row is timed out by the packet that holds it */
+            if (SCSpinTrylock(&row->lock) != 0)
+                continue;
 
-            SCFree(tde);
+            if (row->head != NULL)
+                cnt += ThresholdHashRowTimeout(ths, row, (uint32_t)ts->tv_sec);
+            SCSpinUnlock(&row->lock);
         }
     }
+    SCMutexUnlock(&threshold_ctx_list_m);
 
-    return retval;
+    return cnt;
 }
 
 static inline DetectThresholdEntry *DetectThresholdEntryAlloc(DetectThresholdData *td, Packet *p, uint32_t sid, uint32_t gid) {
@@ -188,32 +221,61 @@ static inline DetectThresholdEntry *DetectThresholdEntryAlloc(DetectThresholdDat
 
     ste->track = td->track;
     ste->seconds = td->seconds;
+    ste->timeout = td->timeout;
     ste->tv_timeout = 0;
 
     SCReturnPtr(ste, "DetectThresholdEntry");
 }
 
-static DetectThresholdEntry *ThresholdHostLookupEntry(Host *h, uint32_t sid, uint32_t gid)
+static DetectThresholdEntry *ThresholdHashRowLookupEntry(ThresholdHashRow *row,
+        Address *addr, uint32_t sid, uint32_t gid)
 {
     DetectThresholdEntry *e;
 
-    for (e = HostGetStorageById(h, threshold_id); e != NULL; e = e->next) {
-        if (e->sid == sid && e->gid == gid)
+    for (e = row->head; e != NULL; e = e->next) {
+        if (e->sid == sid && e->gid == gid && CMP_ADDR(&e->addr, addr))
             break;
     }
 
     return e;
 }
 
+/**
+ *  \brief Add an entry for an address to a threshold table row
+ *
+ *  \param row *LOCKED* row
+ *
+ *  \retval e the new entry
+ *  \retval NULL alloc failure or memcap reached
+ */
+static DetectThresholdEntry *ThresholdHashRowAddEntry(ThresholdCtx *ths, ThresholdHashRow *row,
+        Address *addr, DetectThresholdData *td, Packet *p, uint32_t sid, uint32_t gid)
+{
+    if ((uint64_t)SC_ATOMIC_GET(ths->memuse) + sizeof(DetectThresholdEntry) > ths->memcap)
+        return NULL;
+
+    DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+    if (e == NULL)
+        return NULL;
+    (void) SC_ATOMIC_ADD(ths->memuse, sizeof(DetectThresholdEntry));
+
+    COPY_ADDRESS(addr, &e->addr);
+    e->next = row->head;
+    row->head = e;
+    return e;
+}
+
 /**
  *  \retval 2 silent match (no alert but apply actions)
  *  \retval 1 normal match
  *  \retval 0 no match
  */
-int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint32_t sid, uint32_t gid) {
+static int ThresholdHandlePacketAddr(ThresholdCtx *ths, ThresholdHashRow *row, Address *addr,
+        Packet *p, DetectThresholdData *td, uint32_t sid, uint32_t gid)
+{
     int ret = 0;
 
-    DetectThresholdEntry *lookup_tsh = ThresholdHostLookupEntry(h, sid, gid);
+    DetectThresholdEntry *lookup_tsh = ThresholdHashRowLookupEntry(row, addr, sid, gid);
     SCLogDebug("lookup_tsh %p sid %u gid %u", lookup_tsh, sid, gid);
 
     switch(td->type)   {
@@ -237,7 +299,7 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                     ret = 1;
                 }
             } else {
-                DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+                DetectThresholdEntry *e = ThresholdHashRowAddEntry(ths, row, addr, td, p, sid, gid);
                 if (e == NULL) {
                     break;
                 }
@@ -246,9 +308,6 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                 e->current_count = 1;
 
                 ret = 1;
-
-                e->next = HostGetStorageById(h, threshold_id);
-                HostSetStorageById(h, threshold_id, e);
             }
             break;
         }
@@ -272,16 +331,13 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                 if (td->count == 1)  {
                     ret = 1;
                 } else {
-                    DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+                    DetectThresholdEntry *e = ThresholdHashRowAddEntry(ths, row, addr, td, p, sid, gid);
                     if (e == NULL) {
                         break;
                     }
 
                     e->current_count = 1;
                     e->tv_sec1 = p->ts.tv_sec;
-
-                    e->next = HostGetStorageById(h, threshold_id);
-                    HostSetStorageById(h, threshold_id, e);
                 }
             }
             break;
@@ -312,7 +368,7 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                     }
                 }
             } else {
-                DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+                DetectThresholdEntry *e = ThresholdHashRowAddEntry(ths, row, addr, td, p, sid, gid);
                 if (e == NULL) {
                     break;
                 }
@@ -320,9 +376,6 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                 e->current_count = 1;
                 e->tv_sec1 = p->ts.tv_sec;
 
-                e->next = HostGetStorageById(h, threshold_id);
-                HostSetStorageById(h, threshold_id, e);
-
                 /* for the first match we return 1 to
                  * indicate we should alert */
                 if (td->count == 1)  {
@@ -355,7 +408,7 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                     lookup_tsh->current_count = 1;
                 }
             } else {
-                DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+                DetectThresholdEntry *e = ThresholdHashRowAddEntry(ths, row, addr, td, p, sid, gid);
                 if (e == NULL) {
                     break;
                 }
@@ -363,9 +416,6 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                 e->current_count = 1;
                 e->tv_sec1 = p->ts.tv_sec;
                 e->tv_usec1 = p->ts.tv_usec;
-
-                e->next = HostGetStorageById(h, threshold_id);
-                HostSetStorageById(h, threshold_id, e);
             }
             break;
         }
@@ -444,7 +494,7 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                     ret = 1;
                 }
 
-                DetectThresholdEntry *e = DetectThresholdEntryAlloc(td, p, sid, gid);
+                DetectThresholdEntry *e = ThresholdHashRowAddEntry(ths, row, addr, td, p, sid, gid);
                 if (e == NULL) {
                     break;
                 }
@@ -452,9 +502,6 @@ int ThresholdHandlePacketHost(Host *h, Packet *p, DetectThresholdData *td, uint3
                 e->current_count = 1;
                 e->tv_sec1 = p->ts.tv_sec;
                 e->tv_timeout = 0;
-
-                e->next = HostGetStorageById(h, threshold_id);
-                HostSetStorageById(h, threshold_id, e);
             }
             break;
         }
@@ -572,6 +619,24 @@ static int ThresholdHandlePacketRule(DetectEngineCtx *de_ctx, Packet *p, DetectT
     return ret;
 }
 
+/**
+ *  \brief Apply a by_src/by_dst threshold using the entry of the address.
+ *         Only the row of the address is locked.
+ */
+static int ThresholdHandlePacketTable(ThresholdCtx *ths, Packet *p, Address *addr,
+                                      DetectThresholdData *td, Signature *s)
+{
+    ThresholdHashRow *row = &ths->hash[ThresholdHashAddr(ths, addr, s->id, s->gid)];
+    int ret;
+
+    SCSpinLock(&row->lock);
+    ThresholdHashRowTimeout(ths, row, (uint32_t)p->ts.tv_sec);
+    ret = ThresholdHandlePacketAddr(ths, row, addr, p, td, s->id, s->gid);
+    SCSpinUnlock(&row->lock);
+
+    return ret;
+}
+
 /**
  * \brief Make the threshold logic for signatures
  *
@@ -595,21 +660,18 @@ int PacketAlertThreshold(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx
     }
 
     if (td->track == TRACK_SRC) {
-        Host *src = HostGetHostFromHash(&p->src);
-        if (src) {
-            ret = ThresholdHandlePacketHost(src,p,td,s->id,s->gid);
-            HostRelease(src);
-        }
+        ret = ThresholdHandlePacketTable(&de_ctx->ths_ctx, p, &p->src, td, s);
     } else if (td->track == TRACK_DST) {
-        Host *dst = HostGetHostFromHash(&p->dst);
-        if (dst) {
-            ret = ThresholdHandlePacketHost(dst,p,td,s->id,s->gid);
-            HostRelease(dst);
-        }
+        ret = ThresholdHandlePacketTable(&de_ctx->ths_ctx, p, &p->dst, td, s);
     } else if (td->track == TRACK_RULE) {
-        SCMutexLock(&de_ctx->ths_ctx.threshold_table_lock);
+        /* only rate_filter keeps by_rule state */
+        if (td->type != TYPE_RATE)
+            SCReturnInt(1);
+
+        SCMutex *m = &de_ctx->ths_ctx.th_entry_lock[s->num % THRESHOLD_ENTRY_LOCKS];
+        SCMutexLock(m);
         ret = ThresholdHandlePacketRule(de_ctx,p,td,s);
-        SCMutexUnlock(&de_ctx->ths_ctx.threshold_table_lock);
+        SCMutexUnlock(m);
     }
 
     SCReturnInt(ret);
@@ -623,11 +685,65 @@ int PacketAlertThreshold(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx
  */
 void ThresholdHashInit(DetectEngineCtx *de_ctx)
 {
-    if (SCMutexInit(&de_ctx->ths_ctx.threshold_table_lock, NULL) != 0) {
+    ThresholdCtx *ths = &de_ctx->ths_ctx;
+    char *conf_val;
+    uint32_t configval = 0;
+    int i;
+
+    ths->hash_size = THRESHOLD_DEFAULT_HASHSIZE;
+    ths->memcap = THRESHOLD_DEFAULT_MEMCAP;
+    SC_ATOMIC_INIT(ths->memuse);
+
+    if ((ConfGet("threshold.memcap", &conf_val)) == 1)
+    {
+        if (ParseSizeStringU64(conf_val, &ths->memcap) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "Error parsing threshold.memcap "
+                       "from conf file - %s.  Killing engine",
+                       conf_val);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if ((ConfGet("threshold.hash-size", &conf_val)) == 1)
+    {
+        if (ByteExtractStringUint32(&configval, 10, strlen(conf_val),
+                                    conf_val) > 0 && configval > 0) {
+            ths->hash_size = configval;
+        }
+    }
+
+    uint64_t hash_size = ths->hash_size * sizeof(ThresholdHashRow);
+    if (hash_size > ths->memcap) {
+        SCLogError(SC_ERR_THRESHOLD_HASH_ADD,
+                "threshold memcap is smaller than projected hash size. "
+                "Memcap: %"PRIu64", Hash table size %"PRIu64". Calculate "
+                "total hash size by multiplying \"threshold.hash-size\" with %"PRIuMAX", "
+                "which is the hash bucket size.", ths->memcap, hash_size,
+                (uintmax_t)sizeof(ThresholdHashRow));
+        exit(EXIT_FAILURE);
+    }
+    ths->hash = SCCalloc(ths->hash_size, sizeof(ThresholdHashRow));
+    if (unlikely(ths->hash == NULL)) {
         SCLogError(SC_ERR_MEM_ALLOC,
-                "Threshold: Failed to initialize hash table mutex.");
+                "Threshold: Failed to allocate the hash table.");
         exit(EXIT_FAILURE);
     }
+    for (i = 0; i < (int)ths->hash_size; i++) {
+        SCSpinInit(&ths->hash[i].lock, 0);
+    }
+    (void) SC_ATOMIC_ADD(ths->memuse, hash_size);
+
+    for (i = 0; i < THRESHOLD_ENTRY_LOCKS; i++) {
+        if (SCMutexInit(&ths->th_entry_lock[i], NULL) != 0) {
+            SCLogError(SC_ERR_MEM_ALLOC,
+                    "Threshold: Failed to initialize hash table mutex.");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    SCMutexLock(&threshold_ctx_list_m);
+    ths->next = threshold_ctx_list;
+    threshold_ctx_list = ths;
+    SCMutexUnlock(&threshold_ctx_list_m);
 }
 
 /**
@@ -638,9 +754,40 @@ void ThresholdHashInit(DetectEngineCtx *de_ctx)
  */
 void ThresholdContextDestroy(DetectEngineCtx *de_ctx)
 {
-    if (de_ctx->ths_ctx.th_entry != NULL)
-        SCFree(de_ctx->ths_ctx.th_entry);
-    SCMutexDestroy(&de_ctx->ths_ctx.threshold_table_lock);
+    ThresholdCtx *ths = &de_ctx->ths_ctx;
+    ThresholdCtx **prev;
+    uint32_t u;
+    int i;
+
+    /* no more time outs from the flow manager */
+    SCMutexLock(&threshold_ctx_list_m);
+    for (prev = &threshold_ctx_list; *prev != NULL; prev = &(*prev)->next) {
+        if (*prev == ths) {
+            *prev = ths->next;
+            break;
+        }
+    }
+    SCMutexUnlock(&threshold_ctx_list_m);
+
+    if (ths->th_entry != NULL) {
+        for (u = 0; u < ths->th_size; u++) {
+            if (ths->th_entry[u] != NULL)
+                SCFree(ths->th_entry[u]);
+        }
+        SCFree(ths->th_entry);
+    }
+    if (ths->hash != NULL) {
+        for (u = 0; u < ths->hash_size; u++) {
+            ThresholdListFree(ths->hash[u].head);
+            SCSpinDestroy(&ths->hash[u].lock);
+        }
+        SCFree(ths->hash);
+        ths->hash = NULL;
+    }
+    SC_ATOMIC_DESTROY(ths->memuse);
+    for (i = 0; i < THRESHOLD_ENTRY_LOCKS; i++) {
+        SCMutexDestroy(&ths->th_entry_lock[i]);
+    }
 }
 
 /**
@@ -661,6 +808,20 @@ void ThresholdListFree(void *ptr) {
     }
 }
 
+#ifdef UNITTESTS
+/**
+ * \brief Look up the by_src/by_dst entry of a sig for an address, unlocked.
+ */
+DetectThresholdEntry *ThresholdLookupEntry(DetectEngineCtx *de_ctx, Address *addr,
+                                           uint32_t sid, uint32_t gid)
+{
+    ThresholdCtx *ths = &de_ctx->ths_ctx;
+
+    return ThresholdHashRowLookupEntry(&ths->hash[ThresholdHashAddr(ths, addr, sid, gid)],
+                                       addr, sid, gid);
+}
+#endif
+
 /**
  * @}
  */
@@ -26,12 +26,15 @@
 #define __DETECT_ENGINE_THRESHOLD_H__
 
 #include "detect.h"
-#include "host.h"
 
-void ThresholdInit(void);
+#define THRESHOLD_DEFAULT_HASHSIZE  16384
+#define THRESHOLD_DEFAULT_MEMCAP    (16 * 1024 * 1024)
 
-int ThresholdHostStorageId(void);
-int ThresholdHostHasThreshold(Host *);
+/** a row of the by_src/by_dst threshold table */
+typedef struct ThresholdHashRow_ {
+    SCSpinlock lock;
+    DetectThresholdEntry *head;
+} ThresholdHashRow;
 
 DetectThresholdData *SigGetThresholdTypeIter(Signature *, Packet *, SigMatch **, int list);
 int PacketAlertThreshold(DetectEngineCtx *, DetectEngineThreadCtx *,
@@ -39,8 +42,12 @@ int PacketAlertThreshold(DetectEngineCtx *, DetectEngineThreadCtx *,
 
 void ThresholdHashInit(DetectEngineCtx *);
 void ThresholdContextDestroy(DetectEngineCtx *);
+uint32_t ThresholdTimeoutHash(struct timeval *);
 
-int ThresholdTimeoutCheck(Host *, struct timeval *);
 void ThresholdListFree(void *ptr);
 
+#ifdef UNITTESTS
+DetectThresholdEntry *ThresholdLookupEntry(DetectEngineCtx *, Address *, uint32_t, uint32_t);
+#endif
+
 #endif /* __DETECT_ENGINE_THRESHOLD_H__ */
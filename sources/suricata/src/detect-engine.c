@@ -37,6 +37,10 @@
 #include "detect-engine-sigorder.h"
 
 #include "detect-engine-siggroup.h"
+#include "detect-engine-prefilter.h"
+#include "detect-engine-candidates.h"
+#include "detect-engine-rule-sample.h"
+#include "detect-engine-alert.h"
 #include "detect-engine-address.h"
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
@@ -67,6 +71,7 @@
 #include "detect-content.h"
 #include "detect-uricontent.h"
 #include "detect-engine-threshold.h"
+#include "detect-pcre.h"
 
 #include "util-classification-config.h"
 #include "util-reference-config.h"
@@ -76,9 +81,11 @@
 #include "util-byte.h"
 #include "util-debug.h"
 #include "util-unittest.h"
+#include "util-unittest-helper.h"
 #include "util-action.h"
 #include "util-magic.h"
 #include "util-signal.h"
+#include "util-mpm-ac.h"
 
 #include "util-var-name.h"
 
@@ -91,6 +98,7 @@
 
 #include "reputation.h"
 
+
 #define DETECT_ENGINE_DEFAULT_INSPECTION_RECURSION_LIMIT 3000
 
 static uint32_t detect_engine_ctx_id = 1;
@@ -897,6 +905,7 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx) {
     DetectPortSpHashFree(de_ctx);
     DetectPortDpHashFree(de_ctx);
     ThresholdContextDestroy(de_ctx);
+    DetectPcreCtxFree(de_ctx);
     SigCleanSignatures(de_ctx);
 
     VariableNameFreeHash(de_ctx);
@@ -907,6 +916,10 @@ void DetectEngineCtxFree(DetectEngineCtx *de_ctx) {
     SCRConfDeInitContext(de_ctx);
 
     SigGroupCleanup(de_ctx);
+    if (de_ctx->mpm_prepare_queue != NULL)
+        SCFree(de_ctx->mpm_prepare_queue);
+    if (de_ctx->mpm_cache_dir != NULL)
+        SCFree(de_ctx->mpm_cache_dir);
 
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
         MpmFactoryDeRegisterAllMpmCtxProfiles(de_ctx);
@@ -939,6 +952,9 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
     const char *max_uniq_toserver_dp_groups_str = NULL;
 
     char *sgh_mpm_context = NULL;
+    char *build_threads = NULL;
+    char *mpm_cache_dir = NULL;
+    ConfNode *rule_sampling = NULL;
 
     ConfNode *de_ctx_custom = ConfGetNode("detect-engine");
     ConfNode *opt = NULL;
@@ -949,6 +965,12 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
                 de_ctx_profile = opt->head.tqh_first->val;
             } else if (strcmp(opt->val, "sgh-mpm-context") == 0) {
                 sgh_mpm_context = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "build-threads") == 0) {
+                build_threads = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "mpm-cache-dir") == 0) {
+                mpm_cache_dir = opt->head.tqh_first->val;
+            } else if (strcmp(opt->val, "rule-sampling") == 0) {
+                rule_sampling = opt->head.tqh_first;
             }
         }
     }
@@ -1010,6 +1032,56 @@ static uint8_t DetectEngineCtxLoadConf(DetectEngineCtx *de_ctx) {
         de_ctx->sgh_mpm_context = ENGINE_SGH_MPM_FACTORY_CONTEXT_FULL;
     }
 
+    /* detect-engine.build-threads option parsing */
+    if (build_threads == NULL || strcmp(build_threads, "auto") == 0) {
+        de_ctx->build_threads = UtilCpuGetNumProcessorsOnline();
+    } else if (ByteExtractStringUint16(&de_ctx->build_threads, 10,
+                strlen(build_threads), (const char *)build_threads) <= 0) {
+        de_ctx->build_threads = 1;
+        SCLogWarning(SC_ERR_SIZE_PARSE, "parsing '%s' for build-threads "
+                "failed, using %u", build_threads, de_ctx->build_threads);
+    }
+    if (de_ctx->build_threads == 0)
+        de_ctx->build_threads = 1;
+    else if (de_ctx->build_threads > DETECT_ENGINE_BUILD_THREADS_MAX)
+        de_ctx->build_threads = DETECT_ENGINE_BUILD_THREADS_MAX;
+    SCLogDebug("detection engine build threads: %u", de_ctx->build_threads);
+
+    /* detect-engine.mpm-cache-dir option parsing */
+    if (mpm_cache_dir != NULL && strlen(mpm_cache_dir) > 0) {
+        struct stat st;
+        if (stat(mpm_cache_dir, &st) != 0 && mkdir(mpm_cache_dir, 0700) != 0) {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "can't create "
+                    "mpm-cache-dir \"%s\": %s, mpm cache disabled",
+                    mpm_cache_dir, strerror(errno));
+        } else if (stat(mpm_cache_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            SCLogWarning(SC_ERR_INVALID_YAML_CONF_ENTRY, "mpm-cache-dir \"%s\" "
+                    "is not a directory, mpm cache disabled", mpm_cache_dir);
+        } else {
+            de_ctx->mpm_cache_dir = SCStrdup(mpm_cache_dir);
+            if (unlikely(de_ctx->mpm_cache_dir == NULL)) {
+                SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            SCLogDebug("mpm cache dir: %s", de_ctx->mpm_cache_dir);
+        }
+    }
+
+    /* detect-engine.rule-sampling option parsing */
+    if (rule_sampling != NULL && ConfNodeChildValueIsTrue(rule_sampling, "enabled")) {
+        const char *rate = ConfNodeLookupChildValue(rule_sampling, "sample-rate");
+
+        de_ctx->rule_sample_rate = DETECT_RULE_SAMPLE_DEFAULT_RATE;
+        if (rate != NULL && (ByteExtractStringUint32(&de_ctx->rule_sample_rate, 10,
+                    strlen(rate), rate) <= 0 || de_ctx->rule_sample_rate == 0)) {
+            de_ctx->rule_sample_rate = DETECT_RULE_SAMPLE_DEFAULT_RATE;
+            SCLogWarning(SC_ERR_SIZE_PARSE, "parsing '%s' for rule-sampling "
+                    "sample-rate failed, using %u", rate, de_ctx->rule_sample_rate);
+        }
+        SCLogInfo("rule sampling enabled, sampling 1 in %u packets",
+                de_ctx->rule_sample_rate);
+    }
+
     opt = NULL;
     switch (profile) {
         case ENGINE_PROFILE_LOW:
@@ -1194,6 +1266,93 @@ void DetectEngineResetMaxSigId(DetectEngineCtx *de_ctx) {
     de_ctx->signum = 0;
 }
 
+/** \brief work shared by the detection engine build threads */
+typedef struct DetectEngineBuildJob_ {
+    DetectEngineCtx *de_ctx;
+    DetectEngineBuildFunc Func;
+    void *data;
+    uint32_t cnt;
+    /* next item to hand out, protected by m */
+    uint32_t next;
+    SCMutex m;
+} DetectEngineBuildJob;
+
+static void *DetectEngineBuildWorker(void *arg)
+{
+    DetectEngineBuildJob *job = (DetectEngineBuildJob *)arg;
+
+    while (1) {
+        SCMutexLock(&job->m);
+        uint32_t idx = job->next++;
+        SCMutexUnlock(&job->m);
+
+        if (idx >= job->cnt)
+            break;
+
+        job->Func(job->de_ctx, job->data, idx);
+    }
+
+    return NULL;
+}
+
+/**
+ * \brief Run Func for items 0..cnt-1 on up to de_ctx->build_threads threads.
+ *
+ *        The calling thread takes part in the work and the call returns
+ *        when all items are done. Func must only touch state that belongs
+ *        to its item, the order in which items are handled is undefined.
+ *
+ * \param de_ctx detection engine ctx
+ * \param cnt    number of items
+ * \param Func   function called for each item
+ * \param data   passed to Func
+ */
+void DetectEngineBuildRunParallel(DetectEngineCtx *de_ctx, uint32_t cnt,
+                                  DetectEngineBuildFunc Func, void *data)
+{
+    uint32_t threads = de_ctx->build_threads;
+    uint32_t started = 0;
+    uint32_t i;
+
+    if (threads > cnt)
+        threads = cnt;
+
+    if (threads <= 1) {
+        for (i = 0; i < cnt; i++)
+            Func(de_ctx, data, i);
+        return;
+    }
+
+    DetectEngineBuildJob job;
+    memset(&job, 0, sizeof(job));
+    job.de_ctx = de_ctx;
+    job.Func = Func;
+    job.data = data;
+    job.cnt = cnt;
+    SCMutexInit(&job.m, NULL);
+
+    pthread_t *tids = SCMalloc((threads - 1) * sizeof(pthread_t));
+    if (tids != NULL) {
+        for (started = 0; started < threads - 1; started++) {
+            if (pthread_create(&tids[started], NULL, DetectEngineBuildWorker, &job) != 0) {
+                SCLogWarning(SC_ERR_THREAD_CREATE, "creating detection engine "
+                        "build thread failed, continuing with %u threads",
+                        started + 1);
+                break;
+            }
+        }
+    }
+
+    (void)DetectEngineBuildWorker(&job);
+
+    for (i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    if (tids != NULL)
+        SCFree(tids);
+    SCMutexDestroy(&job.m);
+}
+
 static int DetectEngineThreadCtxInitKeywords(DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx) {
     if (de_ctx->keyword_id > 0) {
         det_ctx->keyword_ctxs_array = SCMalloc(de_ctx->keyword_id * sizeof(void *));
@@ -1268,6 +1427,11 @@ static TmEcode ThreadCtxDoInit (DetectEngineCtx *de_ctx, DetectEngineThreadCtx *
         }
         memset(det_ctx->de_state_sig_array, 0,
                det_ctx->de_state_sig_array_len * sizeof(uint8_t));
+        det_ctx->de_state_sig_marked = SCMalloc(det_ctx->de_state_sig_array_len * sizeof(SigIntId));
+        if (det_ctx->de_state_sig_marked == NULL) {
+            return TM_ECODE_FAILED;
+        }
+        det_ctx->de_state_sig_marked_cnt = 0;
 
         det_ctx->match_array_len = de_ctx->sig_array_len;
         det_ctx->match_array = SCMalloc(det_ctx->match_array_len * sizeof(Signature *));
@@ -1276,6 +1440,20 @@ static TmEcode ThreadCtxDoInit (DetectEngineCtx *de_ctx, DetectEngineThreadCtx *
         }
         memset(det_ctx->match_array, 0,
                det_ctx->match_array_len * sizeof(Signature *));
+
+        if (DetectPrefilterThreadInit(de_ctx, det_ctx) != 0) {
+            return TM_ECODE_FAILED;
+        }
+        if (DetectCandidatesThreadInit(de_ctx, det_ctx) != 0) {
+            return TM_ECODE_FAILED;
+        }
+        if (DetectRuleSampleThreadInit(de_ctx, det_ctx) != 0) {
+            return TM_ECODE_FAILED;
+        }
+    }
+
+    if (PacketAlertThreadInit(det_ctx) != 0) {
+        return TM_ECODE_FAILED;
     }
 
     /* byte_extract storage */
@@ -1322,6 +1500,10 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data)
      * rules haven't been loaded yet. */
     uint16_t counter_alerts = SCPerfTVRegisterCounter("detect.alert", tv,
                                                       SC_PERF_TYPE_UINT64, "NULL");
+    uint16_t counter_inspection_limit = SCPerfTVRegisterCounter(
+            "detect.inspection_limit", tv, SC_PERF_TYPE_UINT64, "NULL");
+    uint16_t counter_alert_queue_overflow = SCPerfTVRegisterCounter(
+            "detect.alert_queue_overflow", tv, SC_PERF_TYPE_UINT64, "NULL");
     if (de_ctx->delayed_detect == 1 && de_ctx->delayed_detect_initialized == 0) {
         *data = NULL;
         return TM_ECODE_OK;
@@ -1340,6 +1522,8 @@ TmEcode DetectEngineThreadCtxInit(ThreadVars *tv, void *initdata, void **data)
 
     /** alert counter setup */
     det_ctx->counter_alerts = counter_alerts;
+    det_ctx->counter_inspection_limit = counter_inspection_limit;
+    det_ctx->counter_alert_queue_overflow = counter_alert_queue_overflow;
 
     /* pass thread data back to caller */
     *data = (void *)det_ctx;
@@ -1376,6 +1560,10 @@ static TmEcode DetectEngineThreadCtxInitForLiveRuleSwap(ThreadVars *tv, void *in
     /** alert counter setup */
     det_ctx->counter_alerts = SCPerfTVRegisterCounter("detect.alert", tv,
                                                       SC_PERF_TYPE_UINT64, "NULL");
+    det_ctx->counter_inspection_limit = SCPerfTVRegisterCounter(
+            "detect.inspection_limit", tv, SC_PERF_TYPE_UINT64, "NULL");
+    det_ctx->counter_alert_queue_overflow = SCPerfTVRegisterCounter(
+            "detect.alert_queue_overflow", tv, SC_PERF_TYPE_UINT64, "NULL");
     /* no counter creation here */
 
     /* pass thread data back to caller */
@@ -1412,24 +1600,18 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *tv, void *data) {
 
     if (det_ctx->de_state_sig_array != NULL)
         SCFree(det_ctx->de_state_sig_array);
+    if (det_ctx->de_state_sig_marked != NULL)
+        SCFree(det_ctx->de_state_sig_marked);
     if (det_ctx->match_array != NULL)
         SCFree(det_ctx->match_array);
+    DetectPrefilterThreadDeinit(det_ctx);
+    DetectCandidatesThreadDeinit(det_ctx);
+    DetectRuleSampleThreadDeinit(det_ctx);
+    PacketAlertThreadDeinit(det_ctx);
 
     if (det_ctx->bj_values != NULL)
         SCFree(det_ctx->bj_values);
 
-    /* HHD temp storage */
-    for (i = 0; i < det_ctx->hhd_buffers_size; i++) {
-        if (det_ctx->hhd_buffers[i] != NULL)
-            SCFree(det_ctx->hhd_buffers[i]);
-    }
-    if (det_ctx->hhd_buffers)
-        SCFree(det_ctx->hhd_buffers);
-    det_ctx->hhd_buffers = NULL;
-    if (det_ctx->hhd_buffers_len)
-        SCFree(det_ctx->hhd_buffers_len);
-    det_ctx->hhd_buffers_len = NULL;
-
     /* HSBD */
     if (det_ctx->hsbd != NULL) {
         SCLogDebug("det_ctx hsbd %u", det_ctx->hsbd_buffers_size);
@@ -1519,7 +1701,7 @@ int DetectRegisterThreadCtxFuncs(DetectEngineCtx *de_ctx, const char *name, void
  *  \retval ctx or NULL on error
  */
 void *DetectThreadCtxGetKeywordThreadCtx(DetectEngineThreadCtx *det_ctx, int id) {
-    if (id < 0 || id > det_ctx->keyword_ctxs_size || det_ctx->keyword_ctxs_array == NULL)
+    if (id < 0 || id >= det_ctx->keyword_ctxs_size || det_ctx->keyword_ctxs_array == NULL)
         return NULL;
 
     return det_ctx->keyword_ctxs_array[id];
@@ -2170,6 +2352,179 @@ static int DetectEngineTest09(void)
     return result;
 }
 
+/**
+ * \test build the same ruleset with 1 and with 4 build threads, the
+ *       resulting engines need to behave the same.
+ */
+static int DetectEngineTest10(void)
+{
+    char *conf =
+        "%YAML 1.1\n"
+        "---\n"
+        "detect-engine:\n"
+        "  - build-threads: 4\n";
+
+    DetectEngineCtx *de_ctx[2] = { NULL, NULL };
+    DetectEngineThreadCtx *det_ctx[2] = { NULL, NULL };
+    ThreadVars th_v;
+    char sig[128];
+    char buf[32];
+    int result = 0;
+    int e, i;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    if (DetectEngineInitYamlConf(conf) == -1)
+        return 0;
+
+    for (e = 0; e < 2; e++) {
+        de_ctx[e] = DetectEngineCtxInit();
+        if (de_ctx[e] == NULL)
+            goto end;
+        if (de_ctx[e]->build_threads != 4) {
+            printf("build_threads %u, expected 4: ", de_ctx[e]->build_threads);
+            goto end;
+        }
+        if (e == 0)
+            de_ctx[e]->build_threads = 1;
+
+        for (i = 0; i < 40; i++) {
+            snprintf(sig, sizeof(sig), "alert tcp any any -> any %d "
+                     "(content:\"pattern%02d\"; content:\"common\"; sid:%d;)",
+                     1000 + i, i, i + 1);
+            if (DetectEngineAppendSig(de_ctx[e], sig) == NULL)
+                goto end;
+        }
+        SigGroupBuild(de_ctx[e]);
+        DetectEngineThreadCtxInit(&th_v, (void *)de_ctx[e], (void *)&det_ctx[e]);
+    }
+
+    for (i = 0; i < 40; i++) {
+        snprintf(buf, sizeof(buf), "xx pattern%02d common", i);
+        for (e = 0; e < 2; e++) {
+            Packet *p = UTHBuildPacketReal((uint8_t *)buf, strlen(buf),
+                    IPPROTO_TCP, "192.168.1.1", "1.2.3.4", 60000, 1000 + i);
+            if (p == NULL)
+                goto end;
+            SigMatchSignatures(&th_v, de_ctx[e], det_ctx[e], p);
+            int alerted = PacketAlertCheck(p, i + 1);
+            int cnt = p->alerts.cnt;
+            UTHFreePackets(&p, 1);
+            if (!alerted || cnt != 1) {
+                printf("engine %d: packet %d alerted %d cnt %d: ", e, i, alerted, cnt);
+                goto end;
+            }
+        }
+    }
+
+    result = 1;
+ end:
+    for (e = 0; e < 2; e++) {
+        if (det_ctx[e] != NULL)
+            DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx[e]);
+        if (de_ctx[e] != NULL) {
+            SigGroupCleanup(de_ctx[e]);
+            DetectEngineCtxFree(de_ctx[e]);
+        }
+    }
+    DetectEngineDeInitYamlConf();
+    return result;
+}
+
+static int DetectEngineTest11Cached(SigGroupHead *sgh)
+{
+    MpmCtx *mpm_ctx = sgh ? sgh->mpm_stream_ctx_ts : NULL;
+
+    return (mpm_ctx != NULL && mpm_ctx->mpm_type == MPM_AC &&
+            mpm_ctx->ctx != NULL && ((SCACCtx *)mpm_ctx->ctx)->cache_map != NULL);
+}
+
+/** \test second engine with the same rules loads its mpm ctxs from the mpm
+ *        cache the first one wrote, and alerts the same */
+static int DetectEngineTest11(void)
+{
+    char dir[] = "/tmp/suricata-mpm-cache-XXXXXX";
+    char conf[256];
+    DetectEngineCtx *de_ctx[2] = { NULL, NULL };
+    DetectEngineThreadCtx *det_ctx[2] = { NULL, NULL };
+    ThreadVars th_v;
+    char sig[128];
+    char buf[32];
+    int result = 0;
+    int e, i;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+    snprintf(conf, sizeof(conf),
+        "%%YAML 1.1\n"
+        "---\n"
+        "mpm-algo: ac\n"
+        "detect-engine:\n"
+        "  - mpm-cache-dir: %s\n", dir);
+
+    if (DetectEngineInitYamlConf(conf) == -1)
+        goto cleanup;
+
+    for (e = 0; e < 2; e++) {
+        de_ctx[e] = DetectEngineCtxInit();
+        if (de_ctx[e] == NULL)
+            goto end;
+        if (de_ctx[e]->mpm_cache_dir == NULL) {
+            printf("mpm cache dir not set: ");
+            goto end;
+        }
+
+        for (i = 0; i < 8; i++) {
+            snprintf(sig, sizeof(sig), "alert tcp any any -> any %d "
+                     "(content:\"pattern%02d\"; content:\"common\"; "
+                     "fast_pattern; sid:%d;)", 1000 + i, i, i + 1);
+            if (DetectEngineAppendSig(de_ctx[e], sig) == NULL)
+                goto end;
+        }
+        SigGroupBuild(de_ctx[e]);
+        DetectEngineThreadCtxInit(&th_v, (void *)de_ctx[e], (void *)&det_ctx[e]);
+    }
+
+    for (i = 0; i < 8; i++) {
+        snprintf(buf, sizeof(buf), "xx pattern%02d common", i);
+        for (e = 0; e < 2; e++) {
+            Packet *p = UTHBuildPacketReal((uint8_t *)buf, strlen(buf),
+                    IPPROTO_TCP, "192.168.1.1", "1.2.3.4", 60000, 1000 + i);
+            if (p == NULL)
+                goto end;
+            SigMatchSignatures(&th_v, de_ctx[e], det_ctx[e], p);
+            int alerted = PacketAlertCheck(p, i + 1);
+            int cnt = p->alerts.cnt;
+            /* only the second engine can find the ctxs in the cache */
+            int cached = DetectEngineTest11Cached(
+                    SigMatchSignaturesGetSgh(de_ctx[e], det_ctx[e], p));
+            UTHFreePackets(&p, 1);
+            if (!alerted || cnt != 1 || cached != e) {
+                printf("engine %d: packet %d alerted %d cnt %d cached %d: ",
+                       e, i, alerted, cnt, cached);
+                goto end;
+            }
+        }
+    }
+
+    result = 1;
+ end:
+    for (e = 0; e < 2; e++) {
+        if (det_ctx[e] != NULL)
+            DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx[e]);
+        if (de_ctx[e] != NULL) {
+            SigGroupCleanup(de_ctx[e]);
+            DetectEngineCtxFree(de_ctx[e]);
+        }
+    }
+    DetectEngineDeInitYamlConf();
+ cleanup:
+    SCACTestCacheClean(dir);
+    return result;
+}
+
 #endif
 
 void DetectEngineRegisterTests()
@@ -2185,6 +2540,8 @@ void DetectEngineRegisterTests()
     UtRegisterTest("DetectEngineTest07", DetectEngineTest07, 1);
     UtRegisterTest("DetectEngineTest08", DetectEngineTest08, 1);
     UtRegisterTest("DetectEngineTest09", DetectEngineTest09, 1);
+    UtRegisterTest("DetectEngineTest10", DetectEngineTest10, 1);
+    UtRegisterTest("DetectEngineTest11", DetectEngineTest11, 1);
 #endif
 
     return;
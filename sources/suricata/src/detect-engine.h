@@ -66,6 +66,13 @@ TmEcode DetectEngineThreadCtxDeinit(ThreadVars *, void *);
 /* faster as a macro than a inline function on my box -- VJ */
 #define DetectEngineGetMaxSigId(de_ctx) ((de_ctx)->signum)
 void DetectEngineResetMaxSigId(DetectEngineCtx *);
+
+/** upper limit for detect-engine.build-threads */
+#define DETECT_ENGINE_BUILD_THREADS_MAX 64
+
+typedef void (*DetectEngineBuildFunc)(DetectEngineCtx *, void *, uint32_t);
+void DetectEngineBuildRunParallel(DetectEngineCtx *, uint32_t,
+                                  DetectEngineBuildFunc, void *);
 void DetectEngineRegisterTests(void);
 const char *DetectSigmatchListEnumToString(enum DetectSigmatchListEnum type);
 
@@ -59,6 +59,8 @@ static pcre_extra *parse_regex_study;
 static int DetectFlagsMatch (ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
 static int DetectFlagsSetup (DetectEngineCtx *, Signature *, char *);
 static void DetectFlagsFree(void *);
+static int PrefilterFlagsGetValue(const Packet *, uint8_t *);
+static int PrefilterFlagsMatchValue(const SigMatch *, uint8_t);
 
 /**
  * \brief Registration function for flags: keyword
@@ -70,6 +72,8 @@ void DetectFlagsRegister (void) {
     sigmatch_table[DETECT_FLAGS].Setup = DetectFlagsSetup;
     sigmatch_table[DETECT_FLAGS].Free  = DetectFlagsFree;
     sigmatch_table[DETECT_FLAGS].RegisterTests = FlagsRegisterTests;
+    sigmatch_table[DETECT_FLAGS].PrefilterGetValue = PrefilterFlagsGetValue;
+    sigmatch_table[DETECT_FLAGS].PrefilterMatchValue = PrefilterFlagsMatchValue;
 
     const char *eb;
     int opts = 0;
@@ -94,6 +98,47 @@ error:
 
 }
 
+static inline int FlagsMatch(uint8_t pflags, const DetectFlagsData *de)
+{
+    if (!de->flags && pflags) {
+        if(de->modifier == MODIFIER_NOT) {
+            return 1;
+        }
+
+        return 0;
+    }
+
+    pflags &= de->ignored_flags;
+
+    switch (de->modifier) {
+        case MODIFIER_ANY:
+            if ((pflags & de->flags) > 0) {
+                return 1;
+            }
+            return 0;
+
+        case MODIFIER_PLUS:
+            if (((pflags & de->flags) == de->flags)) {
+                return 1;
+            }
+            return 0;
+
+        case MODIFIER_NOT:
+            if ((pflags & de->flags) != de->flags) {
+                return 1;
+            }
+            return 0;
+
+        default:
+            SCLogDebug("flags %"PRIu8" and de->flags %"PRIu8"",pflags,de->flags);
+            if (pflags == de->flags) {
+                return 1;
+            }
+    }
+
+    return 0;
+}
+
 /**
  * \internal
  * \brief This function is used to match flags on a packet with those passed via flags:
@@ -111,52 +156,27 @@ static int DetectFlagsMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Pack
 {
     SCEnter();
 
-    uint8_t flags = 0;
     DetectFlagsData *de = (DetectFlagsData *)m->ctx;
 
     if (!(PKT_IS_TCP(p)) || PKT_IS_PSEUDOPKT(p)) {
         SCReturnInt(0);
     }
 
-    flags = p->tcph->th_flags;
-
-    if (!de->flags && flags) {
-        if(de->modifier == MODIFIER_NOT) {
-            SCReturnInt(1);
-        }
-
-        SCReturnInt(0);
-    }
-
-    flags &= de->ignored_flags;
-
-    switch (de->modifier) {
-        case MODIFIER_ANY:
-            if ((flags & de->flags) > 0) {
-                SCReturnInt(1);
-            }
-            SCReturnInt(0);
-
-        case MODIFIER_PLUS:
-            if (((flags & de->flags) == de->flags)) {
-                SCReturnInt(1);
-            }
-            SCReturnInt(0);
+    SCReturnInt(FlagsMatch(p->tcph->th_flags, de));
+}
 
-        case MODIFIER_NOT:
-            if ((flags & de->flags) != de->flags) {
-                SCReturnInt(1);
-            }
-            SCReturnInt(0);
+static int PrefilterFlagsGetValue(const Packet *p, uint8_t *value)
+{
+    if (!(PKT_IS_TCP(p)) || PKT_IS_PSEUDOPKT(p))
+        return 0;
 
-        default:
-            SCLogDebug("flags %"PRIu8" and de->flags %"PRIu8"",flags,de->flags);
-            if (flags == de->flags) {
-                SCReturnInt(1);
-            }
-    }
+    *value = p->tcph->th_flags;
+    return 1;
+}
 
-    SCReturnInt(0);
+static int PrefilterFlagsMatchValue(const SigMatch *sm, uint8_t value)
+{
+    return FlagsMatch(value, (const DetectFlagsData *)sm->ctx);
 }
 
 /**
@@ -734,7 +734,7 @@ static int FlowBitsTestSig06(void) {
     DetectEngineThreadCtx *det_ctx = NULL;
     DetectEngineCtx *de_ctx = NULL;
     Flow f;
-    GenericVar flowvar, *gv = NULL;
+    GenericVar flowvar;
     int result = 0;
     int idx = 0;
 
@@ -776,13 +776,8 @@ static int FlowBitsTestSig06(void) {
 
     idx = VariableNameGetIdx(de_ctx, "myflow", DETECT_FLOWBITS);
 
-    gv = p->flow->flowvar;
-
-    for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
-                result = 1;
-        }
-    }
+    if (FlowBitIsset(p->flow, idx))
+        result = 1;
 
     SigGroupCleanup(de_ctx);
     SigCleanSignatures(de_ctx);
@@ -790,7 +785,6 @@ static int FlowBitsTestSig06(void) {
     DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
     DetectEngineCtxFree(de_ctx);
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
 
     SCFree(p);
@@ -810,7 +804,6 @@ end:
         DetectEngineCtxFree(de_ctx);
     }
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
     SCFree(p);
     return result;
@@ -837,7 +830,7 @@ static int FlowBitsTestSig07(void) {
     DetectEngineThreadCtx *det_ctx = NULL;
     DetectEngineCtx *de_ctx = NULL;
     Flow f;
-    GenericVar flowvar, *gv = NULL;
+    GenericVar flowvar;
     int result = 0;
     int idx = 0;
 
@@ -881,13 +874,8 @@ static int FlowBitsTestSig07(void) {
 
     idx = VariableNameGetIdx(de_ctx, "myflow", DETECT_FLOWBITS);
 
-    gv = p->flow->flowvar;
-
-    for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
-                result = 1;
-        }
-    }
+    if (FlowBitIsset(p->flow, idx))
+        result = 1;
 
     SigGroupCleanup(de_ctx);
     SigCleanSignatures(de_ctx);
@@ -895,7 +883,6 @@ static int FlowBitsTestSig07(void) {
     DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
     DetectEngineCtxFree(de_ctx);
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
 
     SCFree(p);
@@ -915,7 +902,6 @@ end:
         DetectEngineCtxFree(de_ctx);
     }
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
 
     SCFree(p);
@@ -943,7 +929,7 @@ static int FlowBitsTestSig08(void) {
     DetectEngineThreadCtx *det_ctx = NULL;
     DetectEngineCtx *de_ctx = NULL;
     Flow f;
-    GenericVar flowvar, *gv = NULL;
+    GenericVar flowvar;
     int result = 0;
     int idx = 0;
 
@@ -989,13 +975,8 @@ static int FlowBitsTestSig08(void) {
 
     idx = VariableNameGetIdx(de_ctx, "myflow", DETECT_FLOWBITS);
 
-    gv = p->flow->flowvar;
-
-    for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
-                result = 1;
-        }
-    }
+    if (FlowBitIsset(p->flow, idx))
+        result = 1;
 
     SigGroupCleanup(de_ctx);
     SigCleanSignatures(de_ctx);
@@ -1003,7 +984,6 @@ static int FlowBitsTestSig08(void) {
     DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
     DetectEngineCtxFree(de_ctx);
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
 
     SCFree(p);
@@ -1023,7 +1003,6 @@ end:
         DetectEngineCtxFree(de_ctx);
     }
 
-    if(gv) GenericVarFree(gv);
     FLOW_DESTROY(&f);
 
     SCFree(p);
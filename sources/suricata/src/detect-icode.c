@@ -49,6 +49,8 @@ int DetectICodeMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature
 static int DetectICodeSetup(DetectEngineCtx *, Signature *, char *);
 void DetectICodeRegisterTests(void);
 void DetectICodeFree(void *);
+static int PrefilterICodeGetValue(const Packet *, uint8_t *);
+static int PrefilterICodeMatchValue(const SigMatch *, uint8_t);
 
 
 /**
@@ -62,6 +64,8 @@ void DetectICodeRegister (void) {
     sigmatch_table[DETECT_ICODE].Setup = DetectICodeSetup;
     sigmatch_table[DETECT_ICODE].Free = DetectICodeFree;
     sigmatch_table[DETECT_ICODE].RegisterTests = DetectICodeRegisterTests;
+    sigmatch_table[DETECT_ICODE].PrefilterGetValue = PrefilterICodeGetValue;
+    sigmatch_table[DETECT_ICODE].PrefilterMatchValue = PrefilterICodeMatchValue;
 
     const char *eb;
     int eo;
@@ -86,6 +90,28 @@ error:
     return;
 }
 
+static inline int ICodeMatch(const uint8_t picode, const DetectICodeData *icd)
+{
+    int ret = 0;
+
+    switch(icd->mode) {
+        case DETECT_ICODE_EQ:
+            ret = (picode == icd->code1) ? 1 : 0;
+            break;
+        case DETECT_ICODE_LT:
+            ret = (picode < icd->code1) ? 1 : 0;
+            break;
+        case DETECT_ICODE_GT:
+            ret = (picode > icd->code1) ? 1 : 0;
+            break;
+        case DETECT_ICODE_RN:
+            ret = (picode >= icd->code1 && picode <= icd->code2) ? 1 : 0;
+            break;
+    }
+
+    return ret;
+}
+
 /**
  * \brief This function is used to match icode rule option set on a packet with those passed via icode:
  *
@@ -98,38 +124,34 @@ error:
  * \retval 1 match
  */
 int DetectICodeMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Packet *p, Signature *s, SigMatch *m) {
-    int ret = 0;
     uint8_t picode;
     DetectICodeData *icd = (DetectICodeData *)m->ctx;
 
+    if (PrefilterICodeGetValue(p, &picode) == 0)
+        return 0;
+
+    return ICodeMatch(picode, icd);
+}
+
+static int PrefilterICodeGetValue(const Packet *p, uint8_t *value)
+{
     if (PKT_IS_PSEUDOPKT(p))
         return 0;
 
     if (PKT_IS_ICMPV4(p)) {
-        picode = ICMPV4_GET_CODE(p);
+        *value = ICMPV4_GET_CODE(p);
     } else if (PKT_IS_ICMPV6(p)) {
-        picode = ICMPV6_GET_CODE(p);
+        *value = ICMPV6_GET_CODE(p);
     } else {
         /* Packet not ICMPv4 nor ICMPv6 */
-        return ret;
-    }
-
-    switch(icd->mode) {
-        case DETECT_ICODE_EQ:
-            ret = (picode == icd->code1) ? 1 : 0;
-            break;
-        case DETECT_ICODE_LT:
-            ret = (picode < icd->code1) ? 1 : 0;
-            break;
-        case DETECT_ICODE_GT:
-            ret = (picode > icd->code1) ? 1 : 0;
-            break;
-        case DETECT_ICODE_RN:
-            ret = (picode >= icd->code1 && picode <= icd->code2) ? 1 : 0;
-            break;
+        return 0;
     }
+    return 1;
+}
 
-    return ret;
+static int PrefilterICodeMatchValue(const SigMatch *sm, uint8_t value)
+{
+    return ICodeMatch(value, (const DetectICodeData *)sm->ctx);
 }
 
 /**
@@ -49,6 +49,8 @@ int DetectITypeMatch(ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature
 static int DetectITypeSetup(DetectEngineCtx *, Signature *, char *);
 void DetectITypeRegisterTests(void);
 void DetectITypeFree(void *);
+static int PrefilterITypeGetValue(const Packet *, uint8_t *);
+static int PrefilterITypeMatchValue(const SigMatch *, uint8_t);
 
 
 /**
@@ -62,6 +64,8 @@ void DetectITypeRegister (void) {
     sigmatch_table[DETECT_ITYPE].Setup = DetectITypeSetup;
     sigmatch_table[DETECT_ITYPE].Free = DetectITypeFree;
     sigmatch_table[DETECT_ITYPE].RegisterTests = DetectITypeRegisterTests;
+    sigmatch_table[DETECT_ITYPE].PrefilterGetValue = PrefilterITypeGetValue;
+    sigmatch_table[DETECT_ITYPE].PrefilterMatchValue = PrefilterITypeMatchValue;
 
     const char *eb;
     int eo;
@@ -86,6 +90,28 @@ error:
     return;
 }
 
+static inline int ITypeMatch(const uint8_t pitype, const DetectITypeData *itd)
+{
+    int ret = 0;
+
+    switch(itd->mode) {
+        case DETECT_ITYPE_EQ:
+            ret = (pitype == itd->type1) ? 1 : 0;
+            break;
+        case DETECT_ITYPE_LT:
+            ret = (pitype < itd->type1) ? 1 : 0;
+            break;
+        case DETECT_ITYPE_GT:
+            ret = (pitype > itd->type1) ? 1 : 0;
+            break;
+        case DETECT_ITYPE_RN:
+            ret = (pitype > itd->type1 && pitype < itd->type2) ? 1 : 0;
+            break;
+    }
+
+    return ret;
+}
+
 /**
  * \brief This function is used to match itype rule option set on a packet with those passed via itype:
  *
@@ -98,38 +124,34 @@ error:
  * \retval 1 match
  */
 int DetectITypeMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Packet *p, Signature *s, SigMatch *m) {
-    int ret = 0;
     uint8_t pitype;
     DetectITypeData *itd = (DetectITypeData *)m->ctx;
 
+    if (PrefilterITypeGetValue(p, &pitype) == 0)
+        return 0;
+
+    return ITypeMatch(pitype, itd);
+}
+
+static int PrefilterITypeGetValue(const Packet *p, uint8_t *value)
+{
     if (PKT_IS_PSEUDOPKT(p))
         return 0;
 
     if (PKT_IS_ICMPV4(p)) {
-        pitype = ICMPV4_GET_TYPE(p);
+        *value = ICMPV4_GET_TYPE(p);
     } else if (PKT_IS_ICMPV6(p)) {
-        pitype = ICMPV6_GET_TYPE(p);
+        *value = ICMPV6_GET_TYPE(p);
     } else {
         /* Packet not ICMPv4 nor ICMPv6 */
-        return ret;
-    }
-
-    switch(itd->mode) {
-        case DETECT_ITYPE_EQ:
-            ret = (pitype == itd->type1) ? 1 : 0;
-            break;
-        case DETECT_ITYPE_LT:
-            ret = (pitype < itd->type1) ? 1 : 0;
-            break;
-        case DETECT_ITYPE_GT:
-            ret = (pitype > itd->type1) ? 1 : 0;
-            break;
-        case DETECT_ITYPE_RN:
-            ret = (pitype > itd->type1 && pitype < itd->type2) ? 1 : 0;
-            break;
+        return 0;
     }
+    return 1;
+}
 
-    return ret;
+static int PrefilterITypeMatchValue(const SigMatch *sm, uint8_t value)
+{
+    return ITypeMatch(value, (const DetectITypeData *)sm->ctx);
 }
 
 /**
@@ -32,6 +32,7 @@
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
 #include "detect-engine-state.h"
+#include "detect-engine-content-inspection.h"
 
 #include "detect-content.h"
 #include "detect-pcre.h"
@@ -969,6 +970,8 @@ void SigFree(Signature *s) {
         SCFree(s->addr_dst_match6);
     }
 
+    DetectEngineContentInspectionFreeSig(s);
+
     SigRefFree(s);
 
     SCFree(s);
@@ -1534,6 +1537,9 @@ static Signature *SigInitHelper(DetectEngineCtx *de_ctx, char *sigstr,
         goto error;
     }
 
+    if (DetectPcreSetupPrefilter(sig) < 0)
+        goto error;
+
     return sig;
 
 error:
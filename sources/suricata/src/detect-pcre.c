@@ -34,6 +34,7 @@
 
 #include "detect-pcre.h"
 #include "detect-flowvar.h"
+#include "detect-content.h"
 
 #include "detect-parse.h"
 #include "detect-engine.h"
@@ -47,6 +48,9 @@
 #include "util-unittest.h"
 #include "util-print.h"
 #include "util-pool.h"
+#include "util-misc.h"
+#include "util-cpu.h"
+#include "util-spm-bm.h"
 
 #include "conf.h"
 #include "app-layer.h"
@@ -68,8 +72,43 @@
 #define SC_MATCH_LIMIT_DEFAULT 3500
 #define SC_MATCH_LIMIT_RECURSION_DEFAULT 1500
 
+/* the jit stack of each thread grows from the min up to jit-stack-size */
+#define DETECT_PCRE_JIT_STACK_MIN       (32 * 1024)
+#define DETECT_PCRE_JIT_STACK_DEFAULT   (512 * 1024)
+
+/** number of the most expensive pcres logged at exit */
+#define DETECT_PCRE_STATS_LOG_MAX       10
+/** pcres returned by the "pcre-stats" unix socket command by default */
+#define DETECT_PCRE_STATS_DUMP_DEFAULT  20
+
+/* literals shorter than this make poor mpm patterns */
+#define DETECT_PCRE_PREFILTER_MIN_LEN   3
+/* the longest content we support */
+#define DETECT_PCRE_PREFILTER_MAX_LEN   255
+#define DETECT_PCRE_PREFILTER_MAX_DEPTH 16
+
 static int pcre_match_limit = 0;
 static int pcre_match_limit_recursion = 0;
+static int pcre_prefilter = 1;
+
+#if defined(PCRE_HAVE_JIT) && defined(TLS)
+#define DETECT_PCRE_JIT_STACK
+static uint32_t pcre_jit_stack_size = DETECT_PCRE_JIT_STACK_DEFAULT;
+
+/** the jit stack of the thread running pcre_exec. The pcre_extra of a
+ *  pcre is shared by all threads, so its jit stack callback returns this */
+static __thread pcre_jit_stack *pcre_jit_stack_cur = NULL;
+
+static pcre_jit_stack *DetectPcreJitStackCallback(void *data)
+{
+    return pcre_jit_stack_cur;
+}
+#endif
+
+/** thread data of the running detect threads, for DetectPcreStatsGet().
+ *  The lock protects the list, not the counters. */
+static DetectPcreThreadData *pcre_thread_list = NULL;
+static SCMutex pcre_thread_list_m = SCMUTEX_INITIALIZER;
 
 static pcre *parse_regex;
 static pcre_extra *parse_regex_study;
@@ -130,6 +169,26 @@ void DetectPcreRegister (void)
         }
     }
 
+    if (ConfGetBool("pcre.prefilter", &pcre_prefilter) != 1)
+        pcre_prefilter = 1;
+    SCLogDebug("pcre prefilter extraction %s", pcre_prefilter ? "enabled" : "disabled");
+
+#ifdef DETECT_PCRE_JIT_STACK
+    char *jit_stack_size = NULL;
+    if (ConfGet("pcre.jit-stack-size", &jit_stack_size) == 1 && jit_stack_size != NULL) {
+        if (ParseSizeStringU32(jit_stack_size, &pcre_jit_stack_size) < 0 ||
+            pcre_jit_stack_size < DETECT_PCRE_JIT_STACK_MIN) {
+            SCLogError(SC_ERR_SIZE_PARSE, "invalid pcre.jit-stack-size \"%s\", "
+                    "using the default of %u", jit_stack_size,
+                    DETECT_PCRE_JIT_STACK_DEFAULT);
+            pcre_jit_stack_size = DETECT_PCRE_JIT_STACK_DEFAULT;
+        } else {
+            SCLogInfo("Using PCRE jit-stack-size setting of: %"PRIu32,
+                    pcre_jit_stack_size);
+        }
+    }
+#endif
+
     parse_regex = pcre_compile(PARSE_REGEX, opts, &eb, &eo, NULL);
     if(parse_regex == NULL)
     {
@@ -192,6 +251,11 @@ int DetectPcrePayloadMatch(DetectEngineThreadCtx *det_ctx, Signature *s,
     uint16_t capture_len = 0;
 
     DetectPcreData *pe = (DetectPcreData *)sm->ctx;
+    DetectPcreThreadData *tpe = (DetectPcreThreadData *)
+        DetectThreadCtxGetKeywordThreadCtx(det_ctx, pe->thread_ctx_id);
+    DetectPcreStats *stats = NULL;
+    if (tpe != NULL && pe->idx < tpe->stats_cnt)
+        stats = &tpe->stats[pe->idx];
 
     if (pe->flags & DETECT_PCRE_RELATIVE) {
         ptr = payload + det_ctx->buffer_offset;
@@ -206,8 +270,20 @@ int DetectPcrePayloadMatch(DetectEngineThreadCtx *det_ctx, Signature *s,
         start_offset = (payload + det_ctx->pcre_match_start_offset - ptr);
     }
 
+#ifdef DETECT_PCRE_JIT_STACK
+    pcre_jit_stack_cur = (tpe != NULL) ? tpe->jit_stack : NULL;
+#endif
+#ifdef PROFILING
+    uint64_t pcre_ticks = UtilCpuGetTicks();
+#endif
     /* run the actual pcre detection */
     ret = pcre_exec(pe->re, pe->sd, (char *)ptr, len, start_offset, 0, ov, MAX_SUBSTRINGS);
+    if (stats != NULL) {
+        stats->calls++;
+#ifdef PROFILING
+        stats->ticks += UtilCpuGetTicks() - pcre_ticks;
+#endif
+    }
     SCLogDebug("ret %d (negating %s)", ret, (pe->flags & DETECT_PCRE_NEGATE) ? "set" : "not set");
 
     if (ret == PCRE_ERROR_NOMATCH) {
@@ -259,7 +335,17 @@ int DetectPcrePayloadMatch(DetectEngineThreadCtx *det_ctx, Signature *s,
         }
 
     } else {
-        SCLogDebug("pcre had matching error");
+        SCLogDebug("pcre had matching error %d", ret);
+        if (stats != NULL) {
+            if (ret == PCRE_ERROR_MATCHLIMIT)
+                stats->match_limit++;
+            else if (ret == PCRE_ERROR_RECURSIONLIMIT)
+                stats->recursion_limit++;
+#ifdef PCRE_ERROR_JIT_STACKLIMIT
+            else if (ret == PCRE_ERROR_JIT_STACKLIMIT)
+                stats->jit_stack_limit++;
+#endif
+        }
         ret = 0;
     }
     SCReturnInt(ret);
@@ -273,6 +359,291 @@ static int DetectPcreSetList(int list, int set) {
     return set;
 }
 
+/** \internal
+ *  \brief the literal being built and the longest one found so far */
+typedef struct DetectPcreLiteral_ {
+    uint8_t cur[DETECT_PCRE_PREFILTER_MAX_LEN];
+    uint16_t cur_len;
+    uint8_t best[DETECT_PCRE_PREFILTER_MAX_LEN];
+    uint16_t best_len;
+} DetectPcreLiteral;
+
+static void DetectPcreLiteralEnd(DetectPcreLiteral *l)
+{
+    if (l->cur_len > l->best_len) {
+        memcpy(l->best, l->cur, l->cur_len);
+        l->best_len = l->cur_len;
+    }
+    l->cur_len = 0;
+}
+
+static void DetectPcreLiteralAdd(DetectPcreLiteral *l, uint8_t c)
+{
+    if (l->cur_len == DETECT_PCRE_PREFILTER_MAX_LEN)
+        DetectPcreLiteralEnd(l);
+    l->cur[l->cur_len++] = c;
+}
+
+static int DetectPcreHexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/** \internal
+ *  \brief Parse the quantifier at re[*pos], if any.
+ *
+ *  \retval -1 no quantifier
+ *  \retval min the minimum number of repeats
+ */
+static int DetectPcreLiteralQuantifier(const char *re, size_t *pos)
+{
+    size_t i = *pos;
+    int min;
+
+    switch (re[i]) {
+        case '*':
+        case '?':
+            min = 0;
+            i++;
+            break;
+        case '+':
+            min = 1;
+            i++;
+            break;
+        case '{':
+            if (!isdigit((unsigned char)re[i + 1]))
+                return -1;
+            min = 0;
+            for (i++; isdigit((unsigned char)re[i]); i++)
+                min = (min < 1000) ? min * 10 + (re[i] - '0') : min;
+            if (re[i] == ',') {
+                for (i++; isdigit((unsigned char)re[i]); i++)
+                    ;
+            }
+            if (re[i] != '}')
+                return -1;
+            i++;
+            break;
+        default:
+            return -1;
+    }
+
+    /* lazy or possessive */
+    if (re[i] == '?' || re[i] == '+')
+        i++;
+    *pos = i;
+    return min;
+}
+
+/** \internal
+ *  \brief Find the literals that every match of the sequence at re[*pos]
+ *         contains, up to the ')' that closes it or the end of re.
+ *
+ *  Constructs that match anything other than a known byte end the
+ *  literal being built. A sequence with alternatives requires none of
+ *  them. Constructs that can't be skipped reliably fail the analysis.
+ *
+ *  \retval 0 ok, l->best_len is the longest literal, *pos is at the end
+ *  \retval -1 the regex couldn't be analyzed
+ */
+static int DetectPcreLiteralSeq(const char *re, size_t *pos, DetectPcreLiteral *l,
+                                int depth)
+{
+    size_t i = *pos;
+    int alt = 0;
+
+    if (depth > DETECT_PCRE_PREFILTER_MAX_DEPTH)
+        return -1;
+
+    while (re[i] != '\0' && re[i] != ')') {
+        int byte = -1;      /* the literal byte the atom matches */
+        int zero_width = 0;
+        DetectPcreLiteral group;
+        int group_ok = 0;
+        int lookaround = 0;
+
+        switch (re[i]) {
+            case '|':
+                /* none of the alternatives' literals is required */
+                alt = 1;
+                DetectPcreLiteralEnd(l);
+                i++;
+                continue;
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                /* nothing to repeat, or a literal '{' */
+                return -1;
+            case '^':
+            case '$':
+                zero_width = 1;
+                i++;
+                break;
+            case '.':
+                i++;
+                break;
+            case '[':
+                i++;
+                if (re[i] == '^')
+                    i++;
+                if (re[i] == ']')
+                    i++;
+                while (re[i] != ']') {
+                    if (re[i] == '\0')
+                        return -1;
+                    if (re[i] == '\\') {
+                        if (re[i + 1] == '\0')
+                            return -1;
+                        i += 2;
+                    } else if (re[i] == '[' && re[i + 1] == ':') {
+                        const char *end = strstr(re + i + 2, ":]");
+                        if (end == NULL)
+                            return -1;
+                        i = (end - re) + 2;
+                    } else {
+                        i++;
+                    }
+                }
+                i++;
+                break;
+            case '(':
+                i++;
+                if (re[i] == '?') {
+                    if (re[i + 1] == ':' || re[i + 1] == '>') {
+                        i += 2;
+                    } else if (re[i + 1] == '=' || re[i + 1] == '!') {
+                        lookaround = 1;
+                        i += 2;
+                    } else if (re[i + 1] == '<' && (re[i + 2] == '=' || re[i + 2] == '!')) {
+                        lookaround = 1;
+                        i += 3;
+                    } else if ((re[i + 1] == 'P' && re[i + 2] == '<') ||
+                               (re[i + 1] == '<' && re[i + 2] != '=' && re[i + 2] != '!')) {
+                        const char *end = strchr(re + i, '>');
+                        if (end == NULL)
+                            return -1;
+                        i = (end - re) + 1;
+                    } else {
+                        /* inline options, conditionals, ... */
+                        return -1;
+                    }
+                }
+                memset(&group, 0, sizeof(group));
+                if (DetectPcreLiteralSeq(re, &i, &group, depth + 1) < 0)
+                    return -1;
+                if (re[i] != ')')
+                    return -1;
+                i++;
+                /* what a lookaround looks at isn't part of the match */
+                if (lookaround)
+                    zero_width = 1;
+                else
+                    group_ok = 1;
+                break;
+            case '\\': {
+                char e = re[i + 1];
+                if (e == '\0')
+                    return -1;
+                i += 2;
+                switch (e) {
+                    case 'n': byte = '\n'; break;
+                    case 'r': byte = '\r'; break;
+                    case 't': byte = '\t'; break;
+                    case 'f': byte = '\f'; break;
+                    case 'e': byte = 0x1b; break;
+                    case 'a': byte = 0x07; break;
+                    case 'x': {
+                        int h = DetectPcreHexValue(re[i]);
+                        if (h < 0)
+                            return -1;
+                        byte = h;
+                        i++;
+                        h = DetectPcreHexValue(re[i]);
+                        if (h >= 0) {
+                            byte = byte * 16 + h;
+                            i++;
+                        }
+                        break;
+                    }
+                    case 'd': case 'D': case 'w': case 'W': case 's':
+                    case 'S': case 'h': case 'H': case 'v': case 'V':
+                        break;
+                    case 'b': case 'B': case 'A': case 'z': case 'Z':
+                    case 'G':
+                        zero_width = 1;
+                        break;
+                    default:
+                        /* backreferences, properties, \Q..\E, ... */
+                        if (isalnum((unsigned char)e))
+                            return -1;
+                        byte = (uint8_t)e;
+                        break;
+                }
+                break;
+            }
+            default:
+                byte = (uint8_t)re[i];
+                i++;
+                break;
+        }
+
+        int min = DetectPcreLiteralQuantifier(re, &i);
+        if (zero_width) {
+            if (min != -1)
+                return -1;
+            DetectPcreLiteralEnd(l);
+        } else if (byte >= 0 && min == -1) {
+            DetectPcreLiteralAdd(l, (uint8_t)byte);
+        } else if (byte >= 0) {
+            /* the byte is there at least once if it has to be */
+            if (min > 0)
+                DetectPcreLiteralAdd(l, (uint8_t)byte);
+            DetectPcreLiteralEnd(l);
+        } else {
+            DetectPcreLiteralEnd(l);
+            /* a group that has to match brings its literals */
+            if (group_ok && min != 0 && group.best_len > l->best_len) {
+                memcpy(l->best, group.best, group.best_len);
+                l->best_len = group.best_len;
+            }
+        }
+    }
+
+    DetectPcreLiteralEnd(l);
+    if (alt)
+        l->best_len = 0;
+    *pos = i;
+    return 0;
+}
+
+/** \internal
+ *  \brief Find the longest literal every match of a regex contains.
+ *
+ *  \param re the regex, without delimiters and modifiers
+ *  \param lit buffer of DETECT_PCRE_PREFILTER_MAX_LEN bytes for the literal
+ *
+ *  \retval len length of the literal, 0 if none was found
+ */
+static uint16_t DetectPcreExtractLiteral(const char *re, uint8_t *lit)
+{
+    DetectPcreLiteral l;
+    size_t pos = 0;
+
+    memset(&l, 0, sizeof(l));
+    if (DetectPcreLiteralSeq(re, &pos, &l, 0) < 0 || re[pos] != '\0')
+        return 0;
+
+    memcpy(lit, l.best, l.best_len);
+    return l.best_len;
+}
+
 static DetectPcreData *DetectPcreParse (DetectEngineCtx *de_ctx, char *regexstr, int *sm_list)
 {
     int ec;
@@ -330,6 +701,7 @@ static DetectPcreData *DetectPcreParse (DetectEngineCtx *de_ctx, char *regexstr,
     if (unlikely(pd == NULL))
         goto error;
     memset(pd, 0, sizeof(DetectPcreData));
+    pd->thread_ctx_id = -1;
 
     if (negate)
         pd->flags |= DETECT_PCRE_NEGATE;
@@ -504,6 +876,24 @@ static DetectPcreData *DetectPcreParse (DetectEngineCtx *de_ctx, char *regexstr,
         SCLogError(SC_ERR_PCRE_COMPILE, "pcre compile of \"%s\" failed at offset %" PRId32 ": %s", regexstr, eo, eb);
         goto error;
     }
+
+    /* a literal every match contains can be a fast pattern for the sig.
+     * Raw bytes aren't inspected by the mpm and extended regexes have
+     * whitespace and comments we don't parse. */
+    if (pcre_prefilter && !negate && !(opts & PCRE_EXTENDED) &&
+        !(pd->flags & DETECT_PCRE_RAWBYTES))
+    {
+        uint8_t lit[DETECT_PCRE_PREFILTER_MAX_LEN];
+        uint16_t lit_len = DetectPcreExtractLiteral(re, lit);
+
+        if (lit_len >= DETECT_PCRE_PREFILTER_MIN_LEN) {
+            pd->prefilter = SCMalloc(lit_len);
+            if (unlikely(pd->prefilter == NULL))
+                goto error;
+            memcpy(pd->prefilter, lit, lit_len);
+            pd->prefilter_len = lit_len;
+        }
+    }
 #ifdef PCRE_HAVE_JIT
     pd->sd = pcre_study(pd->re, PCRE_STUDY_JIT_COMPILE, &eb);
     if(eb != NULL)  {
@@ -521,6 +911,11 @@ static DetectPcreData *DetectPcreParse (DetectEngineCtx *de_ctx, char *regexstr,
                 "Falling back to regular PCRE handling (%s:%d)",
                 regexstr, de_ctx->rule_file, de_ctx->rule_line);
     }
+#ifdef DETECT_PCRE_JIT_STACK
+    else {
+        pcre_assign_jit_stack(pd->sd, DetectPcreJitStackCallback, NULL);
+    }
+#endif
 #else
     pd->sd = pcre_study(pd->re, 0, &eb);
     if(eb != NULL)  {
@@ -563,6 +958,8 @@ error:
         pcre_free(pd->re);
     if (pd != NULL && pd->sd != NULL)
         pcre_free(pd->sd);
+    if (pd != NULL && pd->prefilter != NULL)
+        SCFree(pd->prefilter);
     if (pd)
         SCFree(pd);
     return NULL;
@@ -635,6 +1032,444 @@ error:
     return -1;
 }
 
+/** \internal
+ *  \brief note the rule of each pcre keyword, so the stats of a running
+ *         thread can be reported without looking at the sigs
+ */
+static void DetectPcreThreadSetupSigs(DetectPcreThreadData *t)
+{
+    DetectPcreCtx *ctx = t->ctx;
+    Signature *s;
+    int list;
+
+    t->sigs = SCMalloc(ctx->cnt * sizeof(DetectPcreStatsSig));
+    if (unlikely(t->sigs == NULL))
+        return;
+    memset(t->sigs, 0x00, ctx->cnt * sizeof(DetectPcreStatsSig));
+
+    for (s = ctx->de_ctx->sig_list; s != NULL; s = s->next) {
+        for (list = 0; list < DETECT_SM_LIST_MAX; list++) {
+            SigMatch *sm;
+            for (sm = s->sm_lists[list]; sm != NULL; sm = sm->next) {
+                if (sm->type != DETECT_PCRE)
+                    continue;
+
+                DetectPcreData *pd = (DetectPcreData *)sm->ctx;
+                if (pd->idx >= ctx->cnt)
+                    continue;
+                t->sigs[pd->idx].gid = s->gid;
+                t->sigs[pd->idx].sid = s->id;
+                t->sigs[pd->idx].rev = s->rev;
+                t->sigs[pd->idx].sm_idx = sm->idx;
+            }
+        }
+    }
+}
+
+static void *DetectPcreThreadInit(void *data)
+{
+    DetectPcreCtx *ctx = (DetectPcreCtx *)data;
+    BUG_ON(ctx == NULL);
+
+    DetectPcreThreadData *t = SCMalloc(sizeof(DetectPcreThreadData));
+    if (unlikely(t == NULL))
+        return NULL;
+    memset(t, 0x00, sizeof(DetectPcreThreadData));
+    t->ctx = ctx;
+
+    if (ctx->cnt > 0) {
+        t->stats = SCMalloc(ctx->cnt * sizeof(DetectPcreStats));
+        if (unlikely(t->stats == NULL)) {
+            SCFree(t);
+            return NULL;
+        }
+        memset(t->stats, 0x00, ctx->cnt * sizeof(DetectPcreStats));
+        t->stats_cnt = ctx->cnt;
+
+        DetectPcreThreadSetupSigs(t);
+
+        SCMutexLock(&pcre_thread_list_m);
+        t->next = pcre_thread_list;
+        pcre_thread_list = t;
+        SCMutexUnlock(&pcre_thread_list_m);
+    }
+
+#ifdef DETECT_PCRE_JIT_STACK
+    t->jit_stack = pcre_jit_stack_alloc(DETECT_PCRE_JIT_STACK_MIN, pcre_jit_stack_size);
+    if (t->jit_stack == NULL) {
+        SCLogWarning(SC_ERR_MEM_ALLOC, "couldn't alloc the pcre jit stack, "
+                "pcre will use the small default stack");
+    }
+#endif
+    return t;
+}
+
+/** \brief add the thread's stats to the detection engine's and free it */
+static void DetectPcreThreadFree(void *ctx)
+{
+    DetectPcreThreadData *t = (DetectPcreThreadData *)ctx;
+    uint32_t u;
+
+    if (t == NULL)
+        return;
+
+    if (t->stats != NULL) {
+        DetectPcreCtx *pctx = t->ctx;
+        DetectPcreThreadData **prev;
+
+        SCMutexLock(&pcre_thread_list_m);
+        for (prev = &pcre_thread_list; *prev != NULL; prev = &(*prev)->next) {
+            if (*prev == t) {
+                *prev = t->next;
+                break;
+            }
+        }
+        SCMutexUnlock(&pcre_thread_list_m);
+
+        SCMutexLock(&pctx->lock);
+        if (pctx->stats == NULL) {
+            pctx->stats = SCMalloc(pctx->cnt * sizeof(DetectPcreStats));
+            if (pctx->stats != NULL)
+                memset(pctx->stats, 0x00, pctx->cnt * sizeof(DetectPcreStats));
+        }
+        if (pctx->stats != NULL) {
+            for (u = 0; u < t->stats_cnt; u++) {
+                pctx->stats[u].calls += t->stats[u].calls;
+                pctx->stats[u].ticks += t->stats[u].ticks;
+                pctx->stats[u].match_limit += t->stats[u].match_limit;
+                pctx->stats[u].recursion_limit += t->stats[u].recursion_limit;
+                pctx->stats[u].jit_stack_limit += t->stats[u].jit_stack_limit;
+            }
+        }
+        SCMutexUnlock(&pctx->lock);
+        SCFree(t->stats);
+    }
+    if (t->sigs != NULL)
+        SCFree(t->sigs);
+
+#ifdef DETECT_PCRE_JIT_STACK
+    if (t->jit_stack != NULL)
+        pcre_jit_stack_free(t->jit_stack);
+#endif
+    SCFree(t);
+}
+
+/** \internal
+ *  \brief give the pcre its stats index and set up the thread ctx
+ *
+ *  \retval 0 ok
+ *  \retval -1 error
+ */
+static int DetectPcreSetupThreadCtx(DetectEngineCtx *de_ctx, DetectPcreData *pd)
+{
+    if (de_ctx->pcre_ctx == NULL) {
+        DetectPcreCtx *ctx = SCMalloc(sizeof(DetectPcreCtx));
+        if (unlikely(ctx == NULL))
+            return -1;
+        memset(ctx, 0x00, sizeof(DetectPcreCtx));
+        SCMutexInit(&ctx->lock, NULL);
+        ctx->de_ctx = de_ctx;
+
+        de_ctx->pcre_thread_ctx_id = DetectRegisterThreadCtxFuncs(de_ctx,
+                "pcre", DetectPcreThreadInit, (void *)ctx,
+                DetectPcreThreadFree, 1);
+        if (de_ctx->pcre_thread_ctx_id == -1) {
+            SCMutexDestroy(&ctx->lock);
+            SCFree(ctx);
+            return -1;
+        }
+        de_ctx->pcre_ctx = ctx;
+    }
+
+    pd->idx = de_ctx->pcre_ctx->cnt++;
+    pd->thread_ctx_id = de_ctx->pcre_thread_ctx_id;
+    return 0;
+}
+
+typedef struct DetectPcreStatsLogEntry_ {
+    uint64_t cost;
+    DetectPcreStats *stats;
+    Signature *s;
+    SigMatch *sm;
+} DetectPcreStatsLogEntry;
+
+static int DetectPcreStatsLogCompare(const void *a, const void *b)
+{
+    const DetectPcreStatsLogEntry *ea = (const DetectPcreStatsLogEntry *)a;
+    const DetectPcreStatsLogEntry *eb = (const DetectPcreStatsLogEntry *)b;
+
+    if (ea->cost != eb->cost)
+        return ea->cost > eb->cost ? -1 : 1;
+    return 0;
+}
+
+/** \internal
+ *  \brief log the pcres that hit limits, or with profiling the ones
+ *         that took most time
+ */
+static void DetectPcreStatsLog(DetectEngineCtx *de_ctx)
+{
+    DetectPcreCtx *ctx = de_ctx->pcre_ctx;
+    DetectPcreStatsLogEntry *entries;
+    uint32_t cnt = 0, u;
+    Signature *s;
+    int list;
+
+    entries = SCMalloc(ctx->cnt * sizeof(DetectPcreStatsLogEntry));
+    if (unlikely(entries == NULL))
+        return;
+
+    for (s = de_ctx->sig_list; s != NULL; s = s->next) {
+        for (list = 0; list < DETECT_SM_LIST_MAX; list++) {
+            SigMatch *sm;
+            for (sm = s->sm_lists[list]; sm != NULL; sm = sm->next) {
+                if (sm->type != DETECT_PCRE)
+                    continue;
+
+                DetectPcreData *pd = (DetectPcreData *)sm->ctx;
+                if (pd->idx >= ctx->cnt || cnt == ctx->cnt)
+                    continue;
+
+                DetectPcreStats *stats = &ctx->stats[pd->idx];
+#ifdef PROFILING
+                uint64_t cost = stats->ticks;
+#else
+                uint64_t cost = (uint64_t)stats->match_limit +
+                    stats->recursion_limit + stats->jit_stack_limit;
+#endif
+                if (cost == 0)
+                    continue;
+
+                entries[cnt].cost = cost;
+                entries[cnt].stats = stats;
+                entries[cnt].s = s;
+                entries[cnt].sm = sm;
+                cnt++;
+            }
+        }
+    }
+
+    qsort(entries, cnt, sizeof(DetectPcreStatsLogEntry), DetectPcreStatsLogCompare);
+
+    for (u = 0; u < cnt && u < DETECT_PCRE_STATS_LOG_MAX; u++) {
+        DetectPcreStats *stats = entries[u].stats;
+
+        SCLogInfo("pcre at keyword %"PRIu16" of sid %"PRIu32": %"PRIu64" calls, "
+                "%"PRIu64" ticks, %"PRIu32" match-limit, %"PRIu32
+                " match-limit-recursion and %"PRIu32" jit stack limit hits",
+                entries[u].sm->idx, entries[u].s->id, stats->calls,
+                stats->ticks, stats->match_limit, stats->recursion_limit,
+                stats->jit_stack_limit);
+    }
+
+    SCFree(entries);
+}
+
+static int DetectPcreStatsCompareSig(const void *a, const void *b)
+{
+    const DetectPcreStatsSig *sa = &((const DetectPcreStatsSummary *)a)->sig;
+    const DetectPcreStatsSig *sb = &((const DetectPcreStatsSummary *)b)->sig;
+
+    if (sa->gid != sb->gid)
+        return sa->gid < sb->gid ? -1 : 1;
+    if (sa->sid != sb->sid)
+        return sa->sid < sb->sid ? -1 : 1;
+    if (sa->rev != sb->rev)
+        return sa->rev < sb->rev ? -1 : 1;
+    if (sa->sm_idx != sb->sm_idx)
+        return sa->sm_idx < sb->sm_idx ? -1 : 1;
+    return 0;
+}
+
+/** \internal \brief limit hits first, then time, then calls */
+static int DetectPcreStatsCompareCost(const void *a, const void *b)
+{
+    const DetectPcreStats *sa = &((const DetectPcreStatsSummary *)a)->stats;
+    const DetectPcreStats *sb = &((const DetectPcreStatsSummary *)b)->stats;
+    uint64_t ha = (uint64_t)sa->match_limit + sa->recursion_limit + sa->jit_stack_limit;
+    uint64_t hb = (uint64_t)sb->match_limit + sb->recursion_limit + sb->jit_stack_limit;
+
+    if (ha != hb)
+        return ha > hb ? -1 : 1;
+    if (sa->ticks != sb->ticks)
+        return sa->ticks > sb->ticks ? -1 : 1;
+    if (sa->calls != sb->calls)
+        return sa->calls > sb->calls ? -1 : 1;
+    return DetectPcreStatsCompareSig(a, b);
+}
+
+/**
+ *  \brief Get the counters of the pcres the running detect threads called,
+ *         summed over the threads, the pcres that hit limits first.
+ *
+ *  \param out array of pcres, to be freed by the caller
+ *  \param out_cnt number of pcres in out
+ *
+ *  \retval 0 ok
+ *  \retval -1 out of memory
+ */
+int DetectPcreStatsGet(DetectPcreStatsSummary **out, uint32_t *out_cnt)
+{
+    DetectPcreStatsSummary *list = NULL;
+    DetectPcreThreadData *t;
+    uint32_t cnt = 0, size = 0, u, n;
+
+    *out = NULL;
+    *out_cnt = 0;
+
+    SCMutexLock(&pcre_thread_list_m);
+    for (t = pcre_thread_list; t != NULL; t = t->next) {
+        for (u = 0; u < t->stats_cnt; u++) {
+            /* the thread keeps updating them: read each counter once,
+             * aligned loads of these sizes aren't torn */
+            const volatile DetectPcreStats *src = &t->stats[u];
+            DetectPcreStats c;
+
+            c.calls = src->calls;
+            if (c.calls == 0)
+                continue;
+            c.ticks = src->ticks;
+            c.match_limit = src->match_limit;
+            c.recursion_limit = src->recursion_limit;
+            c.jit_stack_limit = src->jit_stack_limit;
+
+            if (cnt == size) {
+                uint32_t nsize = size ? size * 2 : 64;
+                DetectPcreStatsSummary *ptmp = SCRealloc(list,
+                        nsize * sizeof(DetectPcreStatsSummary));
+                if (ptmp == NULL) {
+                    SCMutexUnlock(&pcre_thread_list_m);
+                    if (list != NULL)
+                        SCFree(list);
+                    return -1;
+                }
+                list = ptmp;
+                size = nsize;
+            }
+            if (t->sigs != NULL)
+                list[cnt].sig = t->sigs[u];
+            else
+                memset(&list[cnt].sig, 0x00, sizeof(DetectPcreStatsSig));
+            list[cnt].stats = c;
+            cnt++;
+        }
+    }
+    SCMutexUnlock(&pcre_thread_list_m);
+
+    if (cnt == 0)
+        return 0;
+
+    /* sum up the counters of the same pcre in different threads */
+    qsort(list, cnt, sizeof(DetectPcreStatsSummary), DetectPcreStatsCompareSig);
+    n = 0;
+    for (u = 0; u < cnt; u++) {
+        if (n > 0 && DetectPcreStatsCompareSig(&list[n - 1], &list[u]) == 0) {
+            DetectPcreStats *d = &list[n - 1].stats;
+            d->calls += list[u].stats.calls;
+            d->ticks += list[u].stats.ticks;
+            d->match_limit += list[u].stats.match_limit;
+            d->recursion_limit += list[u].stats.recursion_limit;
+            d->jit_stack_limit += list[u].stats.jit_stack_limit;
+        } else {
+            if (n != u)
+                list[n] = list[u];
+            n++;
+        }
+    }
+    qsort(list, n, sizeof(DetectPcreStatsSummary), DetectPcreStatsCompareCost);
+
+    *out = list;
+    *out_cnt = n;
+    return 0;
+}
+
+#ifdef BUILD_UNIX_SOCKET
+/** \brief unix socket command "pcre-stats"
+ *
+ *  Arguments: "count", number of pcres (default 20).
+ */
+TmEcode DetectPcreStatsCommand(json_t *cmd, json_t *answer, void *data)
+{
+    DetectPcreStatsSummary *list = NULL;
+    uint32_t cnt = 0, u;
+    uint32_t limit = DETECT_PCRE_STATS_DUMP_DEFAULT;
+
+    json_t *jarg = json_object_get(cmd, "count");
+    if (jarg != NULL) {
+        if (!json_is_integer(jarg) || json_integer_value(jarg) <= 0) {
+            json_object_set_new(answer, "message",
+                    json_string("count is not a positive integer"));
+            return TM_ECODE_FAILED;
+        }
+        limit = (uint32_t)json_integer_value(jarg);
+    }
+
+    if (DetectPcreStatsGet(&list, &cnt) != 0) {
+        json_object_set_new(answer, "message",
+                json_string("internal error getting the pcre stats"));
+        return TM_ECODE_FAILED;
+    }
+
+    json_t *jarray = json_array();
+    if (jarray == NULL) {
+        if (list != NULL)
+            SCFree(list);
+        json_object_set_new(answer, "message",
+                json_string("internal error at json object creation"));
+        return TM_ECODE_FAILED;
+    }
+
+    for (u = 0; u < cnt && u < limit; u++) {
+        const DetectPcreStatsSummary *s = &list[u];
+        json_t *jpcre = json_object();
+        if (jpcre == NULL)
+            continue;
+
+        json_object_set_new(jpcre, "gid", json_integer(s->sig.gid));
+        json_object_set_new(jpcre, "signature_id", json_integer(s->sig.sid));
+        json_object_set_new(jpcre, "rev", json_integer(s->sig.rev));
+        json_object_set_new(jpcre, "keyword", json_integer(s->sig.sm_idx));
+        json_object_set_new(jpcre, "calls", json_integer(s->stats.calls));
+#ifdef PROFILING
+        json_object_set_new(jpcre, "ticks", json_integer(s->stats.ticks));
+#endif
+        json_object_set_new(jpcre, "match_limit",
+                json_integer(s->stats.match_limit));
+        json_object_set_new(jpcre, "match_limit_recursion",
+                json_integer(s->stats.recursion_limit));
+        json_object_set_new(jpcre, "jit_stack_limit",
+                json_integer(s->stats.jit_stack_limit));
+        json_array_append_new(jarray, jpcre);
+    }
+    if (list != NULL)
+        SCFree(list);
+
+    json_object_set_new(answer, "message", jarray);
+    return TM_ECODE_OK;
+}
+#endif /* BUILD_UNIX_SOCKET */
+
+/**
+ * \brief Free the pcre data of a detection engine, after logging the
+ *        stats of its threads.
+ */
+void DetectPcreCtxFree(DetectEngineCtx *de_ctx)
+{
+    DetectPcreCtx *ctx = de_ctx->pcre_ctx;
+
+    if (ctx == NULL)
+        return;
+
+    if (ctx->stats != NULL) {
+        if (!(de_ctx->flags & DE_QUIET))
+            DetectPcreStatsLog(de_ctx);
+        SCFree(ctx->stats);
+    }
+    SCMutexDestroy(&ctx->lock);
+    SCFree(ctx);
+    de_ctx->pcre_ctx = NULL;
+}
+
 static int DetectPcreSetup (DetectEngineCtx *de_ctx, Signature *s, char *regexstr)
 {
     SCEnter();
@@ -648,6 +1483,8 @@ static int DetectPcreSetup (DetectEngineCtx *de_ctx, Signature *s, char *regexst
         goto error;
     if (DetectPcreParseCapture(regexstr, de_ctx, pd) < 0)
         goto error;
+    if (DetectPcreSetupThreadCtx(de_ctx, pd) < 0)
+        goto error;
 
     if (parsed_sm_list == DETECT_SM_LIST_UMATCH ||
         parsed_sm_list == DETECT_SM_LIST_HRUDMATCH ||
@@ -786,11 +1623,122 @@ void DetectPcreFree(void *ptr)
         pcre_free(pd->re);
     if (pd->sd != NULL)
         pcre_free(pd->sd);
+    if (pd->prefilter != NULL)
+        SCFree(pd->prefilter);
 
     SCFree(pd);
     return;
 }
 
+/** \internal
+ *  \brief lists a pcre prefilter can be added to: the ones with a mpm */
+static int DetectPcrePrefilterList(int list)
+{
+    switch (list) {
+        case DETECT_SM_LIST_PMATCH:
+        case DETECT_SM_LIST_UMATCH:
+        case DETECT_SM_LIST_HRUDMATCH:
+        case DETECT_SM_LIST_HCBDMATCH:
+        case DETECT_SM_LIST_HSBDMATCH:
+        case DETECT_SM_LIST_HHDMATCH:
+        case DETECT_SM_LIST_HRHDMATCH:
+        case DETECT_SM_LIST_HMDMATCH:
+        case DETECT_SM_LIST_HCDMATCH:
+        case DETECT_SM_LIST_HSMDMATCH:
+        case DETECT_SM_LIST_HSCDMATCH:
+        case DETECT_SM_LIST_HUADMATCH:
+        case DETECT_SM_LIST_HHHDMATCH:
+        case DETECT_SM_LIST_HRHHDMATCH:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+ *  \brief Give a sig without content a fast pattern from its pcres.
+ *
+ *  A sig without content isn't in the mpm, so its pcres run on every
+ *  packet of its sgh. If a pcre has a literal every match contains, a
+ *  content with it is added after the pcre in the same list. The mpm
+ *  then skips the sig when the literal isn't in the buffer. As the pcre
+ *  matched when the content is inspected, the content can't change the
+ *  result of the sig.
+ *
+ *  \retval 1 a prefilter was added
+ *  \retval 0 no prefilter was added
+ *  \retval -1 error
+ */
+int DetectPcreSetupPrefilter(Signature *s)
+{
+    SigMatch *best = NULL;
+    int best_list = -1;
+    int list;
+
+    for (list = 0; list < DETECT_SM_LIST_MAX; list++) {
+        SigMatch *sm;
+        for (sm = s->sm_lists[list]; sm != NULL; sm = sm->next) {
+            if (sm->type == DETECT_CONTENT)
+                return 0;
+            if (sm->type != DETECT_PCRE || !DetectPcrePrefilterList(list))
+                continue;
+
+            DetectPcreData *pd = (DetectPcreData *)sm->ctx;
+            if (pd->prefilter_len > 0 && (best == NULL ||
+                    pd->prefilter_len > ((DetectPcreData *)best->ctx)->prefilter_len)) {
+                best = sm;
+                best_list = list;
+            }
+        }
+    }
+    if (best == NULL)
+        return 0;
+
+    DetectPcreData *pd = (DetectPcreData *)best->ctx;
+    DetectContentData *cd = SCMalloc(sizeof(DetectContentData) + pd->prefilter_len);
+    if (unlikely(cd == NULL))
+        return -1;
+    memset(cd, 0, sizeof(DetectContentData) + pd->prefilter_len);
+
+    cd->content = (uint8_t *)cd + sizeof(DetectContentData);
+    memcpy(cd->content, pd->prefilter, pd->prefilter_len);
+    cd->content_len = pd->prefilter_len;
+    cd->flags = DETECT_CONTENT_PCRE_PREFILTER;
+
+    cd->bm_ctx = BoyerMooreCtxInit(cd->content, cd->content_len);
+    if (cd->bm_ctx == NULL) {
+        SCFree(cd);
+        return -1;
+    }
+    if (pd->flags & DETECT_PCRE_CASELESS) {
+        cd->flags |= DETECT_CONTENT_NOCASE;
+        BoyerMooreCtxToNocase(cd->bm_ctx, cd->content, cd->content_len);
+    }
+
+    SigMatch *sm = SigMatchAlloc();
+    if (sm == NULL) {
+        DetectContentFree(cd);
+        return -1;
+    }
+    sm->type = DETECT_CONTENT;
+    sm->ctx = (void *)cd;
+    SigMatchAppendSMToList(s, sm, best_list);
+
+    /* the sig's max lens are set already, the sgh inspects buffers based
+     * on them so they have to cover the prefilter too */
+    if (best_list == DETECT_SM_LIST_PMATCH) {
+        if (s->mpm_content_maxlen < cd->content_len)
+            s->mpm_content_maxlen = cd->content_len;
+    } else if (best_list == DETECT_SM_LIST_UMATCH) {
+        if (s->mpm_uricontent_maxlen < cd->content_len)
+            s->mpm_uricontent_maxlen = cd->content_len;
+    }
+
+    SCLogDebug("sig %"PRIu32" got a %"PRIu16" byte prefilter from its pcre",
+            s->id, cd->content_len);
+    return 1;
+}
+
 #ifdef UNITTESTS /* UNITTESTS */
 
 /**
@@ -1171,12 +2119,13 @@ static int DetectPcreParseTest12(void)
         goto end;
     }
 
-    if (s->sm_lists_tail[DETECT_SM_LIST_HSBDMATCH]->type != DETECT_PCRE) {
-        printf("last sm not pcre: ");
+    /* the pcre is followed by its prefilter */
+    if (s->sm_lists[DETECT_SM_LIST_HSBDMATCH]->type != DETECT_PCRE) {
+        printf("first sm not pcre: ");
         goto end;
     }
 
-    data = (DetectPcreData *)s->sm_lists_tail[DETECT_SM_LIST_HSBDMATCH]->ctx;
+    data = (DetectPcreData *)s->sm_lists[DETECT_SM_LIST_HSBDMATCH]->ctx;
     if (data->flags & DETECT_PCRE_RAWBYTES ||
         !(data->flags & DETECT_PCRE_RELATIVE)) {
         printf("flags not right: ");
@@ -1269,12 +2218,13 @@ static int DetectPcreParseTest14(void)
         goto end;
     }
 
-    if (s->sm_lists_tail[DETECT_SM_LIST_HSBDMATCH]->type != DETECT_PCRE) {
-        printf("last sm not pcre: ");
+    /* the pcre is followed by its prefilter */
+    if (s->sm_lists[DETECT_SM_LIST_HSBDMATCH]->type != DETECT_PCRE) {
+        printf("first sm not pcre: ");
         goto end;
     }
 
-    data = (DetectPcreData *)s->sm_lists_tail[DETECT_SM_LIST_HSBDMATCH]->ctx;
+    data = (DetectPcreData *)s->sm_lists[DETECT_SM_LIST_HSBDMATCH]->ctx;
     if (data->flags & DETECT_PCRE_RAWBYTES ||
         data->flags & DETECT_PCRE_RELATIVE) {
         printf("flags not right: ");
@@ -4052,6 +5002,379 @@ end:
     return result;
 }
 
+/**
+ * \test the per thread stats count the calls and the limit hits of each
+ *       pcre, can be dumped while the thread runs and are added up when
+ *       the thread exits
+ */
+static int DetectPcreStatsTest01(void)
+{
+    int result = 0;
+    uint8_t buf[] = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa!";
+    uint16_t buflen = sizeof(buf) - 1;
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    DetectPcreThreadData *t;
+    DetectPcreData *pd1, *pd2;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    p = UTHBuildPacket(buf, buflen, IPPROTO_TCP);
+    if (p == NULL)
+        return 0;
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    /* backtracks until it hits the match limit */
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(pcre:\"/^(a|aa)+$/\"; sid:4711;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(pcre:\"/a!/\"; sid:4712;)");
+    if (s1 == NULL || s2 == NULL) {
+        printf("sig parse failed: ");
+        goto end;
+    }
+    pd1 = (DetectPcreData *)s1->sm_lists[DETECT_SM_LIST_PMATCH]->ctx;
+    pd2 = (DetectPcreData *)s2->sm_lists[DETECT_SM_LIST_PMATCH]->ctx;
+    if (pd1->idx != 0 || pd2->idx != 1 || de_ctx->pcre_ctx == NULL ||
+        de_ctx->pcre_ctx->cnt != 2) {
+        printf("pcre idx not set up: ");
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    t = DetectThreadCtxGetKeywordThreadCtx(det_ctx, de_ctx->pcre_thread_ctx_id);
+    if (t == NULL || t->stats_cnt != 2) {
+        printf("no pcre thread ctx: ");
+        goto end;
+    }
+#ifdef DETECT_PCRE_JIT_STACK
+    if (t->jit_stack == NULL) {
+        printf("no jit stack: ");
+        goto end;
+    }
+#endif
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+
+    if (PacketAlertCheck(p, 4711) || !PacketAlertCheck(p, 4712)) {
+        printf("sid 4711 alerted or sid 4712 didn't: ");
+        goto end;
+    }
+    if (t->stats[0].calls != 2 || t->stats[1].calls != 2) {
+        printf("calls %"PRIu64"/%"PRIu64", expected 2/2: ",
+                t->stats[0].calls, t->stats[1].calls);
+        goto end;
+    }
+    if (t->stats[0].match_limit + t->stats[0].recursion_limit != 2 ||
+        t->stats[1].match_limit + t->stats[1].recursion_limit != 0) {
+        printf("limit hits %"PRIu32"+%"PRIu32"/%"PRIu32"+%"PRIu32", expected 2/0: ",
+                t->stats[0].match_limit, t->stats[0].recursion_limit,
+                t->stats[1].match_limit, t->stats[1].recursion_limit);
+        goto end;
+    }
+
+    /* the running thread's counters can be dumped, the limit hits first.
+     * Threads of other tests may still be listed. */
+    DetectPcreStatsSummary *list = NULL;
+    uint32_t cnt = 0, u, idx[2] = { 0, 0 }, found = 0;
+    if (DetectPcreStatsGet(&list, &cnt) != 0)
+        goto end;
+    for (u = 0; u < cnt; u++) {
+        if (list[u].sig.sid == 4711 || list[u].sig.sid == 4712) {
+            idx[list[u].sig.sid - 4711] = u;
+            found++;
+        }
+    }
+    if (found != 2 || idx[0] > idx[1] || list[idx[0]].stats.calls != 2 ||
+        list[idx[0]].stats.match_limit + list[idx[0]].stats.recursion_limit != 2 ||
+        list[idx[1]].stats.calls != 2) {
+        printf("stats dump wrong: ");
+        if (list != NULL)
+            SCFree(list);
+        goto end;
+    }
+    SCFree(list);
+    list = NULL;
+
+    DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    det_ctx = NULL;
+
+    if (DetectPcreStatsGet(&list, &cnt) != 0)
+        goto end;
+    for (u = 0; u < cnt; u++) {
+        if (list[u].sig.sid == 4711 || list[u].sig.sid == 4712) {
+            printf("stats of an exited thread dumped: ");
+            SCFree(list);
+            goto end;
+        }
+    }
+    if (list != NULL)
+        SCFree(list);
+
+    if (de_ctx->pcre_ctx->stats == NULL ||
+        de_ctx->pcre_ctx->stats[0].calls != 2 ||
+        de_ctx->pcre_ctx->stats[0].match_limit +
+        de_ctx->pcre_ctx->stats[0].recursion_limit != 2) {
+        printf("thread stats not added up: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
+/**
+ * \test the literals required by a regex are found, and only those
+ */
+static int DetectPcrePrefilterTest01(void)
+{
+    struct {
+        const char *re;
+        const char *lit;
+    } tests[] = {
+        { "foo\\d+barbaz", "barbaz" },
+        { "^GET /index\\.php", "GET /index.php" },
+        { "abc(def)?ghij", "ghij" },
+        { "abc(?:defg)+hi", "defg" },
+        { "abcd(ef|gh)ij", "abcd" },
+        { "ab|cdef", "" },
+        { "(?i)abcdef", "" },
+        { "ab+cde", "cde" },
+        { "xyz{0,3}abc", "abc" },
+        { "\\x41\\x42\\x43[a-z]", "ABC" },
+        { "a[bc]+d\\.exe", "d.exe" },
+        { "(?=foobar)abc", "abc" },
+        { "(?!foobar)abcd", "abcd" },
+        { "foo(?P<name>barbaz)", "barbaz" },
+        { "foo\\1", "" },
+        { "\\bword\\b", "word" },
+        { "^a{,3}bc", "" },
+        { NULL, NULL },
+    };
+    int i;
+
+    for (i = 0; tests[i].re != NULL; i++) {
+        uint8_t lit[DETECT_PCRE_PREFILTER_MAX_LEN];
+        uint16_t len = DetectPcreExtractLiteral(tests[i].re, lit);
+
+        if (len != strlen(tests[i].lit) || memcmp(lit, tests[i].lit, len) != 0) {
+            printf("\"%s\": expected \"%s\", got \"%.*s\": ", tests[i].re,
+                    tests[i].lit, (int)len, lit);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * \test a sig with only a pcre gets its literal as fast pattern, and
+ *       still matches as before
+ */
+static int DetectPcrePrefilterTest02(void)
+{
+    int result = 0;
+    uint8_t buf1[] = "xxFOO123BARBAZxx";
+    uint8_t buf2[] = "xxfoo123barbaxx";
+    Packet *p1 = NULL, *p2 = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    DetectContentData *cd;
+    DetectEngineCtx *de_ctx = NULL;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    p1 = UTHBuildPacket(buf1, sizeof(buf1) - 1, IPPROTO_TCP);
+    p2 = UTHBuildPacket(buf2, sizeof(buf2) - 1, IPPROTO_TCP);
+    if (p1 == NULL || p2 == NULL)
+        goto end;
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(pcre:\"/foo\\d+barbaz/i\"; sid:1;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"xx\"; pcre:\"/foo\\d+barbaz/i\"; sid:2;)");
+    Signature *s3 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(pcre:!\"/foo\\d+barbaz/i\"; sid:3;)");
+    Signature *s4 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(pcre:\"/foo\\d+ barbaz/ix\"; sid:4;)");
+    if (s1 == NULL || s2 == NULL || s3 == NULL || s4 == NULL) {
+        printf("sig parse failed: ");
+        goto end;
+    }
+
+    if (s1->sm_lists_tail[DETECT_SM_LIST_PMATCH]->type != DETECT_CONTENT) {
+        printf("sid 1 has no prefilter: ");
+        goto end;
+    }
+    cd = (DetectContentData *)s1->sm_lists_tail[DETECT_SM_LIST_PMATCH]->ctx;
+    if (cd->content_len != 6 || memcmp(cd->content, "barbaz", 6) != 0 ||
+        !(cd->flags & DETECT_CONTENT_PCRE_PREFILTER) ||
+        !(cd->flags & DETECT_CONTENT_NOCASE)) {
+        printf("sid 1 prefilter not set up right: ");
+        goto end;
+    }
+    if (s2->sm_lists_tail[DETECT_SM_LIST_PMATCH]->type != DETECT_PCRE ||
+        s3->sm_lists_tail[DETECT_SM_LIST_PMATCH]->type != DETECT_PCRE ||
+        s4->sm_lists_tail[DETECT_SM_LIST_PMATCH]->type != DETECT_PCRE) {
+        printf("sid 2, 3 or 4 got a prefilter: ");
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    if (s1->mpm_sm != s1->sm_lists_tail[DETECT_SM_LIST_PMATCH]) {
+        printf("prefilter isn't the fast pattern of sid 1: ");
+        goto end;
+    }
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p1);
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p2);
+
+    if (!PacketAlertCheck(p1, 1) || PacketAlertCheck(p2, 1)) {
+        printf("sid 1 didn't alert on p1 or alerted on p2: ");
+        goto end;
+    }
+    if (!PacketAlertCheck(p1, 4) || PacketAlertCheck(p1, 3) ||
+        !PacketAlertCheck(p2, 3)) {
+        printf("sid 3 or 4 results changed: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    UTHFreePackets(&p1, 1);
+    UTHFreePackets(&p2, 1);
+    return result;
+}
+
+/**
+ * \test a uri pcre sig still alerts on a short uri when its sgh also has
+ *       a sig with a longer uricontent
+ */
+static int DetectPcrePrefilterTest03(void)
+{
+    int result = 0;
+    Flow f;
+    uint8_t httpbuf1[] = "GET /abcd HTTP/1.0\r\nUser-Agent: Mozilla/1.0\r\n\r\n";
+    uint32_t httplen1 = sizeof(httpbuf1) - 1; /* minus the \0 */
+    TcpSession ssn;
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    DetectEngineCtx *de_ctx = NULL;
+    AppLayerParserThreadCtx *alp_tctx = AppLayerParserThreadCtxAlloc();
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&f, 0, sizeof(f));
+    memset(&ssn, 0, sizeof(ssn));
+
+    p = UTHBuildPacket(NULL, 0, IPPROTO_TCP);
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = (void *)&ssn;
+    f.proto = IPPROTO_TCP;
+    f.flags |= FLOW_IPV4;
+
+    p->flow = &f;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+    p->flowflags |= FLOW_PKT_ESTABLISHED;
+    p->flags |= PKT_HAS_FLOW|PKT_STREAM_EST;
+    f.alproto = ALPROTO_HTTP;
+
+    StreamTcpInitConfig(TRUE);
+
+    de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+            "(pcre:\"/\\/abcd/U\"; sid:1;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert http any any -> any any "
+            "(uricontent:\"/averyverylongurlpattern\"; sid:2;)");
+    if (s1 == NULL || s2 == NULL) {
+        printf("sig parse failed: ");
+        goto end;
+    }
+
+    if (s1->sm_lists_tail[DETECT_SM_LIST_UMATCH]->type != DETECT_CONTENT) {
+        printf("sid 1 has no prefilter: ");
+        goto end;
+    }
+    if (s1->mpm_uricontent_maxlen != 5) {
+        printf("sid 1 uricontent maxlen %"PRIu16", expected 5: ",
+                s1->mpm_uricontent_maxlen);
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    SCMutexLock(&f.m);
+    int r = AppLayerParserParse(alp_tctx, &f, ALPROTO_HTTP, STREAM_TOSERVER, httpbuf1, httplen1);
+    if (r != 0) {
+        printf("toserver chunk 1 returned %" PRId32 ", expected 0: ", r);
+        SCMutexUnlock(&f.m);
+        goto end;
+    }
+    SCMutexUnlock(&f.m);
+
+    if (f.alstate == NULL) {
+        printf("no http state: ");
+        goto end;
+    }
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+
+    if (!PacketAlertCheck(p, 1) || PacketAlertCheck(p, 2)) {
+        printf("sid 1 didn't alert or sid 2 did: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (alp_tctx != NULL)
+        AppLayerParserThreadCtxFree(alp_tctx);
+    if (det_ctx != NULL)
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+
+    StreamTcpFreeConfig(TRUE);
+    FLOW_DESTROY(&f);
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 /**
@@ -4118,6 +5441,10 @@ void DetectPcreRegisterTests(void) {
     UtRegisterTest("DetectPcreFlowvarCapture01 -- capture for http_header", DetectPcreFlowvarCapture01, 1);
     UtRegisterTest("DetectPcreFlowvarCapture02 -- capture for http_header", DetectPcreFlowvarCapture02, 1);
     UtRegisterTest("DetectPcreFlowvarCapture03 -- capture for http_header", DetectPcreFlowvarCapture03, 1);
+    UtRegisterTest("DetectPcreStatsTest01", DetectPcreStatsTest01, 1);
+    UtRegisterTest("DetectPcrePrefilterTest01", DetectPcrePrefilterTest01, 1);
+    UtRegisterTest("DetectPcrePrefilterTest02", DetectPcrePrefilterTest02, 1);
+    UtRegisterTest("DetectPcrePrefilterTest03", DetectPcrePrefilterTest03, 1);
 
 #endif /* UNITTESTS */
 }
@@ -24,6 +24,10 @@
 #ifndef __DETECT_PCRE_H__
 #define __DETECT_PCRE_H__
 
+#ifdef BUILD_UNIX_SOCKET
+#include <jansson.h>
+#endif
+
 #define DETECT_PCRE_RELATIVE            0x00001
 #define DETECT_PCRE_RAWBYTES            0x00002
 #define DETECT_PCRE_CASELESS            0x00004
@@ -41,14 +45,71 @@ typedef struct DetectPcreData_ {
     uint16_t flags;
     uint16_t capidx;
     char *capname;
+    uint32_t idx;           /**< index in the per thread stats */
+    int thread_ctx_id;
+    uint8_t *prefilter;     /**< literal every match contains, or NULL */
+    uint16_t prefilter_len;
 } DetectPcreData;
 
+/** counters of a pcre keyword, kept per thread and added up in the
+ *  DetectPcreCtx when the thread exits. The thread is the only writer,
+ *  the unix socket thread only reads them while they are updated. */
+typedef struct DetectPcreStats_ {
+    uint64_t calls;
+    uint64_t ticks;             /**< time in pcre_exec, only with profiling */
+    uint32_t match_limit;       /**< match-limit hits */
+    uint32_t recursion_limit;   /**< match-limit-recursion hits */
+    uint32_t jit_stack_limit;   /**< jit stack exhausted */
+} DetectPcreStats;
+
+/** the rule of a pcre keyword */
+typedef struct DetectPcreStatsSig_ {
+    uint32_t gid;
+    uint32_t sid;
+    uint32_t rev;
+    uint16_t sm_idx;            /**< keyword index in the rule */
+} DetectPcreStatsSig;
+
+/** counters of a pcre keyword summed over the running detect threads */
+typedef struct DetectPcreStatsSummary_ {
+    DetectPcreStatsSig sig;
+    DetectPcreStats stats;
+} DetectPcreStatsSummary;
+
+/** pcre keyword data of a detection engine */
+typedef struct DetectPcreCtx_ {
+    uint32_t cnt;               /**< pcre keywords, next DetectPcreData::idx */
+    SCMutex lock;               /**< protects stats */
+    DetectPcreStats *stats;     /**< stats of the threads that exited */
+    struct DetectEngineCtx_ *de_ctx;
+} DetectPcreCtx;
+
+/** per thread pcre keyword data */
+typedef struct DetectPcreThreadData_ {
+    DetectPcreCtx *ctx;
+#ifdef PCRE_HAVE_JIT
+    pcre_jit_stack *jit_stack;
+#endif
+    DetectPcreStats *stats;
+    uint32_t stats_cnt;
+    /** rule of each keyword, copied as the sigs may be freed by a rule
+     *  reload before the unix socket looks at the stats */
+    DetectPcreStatsSig *sigs;
+    struct DetectPcreThreadData_ *next;
+} DetectPcreThreadData;
+
 /* prototypes */
 int DetectPcrePayloadMatch(DetectEngineThreadCtx *, Signature *, SigMatch *, Packet *, Flow *, uint8_t *, uint32_t);
 int DetectPcrePacketPayloadMatch(DetectEngineThreadCtx *, Packet *, Signature *, SigMatch *);
 int DetectPcrePayloadDoMatch(DetectEngineThreadCtx *, Signature *, SigMatch *,
                              Packet *, uint8_t *, uint16_t);
 void DetectPcreRegister (void);
+void DetectPcreCtxFree(DetectEngineCtx *);
+int DetectPcreSetupPrefilter(Signature *);
+int DetectPcreStatsGet(DetectPcreStatsSummary **, uint32_t *);
+#ifdef BUILD_UNIX_SOCKET
+TmEcode DetectPcreStatsCommand(json_t *, json_t *, void *);
+#endif
 
 #endif /* __DETECT_PCRE_H__ */
 
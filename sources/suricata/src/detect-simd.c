@@ -25,12 +25,50 @@
 
 #include "suricata-common.h"
 #include "detect.h"
+#include "detect-engine-candidates.h"
 
+#include "util-cpu.h"
 #include "util-unittest.h"
 #include "util-unittest-helper.h"
 #include "util-vector.h"
 
-/* Included into detect.c */
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+#include <immintrin.h>
+#endif
+
+typedef void (*DetectSimdBuildMatchArrayFunc)(DetectEngineThreadCtx *,
+        Packet *, SignatureMask, AppProto);
+
+/**
+ *  \brief build an array of signatures that will be inspected
+ *
+ *  All signatures that can be filtered out on forehand are not added to it.
+ *  Non-SIMD implementation, also used as reference in the unittests.
+ *
+ *  \param det_ctx detection engine thread ctx -- array is stored here
+ *  \param p packet
+ *  \param mask Packets mask
+ *  \param alproto application layer protocol
+ */
+static void SigMatchSignaturesBuildMatchArrayScalar(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
+{
+    uint32_t u;
+
+    /* reset previous run */
+    det_ctx->match_array_cnt = 0;
+
+    for (u = 0; u < det_ctx->sgh->sig_cnt; u++) {
+        SignatureHeader *s = &det_ctx->sgh->head_array[u];
+        if ((mask & s->mask) == s->mask) {
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                /* okay, store it */
+                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
+                det_ctx->match_array_cnt++;
+            }
+        }
+    }
+}
 
 #if defined(__SSE3__)
 
@@ -44,8 +82,8 @@
  *  On 64 bit systems we inspect in 64 sig batches, creating a u64 with flags.
  *  The size of a register is leading here.
  */
-void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
-                                       Packet *p, SignatureMask mask, AppProto alproto)
+static void SigMatchSignaturesBuildMatchArraySSE3(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
 {
     uint32_t u;
     SigIntId x;
@@ -189,8 +227,8 @@ void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
  *  Mass mask matching is done creating a bitmap of signatures that need
  *  futher inspection.
  */
-void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
-                                       Packet *p, SignatureMask mask, AppProto alproto)
+static void SigMatchSignaturesBuildMatchArrayTile(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
 {
     uint32_t u;
     register uint64_t bm; /* bit mask, 64 bits used */
@@ -243,8 +281,184 @@ void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
 }
 #endif /* defined(__tile__) */
 
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+/**
+ *  \brief AVX2 implementation of mask prefiltering.
+ *
+ *  Compiled for AVX2 regardless of the build flags, only used if
+ *  UtilCpuGetFeatures() reports AVX2 support. Inspects 64 sigs per
+ *  iteration using two 32 byte vectors.
+ */
+__attribute__((target("avx2")))
+static void SigMatchSignaturesBuildMatchArrayAVX2(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
+{
+    uint32_t u;
+    uint64_t bm; /* bit mask, 64 bits used */
+    __m256i sm;
+
+    const SignatureMask *mask_array = det_ctx->sgh->mask_array;
+    const uint32_t sig_cnt = det_ctx->sgh->sig_cnt;
+    SignatureHeader *head_array = det_ctx->sgh->head_array;
+
+    /* load the packet mask into each byte of the vector */
+    const __m256i pm = _mm256_set1_epi8(mask);
+
+    /* reset previous run */
+    det_ctx->match_array_cnt = 0;
+
+    for (u = 0; u < sig_cnt; u += 64) {
+        /* load a batch of masks, AND them with the packet's mask and
+         * compare the result with the original mask */
+        sm = _mm256_loadu_si256((const __m256i *)&mask_array[u]);
+        bm = (uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(sm, _mm256_and_si256(pm, sm)));
+
+        sm = _mm256_loadu_si256((const __m256i *)&mask_array[u+32]);
+        bm |= ((uint64_t)(uint32_t)_mm256_movemask_epi8(
+                _mm256_cmpeq_epi8(sm, _mm256_and_si256(pm, sm)))) << 32;
+
+        /* walk the set bits from the lowest one up */
+        while (bm) {
+            uint32_t x = u + (uint32_t)__builtin_ctzll(bm);
+            if (x >= sig_cnt)
+                break;
+            bm &= bm - 1;
+
+            SignatureHeader *s = &head_array[x];
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                /* okay, store it */
+                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
+                det_ctx->match_array_cnt++;
+            }
+        }
+    }
+}
+
+/**
+ *  \brief AVX-512 implementation of mask prefiltering.
+ *
+ *  Needs AVX512BW for the byte compare. The compare directly produces
+ *  the 64 bit mask, so no movemask step is needed.
+ */
+__attribute__((target("avx512f,avx512bw")))
+static void SigMatchSignaturesBuildMatchArrayAVX512(DetectEngineThreadCtx *det_ctx,
+        Packet *p, SignatureMask mask, AppProto alproto)
+{
+    uint32_t u;
+    uint64_t bm; /* bit mask, 64 bits used */
+    __m512i sm;
+
+    const SignatureMask *mask_array = det_ctx->sgh->mask_array;
+    const uint32_t sig_cnt = det_ctx->sgh->sig_cnt;
+    SignatureHeader *head_array = det_ctx->sgh->head_array;
+
+    /* load the packet mask into each byte of the vector */
+    const __m512i pm = _mm512_set1_epi8(mask);
+
+    /* reset previous run */
+    det_ctx->match_array_cnt = 0;
+
+    for (u = 0; u < sig_cnt; u += 64) {
+        sm = _mm512_loadu_si512((const void *)&mask_array[u]);
+        bm = (uint64_t)_mm512_cmpeq_epi8_mask(_mm512_and_si512(pm, sm), sm);
+
+        while (bm) {
+            uint32_t x = u + (uint32_t)__builtin_ctzll(bm);
+            if (x >= sig_cnt)
+                break;
+            bm &= bm - 1;
+
+            SignatureHeader *s = &head_array[x];
+            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
+                /* okay, store it */
+                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
+                det_ctx->match_array_cnt++;
+            }
+        }
+    }
+}
+#endif /* DETECT_SIMD_RUNTIME_DISPATCH */
+
+typedef struct DetectSimdVariant_ {
+    const char *name;
+    /** UTIL_CPU_FEATURE_* flags the cpu needs for this variant */
+    uint32_t cpu_features;
+    DetectSimdBuildMatchArrayFunc BuildMatchArray;
+} DetectSimdVariant;
+
+/** mask prefilter implementations, ordered from least to most preferred */
+static DetectSimdVariant detect_simd_variants[] = {
+    { "scalar", 0, SigMatchSignaturesBuildMatchArrayScalar },
+#if defined(__SSE3__)
+    { "sse3", 0, SigMatchSignaturesBuildMatchArraySSE3 },
+#elif defined(__tile__)
+    { "tile", 0, SigMatchSignaturesBuildMatchArrayTile },
+#endif
+#ifdef DETECT_SIMD_RUNTIME_DISPATCH
+    { "avx2", UTIL_CPU_FEATURE_AVX2, SigMatchSignaturesBuildMatchArrayAVX2 },
+    { "avx512", UTIL_CPU_FEATURE_AVX512BW, SigMatchSignaturesBuildMatchArrayAVX512 },
+#endif
+};
+
+#define DETECT_SIMD_VARIANTS \
+    (int)(sizeof(detect_simd_variants) / sizeof(detect_simd_variants[0]))
+
+/* until DetectSimdSetup() runs, use the best compile time choice */
+#if defined(__SSE3__)
+static DetectSimdBuildMatchArrayFunc BuildMatchArrayFunc = SigMatchSignaturesBuildMatchArraySSE3;
+#elif defined(__tile__)
+static DetectSimdBuildMatchArrayFunc BuildMatchArrayFunc = SigMatchSignaturesBuildMatchArrayTile;
+#else
+static DetectSimdBuildMatchArrayFunc BuildMatchArrayFunc = SigMatchSignaturesBuildMatchArrayScalar;
+#endif
+
+/**
+ *  \brief Select the mask prefilter implementation for this cpu.
+ *
+ *  Called once at startup, before the packet threads run.
+ */
+void DetectSimdSetup(void)
+{
+    uint32_t features = UtilCpuGetFeatures();
+    int i, selected = 0;
+
+    for (i = 0; i < DETECT_SIMD_VARIANTS; i++) {
+        if ((detect_simd_variants[i].cpu_features & features) ==
+                detect_simd_variants[i].cpu_features)
+            selected = i;
+    }
+
+    BuildMatchArrayFunc = detect_simd_variants[selected].BuildMatchArray;
+    SCLogInfo("using %s signature mask prefilter",
+            detect_simd_variants[selected].name);
+}
+
+/**
+ *  \brief build an array of signatures that will be inspected
+ *
+ *  All signatures that can be filtered out on forehand are not added to it.
+ *  If the mpm found few patterns only their sigs are looked at, see
+ *  detect-engine-candidates.c, otherwise all sigs of the sgh are.
+ *
+ *  \param det_ctx detection engine thread ctx -- array is stored here
+ *  \param p packet
+ *  \param mask Packets mask
+ *  \param alproto application layer protocol
+ */
+void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
+                                       Packet *p, SignatureMask mask, AppProto alproto)
+{
+    if (det_ctx->sgh->candidates != NULL &&
+        DetectCandidatesBuildMatchArray(det_ctx, p, mask, alproto) == 1)
+        return;
+
+    BuildMatchArrayFunc(det_ctx, p, mask, alproto);
+}
+
 
 #ifdef UNITTESTS
+#include "conf.h"
 #include "flow-util.h"
 #include "stream-tcp-reassemble.h"
 #include "util-var-name.h"
@@ -562,6 +776,225 @@ static int SigTestSIMDMask04(void)
     return 1;
 #endif
 }
+
+/** \brief set up a fake sgh with random masks to run the prefilter on */
+static int DetectSimdTestSetup(SigGroupHead *sgh, DetectEngineThreadCtx *det_ctx,
+        Signature **sigs, uint32_t sig_cnt, unsigned int *seed)
+{
+    uint32_t cnt = sig_cnt;
+    uint32_t u;
+
+    memset(sgh, 0, sizeof(*sgh));
+    memset(det_ctx, 0, sizeof(*det_ctx));
+
+    if (cnt % 64 != 0)
+        cnt += (64 - (cnt % 64));
+
+    *sigs = SCMalloc(sig_cnt * sizeof(Signature));
+    sgh->head_array = SCMalloc(sig_cnt * sizeof(SignatureHeader));
+    det_ctx->match_array = SCMalloc(sig_cnt * sizeof(Signature *));
+#ifdef DETECT_SIMD_MASK_ARRAY
+    sgh->mask_array = (SignatureMask *)SCMallocAligned((cnt * sizeof(SignatureMask)), 64);
+    if (sgh->mask_array == NULL)
+        return 0;
+    memset(sgh->mask_array, 0, (cnt * sizeof(SignatureMask)));
+#endif
+    if (*sigs == NULL || sgh->head_array == NULL || det_ctx->match_array == NULL)
+        return 0;
+    memset(sgh->head_array, 0, sig_cnt * sizeof(SignatureHeader));
+
+    sgh->sig_cnt = sig_cnt;
+    for (u = 0; u < sig_cnt; u++) {
+        /* AND two random bytes so that masks have few bits set, like
+         * real sigs */
+        SignatureMask mask = (SignatureMask)(rand_r(seed) & rand_r(seed));
+        sgh->head_array[u].full_sig = &(*sigs)[u];
+        sgh->head_array[u].mask = mask;
+#ifdef DETECT_SIMD_MASK_ARRAY
+        sgh->mask_array[u] = mask;
+#endif
+    }
+    det_ctx->sgh = sgh;
+    return 1;
+}
+
+static void DetectSimdTestCleanup(SigGroupHead *sgh, DetectEngineThreadCtx *det_ctx,
+        Signature *sigs)
+{
+#ifdef DETECT_SIMD_MASK_ARRAY
+    if (sgh->mask_array != NULL)
+        SCFreeAligned(sgh->mask_array);
+#endif
+    if (sgh->head_array != NULL)
+        SCFree(sgh->head_array);
+    if (det_ctx->match_array != NULL)
+        SCFree(det_ctx->match_array);
+    if (sigs != NULL)
+        SCFree(sigs);
+}
+
+/** \brief check variant 'v' against the scalar version for packet mask 'mask'
+ *
+ *  The sigs have no flags set, so the packet is never looked at. */
+static int DetectSimdTestCompare(DetectEngineThreadCtx *det_ctx, int v,
+        SignatureMask mask, Signature **ref)
+{
+    uint32_t ref_cnt;
+
+    SigMatchSignaturesBuildMatchArrayScalar(det_ctx, NULL, mask, ALPROTO_UNKNOWN);
+    ref_cnt = det_ctx->match_array_cnt;
+    memcpy(ref, det_ctx->match_array, ref_cnt * sizeof(Signature *));
+
+    detect_simd_variants[v].BuildMatchArray(det_ctx, NULL, mask, ALPROTO_UNKNOWN);
+    if (det_ctx->match_array_cnt != ref_cnt) {
+        printf("%s: mask %02x got %u sigs, expected %u: ",
+                detect_simd_variants[v].name, mask, det_ctx->match_array_cnt, ref_cnt);
+        return 0;
+    }
+    if (memcmp(ref, det_ctx->match_array, ref_cnt * sizeof(Signature *)) != 0) {
+        printf("%s: mask %02x match array differs: ", detect_simd_variants[v].name, mask);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ *  \test Test that all variants the cpu supports produce the same match
+ *        array as the scalar version, including the batch edges.
+ */
+static int SigTestSIMDMask05(void)
+{
+    uint32_t sizes[] = { 1, 17, 63, 64, 65, 127, 1000, 4099 };
+    uint32_t features = UtilCpuGetFeatures();
+    unsigned int seed = 1234;
+    SigGroupHead sgh;
+    DetectEngineThreadCtx det_ctx;
+    Signature *sigs = NULL;
+    Signature **ref = NULL;
+    int result = 0;
+    uint32_t i;
+    int v, m;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        if (DetectSimdTestSetup(&sgh, &det_ctx, &sigs, sizes[i], &seed) == 0)
+            goto end;
+        ref = SCMalloc(sizes[i] * sizeof(Signature *));
+        if (ref == NULL)
+            goto end;
+
+        for (v = 0; v < DETECT_SIMD_VARIANTS; v++) {
+            if ((detect_simd_variants[v].cpu_features & features) !=
+                    detect_simd_variants[v].cpu_features)
+                continue;
+            for (m = 0; m < 256; m++) {
+                if (DetectSimdTestCompare(&det_ctx, v, (SignatureMask)m, ref) == 0)
+                    goto end;
+            }
+        }
+
+        DetectSimdTestCleanup(&sgh, &det_ctx, sigs);
+        sigs = NULL;
+        SCFree(ref);
+        ref = NULL;
+    }
+
+    return 1;
+end:
+    DetectSimdTestCleanup(&sgh, &det_ctx, sigs);
+    if (ref != NULL)
+        SCFree(ref);
+    return result;
+}
+
+/** Comment out this if you want the mask prefilter benchmark
+ *  #define ENABLE_SIMD_BENCH 1
+ */
+
+#ifdef ENABLE_SIMD_BENCH
+/* mask prefilter benchmark
+ *
+ * Runs every variant the cpu supports against sig group heads of 5k, 10k
+ * and 20k sigs and reports the cpu ticks per packet. Build with
+ * ENABLE_SIMD_BENCH and run it using:
+ *
+ *   suricata -u -U DetectSimdBench
+ *
+ * The number of packets per run can be set with:
+ *
+ *   --set unittests.simd-bench.packets=<num> (default 1000)
+ */
+
+#define SIMD_BENCH_DEFAULT_PACKETS  1000
+
+static int DetectSimdBench01(void)
+{
+    uint32_t sizes[] = { 5000, 10000, 20000 };
+    uint32_t features = UtilCpuGetFeatures();
+    unsigned int seed = 4321;
+    SignatureMask pkt_masks[16];
+    SigGroupHead sgh;
+    DetectEngineThreadCtx det_ctx;
+    Signature *sigs = NULL;
+    Signature **ref = NULL;
+    intmax_t packets = 0;
+    int result = 0;
+    uint32_t i;
+    intmax_t n;
+    int v;
+
+    if (ConfGetInt("unittests.simd-bench.packets", &packets) != 1 ||
+        packets <= 0)
+        packets = SIMD_BENCH_DEFAULT_PACKETS;
+
+    for (i = 0; i < sizeof(pkt_masks) / sizeof(pkt_masks[0]); i++) {
+        pkt_masks[i] = (SignatureMask)rand_r(&seed);
+    }
+
+    printf("\n");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        uint64_t scalar_ticks = 0;
+
+        if (DetectSimdTestSetup(&sgh, &det_ctx, &sigs, sizes[i], &seed) == 0)
+            goto end;
+        ref = SCMalloc(sizes[i] * sizeof(Signature *));
+        if (ref == NULL)
+            goto end;
+
+        for (v = 0; v < DETECT_SIMD_VARIANTS; v++) {
+            if ((detect_simd_variants[v].cpu_features & features) !=
+                    detect_simd_variants[v].cpu_features)
+                continue;
+            if (DetectSimdTestCompare(&det_ctx, v, pkt_masks[0], ref) == 0)
+                goto end;
+
+            uint64_t start = UtilCpuGetTicks();
+            for (n = 0; n < packets; n++) {
+                detect_simd_variants[v].BuildMatchArray(&det_ctx, NULL,
+                        pkt_masks[n & 15], ALPROTO_UNKNOWN);
+            }
+            uint64_t ticks = (UtilCpuGetTicks() - start) / (uint64_t)packets;
+            if (v == 0)
+                scalar_ticks = ticks;
+
+            printf("%5u sigs %-7s %8"PRIu64" ticks/packet %6.2fx\n",
+                    sizes[i], detect_simd_variants[v].name, ticks,
+                    ticks ? (double)scalar_ticks / (double)ticks : 0.0);
+        }
+
+        DetectSimdTestCleanup(&sgh, &det_ctx, sigs);
+        sigs = NULL;
+        SCFree(ref);
+        ref = NULL;
+    }
+
+    return 1;
+end:
+    DetectSimdTestCleanup(&sgh, &det_ctx, sigs);
+    if (ref != NULL)
+        SCFree(ref);
+    return result;
+}
+#endif /* ENABLE_SIMD_BENCH */
 #endif /* UNITTESTS */
 
 void DetectSimdRegisterTests(void)
@@ -571,5 +1004,9 @@ void DetectSimdRegisterTests(void)
     UtRegisterTest("SigTestSIMDMask02", SigTestSIMDMask02, 1);
     UtRegisterTest("SigTestSIMDMask03", SigTestSIMDMask03, 1);
     UtRegisterTest("SigTestSIMDMask04", SigTestSIMDMask04, 1);
+    UtRegisterTest("SigTestSIMDMask05", SigTestSIMDMask05, 1);
+#ifdef ENABLE_SIMD_BENCH
+    UtRegisterTest("DetectSimdBench01", DetectSimdBench01, 1);
+#endif
 #endif /* UNITTESTS */
 }
@@ -624,19 +624,11 @@ static int DetectThresholdTestSig3(void)
     SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
     SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
 
-    Host *host = HostLookupHostFromHash(&p->dst);
-    if (host == NULL) {
-        printf("host not found: ");
+    if (ThresholdLookupEntry(de_ctx, &p->dst, s->id, s->gid) == NULL) {
+        printf("dst has no threshold: ");
         goto cleanup;
     }
 
-    if (!(ThresholdHostHasThreshold(host))) {
-        HostRelease(host);
-        printf("host has no threshold: ");
-        goto cleanup;
-    }
-    HostRelease(host);
-
     TimeSetIncrementTime(200);
     TimeGet(&p->ts);
 
@@ -644,16 +636,8 @@ static int DetectThresholdTestSig3(void)
     SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
     SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
 
-    host = HostLookupHostFromHash(&p->dst);
-    if (host == NULL) {
-        printf("host not found: ");
-        goto cleanup;
-    }
-    HostRelease(host);
-
-    lookup_tsh = HostGetStorageById(host, ThresholdHostStorageId());
+    lookup_tsh = ThresholdLookupEntry(de_ctx, &p->dst, s->id, s->gid);
     if (lookup_tsh == NULL) {
-        HostRelease(host);
         printf("lookup_tsh is NULL: ");
         goto cleanup;
     }
@@ -1491,6 +1475,162 @@ end:
     return result;
 }
 
+/**
+ * \test DetectThresholdTestSig13 checks that by_src state is kept per
+ *       source address, with sources sharing the sig interleaved.
+ *
+ *  \retval 1 on succces
+ *  \retval 0 on failure
+ */
+
+static int DetectThresholdTestSig13(void)
+{
+    Packet *p[2] = { NULL, NULL };
+    Signature *s = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx;
+    int result = 0;
+    int alerts[2] = { 0, 0 };
+    int i;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    p[0] = UTHBuildPacketReal((uint8_t *)"A",1,IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+    p[1] = UTHBuildPacketReal((uint8_t *)"A",1,IPPROTO_TCP, "3.3.3.3", "2.2.2.2", 1024, 80);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL) {
+        goto end;
+    }
+
+    de_ctx->flags |= DE_QUIET;
+
+    s = de_ctx->sig_list = SigInit(de_ctx,"alert tcp any any -> any 80 (msg:\"Threshold limit\"; threshold: type limit, track by_src, count 2, seconds 60; sid:10;)");
+    if (s == NULL) {
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    for (i = 0; i < 6; i++) {
+        TimeGet(&p[i % 2]->ts);
+        SigMatchSignatures(&th_v, de_ctx, det_ctx, p[i % 2]);
+        alerts[i % 2] += PacketAlertCheck(p[i % 2], 10);
+    }
+
+    if (alerts[0] != 2 || alerts[1] != 2) {
+        printf("alerts %d %d, expected 2 2: ", alerts[0], alerts[1]);
+        goto cleanup;
+    }
+
+    DetectThresholdEntry *e0 = ThresholdLookupEntry(de_ctx, &p[0]->src, s->id, s->gid);
+    DetectThresholdEntry *e1 = ThresholdLookupEntry(de_ctx, &p[1]->src, s->id, s->gid);
+    if (e0 == NULL || e1 == NULL || e0 == e1 ||
+        e0->current_count != 3 || e1->current_count != 3) {
+        printf("src entries not separate: ");
+        goto cleanup;
+    }
+    if (ThresholdLookupEntry(de_ctx, &p[0]->dst, s->id, s->gid) != NULL) {
+        printf("dst has an entry: ");
+        goto cleanup;
+    }
+
+    result = 1;
+
+cleanup:
+    SigGroupCleanup(de_ctx);
+    SigCleanSignatures(de_ctx);
+
+    DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    DetectEngineCtxFree(de_ctx);
+end:
+    UTHFreePackets(p, 2);
+    return result;
+}
+
+/**
+ * \test DetectThresholdTestSig14 checks that the flow manager time out
+ *       removes an expired by_src entry and gives back its memory, and
+ *       keeps it for times before the entry's own.
+ *
+ *  \retval 1 on succces
+ *  \retval 0 on failure
+ */
+
+static int DetectThresholdTestSig14(void)
+{
+    Packet *p = NULL;
+    Signature *s = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx;
+    struct timeval ts;
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+
+    p = UTHBuildPacketReal((uint8_t *)"A",1,IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL) {
+        goto end;
+    }
+
+    de_ctx->flags |= DE_QUIET;
+
+    s = de_ctx->sig_list = SigInit(de_ctx,"alert tcp any any -> any 80 (msg:\"Threshold limit\"; threshold: type limit, track by_src, count 2, seconds 60; sid:10;)");
+    if (s == NULL) {
+        goto end;
+    }
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    uint64_t memuse = SC_ATOMIC_GET(de_ctx->ths_ctx.memuse);
+
+    p->ts.tv_sec = 1000000;
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+    if (ThresholdLookupEntry(de_ctx, &p->src, s->id, s->gid) == NULL) {
+        printf("no entry: ");
+        goto cleanup;
+    }
+
+    memset(&ts, 0, sizeof(ts));
+    /* time of another thread that is behind: no wrap to a huge age */
+    ts.tv_sec = p->ts.tv_sec - 10;
+    ThresholdTimeoutHash(&ts);
+    ts.tv_sec = p->ts.tv_sec + 30;
+    ThresholdTimeoutHash(&ts);
+    if (ThresholdLookupEntry(de_ctx, &p->src, s->id, s->gid) == NULL) {
+        printf("entry timed out early: ");
+        goto cleanup;
+    }
+
+    ts.tv_sec = p->ts.tv_sec + 61;
+    if (ThresholdTimeoutHash(&ts) != 1 ||
+        ThresholdLookupEntry(de_ctx, &p->src, s->id, s->gid) != NULL) {
+        printf("entry not timed out: ");
+        goto cleanup;
+    }
+    if (SC_ATOMIC_GET(de_ctx->ths_ctx.memuse) != memuse) {
+        printf("memuse %"PRIu64" != %"PRIu64": ",
+               (uint64_t)SC_ATOMIC_GET(de_ctx->ths_ctx.memuse), memuse);
+        goto cleanup;
+    }
+
+    result = 1;
+
+cleanup:
+    SigGroupCleanup(de_ctx);
+    SigCleanSignatures(de_ctx);
+
+    DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+    DetectEngineCtxFree(de_ctx);
+end:
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void ThresholdRegisterTests(void)
@@ -1513,6 +1653,8 @@ void ThresholdRegisterTests(void)
     UtRegisterTest("DetectThresholdTestSig10", DetectThresholdTestSig10, 1);
     UtRegisterTest("DetectThresholdTestSig11", DetectThresholdTestSig11, 1);
     UtRegisterTest("DetectThresholdTestSig12", DetectThresholdTestSig12, 1);
+    UtRegisterTest("DetectThresholdTestSig13", DetectThresholdTestSig13, 1);
+    UtRegisterTest("DetectThresholdTestSig14", DetectThresholdTestSig14, 1);
 #endif /* UNITTESTS */
 }
 
@@ -46,6 +46,8 @@ int DetectTtlMatch (ThreadVars *, DetectEngineThreadCtx *, Packet *, Signature *
 static int DetectTtlSetup (DetectEngineCtx *, Signature *, char *);
 void DetectTtlFree (void *);
 void DetectTtlRegisterTests (void);
+static int PrefilterTtlGetValue(const Packet *, uint8_t *);
+static int PrefilterTtlMatchValue(const SigMatch *, uint8_t);
 
 /**
  * \brief Registration function for ttl: keyword
@@ -59,6 +61,8 @@ void DetectTtlRegister(void) {
     sigmatch_table[DETECT_TTL].Setup = DetectTtlSetup;
     sigmatch_table[DETECT_TTL].Free = DetectTtlFree;
     sigmatch_table[DETECT_TTL].RegisterTests = DetectTtlRegisterTests;
+    sigmatch_table[DETECT_TTL].PrefilterGetValue = PrefilterTtlGetValue;
+    sigmatch_table[DETECT_TTL].PrefilterMatchValue = PrefilterTtlMatchValue;
 
     const char *eb;
     int eo;
@@ -83,6 +87,20 @@ error:
     return;
 }
 
+static inline int TtlMatch(const uint8_t pttl, const DetectTtlData *ttld)
+{
+    if (ttld->mode == DETECT_TTL_EQ && pttl == ttld->ttl1)
+        return 1;
+    else if (ttld->mode == DETECT_TTL_LT && pttl < ttld->ttl1)
+        return 1;
+    else if (ttld->mode == DETECT_TTL_GT && pttl > ttld->ttl1)
+        return 1;
+    else if (ttld->mode == DETECT_TTL_RA && (pttl > ttld->ttl1 && pttl < ttld->ttl2))
+        return 1;
+
+    return 0;
+}
+
 /**
  * \brief This function is used to match TTL rule option on a packet with those passed via ttl:
  *
@@ -96,32 +114,34 @@ error:
  */
 int DetectTtlMatch (ThreadVars *t, DetectEngineThreadCtx *det_ctx, Packet *p, Signature *s, SigMatch *m) {
 
-    int ret = 0;
     uint8_t pttl;
     DetectTtlData *ttld = (DetectTtlData *) m->ctx;
 
+    if (PrefilterTtlGetValue(p, &pttl) == 0)
+        return 0;
+
+    return TtlMatch(pttl, ttld);
+}
+
+static int PrefilterTtlGetValue(const Packet *p, uint8_t *value)
+{
     if (PKT_IS_PSEUDOPKT(p))
         return 0;
 
     if (PKT_IS_IPV4(p)) {
-        pttl = IPV4_GET_IPTTL(p);
+        *value = IPV4_GET_IPTTL(p);
     } else if (PKT_IS_IPV6(p)) {
-        pttl = IPV6_GET_HLIM(p);
+        *value = IPV6_GET_HLIM(p);
     } else {
         SCLogDebug("Packet is of not IPv4 or IPv6");
-        return ret;
+        return 0;
     }
+    return 1;
+}
 
-    if (ttld->mode == DETECT_TTL_EQ && pttl == ttld->ttl1)
-        ret = 1;
-    else if (ttld->mode == DETECT_TTL_LT && pttl < ttld->ttl1)
-        ret = 1;
-    else if (ttld->mode == DETECT_TTL_GT && pttl > ttld->ttl1)
-        ret = 1;
-    else if (ttld->mode == DETECT_TTL_RA && (pttl > ttld->ttl1 && pttl < ttld->ttl2))
-        ret = 1;
-
-    return ret;
+static int PrefilterTtlMatchValue(const SigMatch *sm, uint8_t value)
+{
+    return TtlMatch(value, (const DetectTtlData *)sm->ctx);
 }
 
 /**
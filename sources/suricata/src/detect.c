@@ -36,18 +36,24 @@
 
 #include "detect-engine-alert.h"
 #include "detect-engine-siggroup.h"
+#include "detect-engine-prefilter.h"
+#include "detect-engine-candidates.h"
+#include "detect-engine-rule-sample.h"
 #include "detect-engine-address.h"
 #include "detect-engine-proto.h"
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
 #include "detect-engine-iponly.h"
 #include "detect-engine-threshold.h"
+#include "host.h"
 
 #include "detect-engine-payload.h"
 #include "detect-engine-dcepayload.h"
 #include "detect-engine-uri.h"
 #include "detect-dns-query.h"
 #include "detect-engine-state.h"
+#include "detect-engine-content-inspection.h"
+#include "detect-engine-sgh-lookup.h"
 #include "detect-engine-analyzer.h"
 
 #include "detect-http-cookie.h"
@@ -544,6 +550,15 @@ int SigMatchSignaturesBuildMatchArrayAddSignature(DetectEngineThreadCtx *det_ctx
         }
     }
 
+    /* sigs without a fast pattern that are prefiltered on a keyword: the
+     * keyword's engine has to have picked the sig for this packet */
+    if (s->flags & SIG_FLAG_PREFILTER) {
+        if (!(det_ctx->prefilter_bitarray[(s->num / 8)] & (1 << (s->num % 8)))) {
+            SCLogDebug("not a candidate of the prefilter engine");
+            return 0;
+        }
+    }
+
     /* de_state check, filter out all signatures that already had a match before
      * or just partially match */
     if (s->flags & SIG_FLAG_STATE_MATCH) {
@@ -554,47 +569,15 @@ int SigMatchSignaturesBuildMatchArrayAddSignature(DetectEngineThreadCtx *det_ctx
          */
         if (det_ctx->de_state_sig_array[s->num] == DE_STATE_MATCH_NO_NEW_STATE)
             return 0;
+        if (det_ctx->de_state_done != NULL &&
+            DeStateSigIsDone(det_ctx->de_state_done, s->num))
+            return 0;
     }
 
     return 1;
 }
 
-#if defined(__SSE3__) || defined(__tile__)
-/* SIMD implementations are in detect-simd.c */
-#else
-/* Non-SIMD implementation */
-/**
- *  \brief build an array of signatures that will be inspected
- *
- *  All signatures that can be filtered out on forehand are not added to it.
- *
- *  \param de_ctx detection engine ctx
- *  \param det_ctx detection engine thread ctx -- array is stored here
- *  \param p packet
- *  \param mask Packets mask
- *  \param alproto application layer protocol
- */
-void SigMatchSignaturesBuildMatchArray(DetectEngineThreadCtx *det_ctx,
-                                       Packet *p, SignatureMask mask,
-                                       AppProto alproto)
-{
-    uint32_t u;
-
-    /* reset previous run */
-    det_ctx->match_array_cnt = 0;
-
-    for (u = 0; u < det_ctx->sgh->sig_cnt; u++) {
-        SignatureHeader *s = &det_ctx->sgh->head_array[u];
-        if ((mask & s->mask) == s->mask) {
-            if (SigMatchSignaturesBuildMatchArrayAddSignature(det_ctx, p, s, alproto) == 1) {
-                /* okay, store it */
-                det_ctx->match_array[det_ctx->match_array_cnt] = s->full_sig;
-                det_ctx->match_array_cnt++;
-            }
-        }
-    }
-}
-#endif /* No SIMD implementation */
+/* SigMatchSignaturesBuildMatchArray() implementations are in detect-simd.c */
 
 int SigMatchSignaturesRunPostMatch(ThreadVars *tv,
                                    DetectEngineCtx *de_ctx, DetectEngineThreadCtx *det_ctx, Packet *p,
@@ -653,11 +636,14 @@ SigGroupHead *SigMatchSignaturesGetSgh(DetectEngineCtx *de_ctx, DetectEngineThre
     SCLogDebug("f %d", f);
     SCLogDebug("IP_GET_IPPROTO(p) %u", IP_GET_IPPROTO(p));
 
-    /* find the right mpm instance */
-    DetectAddress *ag = DetectAddressLookupInHead(de_ctx->flow_gh[f].src_gh[IP_GET_IPPROTO(p)], &p->src);
+    /* find the right mpm instance, using the compiled lookup for the
+     * lists that have one */
+    const void *next = NULL;
+    DetectAddress *ag = DetectSghLookupAddressGroup(de_ctx->flow_gh[f].src_lookup[IP_GET_IPPROTO(p)],
+            de_ctx->flow_gh[f].src_gh[IP_GET_IPPROTO(p)], &p->src, &next);
     if (ag != NULL) {
         /* source group found, lets try a dst group */
-        ag = DetectAddressLookupInHead(ag->dst_gh, &p->dst);
+        ag = DetectSghLookupAddressGroup(next, ag->dst_gh, &p->dst, &next);
         if (ag != NULL) {
             if (ag->port == NULL) {
                 SCLogDebug("we don't have ports");
@@ -665,9 +651,10 @@ SigGroupHead *SigMatchSignaturesGetSgh(DetectEngineCtx *de_ctx, DetectEngineThre
             } else {
                 SCLogDebug("we have ports");
 
-                DetectPort *sport = DetectPortLookupGroup(ag->port,p->sp);
+                const DetectSghLookupPorts *lp = NULL;
+                DetectPort *sport = DetectSghLookupPortGroup(next, ag->port, p->sp, &lp);
                 if (sport != NULL) {
-                    DetectPort *dport = DetectPortLookupGroup(sport->dst_ph,p->dp);
+                    DetectPort *dport = DetectSghLookupPortGroup(lp, sport->dst_ph, p->dp, &lp);
                     if (dport != NULL) {
                         sgh = dport->sh;
                     } else {
@@ -687,6 +674,43 @@ SigGroupHead *SigMatchSignaturesGetSgh(DetectEngineCtx *de_ctx, DetectEngineThre
     SCReturnPtr(sgh, "SigGroupHead");
 }
 
+/**
+ *  \brief Get the raw stream mpm window for the direction of the packet,
+ *         setting it up if needed. The window is accounted to the stream
+ *         memcap, it's freed with the session.
+ *
+ *  \param f flow, locked
+ *  \param p packet
+ *
+ *  \retval win window or NULL if we have no tcp session or no memory, in
+ *           which case the smsgs are scanned in full
+ */
+static StreamMpmWindow *SigMatchSignaturesGetMpmWindow(Flow *f, Packet *p)
+{
+    TcpSession *ssn = (TcpSession *)f->protoctx;
+    StreamMpmWindow **win;
+
+    if (ssn == NULL)
+        return NULL;
+
+    if (p->flowflags & FLOW_PKT_TOSERVER)
+        win = &ssn->toserver_mpm_window;
+    else
+        win = &ssn->toclient_mpm_window;
+
+    if (*win == NULL) {
+        if (StreamTcpCheckMemcap((uint64_t)sizeof(StreamMpmWindow)) == 0)
+            return NULL;
+
+        *win = SCMalloc(sizeof(StreamMpmWindow));
+        if (unlikely(*win == NULL))
+            return NULL;
+        memset(*win, 0x00, sizeof(StreamMpmWindow));
+        StreamTcpIncrMemuse((uint64_t)sizeof(StreamMpmWindow));
+    }
+    return *win;
+}
+
 /** \brief Get the smsgs relevant to this packet
  *
  *  \param f LOCKED flow
@@ -1030,20 +1054,13 @@ static void DebugInspectIds(Packet *p, Flow *f, StreamMsg *smsg)
 
 static void AlertDebugLogModeSyncFlowbitsNamesToPacketStruct(Packet *p, DetectEngineCtx *de_ctx)
 {
-#define MALLOC_JUMP 5
-
     int i = 0;
+    int idx;
 
-    GenericVar *gv = p->flow->flowvar;
-
-    while (gv != NULL) {
-        i++;
-        gv = gv->next;
-    }
-    if (i == 0)
+    if (p->flow->flowbits_cnt == 0)
         return;
 
-    p->debuglog_flowbits_names_len = i;
+    p->debuglog_flowbits_names_len = p->flow->flowbits_cnt;
 
     p->debuglog_flowbits_names = SCMalloc(sizeof(char *) *
                                           p->debuglog_flowbits_names_len);
@@ -1053,42 +1070,14 @@ static void AlertDebugLogModeSyncFlowbitsNamesToPacketStruct(Packet *p, DetectEn
     memset(p->debuglog_flowbits_names, 0,
            sizeof(char *) * p->debuglog_flowbits_names_len);
 
-    i = 0;
-    gv = p->flow->flowvar;
-    while (gv != NULL) {
-        if (gv->type != DETECT_FLOWBITS) {
-            gv = gv->next;
-            continue;
-        }
-
-        FlowBit *fb = (FlowBit *) gv;
-        char *name = VariableIdxGetName(de_ctx, fb->idx, fb->type);
+    for (idx = FlowBitGetNext(p->flow, 0);
+         idx != -1 && i < p->debuglog_flowbits_names_len;
+         idx = (idx < UINT16_MAX) ? FlowBitGetNext(p->flow, (uint16_t)(idx + 1)) : -1)
+    {
+        char *name = VariableIdxGetName(de_ctx, (uint16_t)idx, DETECT_FLOWBITS);
         if (name != NULL) {
-            p->debuglog_flowbits_names[i] = SCStrdup(name);
-            if (p->debuglog_flowbits_names[i] == NULL) {
-                return;
-            }
-            i++;
-        }
-
-        if (i == p->debuglog_flowbits_names_len) {
-            p->debuglog_flowbits_names_len += MALLOC_JUMP;
-            const char **names = SCRealloc(p->debuglog_flowbits_names,
-                                                   sizeof(char *) *
-                                                   p->debuglog_flowbits_names_len);
-            if (names == NULL) {
-                SCFree(p->debuglog_flowbits_names);
-                p->debuglog_flowbits_names = NULL;
-                p->debuglog_flowbits_names_len = 0;
-                return;
-            }
-            p->debuglog_flowbits_names = names;
-            memset(p->debuglog_flowbits_names +
-                   p->debuglog_flowbits_names_len - MALLOC_JUMP,
-                   0, sizeof(char *) * MALLOC_JUMP);
+            p->debuglog_flowbits_names[i++] = name;
         }
-
-        gv = gv->next;
     }
 
     return;
@@ -1105,9 +1094,7 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
     uint8_t sms_runflags = 0;   /* function flags */
     uint8_t alert_flags = 0;
     AppProto alproto = ALPROTO_UNKNOWN;
-#ifdef PROFILING
     int smatch = 0; /* signature match: 1, no match: 0 */
-#endif
     uint32_t idx;
     uint8_t flags = 0;          /* flow/state flags */
     StreamMsg *smsg = NULL;
@@ -1126,12 +1113,18 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
 
     p->alerts.cnt = 0;
     det_ctx->filestore_cnt = 0;
+    det_ctx->smsg_mpm_window = NULL;
+    det_ctx->de_state_done = NULL;
+    det_ctx->alert_queue_cnt = 0;
+    det_ctx->alert_queue_unsorted = 0;
 
     /* No need to perform any detection on this packet, if the the given flag is set.*/
     if (p->flags & PKT_NOPACKET_INSPECTION) {
         SCReturnInt(0);
     }
 
+    DetectRuleSamplePacket(det_ctx);
+
     /* Load the Packet's flow early, even though it might not be needed.
      * Mark as a constant pointer, although the flow can change.
      */
@@ -1161,6 +1154,7 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
                 pflow->de_ctx_id = de_ctx->id;
                 GenericVarFree(pflow->flowvar);
                 pflow->flowvar = NULL;
+                FlowBitFreeAll(pflow);
             }
 
             /* set the iponly stuff */
@@ -1183,6 +1177,8 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
                 PACKET_PROFILING_DETECT_END(p, PROF_DETECT_GETSGH);
 
                 smsg = SigMatchSignaturesGetSmsg(pflow, p, flags);
+                if (smsg != NULL && StreamTcpRawSlidingWindowMode())
+                    det_ctx->smsg_mpm_window = SigMatchSignaturesGetMpmWindow(pflow, p);
 #if 0
                 StreamMsg *tmpsmsg = smsg;
                 while (tmpsmsg) {
@@ -1297,8 +1293,8 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
     PACKET_PROFILING_DETECT_START(p, PROF_DETECT_STATEFUL);
     /* stateful app layer detection */
     if ((p->flags & PKT_HAS_FLOW) && has_state) {
-        /* initialize to 0(DE_STATE_MATCH_HAS_NEW_STATE) */
-        memset(det_ctx->de_state_sig_array, 0x00, det_ctx->de_state_sig_array_len);
+        /* reset the sigs the last packet set to 0(DE_STATE_MATCH_HAS_NEW_STATE) */
+        DeStateResetSigArray(det_ctx);
         int has_inspectable_state = DeStateFlowHasInspectableState(pflow, alproto, alversion, flags);
         if (has_inspectable_state == 1) {
             DeStateDetectContinueDetection(th_v, de_ctx, det_ctx, p, pflow,
@@ -1320,18 +1316,22 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
     PACKET_PROFILING_DETECT_END(p, PROF_DETECT_MPM);
 
     PACKET_PROFILING_DETECT_START(p, PROF_DETECT_PREFILTER);
+    /* flag the candidates of the keyword prefilter engines */
+    if (det_ctx->sgh->prefilter_engines != NULL)
+        DetectPrefilterRun(det_ctx, p);
     /* build the match array */
     SigMatchSignaturesBuildMatchArray(det_ctx, p, mask, alproto);
+    if (det_ctx->sgh->prefilter_engines != NULL)
+        DetectPrefilterReset(det_ctx, p);
     PACKET_PROFILING_DETECT_END(p, PROF_DETECT_PREFILTER);
 
     PACKET_PROFILING_DETECT_START(p, PROF_DETECT_RULES);
     /* inspect the sigs against the packet */
     for (idx = 0; idx < det_ctx->match_array_cnt; idx++) {
         RULE_PROFILING_START(p);
+        RULE_SAMPLE_START(det_ctx);
         state_alert = 0;
-#ifdef PROFILING
         smatch = 0;
-#endif
 
         s = det_ctx->match_array[idx];
         SCLogDebug("inspecting signature id %"PRIu32"", s->id);
@@ -1341,7 +1341,7 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
          * can't match and we skip it. */
         if ((p->flags & PKT_HAS_FLOW) && (s->flags & SIG_FLAG_REQUIRE_FLOWVAR)) {
             FLOWLOCK_RDLOCK(pflow);
-            int m  = pflow->flowvar ? 1 : 0;
+            int m  = (pflow->flowvar || pflow->flowbits_cnt) ? 1 : 0;
             FLOWLOCK_UNLOCK(pflow);
 
             /* no flowvars? skip this sig */
@@ -1542,9 +1542,7 @@ int SigMatchSignatures(ThreadVars *th_v, DetectEngineCtx *de_ctx, DetectEngineTh
             alert_flags |= PACKET_ALERT_FLAG_STATE_MATCH;
         }
 
-#ifdef PROFILING
         smatch = 1;
-#endif
 
         SigMatchSignaturesRunPostMatch(th_v, de_ctx, det_ctx, p, s);
 
@@ -1562,6 +1560,7 @@ next:
         DetectReplaceFree(det_ctx->replist);
         det_ctx->replist = NULL;
         RULE_PROFILING_END(det_ctx, s, smatch, p);
+        RULE_SAMPLE_END(det_ctx, s, smatch);
 
         det_ctx->flags = 0;
         continue;
@@ -1593,7 +1592,6 @@ end:
 
     DetectEngineCleanHCBDBuffers(det_ctx);
     DetectEngineCleanHSBDBuffers(det_ctx);
-    DetectEngineCleanHHDBuffers(det_ctx);
 
     /* store the found sgh (or NULL) in the flow to save us from looking it
      * up again for the next packet. Also return any stream chunk we processed
@@ -3871,6 +3869,9 @@ int SigAddressCleanupStage1(DetectEngineCtx *de_ctx) {
         SCLogDebug("cleaning up signature grouping structure...");
     }
 
+    /* the compiled lookup points into the lists freed below */
+    DetectSghLookupFree(de_ctx);
+
     int f, proto;
     for (f = 0; f < FLOW_STATES; f++) {
         for (proto = 0; proto < 256; proto++) {
@@ -3942,29 +3943,57 @@ void DbgSghContainsSig(DetectEngineCtx *de_ctx, SigGroupHead *sgh, uint32_t sid)
     printf("\n");
 }
 
+/** \brief finalize a single sgh, called from the build threads
+ *
+ *  \param data uint32_t counter of failed sghs, updated atomically
+ */
+static void SigAddressPrepareStage4Sgh(DetectEngineCtx *de_ctx, void *data, uint32_t idx)
+{
+    SigGroupHead *sgh = de_ctx->sgh_array[idx];
+    if (sgh == NULL)
+        return;
+
+    SigGroupHeadBuildHeadArray(de_ctx, sgh);
+    /* the prefilter sigs are only candidates through their engine */
+    if (DetectPrefilterBuildSgh(de_ctx, sgh) != 0) {
+        SCLogError(SC_ERR_MEM_ALLOC, "building the prefilter engines of "
+                   "sgh %"PRIu32" failed", idx);
+        (void)SCAtomicFetchAndAdd((uint32_t *)data, 1);
+        return;
+    }
+    DetectCandidatesBuildSgh(de_ctx, sgh);
+    SigGroupHeadSetFilemagicFlag(de_ctx, sgh);
+    SigGroupHeadSetFileMd5Flag(de_ctx, sgh);
+    SigGroupHeadSetFilesizeFlag(de_ctx, sgh);
+    SigGroupHeadSetFilestoreCount(de_ctx, sgh);
+    SCLogDebug("filestore count %u", sgh->filestore_cnt);
+}
+
 /** \brief finalize preparing sgh's */
 int SigAddressPrepareStage4(DetectEngineCtx *de_ctx) {
     SCEnter();
+    uint32_t failed = 0;
 
     //SCLogInfo("sgh's %"PRIu32, de_ctx->sgh_array_cnt);
 
-    uint32_t idx = 0;
+    /* the mpm flags of the sigs are final now, assign the prefilter
+     * keywords before the head arrays copy the flags */
+    DetectPrefilterSetupSignatures(de_ctx);
 
-    for (idx = 0; idx < de_ctx->sgh_array_cnt; idx++) {
-        SigGroupHead *sgh = de_ctx->sgh_array[idx];
-        if (sgh == NULL)
-            continue;
-
-        SigGroupHeadBuildHeadArray(de_ctx, sgh);
-        SigGroupHeadSetFilemagicFlag(de_ctx, sgh);
-        SigGroupHeadSetFileMd5Flag(de_ctx, sgh);
-        SigGroupHeadSetFilesizeFlag(de_ctx, sgh);
-        SigGroupHeadSetFilestoreCount(de_ctx, sgh);
-        SCLogDebug("filestore count %u", sgh->filestore_cnt);
-    }
+    /* the sghs in the array are unique, so they can be done in parallel */
+    DetectEngineBuildRunParallel(de_ctx, de_ctx->sgh_array_cnt,
+                                 SigAddressPrepareStage4Sgh, &failed);
+    if (failed > 0)
+        SCReturnInt(-1);
 
     if (de_ctx->decoder_event_sgh != NULL) {
         SigGroupHeadBuildHeadArray(de_ctx, de_ctx->decoder_event_sgh);
+        if (DetectPrefilterBuildSgh(de_ctx, de_ctx->decoder_event_sgh) != 0) {
+            SCLogError(SC_ERR_MEM_ALLOC, "building the prefilter engines of "
+                       "the decoder event sgh failed");
+            SCReturnInt(-1);
+        }
+        DetectCandidatesBuildSgh(de_ctx, de_ctx->decoder_event_sgh);
         /* no need to set filestore count here as that would make a
          * signature not decode event only. */
     }
@@ -4287,6 +4316,18 @@ int SigAddressPrepareStage5(DetectEngineCtx *de_ctx) {
     return 0;
 }
 
+/** \brief wall clock ms since t, t is updated to now */
+static uint32_t SigGroupBuildElapsed(struct timeval *t)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    uint32_t ms = (uint32_t)((now.tv_sec - t->tv_sec) * 1000 +
+                             (now.tv_usec - t->tv_usec) / 1000);
+    *t = now;
+    return ms;
+}
+
 /**
  * \brief Convert the signature list into the runtime match structure.
  *
@@ -4299,6 +4340,12 @@ int SigAddressPrepareStage5(DetectEngineCtx *de_ctx) {
 int SigGroupBuild(DetectEngineCtx *de_ctx)
 {
     Signature *s = de_ctx->sig_list;
+    struct timeval start, t;
+    uint32_t ms_stage[5];
+    uint32_t mpm_cnt = 0;
+
+    gettimeofday(&start, NULL);
+    t = start;
 
     /* Assign the unique order id of signatures after sorting,
      * so the IP Only engine process them in order too.  Also
@@ -4314,31 +4361,62 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
     if (DetectSetFastPatternAndItsId(de_ctx) < 0)
         return -1;
+    if (DetectEngineContentInspectionBuild(de_ctx) < 0)
+        return -1;
+    ms_stage[0] = SigGroupBuildElapsed(&t);
 
     /* if we are using single sgh_mpm_context then let us init the standard mpm
      * contexts using the mpm_ctx factory */
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
         SigInitStandardMpmFactoryContexts(de_ctx);
+
+        /* the mpm cache needs to know which patterns went into a ctx */
+        if (de_ctx->mpm_cache_dir != NULL) {
+            int i;
+            MpmCtxFactoryContainer *mcfc = de_ctx->mpm_ctx_factory_container;
+            for (i = 0; mcfc != NULL && i < mcfc->no_of_items; i++) {
+                if (mcfc->items[i].mpm_ctx_ts != NULL &&
+                    MpmCtxRecordPatternKeys(mcfc->items[i].mpm_ctx_ts) != 0)
+                    break;
+                if (mcfc->items[i].mpm_ctx_tc != NULL &&
+                    MpmCtxRecordPatternKeys(mcfc->items[i].mpm_ctx_tc) != 0)
+                    break;
+            }
+        }
+    } else {
+        /* per sgh contexts: share the ones with identical pattern sets */
+        if (MpmStoreInit(de_ctx) != 0) {
+            SCLogError(SC_ERR_DETECT_PREPARE, "initializing the mpm store failed");
+            exit(EXIT_FAILURE);
+        }
     }
 
     if (SigAddressPrepareStage1(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    ms_stage[1] = SigGroupBuildElapsed(&t);
 //exit(0);
     if (SigAddressPrepareStage2(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    ms_stage[2] = SigGroupBuildElapsed(&t);
 
     if (SigAddressPrepareStage3(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    ms_stage[3] = SigGroupBuildElapsed(&t);
     if (SigAddressPrepareStage4(de_ctx) != 0) {
         SCLogError(SC_ERR_DETECT_PREPARE, "initializing the detection engine failed");
         exit(EXIT_FAILURE);
     }
+    if (DetectSghLookupBuild(de_ctx) != 0) {
+        SCLogWarning(SC_ERR_MEM_ALLOC, "compiling the sgh lookup failed, "
+                "falling back to walking the address and port lists");
+    }
+    ms_stage[4] = SigGroupBuildElapsed(&t);
 
     if (de_ctx->sgh_mpm_context == ENGINE_SGH_MPM_FACTORY_CONTEXT_SINGLE) {
         MpmCtx *mpm_ctx = NULL;
@@ -4363,178 +4441,115 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 #endif
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_tcp_packet, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_udp_packet, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_proto_other_packet, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("packet- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_uri, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_uri, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("uri- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcbd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcbd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hcbd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsbd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsbd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hsbd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hrhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hmd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hmd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hmd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hcd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hcd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrud, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrud, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hrud- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_stream, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("stream- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsmd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hsmd- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hsmd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hsmd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hscd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hscd- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hscd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hscd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_huad, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("huad- %d\n", mpm_ctx->pattern_cnt);
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_huad, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("huad- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhhd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hhhd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhhd, 0);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hrhhd- %d\n", mpm_ctx->pattern_cnt);
 
         mpm_ctx = MpmFactoryGetMpmCtxForProfile(de_ctx, de_ctx->sgh_mpm_context_hrhhd, 1);
-        if (mpm_table[de_ctx->mpm_matcher].Prepare != NULL) {
-            mpm_table[de_ctx->mpm_matcher].Prepare(mpm_ctx);
-        }
+        MpmPrepareQueueAdd(de_ctx, mpm_ctx);
         //printf("hrhhd- %d\n", mpm_ctx->pattern_cnt);
 
+        /* prepare while the cuda context is pushed */
+        mpm_cnt += MpmPrepareQueueRun(de_ctx);
+
 #ifdef __SC_CUDA_SUPPORT__
         if (PatternMatchDefaultMatcher() == MPM_AC_CUDA) {
             int r = SCCudaCtxPopCurrent(NULL);
@@ -4551,6 +4566,19 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
     }
 
+    /* the unique per sgh ctxs queued by the mpm store */
+    mpm_cnt += MpmPrepareQueueRun(de_ctx);
+    uint32_t ms_mpm = SigGroupBuildElapsed(&t);
+
+    MpmStoreReportStats(de_ctx);
+
+    SCLogInfo("detection engine build took %"PRIu32" ms (%"PRIu16" threads): "
+            "fast patterns %"PRIu32" ms, stage 1 %"PRIu32" ms, stage 2 %"PRIu32
+            " ms, stage 3 %"PRIu32" ms, stage 4 %"PRIu32" ms, mpm prepare "
+            "(%"PRIu32" contexts) %"PRIu32" ms",
+            SigGroupBuildElapsed(&start), de_ctx->build_threads, ms_stage[0],
+            ms_stage[1], ms_stage[2], ms_stage[3], ms_stage[4], mpm_cnt, ms_mpm);
+
 //    SigAddressPrepareStage5(de_ctx);
 //    DetectAddressPrintMemory();
 //    DetectSigGroupPrintMemory();
@@ -4563,6 +4591,8 @@ int SigGroupBuild(DetectEngineCtx *de_ctx)
 
 int SigGroupCleanup (DetectEngineCtx *de_ctx) {
     SigAddressCleanupStage1(de_ctx);
+    /* the sghs are gone, so are the users of the shared mpm ctxs */
+    MpmStoreFree(de_ctx);
 
     return 0;
 }
@@ -10694,6 +10724,112 @@ static int SigTestDepthOffset01Wm (void) {
     return SigTestDepthOffset01Real(MPM_WUMANBER);
 }
 
+/** \test raw stream sliding window: a pattern split over the new data of
+ *        two overlapping smsgs is found by the rescan with look back, a
+ *        match from the skipped part is re-added from the window and
+ *        dropped once its data left the window */
+static int SigTestStreamMpmWindow01(void)
+{
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    StreamMpmWindow win;
+    StreamMsg smsg;
+    Packet *p = NULL;
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+    memset(&win, 0, sizeof(win));
+    memset(&smsg, 0, sizeof(smsg));
+
+    p = UTHBuildPacket((uint8_t *)"x", 1, IPPROTO_TCP);
+    if (p == NULL)
+        return 0;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->flags |= DE_QUIET;
+
+    Signature *s1 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"abcdef\"; sid:1;)");
+    Signature *s2 = DetectEngineAppendSig(de_ctx, "alert tcp any any -> any any "
+            "(content:\"xxxx\"; sid:2;)");
+    if (s1 == NULL || s2 == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    det_ctx->sgh = SigMatchSignaturesGetSgh(de_ctx, det_ctx, p);
+    if (det_ctx->sgh == NULL || det_ctx->sgh->mpm_stream_ctx_ts == NULL) {
+        printf("no stream mpm ctx: ");
+        goto end;
+    }
+    det_ctx->smsg_mpm_window = &win;
+
+    uint32_t pid1 = ((DetectContentData *)s1->mpm_sm->ctx)->id;
+    uint32_t pid2 = ((DetectContentData *)s2->mpm_sm->ctx)->id;
+    PatternMatcherQueue *pmq = &det_ctx->smsg_pmq[0];
+
+    /* all new data, only "xxxx" matches */
+    smsg.seq = 1;
+    smsg.new_data_offset = 0;
+    smsg.data_len = 13;
+    memcpy(smsg.data, "xxxxxxxxxxabc", 13);
+    StreamPatternSearch(det_ctx, p, &smsg, STREAM_TOSERVER);
+    if (pmq->pattern_id_array_cnt != 1 || pmq->pattern_id_array[0] != pid2) {
+        printf("smsg 1: expected only pid %u, got %u pids: ", pid2,
+                pmq->pattern_id_array_cnt);
+        goto end;
+    }
+    PmqReset(pmq);
+    PmqReset(&det_ctx->pmq);
+
+    /* the window slides: old 13 bytes plus new data completing "abcdef".
+     * Only "xxabcdefyyyy" is scanned, "xxxx" comes from the window. */
+    smsg.seq = 14;
+    smsg.new_data_offset = 13;
+    smsg.data_len = 20;
+    memcpy(smsg.data, "xxxxxxxxxxabcdefyyyy", 20);
+    StreamPatternSearch(det_ctx, p, &smsg, STREAM_TOSERVER);
+    if (pmq->pattern_id_array_cnt != 2 ||
+        !(pmq->pattern_id_bitarray[pid1 / 8] & (1 << (pid1 % 8))) ||
+        !(pmq->pattern_id_bitarray[pid2 / 8] & (1 << (pid2 % 8)))) {
+        printf("smsg 2: expected pids %u and %u, got %u pids: ", pid1, pid2,
+                pmq->pattern_id_array_cnt);
+        goto end;
+    }
+    if (det_ctx->pmq.pattern_id_array_cnt != 2) {
+        printf("smsg 2: pmq not merged: ");
+        goto end;
+    }
+    PmqReset(pmq);
+    PmqReset(&det_ctx->pmq);
+
+    /* earlier data left the window, nothing may be re-added */
+    smsg.seq = 21;
+    smsg.new_data_offset = 0;
+    smsg.data_len = 6;
+    memcpy(smsg.data, "zzzzzz", 6);
+    StreamPatternSearch(det_ctx, p, &smsg, STREAM_TOSERVER);
+    if (pmq->pattern_id_array_cnt != 0 || win.hits_cnt != 0) {
+        printf("smsg 3: expected no pids and hits, got %u/%u: ",
+                pmq->pattern_id_array_cnt, win.hits_cnt);
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (de_ctx != NULL) {
+        if (det_ctx != NULL)
+            DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
 static int SigTestDetectAlertCounter(void)
 {
     Packet *p = NULL;
@@ -10753,6 +10889,91 @@ end:
     return result;
 }
 
+/** \test more sigs match than fit in the packet's alert array: the
+ *        alerts of the lowest sig nums (highest priority) are kept, the
+ *        rest is counted, but the action of the last one still applies */
+static int SigTestDetectAlertQueueOverflow(void)
+{
+    Packet *p = NULL;
+    ThreadVars tv;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    Signature *s = NULL;
+    char sig[128];
+    int result = 0;
+    int i;
+
+    memset(&tv, 0, sizeof(tv));
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL) {
+        goto end;
+    }
+
+    de_ctx->mpm_matcher = MPM_B2G;
+    de_ctx->flags |= DE_QUIET;
+
+    for (i = 1; i <= PACKET_ALERT_MAX + 5; i++) {
+        snprintf(sig, sizeof(sig), "%s tcp any any -> any any "
+                 "(content:\"boo\"; sid:%d;)",
+                 i == 1 ? "drop" : "alert", i);
+        Signature *sig_tmp = DetectEngineAppendSig(de_ctx, sig);
+        if (sig_tmp == NULL) {
+            goto end;
+        }
+        /* sigs are prepended, so the first one gets the highest num */
+        if (i == 1)
+            s = sig_tmp;
+    }
+
+    SigGroupBuild(de_ctx);
+    if (s->num < PACKET_ALERT_MAX) {
+        printf("drop sig has num %u, expected it to overflow: ", s->num);
+        goto end;
+    }
+    tv.name = "detect_test";
+    DetectEngineThreadCtxInit(&tv, de_ctx, (void *)&det_ctx);
+
+    /* init counters */
+    tv.sc_perf_pca = SCPerfGetAllCountersArray(&tv.sc_perf_pctx);
+    SCPerfAddToClubbedTMTable((tv.thread_group_name != NULL) ?
+            tv.thread_group_name : tv.name, &tv.sc_perf_pctx);
+
+    p = UTHBuildPacket((uint8_t *)"boo", strlen("boo"), IPPROTO_TCP);
+    Detect(&tv, p, det_ctx, NULL, NULL);
+
+    if (p->alerts.cnt != PACKET_ALERT_MAX) {
+        printf("alerts %u, expected %u: ", p->alerts.cnt, PACKET_ALERT_MAX);
+        goto end;
+    }
+    for (i = 0; i < p->alerts.cnt; i++) {
+        if (p->alerts.alerts[i].num != i) {
+            printf("alert %d has sig num %u: ", i, p->alerts.alerts[i].num);
+            goto end;
+        }
+    }
+    if (SCPerfGetLocalCounterValue(det_ctx->counter_alert_queue_overflow, tv.sc_perf_pca) != 5) {
+        printf("overflow counter %"PRIu64", expected 5: ", (uint64_t)
+               SCPerfGetLocalCounterValue(det_ctx->counter_alert_queue_overflow, tv.sc_perf_pca));
+        goto end;
+    }
+    if (!PACKET_TEST_ACTION(p, ACTION_DROP)) {
+        printf("action of the overflowed drop sig not applied: ");
+        goto end;
+    }
+
+    result = 1;
+end:
+    UTHFreePackets(&p, 1);
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+        if (det_ctx != NULL)
+            DetectEngineThreadCtxDeinit(&tv, (void *)det_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+    return result;
+}
+
 /** \test test if the engine set flag to drop pkts of a flow that
  *        triggered a drop action on IPS mode */
 static int SigTestDropFlow01(void)
@@ -11756,7 +11977,9 @@ void SigRegisterTests(void) {
     UtRegisterTest("SigTestDepthOffset01B3g", SigTestDepthOffset01B3g, 1);
     UtRegisterTest("SigTestDepthOffset01Wm", SigTestDepthOffset01Wm, 1);
 
+    UtRegisterTest("SigTestStreamMpmWindow01", SigTestStreamMpmWindow01, 1);
     UtRegisterTest("SigTestDetectAlertCounter", SigTestDetectAlertCounter, 1);
+    UtRegisterTest("SigTestDetectAlertQueueOverflow", SigTestDetectAlertQueueOverflow, 1);
 
     UtRegisterTest("SigTestDropFlow01", SigTestDropFlow01, 1);
     UtRegisterTest("SigTestDropFlow02", SigTestDropFlow02, 1);
@@ -11771,6 +11994,10 @@ void SigRegisterTests(void) {
     UtRegisterTest("SigTestPorts01", SigTestPorts01, 1);
 
     DetectSimdRegisterTests();
+    DetectPrefilterRegisterTests();
+    DetectCandidatesRegisterTests();
+    DetectSghLookupRegisterTests();
+    DetectRuleSampleRegisterTests();
 #endif /* UNITTESTS */
 }
 
@@ -39,6 +39,7 @@
 #include "util-error.h"
 #include "util-radix-tree.h"
 #include "util-file.h"
+#include "util-cpu.h"
 
 #include "detect-mark.h"
 
@@ -281,6 +282,8 @@ typedef struct DetectPort_ {
 
 #define SIG_FLAG_TLSSTORE               (1<<21)
 
+#define SIG_FLAG_PREFILTER              (1<<22) /**< non-mpm sig that is prefiltered on the value of one of its keywords */
+
 /* signature init flags */
 #define SIG_FLAG_INIT_DEONLY         1  /**< decode event only signature */
 #define SIG_FLAG_INIT_PACKET         (1<<1)  /**< signature has matches against a packet (as opposed to app layer) */
@@ -443,6 +446,11 @@ typedef struct Signature_ {
     /* holds all sm lists' tails */
     struct SigMatch_ *sm_lists_tail[DETECT_SM_LIST_MAX];
 
+    /** content inspection lists compiled at load time
+     *  (detect-engine-content-inspection.c) */
+    struct DetectEngineContentProg_ *ci_progs;
+    uint16_t ci_prog_cnt;
+
     SigMatch *filestore_sm;
 
     char *msg;
@@ -465,6 +473,8 @@ typedef struct Signature_ {
     SigMatch *dsize_sm;
     /* the fast pattern added from this signature */
     SigMatch *mpm_sm;
+    /* keyword the sig is prefiltered on if it has no fast pattern */
+    SigMatch *prefilter_sm;
     /* helper for init phase */
     uint16_t mpm_content_maxlen;
     uint16_t mpm_uricontent_maxlen;
@@ -517,6 +527,10 @@ typedef struct DetectEngineIPOnlyCtx_ {
     SCRadixTree *tree_ipv4src, *tree_ipv4dst;
     SCRadixTree *tree_ipv6src, *tree_ipv6dst;
 
+    /* compiled lookups of the trees, NULL means the tree is used */
+    struct IPOnlyLookup4_ *lookup_ipv4src, *lookup_ipv4dst;
+    struct IPOnlyLookup6_ *lookup_ipv6src, *lookup_ipv6dst;
+
     /* Used to build the radix trees */
     IPOnlyCIDRItem *ip_src, *ip_dst;
 
@@ -539,6 +553,8 @@ typedef struct DetectEngineIPOnlyCtx_ {
 typedef struct DetectEngineLookupFlow_ {
     DetectAddressHead *src_gh[256]; /* a head for each protocol */
     DetectAddressHead *tmp_gh[256];
+    /** compiled lookup of src_gh, NULL means walk it */
+    struct DetectSghLookupAddrs_ *src_lookup[256];
 } DetectEngineLookupFlow;
 
 /* Flow status
@@ -557,13 +573,26 @@ typedef struct MpmPatternIdStore_ {
     uint32_t shared_patterns;
 } MpmPatternIdStore;
 
+/** locks for the rate_filter by_rule entries, a sig uses num % this */
+#define THRESHOLD_ENTRY_LOCKS   64
+
 /** \brief threshold ctx */
 typedef struct ThresholdCtx_    {
-    SCMutex threshold_table_lock;                   /**< Mutex for hash table */
+    /** by_src/by_dst state keyed on sid, gid and address. Each row has
+     *  its own lock. */
+    struct ThresholdHashRow_ *hash;
+    uint32_t hash_size;
+    uint64_t memcap;
+    SC_ATOMIC_DECLARE(uint64_t, memuse);
+
+    SCMutex th_entry_lock[THRESHOLD_ENTRY_LOCKS];
 
     /** to support rate_filter "by_rule" option */
     DetectThresholdEntry **th_entry;
     uint32_t th_size;
+
+    /** list of the ctxs the flow manager times out */
+    struct ThresholdCtx_ *next;
 } ThresholdCtx;
 
 typedef struct DetectEngineThreadKeywordCtxItem_ {
@@ -575,6 +604,16 @@ typedef struct DetectEngineThreadKeywordCtxItem_ {
     const char *name; /* keyword name, for error printing */
 } DetectEngineThreadKeywordCtxItem;
 
+/** \brief mpm ctx waiting to be prepared by the build threads */
+typedef struct MpmPrepareQueueItem_ {
+    MpmCtx *mpm_ctx;
+    /** keys of the patterns added to the ctx, used for the mpm cache. Not
+     *  owned by the queue. */
+    MpmPatternKeyList *keys;
+    /** set if the ctx was loaded from the mpm cache */
+    int cached;
+} MpmPrepareQueueItem;
+
 /** \brief main detection engine ctx */
 typedef struct DetectEngineCtx_ {
     uint8_t flags;
@@ -617,15 +656,26 @@ typedef struct DetectEngineCtx_ {
     HashListTable *sgh_mpm_uri_hash_table;
     HashListTable *sgh_mpm_stream_hash_table;
 
+    /* prepared per sgh mpm ctxs by pattern set, so sghs that end up with
+     * the same patterns share a single ctx (full sgh-mpm-context only) */
+    HashListTable *mpm_hash_table;
+
     HashListTable *sgh_sport_hash_table;
     HashListTable *sgh_dport_hash_table;
 
     HashListTable *sport_hash_table;
     HashListTable *dport_hash_table;
 
+    /* compiled sgh lookup of each address head and port list, owns them */
+    HashListTable *sgh_lookup_hash_table;
+    uint32_t sgh_lookup_map_size;
+
     HashListTable *variable_names;
     HashListTable *variable_idxs;
     uint16_t variable_names_idx;
+    /** flowbits are numbered on their own so the per flow bit array
+     *  stays dense */
+    uint16_t variable_flowbits_idx;
 
     /* hash table used to cull out duplicate sigs */
     HashListTable *dup_sig_hash_table;
@@ -671,6 +721,21 @@ typedef struct DetectEngineCtx_ {
 
     MpmCtxFactoryContainer *mpm_ctx_factory_container;
 
+    /* mpm ctxs waiting to be prepared by the build threads, see
+     * MpmPrepareQueueRun() */
+    MpmPrepareQueueItem *mpm_prepare_queue;
+    uint32_t mpm_prepare_queue_cnt;
+    uint32_t mpm_prepare_queue_size;
+
+    /* directory prepared mpm ctxs are cached in, NULL if disabled */
+    char *mpm_cache_dir;
+
+    /* number of threads used to build the detection engine */
+    uint16_t build_threads;
+
+    /* sample the rules of 1 in rule_sample_rate packets, 0 if disabled */
+    uint32_t rule_sample_rate;
+
     /* maximum recursion depth for content inspection */
     int inspection_recursion_limit;
 
@@ -730,6 +795,10 @@ typedef struct DetectEngineCtx_ {
 
     int detect_luajit_instances;
 
+    /** pcre keyword stats and their thread ctx */
+    struct DetectPcreCtx_ *pcre_ctx;
+    int pcre_thread_ctx_id;
+
 #ifdef PROFILING
     struct SCProfileDetectCtx_ *profile_ctx;
     struct SCProfileKeywordDetectCtx_ *profile_keyword_ctx;
@@ -793,14 +862,12 @@ typedef struct DetectionEngineThreadCtx_ {
     uint16_t hcbd_buffers_size;
     uint16_t hcbd_buffers_list_len;
 
-    uint8_t **hhd_buffers;
-    uint32_t *hhd_buffers_len;
-    uint16_t hhd_buffers_size;
-    uint16_t hhd_buffers_list_len;
-    uint64_t hhd_start_tx_id;
-
     /** id for alert counter */
     uint16_t counter_alerts;
+    /** content inspections stopped by the inspection recursion limit */
+    uint16_t counter_inspection_limit;
+    /** alerts dropped because the packet alert array was full */
+    uint16_t counter_alert_queue_overflow;
 
     /* used to discontinue any more matching */
     uint16_t discontinue_matching;
@@ -823,9 +890,37 @@ typedef struct DetectionEngineThreadCtx_ {
     /** size in use */
     SigIntId match_array_cnt;
 
+    /** alerts of the current packet, appended unsorted and moved to
+     *  the packet by PacketAlertFinalize */
+    PacketAlert *alert_queue;
+    uint32_t alert_queue_size;
+    uint32_t alert_queue_cnt;
+    /** set if alerts were queued out of sig num order */
+    int alert_queue_unsorted;
+
     /** Array of sigs that had a state change */
     SigIntId de_state_sig_array_len;
     uint8_t *de_state_sig_array;
+    /** the sigs set in de_state_sig_array, so only those are cleared */
+    SigIntId *de_state_sig_marked;
+    SigIntId de_state_sig_marked_cnt;
+    /** state direction whose done sigs have no new state for the current
+     *  packet, NULL if none */
+    struct DetectEngineStateDirection_ *de_state_done;
+
+    /** bit array of sig nums, the candidates the prefilter engines picked
+     *  for the current packet */
+    uint8_t *prefilter_bitarray;
+
+    /** candidate lists to merge for the current packet and the buffers
+     *  the merge rounds write to (detect-engine-candidates.c) */
+    struct DetectCandidatesList_ *candidate_lists;
+    SigIntId *candidate_buf[2];
+
+    /** sampling rule profiler counters (detect-engine-rule-sample.c),
+     *  rule_sample_active is set if the current packet is sampled */
+    struct DetectRuleSampleThreadCtx_ *rule_sample;
+    int rule_sample_active;
 
     struct SigGroupHead_ *sgh;
     /** pointer to the current mpm ctx that is stored
@@ -836,6 +931,9 @@ typedef struct DetectionEngineThreadCtx_ {
     MpmThreadCtx mtcs;  /**< thread ctx for stream mpm */
     PatternMatcherQueue pmq;
     PatternMatcherQueue smsg_pmq[DETECT_SMSG_PMQ_NUM];
+    /** raw stream mpm state of the flow direction we inspect, only set
+     *  in raw sliding window mode */
+    struct StreamMpmWindow_ *smsg_mpm_window;
 
     /** ip only rules ctx */
     DetectEngineIPOnlyThreadCtx io_ctx;
@@ -896,6 +994,13 @@ typedef struct SigTableElmt_ {
     void (*Free)(void *);
     void (*RegisterTests)(void);
 
+    /** prefilter support for non-mpm sigs (detect-engine-prefilter.c):
+     *  get the one byte packet value the keyword inspects, returns 0 if
+     *  the keyword can't match the packet at all */
+    int (*PrefilterGetValue)(const Packet *, uint8_t *);
+    /** prefilter support: does the keyword match a packet with this value */
+    int (*PrefilterMatchValue)(const SigMatch *, uint8_t);
+
     uint8_t flags;
     char *name;     /**< keyword name alias */
     char *alias;    /**< name alias */
@@ -952,6 +1057,18 @@ typedef struct SigGroupHeadInitData_ {
     struct DetectPort_ *port;
 } SigGroupHeadInitData;
 
+/** x86-64 builds carry AVX2 and AVX-512 versions of the mask prefilter
+ *  that are picked at runtime based on the cpu, see detect-simd.c */
+#if !defined(__tile__) && defined(UTIL_CPU_TARGET_ATTR)
+#define DETECT_SIMD_RUNTIME_DISPATCH 1
+/* _mm_malloc for the mask array, normally pulled in with the SSE headers */
+#include <mm_malloc.h>
+#endif
+
+#if defined(__SSE3__) || defined(__tile__) || defined(DETECT_SIMD_RUNTIME_DISPATCH)
+#define DETECT_SIMD_MASK_ARRAY 1
+#endif
+
 /** \brief Container for matching data for a signature group */
 typedef struct SigGroupHead_ {
     uint32_t flags;
@@ -962,7 +1079,7 @@ typedef struct SigGroupHead_ {
 
     /** array of masks, used to check multiple masks against
      *  a packet using SIMD. */
-#if defined(__SSE3__) || defined(__tile__)
+#ifdef DETECT_SIMD_MASK_ARRAY
     SignatureMask *mask_array;
 #endif
     /** chunk of memory containing the "header" part of each
@@ -1007,6 +1124,13 @@ typedef struct SigGroupHead_ {
     /** Array with sig ptrs... size is sig_cnt * sizeof(Signature *) */
     Signature **match_array;
 
+    /** prefilter engines for the non-mpm sigs in this head */
+    struct DetectPrefilterEngine_ *prefilter_engines;
+
+    /** per pattern id lists of the sigs, to build the match array from
+     *  the mpm hits */
+    struct DetectCandidates_ *candidates;
+
     /* ptr to our init data we only use at... init :) */
     SigGroupHeadInitData *init;
 } SigGroupHead;
@@ -1165,6 +1289,7 @@ void SigCleanSignatures(DetectEngineCtx *);
 
 void SigTableRegisterTests(void);
 void SigRegisterTests(void);
+void DetectSimdSetup(void);
 void DetectSimdRegisterTests(void);
 void TmModuleDetectRegister (void);
 
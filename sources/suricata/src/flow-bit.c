@@ -24,7 +24,6 @@
  * but called that way because of Snort's flowbits.
  * It's a binary storage.
  *
- * \todo move away from a linked list implementation
  * \todo use different datatypes, such as string, int, etc.
  * \todo have more than one instance of the same var, and be able to match on a
  *       specific one, or one all at a time. So if a certain capture matches
@@ -42,63 +41,77 @@
 #include "util-debug.h"
 #include "util-unittest.h"
 
+/** flowbits grow by this many 32 bit words at a time */
+#define FLOWBITS_GROW_WORDS 4
+
 /* get the flowbit with idx from the flow */
-static FlowBit *FlowBitGet(Flow *f, uint16_t idx)
+static inline int FlowBitGet(Flow *f, uint16_t idx)
 {
-    GenericVar *gv = f->flowvar;
-    for ( ; gv != NULL; gv = gv->next) {
-        if (gv->type == DETECT_FLOWBITS && gv->idx == idx) {
-            return (FlowBit *)gv;
-        }
-    }
+    if ((uint32_t)(idx / 32) >= f->flowbits_size)
+        return 0;
 
-    return NULL;
+    return (f->flowbits[idx / 32] >> (idx % 32)) & 1;
+}
+
+/**
+ *  \brief Grow the flowbits of a flow so idx fits
+ *
+ *  \retval 0 ok
+ *  \retval -1 alloc failure
+ */
+static int FlowBitGrow(Flow *f, uint16_t idx)
+{
+    uint32_t size = (uint32_t)(idx / 32) + 1;
+
+    if (size <= f->flowbits_size)
+        return 0;
+
+    size = (size + FLOWBITS_GROW_WORDS - 1) & ~(FLOWBITS_GROW_WORDS - 1);
+    uint32_t *ptmp = SCRealloc(f->flowbits, size * sizeof(uint32_t));
+    if (unlikely(ptmp == NULL))
+        return -1;
+
+    memset(ptmp + f->flowbits_size, 0, (size - f->flowbits_size) * sizeof(uint32_t));
+#ifdef FLOWBITS_STATS
+    SCMutexLock(&flowbits_mutex);
+    flowbits_memuse += (size - f->flowbits_size) * sizeof(uint32_t);
+    if (flowbits_memuse > flowbits_memuse_max)
+        flowbits_memuse_max = flowbits_memuse;
+    SCMutexUnlock(&flowbits_mutex);
+#endif /* FLOWBITS_STATS */
+    f->flowbits = ptmp;
+    f->flowbits_size = (uint16_t)size;
+    return 0;
 }
 
-/* add a flowbit to the flow */
 static void FlowBitAdd(Flow *f, uint16_t idx)
 {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        fb = SCMalloc(sizeof(FlowBit));
-        if (unlikely(fb == NULL))
-            return;
-
-        fb->type = DETECT_FLOWBITS;
-        fb->idx = idx;
-        fb->next = NULL;
-        GenericVarAppend(&f->flowvar, (GenericVar *)fb);
-
-        //printf("FlowBitAdd: adding flowbit with idx %" PRIu32 "\n", idx);
+    if (FlowBitGet(f, idx))
+        return;
+    if (FlowBitGrow(f, idx) != 0)
+        return;
+
+    f->flowbits[idx / 32] |= (1U << (idx % 32));
+    f->flowbits_cnt++;
+
 #ifdef FLOWBITS_STATS
-        SCMutexLock(&flowbits_mutex);
-        flowbits_added++;
-        flowbits_memuse += sizeof(FlowBit);
-        if (flowbits_memuse > flowbits_memuse_max)
-            flowbits_memuse_max = flowbits_memuse;
-        SCMutexUnlock(&flowbits_mutex);
+    SCMutexLock(&flowbits_mutex);
+    flowbits_added++;
+    SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
-    }
 }
 
 static void FlowBitRemove(Flow *f, uint16_t idx)
 {
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL)
+    if (!FlowBitGet(f, idx))
         return;
 
-    GenericVarRemove(&f->flowvar, (GenericVar *)fb);
+    f->flowbits[idx / 32] &= ~(1U << (idx % 32));
+    f->flowbits_cnt--;
 
-    //printf("FlowBitRemove: remove flowbit with idx %" PRIu32 "\n", idx);
 #ifdef FLOWBITS_STATS
     SCMutexLock(&flowbits_mutex);
     flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
-    else {
-        printf("ERROR: flowbits memory usage going below 0!\n");
-        flowbits_memuse = 0;
-    }
     SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
 }
@@ -106,24 +119,14 @@ static void FlowBitRemove(Flow *f, uint16_t idx)
 void FlowBitSet(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        FlowBitAdd(f, idx);
-    }
-
+    FlowBitAdd(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
 void FlowBitUnset(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
-
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        FlowBitRemove(f, idx);
-    }
-
+    FlowBitRemove(f, idx);
     FLOWLOCK_UNLOCK(f);
 }
 
@@ -131,8 +134,7 @@ void FlowBitToggle(Flow *f, uint16_t idx)
 {
     FLOWLOCK_WRLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
+    if (FlowBitGet(f, idx)) {
         FlowBitRemove(f, idx);
     } else {
         FlowBitAdd(f, idx);
@@ -146,10 +148,7 @@ int FlowBitIsset(Flow *f, uint16_t idx)
     int r = 0;
     FLOWLOCK_RDLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb != NULL) {
-        r = 1;
-    }
+    r = FlowBitGet(f, idx);
 
     FLOWLOCK_UNLOCK(f);
     return r;
@@ -160,37 +159,62 @@ int FlowBitIsnotset(Flow *f, uint16_t idx)
     int r = 0;
     FLOWLOCK_RDLOCK(f);
 
-    FlowBit *fb = FlowBitGet(f, idx);
-    if (fb == NULL) {
-        r = 1;
-    }
+    r = !FlowBitGet(f, idx);
 
     FLOWLOCK_UNLOCK(f);
     return r;
 }
 
-void FlowBitFree(FlowBit *fb)
+/**
+ *  \brief Get the next flowbit that is set, unlocked.
+ *
+ *  \param idx idx to start looking from
+ *
+ *  \retval idx of the next set flowbit, or -1 if there is none
+ */
+int FlowBitGetNext(Flow *f, uint16_t idx)
 {
-    if (fb == NULL)
-        return;
+    uint32_t i = idx;
+
+    for ( ; i < (uint32_t)f->flowbits_size * 32; i++) {
+        uint32_t word = f->flowbits[i / 32] >> (i % 32);
+        if (word == 0) {
+            /* skip the rest of the word */
+            i |= 31;
+            continue;
+        }
+        if (word & 1)
+            return (int)i;
+    }
+
+    return -1;
+}
 
-    SCFree(fb);
+/** \brief free the flowbits of a flow */
+void FlowBitFreeAll(Flow *f)
+{
+    if (f->flowbits == NULL)
+        return;
 
 #ifdef FLOWBITS_STATS
     SCMutexLock(&flowbits_mutex);
-    flowbits_removed++;
-    if (flowbits_memuse >= sizeof(FlowBit))
-        flowbits_memuse -= sizeof(FlowBit);
+    flowbits_removed += f->flowbits_cnt;
+    if (flowbits_memuse >= f->flowbits_size * sizeof(uint32_t))
+        flowbits_memuse -= f->flowbits_size * sizeof(uint32_t);
     else {
         printf("ERROR: flowbits memory usage going below 0!\n");
         flowbits_memuse = 0;
     }
     SCMutexUnlock(&flowbits_mutex);
 #endif /* FLOWBITS_STATS */
+
+    SCFree(f->flowbits);
+    f->flowbits = NULL;
+    f->flowbits_size = 0;
+    f->flowbits_cnt = 0;
 }
 
 
-/* TESTS */
 #ifdef UNITTESTS
 static int FlowBitTest01 (void)
 {
@@ -201,11 +225,11 @@ static int FlowBitTest01 (void)
 
     FlowBitAdd(&f, 0);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -216,11 +240,11 @@ static int FlowBitTest02 (void)
     Flow f;
     memset(&f, 0, sizeof(Flow));
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -233,23 +257,23 @@ static int FlowBitTest03 (void)
 
     FlowBitAdd(&f, 0);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL) {
-        printf("fb == NULL although it was just added: ");
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0) {
+        printf("fb == 0 although it was just added: ");
         goto end;
     }
 
     FlowBitRemove(&f, 0);
 
     fb = FlowBitGet(&f,0);
-    if (fb != NULL) {
-        printf("fb != NULL although it was just removed: ");
+    if (fb != 0) {
+        printf("fb != 0 although it was just removed: ");
         goto end;
     } else {
         ret = 1;
     }
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -265,11 +289,11 @@ static int FlowBitTest04 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -285,11 +309,11 @@ static int FlowBitTest05 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,1);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,1);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -305,11 +329,11 @@ static int FlowBitTest06 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,2);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,2);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -325,11 +349,11 @@ static int FlowBitTest07 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,3);
-    if (fb != NULL)
+    int fb = FlowBitGet(&f,3);
+    if (fb != 0)
         ret = 1;
 
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -345,21 +369,21 @@ static int FlowBitTest08 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,0);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,0);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,0);
 
     fb = FlowBitGet(&f,0);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -375,21 +399,21 @@ static int FlowBitTest09 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,1);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,1);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,1);
 
     fb = FlowBitGet(&f,1);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -405,21 +429,21 @@ static int FlowBitTest10 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,2);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,2);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,2);
 
     fb = FlowBitGet(&f,2);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -435,21 +459,60 @@ static int FlowBitTest11 (void)
     FlowBitAdd(&f, 2);
     FlowBitAdd(&f, 3);
 
-    FlowBit *fb = FlowBitGet(&f,3);
-    if (fb == NULL)
+    int fb = FlowBitGet(&f,3);
+    if (fb == 0)
         goto end;
 
     FlowBitRemove(&f,3);
 
     fb = FlowBitGet(&f,3);
-    if (fb != NULL) {
-        printf("fb != NULL even though it was removed: ");
+    if (fb != 0) {
+        printf("fb != 0 even though it was removed: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    FlowBitFreeAll(&f);
+    return ret;
+}
+
+static int FlowBitTest12 (void)
+{
+    int ret = 0;
+
+    Flow f;
+    memset(&f, 0, sizeof(Flow));
+
+    /* sparse bits far apart, the array grows to hold them */
+    FlowBitAdd(&f, 3);
+    FlowBitAdd(&f, 1000);
+    FlowBitAdd(&f, 65535);
+    FlowBitAdd(&f, 1000);
+
+    if (f.flowbits_cnt != 3 || f.flowbits_size < 65536 / 32) {
+        printf("cnt %u size %u: ", f.flowbits_cnt, f.flowbits_size);
+        goto end;
+    }
+    if (FlowBitGetNext(&f, 0) != 3 || FlowBitGetNext(&f, 4) != 1000 ||
+        FlowBitGetNext(&f, 1001) != 65535) {
+        printf("FlowBitGetNext failed: ");
+        goto end;
+    }
+    if (FlowBitGet(&f, 999) || FlowBitGet(&f, 1001) || !FlowBitGet(&f, 65535)) {
+        printf("FlowBitGet failed: ");
+        goto end;
+    }
+
+    FlowBitRemove(&f, 65535);
+    if (f.flowbits_cnt != 2 || FlowBitGetNext(&f, 1001) != -1) {
+        printf("remove failed: ");
         goto end;
     }
 
     ret = 1;
 end:
-    GenericVarFree(f.flowvar);
+    FlowBitFreeAll(&f);
     return ret;
 }
 
@@ -469,6 +532,7 @@ void FlowBitRegisterTests(void)
     UtRegisterTest("FlowBitTest09", FlowBitTest09, 1);
     UtRegisterTest("FlowBitTest10", FlowBitTest10, 1);
     UtRegisterTest("FlowBitTest11", FlowBitTest11, 1);
+    UtRegisterTest("FlowBitTest12", FlowBitTest12, 1);
 #endif /* UNITTESTS */
 }
 
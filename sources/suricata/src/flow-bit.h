@@ -27,15 +27,7 @@
 #include "flow.h"
 #include "util-var.h"
 
-typedef struct FlowBit_ {
-    uint8_t type; /* type, DETECT_FLOWBITS in this case */
-    uint16_t idx; /* name idx */
-    GenericVar *next; /* right now just implement this as a list,
-                       * in the long run we have think of something
-                       * faster. */
-} FlowBit;
-
-void FlowBitFree(FlowBit *);
+void FlowBitFreeAll(Flow *);
 void FlowBitRegisterTests(void);
 
 void FlowBitSet(Flow *, uint16_t);
@@ -43,5 +35,6 @@ void FlowBitUnset(Flow *, uint16_t);
 void FlowBitToggle(Flow *, uint16_t);
 int FlowBitIsset(Flow *, uint16_t);
 int FlowBitIsnotset(Flow *, uint16_t);
+int FlowBitGetNext(Flow *, uint16_t);
 #endif /* __FLOW_BIT_H__ */
 
@@ -57,6 +57,7 @@
 #include "threads.h"
 #include "detect.h"
 #include "detect-engine-state.h"
+#include "detect-engine-threshold.h"
 #include "stream.h"
 
 #include "app-layer-parser.h"
@@ -486,6 +487,7 @@ void *FlowManagerThread(void *td)
         DefragTimeoutHash(&ts);
         //uint32_t hosts_pruned =
         HostTimeoutHash(&ts);
+        ThresholdTimeoutHash(&ts);
 /*
         SCPerfCounterAddUI64(flow_mgr_host_prune, th_v->sc_perf_pca, (uint64_t)hosts_pruned);
         uint32_t hosts_active = HostGetActiveCount();
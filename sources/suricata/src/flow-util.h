@@ -26,6 +26,7 @@
 
 #include "detect-engine-state.h"
 #include "tmqh-flow.h"
+#include "flow-bit.h"
 
 #define COPY_TIMESTAMP(src,dst) ((dst)->tv_sec = (src)->tv_sec, (dst)->tv_usec = (src)->tv_usec)
 
@@ -62,6 +63,9 @@
         (f)->sgh_toserver = NULL; \
         (f)->sgh_toclient = NULL; \
         (f)->flowvar = NULL; \
+        (f)->flowbits = NULL; \
+        (f)->flowbits_size = 0; \
+        (f)->flowbits_cnt = 0; \
         SCMutexInit(&(f)->de_state_m, NULL); \
         (f)->hnext = NULL; \
         (f)->hprev = NULL; \
@@ -105,6 +109,7 @@
         (f)->sgh_toclient = NULL; \
         GenericVarFree((f)->flowvar); \
         (f)->flowvar = NULL; \
+        FlowBitFreeAll((f)); \
         if (SC_ATOMIC_GET((f)->autofp_tmqh_flow_qid) != -1) {   \
             (void) SC_ATOMIC_SET((f)->autofp_tmqh_flow_qid, -1);   \
         }                                       \
@@ -122,6 +127,7 @@
             SCMutexUnlock(&(f)->de_state_m); \
         } \
         GenericVarFree((f)->flowvar); \
+        FlowBitFreeAll((f)); \
         SCMutexDestroy(&(f)->de_state_m); \
         SC_ATOMIC_DESTROY((f)->autofp_tmqh_flow_qid);   \
     } while(0)
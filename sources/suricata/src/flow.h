@@ -366,6 +366,13 @@ typedef struct Flow_
     /* pointer to the var list */
     GenericVar *flowvar;
 
+    /** flowbits, one bit per flowbit idx */
+    uint32_t *flowbits;
+    /** size of flowbits in 32 bit words */
+    uint16_t flowbits_size;
+    /** number of flowbits set */
+    uint16_t flowbits_cnt;
+
     SCMutex de_state_m;          /**< mutex lock for the de_state object */
 
     /** hash list pointers, protected by fb->s */
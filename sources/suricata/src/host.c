@@ -288,7 +288,7 @@ void HostShutdown(void)
 
 /** \brief Cleanup the host engine
  *
- * Cleanup the host engine from tag and threshold.
+ * Cleanup the host engine from tag.
  *
  */
 void HostCleanup(void)
@@ -34,6 +34,7 @@
 #include "detect-engine-mpm.h"
 #include "detect-engine-sigorder.h"
 #include "detect-engine-payload.h"
+#include "detect-engine-content-inspection.h"
 #include "detect-engine-dcepayload.h"
 #include "detect-engine-uri.h"
 #include "detect-engine-hcbd.h"
@@ -228,6 +229,7 @@ int RunUnittests(int list_unittests, char *regex_arg)
     SCCudaRegisterTests();
 #endif
     PayloadRegisterTests();
+    DetectEngineContentInspectionRegisterTests();
     DcePayloadRegisterTests();
     UriRegisterTests();
 #ifdef PROFILING
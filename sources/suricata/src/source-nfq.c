@@ -129,6 +129,27 @@ typedef struct NFQThreadVars_
     int datalen; /** Length of per function and thread data */
 
 } NFQThreadVars;
+/* verdict latency histogram: time between receiving the packet and
+ * issuing the verdict. Each bucket counts packets up to 'usecs'. */
+#define NFQ_VERDICT_LATENCY_BUCKETS 6
+static struct {
+    char *name;
+    uint64_t usecs;
+} nfq_verdict_latency[NFQ_VERDICT_LATENCY_BUCKETS] = {
+    { "nfq.verdict_latency_10us",       10, },
+    { "nfq.verdict_latency_100us",     100, },
+    { "nfq.verdict_latency_1ms",      1000, },
+    { "nfq.verdict_latency_10ms",    10000, },
+    { "nfq.verdict_latency_100ms",  100000, },
+    { "nfq.verdict_latency_inf", UINT64_MAX, },
+};
+
+typedef struct NFQVerdictThreadVars_
+{
+    NFQThreadVars *ntv;
+    uint16_t counter_latency[NFQ_VERDICT_LATENCY_BUCKETS];
+} NFQVerdictThreadVars;
+
 /* shared vars for all for nfq queues and threads */
 static NFQGlobalVars nfq_g;
 
@@ -746,14 +767,27 @@ TmEcode ReceiveNFQThreadDeinit(ThreadVars *t, void *data)
 
 
 TmEcode VerdictNFQThreadInit(ThreadVars *tv, void *initdata, void **data) {
+    int i;
+
+    NFQVerdictThreadVars *vtv = SCMalloc(sizeof(NFQVerdictThreadVars));
+    if (unlikely(vtv == NULL))
+        return TM_ECODE_FAILED;
+    memset(vtv, 0, sizeof(NFQVerdictThreadVars));
+
+    vtv->ntv = (NFQThreadVars *)initdata;
+    for (i = 0; i < NFQ_VERDICT_LATENCY_BUCKETS; i++) {
+        vtv->counter_latency[i] = SCPerfTVRegisterCounter(
+                nfq_verdict_latency[i].name, tv, SC_PERF_TYPE_UINT64, "NULL");
+    }
 
-    *data = (void *)initdata;
+    *data = (void *)vtv;
 
     return TM_ECODE_OK;
 }
 
 TmEcode VerdictNFQThreadDeinit(ThreadVars *tv, void *data) {
-    NFQThreadVars *ntv = (NFQThreadVars *)data;
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
+    NFQThreadVars *ntv = vtv->ntv;
     NFQQueueVars *nq = NFQGetQueue(ntv->nfq_index);
 
     SCLogDebug("starting... will close queuenum %" PRIu32 "", nq->queue_num);
@@ -764,6 +798,7 @@ TmEcode VerdictNFQThreadDeinit(ThreadVars *tv, void *data) {
     }
     NFQMutexUnlock(nq);
 
+    SCFree(vtv);
     return TM_ECODE_OK;
 }
 
@@ -1148,10 +1183,38 @@ TmEcode NFQSetVerdict(Packet *p) {
     return TM_ECODE_OK;
 }
 
+/**
+ * \brief update the verdict latency histogram for a packet
+ */
+static void NFQVerdictLatencyUpdate(ThreadVars *tv, NFQVerdictThreadVars *vtv,
+                                    Packet *p)
+{
+    struct timeval now;
+    uint64_t usecs = 0;
+    int i;
+
+    if (p->flags & PKT_PSEUDO_STREAM_END)
+        return;
+
+    gettimeofday(&now, NULL);
+    if (timercmp(&now, &p->ts, >)) {
+        usecs = ((uint64_t)(now.tv_sec - p->ts.tv_sec) * 1000000) +
+            (now.tv_usec - p->ts.tv_usec);
+    }
+
+    for (i = 0; i < NFQ_VERDICT_LATENCY_BUCKETS; i++) {
+        if (usecs <= nfq_verdict_latency[i].usecs) {
+            SCPerfCounterIncr(vtv->counter_latency[i], tv->sc_perf_pca);
+            break;
+        }
+    }
+}
+
 /**
  * \brief NFQ verdict module packet entry function
  */
 TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, PacketQueue *postpq) {
+    NFQVerdictThreadVars *vtv = (NFQVerdictThreadVars *)data;
     int ret;
     /* if this is a tunnel packet we check if we are ready to verdict
      * already. */
@@ -1179,6 +1242,7 @@ TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
             ret = NFQSetVerdict(p->root ? p->root : p);
             if (ret != TM_ECODE_OK)
                 return ret;
+            NFQVerdictLatencyUpdate(tv, vtv, p->root ? p->root : p);
         } else {
             TUNNEL_INCR_PKT_RTV(p);
         }
@@ -1187,6 +1251,7 @@ TmEcode VerdictNFQ(ThreadVars *tv, Packet *p, void *data, PacketQueue *pq, Packe
         ret = NFQSetVerdict(p);
         if (ret != TM_ECODE_OK)
             return ret;
+        NFQVerdictLatencyUpdate(tv, vtv, p);
     }
     return TM_ECODE_OK;
 }
@@ -218,6 +218,8 @@ typedef struct TcpSession_ {
     struct StreamMsg_ *toserver_smsg_tail;  /**< list of stream msgs (for detection inspection) */
     struct StreamMsg_ *toclient_smsg_head;  /**< list of stream msgs (for detection inspection) */
     struct StreamMsg_ *toclient_smsg_tail;  /**< list of stream msgs (for detection inspection) */
+    struct StreamMpmWindow_ *toserver_mpm_window; /**< raw stream mpm state (sliding window mode) */
+    struct StreamMpmWindow_ *toclient_mpm_window; /**< raw stream mpm state (sliding window mode) */
 
     TcpStateQueue *queue;                   /**< list of SYN/ACK candidates */
 } TcpSession;
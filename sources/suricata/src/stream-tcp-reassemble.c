@@ -45,12 +45,14 @@
 #include "util-host-os-info.h"
 #include "util-unittest-helper.h"
 #include "util-byte.h"
+#include "util-misc.h"
 
 #include "stream-tcp.h"
 #include "stream-tcp-private.h"
 #include "stream-tcp-reassemble.h"
 #include "stream-tcp-inline.h"
 #include "stream-tcp-util.h"
+#include "stream-tcp-sack.h"
 
 #include "stream.h"
 
@@ -667,6 +669,78 @@ static inline uint32_t StreamTcpReassembleGetRaBaseSeq(TcpStream *stream)
     }
 }
 
+/**
+ *  \internal
+ *  \brief Check if a gap at next_seq can be considered permanent based on
+ *         SACK information (gap-policy sack).
+ *
+ *  If the receiver keeps SACK'ing data beyond the gap, the sender has
+ *  been asked to retransmit the missing data a while ago. If we still
+ *  didn't see the retransmission, we assume we missed it so we don't
+ *  have to keep buffering until the gap is finally ACK'd.
+ *
+ *  \retval 1 gap is permanent
+ *  \retval 0 keep waiting for the data
+ */
+static inline int StreamTcpReassembleGapIsPermanent(TcpStream *stream,
+        uint32_t next_seq)
+{
+    if (!(stream_config.flags & STREAMTCP_INIT_FLAG_GAP_POLICY_SACK))
+        return 0;
+
+    uint32_t sacked = StreamTcpSackedSizeBeyond(stream, next_seq);
+    SCLogDebug("%"PRIu32" bytes sacked beyond gap at %"PRIu32, sacked, next_seq);
+    return (sacked > 0 && sacked >= stream_config.reassembly_gap_sack_size);
+}
+
+/**
+ *  \internal
+ *  \brief Get the seq up to which raw reassembly can inspect the stream.
+ *
+ *  Normally that is last_ack. With gap-policy sack, once the stream is in
+ *  gap state the SACK'd data is inspected as well, so the segments behind
+ *  the gap can be freed.
+ *
+ *  \retval seq right edge
+ */
+static inline uint32_t StreamTcpReassembleRawRightEdge(TcpStream *stream)
+{
+    if (!(stream_config.flags & STREAMTCP_INIT_FLAG_GAP_POLICY_SACK) ||
+        !(stream->flags & STREAMTCP_STREAM_FLAG_GAP))
+        return stream->last_ack;
+
+    return StreamTcpSackedRightEdge(stream);
+}
+
+/**
+ *  \internal
+ *  \brief Send the gap signal to the app layer and flag the stream so app
+ *         layer reassembly stops bothering with it.
+ *
+ *  \param flags STREAM_* flags for the app layer, set up by the caller
+ *  \param sack 1 if the gap was declared based on SACK (gap-policy sack)
+ */
+static void StreamTcpReassembleAppLayerGap(ThreadVars *tv,
+        TcpReassemblyThreadCtx *ra_ctx, TcpSession *ssn, TcpStream *stream,
+        Packet *p, uint8_t flags, int sack)
+{
+    AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
+            NULL, 0, flags|STREAM_GAP);
+    AppLayerProfilingStore(ra_ctx->app_tctx, p);
+
+    /* set a GAP flag and make sure not bothering this stream anymore */
+    SCLogDebug("STREAMTCP_STREAM_FLAG_GAP set");
+    stream->flags |= STREAMTCP_STREAM_FLAG_GAP;
+
+    StreamTcpSetEvent(p, STREAM_REASSEMBLY_SEQ_GAP);
+    SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap, tv->sc_perf_pca);
+    if (sack)
+        SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap_sack, tv->sc_perf_pca);
+#ifdef DEBUG
+    dbg_app_layer_gap++;
+#endif
+}
+
 /**
  *  \internal
  *  \brief  Function to handle the insertion newly arrived segment,
@@ -1953,10 +2027,46 @@ static void StreamTcpSetupMsg(TcpSession *ssn, TcpStream *stream, Packet *p,
 {
     SCEnter();
     smsg->data_len = 0;
+    smsg->new_data_offset = 0;
     SCLogDebug("smsg %p", smsg);
     SCReturn;
 }
 
+/** \internal
+ *  \brief track which part of an inline smsg was already part of a
+ *         previous smsg
+ *
+ *  Called before 'len' bytes starting at 'seq' are accounted to the smsg.
+ *  Data up to ra_base_seq has been put in an earlier smsg, so as long as
+ *  the smsg only holds such data we grow the smsg's new_data_offset. This
+ *  lets the detection engine skip rescanning the window's old data.
+ *
+ *  \param smsg smsg the data was copied into at offset smsg->data_len
+ *  \param seq sequence number of the first copied byte
+ *  \param len number of bytes copied
+ *  \param ra_base_seq raw reassembly base seq before the copy
+ */
+static inline void StreamTcpSetupMsgNewData(StreamMsg *smsg, uint32_t seq,
+                                            uint16_t len, uint32_t ra_base_seq)
+{
+    /* new data already started in this smsg */
+    if (smsg->new_data_offset != smsg->data_len)
+        return;
+
+    if (SEQ_GEQ(seq, ra_base_seq + 1)) {
+        /* smsg starts with new data: make sure the smsg seq reflects
+         * where that is, it can be beyond ra_base_seq after a gap */
+        if (smsg->data_len == 0)
+            smsg->seq = seq;
+        return;
+    }
+
+    uint32_t old_len = (ra_base_seq + 1) - seq;
+    if (old_len > len)
+        old_len = len;
+    smsg->new_data_offset += (uint16_t)old_len;
+}
+
 /**
  *  \brief Check the minimum size limits for reassembly.
  *
@@ -2174,19 +2284,7 @@ int StreamTcpReassembleInlineAppLayer(ThreadVars *tv,
         if (SEQ_GT(seg->seq, next_seq) && SEQ_LT(seg->seq, stream->last_ack)) {
             /* send gap signal */
             STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
-            AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
-                    NULL, 0, flags|STREAM_GAP);
-            AppLayerProfilingStore(ra_ctx->app_tctx, p);
-
-            /* set a GAP flag and make sure not bothering this stream anymore */
-            SCLogDebug("STREAMTCP_STREAM_FLAG_GAP set");
-            stream->flags |= STREAMTCP_STREAM_FLAG_GAP;
-
-            StreamTcpSetEvent(p, STREAM_REASSEMBLY_SEQ_GAP);
-            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap, tv->sc_perf_pca);
-#ifdef DEBUG
-            dbg_app_layer_gap++;
-#endif
+            StreamTcpReassembleAppLayerGap(tv, ra_ctx, ssn, stream, p, flags, 0);
             SCReturnInt(0);
         }
     }
@@ -2254,20 +2352,8 @@ int StreamTcpReassembleInlineAppLayer(ThreadVars *tv,
 
             /* send gap signal */
             STREAM_SET_INLINE_FLAGS(ssn, stream, p, flags);
-            AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
-                    NULL, 0, flags|STREAM_GAP);
-            AppLayerProfilingStore(ra_ctx->app_tctx, p);
+            StreamTcpReassembleAppLayerGap(tv, ra_ctx, ssn, stream, p, flags, 0);
             data_sent += data_len;
-
-            /* set a GAP flag and make sure not bothering this stream anymore */
-            SCLogDebug("STREAMTCP_STREAM_FLAG_GAP set");
-            stream->flags |= STREAMTCP_STREAM_FLAG_GAP;
-
-            StreamTcpSetEvent(p, STREAM_REASSEMBLY_SEQ_GAP);
-            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap, tv->sc_perf_pca);
-#ifdef DEBUG
-            dbg_app_layer_gap++;
-#endif
             break;
         }
 
@@ -2620,6 +2706,8 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
             memcpy(smsg->data + smsg_offset, seg->payload + payload_offset,
                     copy_size);
             smsg_offset += copy_size;
+            StreamTcpSetupMsgNewData(smsg, seg->seq + payload_offset,
+                    copy_size, ra_base_seq);
 
             SCLogDebug("seg total %u, seq %u off %u copy %u, ra_base_seq %u",
                     (seg->seq + payload_offset + copy_size), seg->seq,
@@ -2685,6 +2773,8 @@ static int StreamTcpReassembleInlineRaw (TcpReassemblyThreadCtx *ra_ctx,
                     memcpy(smsg->data + smsg_offset, seg->payload +
                             payload_offset, copy_size);
                     smsg_offset += copy_size;
+                    StreamTcpSetupMsgNewData(smsg, seg->seq + payload_offset,
+                            copy_size, ra_base_seq);
                     if (gap == 0 && SEQ_GT((seg->seq + payload_offset + copy_size),ra_base_seq+1)) {
                         ra_base_seq += copy_size;
                     }
@@ -2923,22 +3013,12 @@ int StreamTcpReassembleAppLayer (ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
      * won't get retransmitted, so it's a data gap.
      */
     if (!(p->flow->flags & FLOW_NO_APPLAYER_INSPECTION)) {
-        if (SEQ_GT(seg->seq, next_seq) && SEQ_LT(seg->seq, stream->last_ack)) {
+        if (SEQ_GT(seg->seq, next_seq) && (SEQ_LT(seg->seq, stream->last_ack) ||
+                    StreamTcpReassembleGapIsPermanent(stream, next_seq))) {
             /* send gap signal */
             STREAM_SET_FLAGS(ssn, stream, p, flags);
-            AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
-                    NULL, 0, flags|STREAM_GAP);
-            AppLayerProfilingStore(ra_ctx->app_tctx, p);
-
-            /* set a GAP flag and make sure not bothering this stream anymore */
-            SCLogDebug("STREAMTCP_STREAM_FLAG_GAP set");
-            stream->flags |= STREAMTCP_STREAM_FLAG_GAP;
-
-            StreamTcpSetEvent(p, STREAM_REASSEMBLY_SEQ_GAP);
-            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap, tv->sc_perf_pca);
-#ifdef DEBUG
-            dbg_app_layer_gap++;
-#endif
+            StreamTcpReassembleAppLayerGap(tv, ra_ctx, ssn, stream, p, flags,
+                    !SEQ_LT(seg->seq, stream->last_ack));
             SCReturnInt(0);
         }
     }
@@ -2999,19 +3079,7 @@ int StreamTcpReassembleAppLayer (ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
 
             /* send gap signal */
             STREAM_SET_FLAGS(ssn, stream, p, flags);
-            AppLayerHandleTCPData(tv, ra_ctx, p, p->flow, ssn, stream,
-                    NULL, 0, flags|STREAM_GAP);
-            AppLayerProfilingStore(ra_ctx->app_tctx, p);
-
-            /* set a GAP flag and make sure not bothering this stream anymore */
-            SCLogDebug("STREAMTCP_STREAM_FLAG_GAP set");
-            stream->flags |= STREAMTCP_STREAM_FLAG_GAP;
-
-            StreamTcpSetEvent(p, STREAM_REASSEMBLY_SEQ_GAP);
-            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_gap, tv->sc_perf_pca);
-#ifdef DEBUG
-            dbg_app_layer_gap++;
-#endif
+            StreamTcpReassembleAppLayerGap(tv, ra_ctx, ssn, stream, p, flags, 0);
             break;
         }
 
@@ -3201,6 +3269,22 @@ int StreamTcpReassembleAppLayer (ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
         AppLayerProfilingStore(ra_ctx->app_tctx, p);
     }
 
+    /* gap-policy sack: the data up to last_ack is done, if the receiver
+     * SACK'd enough data beyond the next gap we stop waiting for it. */
+    if (seg != NULL && !(stream->flags & STREAMTCP_STREAM_FLAG_GAP) &&
+        !(p->flow->flags & FLOW_NO_APPLAYER_INSPECTION) &&
+        SEQ_GT(seg->seq, next_seq) &&
+        StreamTcpReassembleGapIsPermanent(stream, next_seq))
+    {
+        SCLogDebug("gap at %"PRIu32" considered permanent based on SACK", next_seq);
+        ra_base_seq = seg->seq - 1;
+
+        /* send gap signal */
+        flags = 0;
+        STREAM_SET_FLAGS(ssn, stream, p, flags);
+        StreamTcpReassembleAppLayerGap(tv, ra_ctx, ssn, stream, p, flags, 1);
+    }
+
     /* store ra_base_seq in the stream */
     if (StreamTcpIsSetStreamFlagAppProtoDetectionCompleted(stream)) {
         stream->ra_app_base_seq = ra_base_seq;
@@ -3254,12 +3338,14 @@ static int StreamTcpReassembleRaw (TcpReassemblyThreadCtx *ra_ctx,
     uint16_t payload_len = 0;
     TcpSegment *seg = stream->seg_list;
     uint32_t next_seq = ra_base_seq + 1;
+    uint32_t right_edge = StreamTcpReassembleRawRightEdge(stream);
 
-    SCLogDebug("ra_base_seq %"PRIu32", last_ack %"PRIu32", next_seq %"PRIu32,
-            ra_base_seq, stream->last_ack, next_seq);
+    SCLogDebug("ra_base_seq %"PRIu32", last_ack %"PRIu32", next_seq %"PRIu32
+            ", right_edge %"PRIu32, ra_base_seq, stream->last_ack, next_seq,
+            right_edge);
 
     /* loop through the segments and fill one or more msgs */
-    for (; seg != NULL && SEQ_LT(seg->seq, stream->last_ack);)
+    for (; seg != NULL && SEQ_LT(seg->seq, right_edge);)
     {
         SCLogDebug("seg %p, SEQ %"PRIu32", LEN %"PRIu16", SUM %"PRIu32", flags %02x",
                 seg, seg->seq, seg->payload_len,
@@ -3322,12 +3408,12 @@ static int StreamTcpReassembleRaw (TcpReassemblyThreadCtx *ra_ctx,
             if (SEQ_GT(ra_base_seq, seg->seq)) {
                 payload_offset = ra_base_seq - seg->seq;
 
-                if (SEQ_LT(stream->last_ack, (seg->seq + seg->payload_len))) {
+                if (SEQ_LT(right_edge, (seg->seq + seg->payload_len))) {
 
-                    if (SEQ_LT(stream->last_ack, ra_base_seq)) {
-                        payload_len = (stream->last_ack - seg->seq);
+                    if (SEQ_LT(right_edge, ra_base_seq)) {
+                        payload_len = (right_edge - seg->seq);
                     } else {
-                        payload_len = (stream->last_ack - seg->seq) - payload_offset;
+                        payload_len = (right_edge - seg->seq) - payload_offset;
                     }
                     partial = TRUE;
                 } else {
@@ -3341,8 +3427,8 @@ static int StreamTcpReassembleRaw (TcpReassemblyThreadCtx *ra_ctx,
             } else {
                 payload_offset = 0;
 
-                if (SEQ_LT(stream->last_ack, (seg->seq + seg->payload_len))) {
-                    payload_len = stream->last_ack - seg->seq;
+                if (SEQ_LT(right_edge, (seg->seq + seg->payload_len))) {
+                    payload_len = right_edge - seg->seq;
                     partial = TRUE;
                 } else {
                     payload_len = seg->payload_len;
@@ -3518,6 +3604,38 @@ int StreamTcpReassembleHandleSegmentUpdateACK (ThreadVars *tv,
     SCReturnInt(r);
 }
 
+/** \internal
+ *  \brief check if the segment of an inline mode packet can skip reassembly
+ *
+ *  With stream.inline-low-latency segments that won't add anything to the
+ *  inspected data are not added to the stream: packets of flows where the
+ *  app layer is done and raw reassembly is disabled. Segments beyond the
+ *  reassembly depth aren't added in any mode. The segments that were
+ *  queued before still need to be pruned, so the inline reassembly
+ *  functions still run.
+ *
+ *  \retval 1 skip adding the segment
+ *  \retval 0 reassemble
+ */
+static inline int StreamTcpReassembleInlineBypass(TcpSession *ssn,
+        TcpStream *stream, Packet *p)
+{
+    if (!(stream_config.flags & STREAMTCP_INIT_FLAG_INLINE_LOW_LATENCY))
+        return 0;
+
+    /* let the stream end handling run as normal */
+    if ((p->flags & PKT_PSEUDO_STREAM_END) || ssn->state > TCP_ESTABLISHED)
+        return 0;
+
+    /* app layer is done and raw isn't needed */
+    if (p->flow != NULL && (p->flow->flags & FLOW_NO_APPLAYER_INSPECTION) &&
+        ((ssn->flags & STREAMTCP_FLAG_DISABLE_RAW) ||
+         (stream->flags & STREAMTCP_STREAM_FLAG_NEW_RAW_DISABLED)))
+        return 1;
+
+    return 0;
+}
+
 int StreamTcpReassembleHandleSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
                                      TcpSession *ssn, TcpStream *stream,
                                      Packet *p, PacketQueue *pq)
@@ -3545,14 +3663,19 @@ int StreamTcpReassembleHandleSegment(ThreadVars *tv, TcpReassemblyThreadCtx *ra_
     /* If no stream reassembly/application layer protocol inspection, then
        simple return */
     if (p->payload_len > 0 && !(stream->flags & STREAMTCP_STREAM_FLAG_NOREASSEMBLY)) {
-        SCLogDebug("calling StreamTcpReassembleHandleSegmentHandleData");
+        if (StreamTcpInlineMode() && StreamTcpReassembleInlineBypass(ssn, stream, p)) {
+            SCLogDebug("ssn %p: low latency inline, not adding the segment", ssn);
+            SCPerfCounterIncr(ra_ctx->counter_tcp_reass_inline_bypass, tv->sc_perf_pca);
+        } else {
+            SCLogDebug("calling StreamTcpReassembleHandleSegmentHandleData");
 
-        if (StreamTcpReassembleHandleSegmentHandleData(tv, ra_ctx, ssn, stream, p) != 0) {
-            SCLogDebug("StreamTcpReassembleHandleSegmentHandleData error");
-            SCReturnInt(-1);
-        }
+            if (StreamTcpReassembleHandleSegmentHandleData(tv, ra_ctx, ssn, stream, p) != 0) {
+                SCLogDebug("StreamTcpReassembleHandleSegmentHandleData error");
+                SCReturnInt(-1);
+            }
 
-        p->flags |= PKT_STREAM_ADD;
+            p->flags |= PKT_STREAM_ADD;
+        }
     }
 
     /* in stream inline mode even if we have no data we call the reassembly
@@ -7739,6 +7862,12 @@ static int StreamTcpReassembleInlineTest02(void) {
         goto end;
     }
 
+    if (smsg->seq != 2 || smsg->new_data_offset != 0) {
+        printf("expected seq 2 and new data offset 0, got %u/%u: ",
+                smsg->seq, smsg->new_data_offset);
+        goto end;
+    }
+
     if (!(memcmp(stream_payload1, smsg->data, 15) == 0)) {
         printf("data is not what we expected:\nExpected:\n");
         PrintRawDataFp(stdout, stream_payload1, 15);
@@ -7770,6 +7899,13 @@ static int StreamTcpReassembleInlineTest02(void) {
         goto end;
     }
 
+    /* first 15 bytes were in the previous smsg */
+    if (smsg->seq != 17 || smsg->new_data_offset != 15) {
+        printf("expected seq 17 and new data offset 15, got %u/%u: ",
+                smsg->seq, smsg->new_data_offset);
+        goto end;
+    }
+
     if (!(memcmp(stream_payload2, smsg->data, 20) == 0)) {
         printf("data is not what we expected:\nExpected:\n");
         PrintRawDataFp(stdout, stream_payload2, 20);
@@ -8734,6 +8870,182 @@ end:
     return ret;
 }
 
+/** \test gap-policy sack: gap beyond last_ack is considered permanent once
+ *        enough data beyond it is SACK'd.
+ */
+static int StreamTcpReassembleGapSackTest01(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    TcpSession ssn;
+    Flow *f = NULL;
+    Packet *p = NULL;
+    StreamTcpSackRecord *rec = NULL;
+    uint8_t orig_flags = stream_config.flags;
+    uint32_t orig_gap_sack_size = stream_config.reassembly_gap_sack_size;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    StreamTcpUTInit(&ra_ctx);
+    StreamTcpUTSetupSession(&ssn);
+    StreamTcpUTSetupStream(&ssn.client, 1);
+
+    f = UTHBuildFlow(AF_INET, "1.1.1.1", "2.2.2.2", 1024, 80);
+    if (f == NULL)
+        goto end;
+    f->protoctx = &ssn;
+    f->proto = IPPROTO_TCP;
+
+    uint8_t payload[] = { 'D', 'D', 'D', 'D', 'D' };
+    p = UTHBuildPacketReal(payload, 5, IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+    if (p == NULL) {
+        printf("couldn't get a packet: ");
+        goto end;
+    }
+    p->tcph->th_seq = htonl(17);
+    p->flow = f;
+    p->flowflags |= FLOW_PKT_TOSERVER;
+
+    SCMutexLock(&f->m);
+    if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client,  2, 'A', 5) == -1) {
+        printf("failed to add segment 1: ");
+        goto end;
+    }
+    /* 7-11 missing */
+    if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 12, 'C', 5) == -1) {
+        printf("failed to add segment 2: ");
+        goto end;
+    }
+    if (StreamTcpUTAddSegmentWithByte(&tv, ra_ctx, &ssn.client, 17, 'D', 5) == -1) {
+        printf("failed to add segment 3: ");
+        goto end;
+    }
+    ssn.client.next_seq = 22;
+    ssn.client.last_ack = 7;
+
+    rec = SCMalloc(sizeof(*rec));
+    if (unlikely(rec == NULL))
+        goto end;
+    rec->le = 12;
+    rec->re = 22;
+    rec->next = NULL;
+    ssn.client.sack_head = ssn.client.sack_tail = rec;
+
+    /* default policy: keep waiting for the gap to be ACK'd */
+    if (StreamTcpReassembleAppLayer(&tv, ra_ctx, &ssn, &ssn.client, p) < 0) {
+        printf("StreamTcpReassembleAppLayer failed: ");
+        goto end;
+    }
+    if (ssn.client.flags & STREAMTCP_STREAM_FLAG_GAP) {
+        printf("gap flag set with gap-policy wait: ");
+        goto end;
+    }
+
+    stream_config.flags |= STREAMTCP_INIT_FLAG_GAP_POLICY_SACK;
+    stream_config.reassembly_gap_sack_size = 11;
+
+    /* not enough SACK'd yet */
+    if (StreamTcpReassembleAppLayer(&tv, ra_ctx, &ssn, &ssn.client, p) < 0) {
+        printf("StreamTcpReassembleAppLayer failed 2: ");
+        goto end;
+    }
+    if (ssn.client.flags & STREAMTCP_STREAM_FLAG_GAP) {
+        printf("gap flag set with only 10 bytes SACK'd: ");
+        goto end;
+    }
+
+    stream_config.reassembly_gap_sack_size = 10;
+
+    if (StreamTcpReassembleAppLayer(&tv, ra_ctx, &ssn, &ssn.client, p) < 0) {
+        printf("StreamTcpReassembleAppLayer failed 3: ");
+        goto end;
+    }
+    if (!(ssn.client.flags & STREAMTCP_STREAM_FLAG_GAP)) {
+        printf("gap flag not set: ");
+        goto end;
+    }
+
+    /* raw reassembly may now inspect the SACK'd data */
+    if (StreamTcpReassembleRawRightEdge(&ssn.client) != 22) {
+        printf("expected raw right edge 22, got %u: ",
+                StreamTcpReassembleRawRightEdge(&ssn.client));
+        goto end;
+    }
+
+    ret = 1;
+end:
+    StreamTcpSackFreeList(&ssn.client);
+    UTHFreePacket(p);
+    StreamTcpUTClearSession(&ssn);
+    StreamTcpUTDeinit(ra_ctx);
+    if (f != NULL) {
+        SCMutexUnlock(&f->m);
+        UTHFreeFlow(f);
+    }
+    stream_config.flags = orig_flags;
+    stream_config.reassembly_gap_sack_size = orig_gap_sack_size;
+    return ret;
+}
+
+/** \test inline low latency bypass conditions
+ */
+static int StreamTcpReassembleInlineBypassTest01(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    TcpSession ssn;
+    Flow f;
+    Packet *p = NULL;
+    uint8_t orig_flags = stream_config.flags;
+
+    StreamTcpUTInit(&ra_ctx);
+    StreamTcpUTSetupSession(&ssn);
+    StreamTcpUTSetupStream(&ssn.client, 1);
+    ssn.state = TCP_ESTABLISHED;
+    memset(&f, 0x00, sizeof(f));
+
+    uint8_t payload[] = { 'A', 'A', 'A', 'A', 'A' };
+    p = UTHBuildPacketReal(payload, 5, IPPROTO_TCP, "1.1.1.1", "2.2.2.2", 1024, 80);
+    if (p == NULL) {
+        printf("couldn't get a packet: ");
+        goto end;
+    }
+    p->flow = &f;
+
+    f.flags |= FLOW_NO_APPLAYER_INSPECTION;
+    ssn.client.flags |= STREAMTCP_STREAM_FLAG_NEW_RAW_DISABLED;
+    if (StreamTcpReassembleInlineBypass(&ssn, &ssn.client, p) != 0) {
+        printf("bypass while low latency mode is off: ");
+        goto end;
+    }
+
+    stream_config.flags |= STREAMTCP_INIT_FLAG_INLINE_LOW_LATENCY;
+    ssn.client.flags &= ~STREAMTCP_STREAM_FLAG_NEW_RAW_DISABLED;
+    if (StreamTcpReassembleInlineBypass(&ssn, &ssn.client, p) != 0) {
+        printf("bypass while raw reassembly is needed: ");
+        goto end;
+    }
+
+    ssn.client.flags |= STREAMTCP_STREAM_FLAG_NEW_RAW_DISABLED;
+    if (StreamTcpReassembleInlineBypass(&ssn, &ssn.client, p) != 1) {
+        printf("no bypass for app layer complete flow: ");
+        goto end;
+    }
+
+    ssn.state = TCP_CLOSE_WAIT;
+    if (StreamTcpReassembleInlineBypass(&ssn, &ssn.client, p) != 0) {
+        printf("bypass while closing: ");
+        goto end;
+    }
+
+    ret = 1;
+end:
+    UTHFreePacket(p);
+    StreamTcpUTClearSession(&ssn);
+    StreamTcpUTDeinit(ra_ctx);
+    stream_config.flags = orig_flags;
+    return ret;
+}
+
 /** \test test insert with overlap
  */
 static int StreamTcpReassembleInsertTest01(void) {
@@ -8906,6 +9218,382 @@ end:
     return ret;
 }
 
+/** Comment out this if you want the reassembly benchmark
+ *  #define ENABLE_REASSEMBLY_BENCH 1
+ */
+
+#ifdef ENABLE_REASSEMBLY_BENCH
+/* reassembly throughput benchmark
+ *
+ * Feeds synthetic sessions through StreamTcpReassembleHandleSegment and
+ * reports segments/s, bytes/s, peak memuse and the segment pool hit rate.
+ * Build with ENABLE_REASSEMBLY_BENCH and run it using:
+ *
+ *   suricata -u -U StreamTcpReassembleBench
+ *
+ * The workload can be tuned with:
+ *
+ *   --set unittests.reassembly-bench.session-size=<size> (default 256kb)
+ *   --set unittests.reassembly-bench.sessions=<num>      (default 4)
+ *
+ * To catch regressions, point it to a baseline file:
+ *
+ *   --set unittests.reassembly-bench.baseline=<file>
+ *   --set unittests.reassembly-bench.max-regression=<percent> (default 10)
+ *
+ * If the file doesn't exist the results of the run are written to it.
+ * Otherwise the test fails if a scenario's segments/s dropped more than
+ * max-regression percent below the baseline's.
+ */
+
+#define BENCH_DEFAULT_SESSION_SIZE  (256 * 1024)
+#define BENCH_DEFAULT_SESSIONS      4
+#define BENCH_DEFAULT_MAX_REGRESSION 10 /**< percent */
+#define BENCH_ACK_INTERVAL          16  /**< ack every this many data pkts */
+#define BENCH_CLIENT_ISN            1000
+#define BENCH_SERVER_ISN            5000
+
+enum {
+    BENCH_MODE_INORDER = 0,
+    BENCH_MODE_REORDER,     /**< every pair of segments is swapped */
+    BENCH_MODE_OVERLAP,     /**< every segment overlaps half of the previous */
+};
+
+typedef struct StreamTcpBenchScenario_ {
+    const char *name;
+    uint16_t seg_size;
+    uint8_t mode;
+} StreamTcpBenchScenario;
+
+static StreamTcpBenchScenario bench_scenarios[] = {
+    { "in-order",       1448, BENCH_MODE_INORDER, },
+    { "reordered",      1448, BENCH_MODE_REORDER, },
+    { "overlapping",    1448, BENCH_MODE_OVERLAP, },
+    { "small-segments",   16, BENCH_MODE_INORDER, },
+    { "jumbo-segments", 8960, BENCH_MODE_INORDER, },
+};
+
+typedef struct StreamTcpBenchResult_ {
+    uint64_t segments;
+    uint64_t bytes;
+    uint64_t usecs;
+    uint64_t peak_memuse;   /**< peak reassembly memuse over the start */
+    uint64_t pool_allocs;   /**< segments that were not served from the pool */
+} StreamTcpBenchResult;
+
+typedef struct StreamTcpBenchSession_ {
+    ThreadVars *tv;
+    TcpReassemblyThreadCtx *ra_ctx;
+    TcpSession ssn;
+    Packet *p;
+    PacketQueue pq;
+    uint64_t base_memuse;
+    StreamTcpBenchResult *result;
+} StreamTcpBenchSession;
+
+static uint8_t bench_payload[9000];
+
+static uint64_t StreamTcpBenchPoolAllocated(void)
+{
+    uint64_t allocated = 0;
+    int u;
+
+    for (u = 0; u < segment_pool_num; u++) {
+        SCMutexLock(&segment_pool_mutex[u]);
+        allocated += segment_pool[u]->allocated;
+        SCMutexUnlock(&segment_pool_mutex[u]);
+    }
+    return allocated;
+}
+
+static int StreamTcpBenchData(StreamTcpBenchSession *bs, uint32_t offset,
+        uint16_t len)
+{
+    Packet *p = bs->p;
+
+    p->flowflags = FLOW_PKT_TOSERVER;
+    p->tcph->th_seq = htonl(BENCH_CLIENT_ISN + 1 + offset);
+    p->tcph->th_ack = htonl(BENCH_SERVER_ISN + 1);
+    p->payload = bench_payload;
+    p->payload_len = len;
+
+    if (StreamTcpReassembleHandleSegment(bs->tv, bs->ra_ctx, &bs->ssn,
+                &bs->ssn.client, p, &bs->pq) == -1)
+        return -1;
+
+    bs->result->segments++;
+    bs->result->bytes += len;
+
+    uint64_t memuse = SC_ATOMIC_GET(ra_memuse);
+    if (memuse > bs->base_memuse &&
+        memuse - bs->base_memuse > bs->result->peak_memuse)
+        bs->result->peak_memuse = memuse - bs->base_memuse;
+    return 0;
+}
+
+static int StreamTcpBenchAck(StreamTcpBenchSession *bs, uint32_t offset)
+{
+    Packet *p = bs->p;
+
+    bs->ssn.client.last_ack = BENCH_CLIENT_ISN + 1 + offset;
+
+    p->flowflags = FLOW_PKT_TOCLIENT;
+    p->tcph->th_seq = htonl(BENCH_SERVER_ISN + 1);
+    p->tcph->th_ack = htonl(bs->ssn.client.last_ack);
+    p->payload = NULL;
+    p->payload_len = 0;
+
+    if (StreamTcpReassembleHandleSegment(bs->tv, bs->ra_ctx, &bs->ssn,
+                &bs->ssn.server, p, &bs->pq) == -1)
+        return -1;
+
+    /* detection would consume the stream msgs */
+    StreamMsgReturnListToPool(bs->ssn.toserver_smsg_head);
+    bs->ssn.toserver_smsg_head = bs->ssn.toserver_smsg_tail = NULL;
+    return 0;
+}
+
+/** \internal
+ *  \brief run one session of 'size' bytes for a scenario
+ */
+static int StreamTcpBenchRunSession(ThreadVars *tv, TcpReassemblyThreadCtx *ra_ctx,
+        StreamTcpBenchScenario *sc, uint32_t size, StreamTcpBenchResult *result)
+{
+    StreamTcpBenchSession bs;
+    Flow f;
+    TCPHdr tcph;
+    struct timeval start, end;
+    uint32_t offset = 0;
+    uint32_t pkts = 0;
+    int ret = 0;
+
+    memset(&bs, 0x00, sizeof(bs));
+    memset(&f, 0x00, sizeof(f));
+    memset(&tcph, 0x00, sizeof(tcph));
+
+    bs.p = PacketGetFromAlloc();
+    if (unlikely(bs.p == NULL))
+        return 0;
+    bs.tv = tv;
+    bs.ra_ctx = ra_ctx;
+    bs.result = result;
+    bs.base_memuse = SC_ATOMIC_GET(ra_memuse);
+
+    StreamTcpUTSetupSession(&bs.ssn);
+    bs.ssn.state = TCP_ESTABLISHED;
+    StreamTcpUTSetupStream(&bs.ssn.client, BENCH_CLIENT_ISN);
+    StreamTcpUTSetupStream(&bs.ssn.server, BENCH_SERVER_ISN);
+    bs.ssn.client.last_ack = BENCH_CLIENT_ISN + 1;
+    bs.ssn.server.last_ack = BENCH_SERVER_ISN + 1;
+
+    FLOW_INITIALIZE(&f);
+    f.protoctx = &bs.ssn;
+    f.proto = IPPROTO_TCP;
+
+    tcph.th_win = htons(65535);
+    tcph.th_flags = TH_ACK|TH_PUSH;
+    bs.p->src.family = AF_INET;
+    bs.p->dst.family = AF_INET;
+    bs.p->proto = IPPROTO_TCP;
+    bs.p->flow = &f;
+    bs.p->tcph = &tcph;
+
+    gettimeofday(&start, NULL);
+
+    while (offset < size) {
+        uint16_t len = sc->seg_size;
+        if (size - offset < len)
+            len = size - offset;
+
+        switch (sc->mode) {
+            case BENCH_MODE_REORDER:
+                if (size - offset > len) {
+                    uint16_t next_len = sc->seg_size;
+                    if (size - offset - len < next_len)
+                        next_len = size - offset - len;
+
+                    if (StreamTcpBenchData(&bs, offset + len, next_len) < 0)
+                        goto end;
+                    pkts++;
+                    len += next_len;
+                    if (StreamTcpBenchData(&bs, offset, sc->seg_size) < 0)
+                        goto end;
+                } else {
+                    if (StreamTcpBenchData(&bs, offset, len) < 0)
+                        goto end;
+                }
+                offset += len;
+                break;
+            case BENCH_MODE_OVERLAP:
+                if (StreamTcpBenchData(&bs, offset, len) < 0)
+                    goto end;
+                if (size - offset > len && len > 1)
+                    offset += len / 2;
+                else
+                    offset += len;
+                break;
+            default:
+                if (StreamTcpBenchData(&bs, offset, len) < 0)
+                    goto end;
+                offset += len;
+                break;
+        }
+
+        if ((++pkts % BENCH_ACK_INTERVAL) == 0) {
+            if (StreamTcpBenchAck(&bs, offset) < 0)
+                goto end;
+        }
+    }
+    if (StreamTcpBenchAck(&bs, offset) < 0)
+        goto end;
+
+    gettimeofday(&end, NULL);
+    result->usecs += ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000) +
+        (end.tv_usec - start.tv_usec);
+    ret = 1;
+end:
+    StreamMsgReturnListToPool(bs.ssn.toserver_smsg_head);
+    StreamMsgReturnListToPool(bs.ssn.toclient_smsg_head);
+    StreamTcpUTClearSession(&bs.ssn);
+    FLOW_DESTROY(&f);
+    SCFree(bs.p);
+    return ret;
+}
+
+/** \internal
+ *  \brief get the segments/s of a scenario from a baseline file
+ *
+ *  The file has a "<scenario> <segments/s>" line per scenario.
+ *
+ *  \retval sps segments/s or 0 if the scenario is not in the file
+ */
+static uint64_t StreamTcpBenchBaselineGet(FILE *fp, const char *name)
+{
+    char line[128];
+    char scenario[64];
+    uint64_t sps;
+
+    rewind(fp);
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%63s %"SCNu64, scenario, &sps) == 2 &&
+            strcmp(scenario, name) == 0)
+            return sps;
+    }
+    return 0;
+}
+
+/** \test reassembly throughput benchmark, see above.
+ */
+static int StreamTcpReassembleBench01(void) {
+    int ret = 0;
+    TcpReassemblyThreadCtx *ra_ctx = NULL;
+    ThreadVars tv;
+    uint32_t size = BENCH_DEFAULT_SESSION_SIZE;
+    intmax_t sessions = BENCH_DEFAULT_SESSIONS;
+    intmax_t max_regression = BENCH_DEFAULT_MAX_REGRESSION;
+    uint32_t orig_depth = stream_config.reassembly_depth;
+    char *baseline = NULL;
+    FILE *baseline_fp = NULL;
+    int baseline_write = 0;
+    char *conf_val;
+    uint32_t u;
+    intmax_t s;
+
+    memset(&tv, 0x00, sizeof(tv));
+
+    if (ConfGet("unittests.reassembly-bench.session-size", &conf_val) == 1) {
+        if (ParseSizeStringU32(conf_val, &size) < 0 || size == 0) {
+            printf("invalid unittests.reassembly-bench.session-size %s: ", conf_val);
+            return 0;
+        }
+    }
+    if (ConfGetInt("unittests.reassembly-bench.sessions", &sessions) != 1 ||
+        sessions <= 0)
+        sessions = BENCH_DEFAULT_SESSIONS;
+    if (ConfGetInt("unittests.reassembly-bench.max-regression", &max_regression) != 1 ||
+        max_regression < 0 || max_regression > 100)
+        max_regression = BENCH_DEFAULT_MAX_REGRESSION;
+
+    if (ConfGet("unittests.reassembly-bench.baseline", &baseline) == 1) {
+        baseline_fp = fopen(baseline, "r");
+        if (baseline_fp == NULL) {
+            baseline_fp = fopen(baseline, "w");
+            if (baseline_fp == NULL) {
+                printf("can't open baseline %s: %s: ", baseline, strerror(errno));
+                return 0;
+            }
+            baseline_write = 1;
+        }
+    }
+
+    memset(bench_payload, 'A', sizeof(bench_payload));
+
+    StreamTcpUTInit(&ra_ctx);
+    stream_config.reassembly_depth = 0;
+
+    for (u = 0; u < sizeof(bench_scenarios) / sizeof(bench_scenarios[0]); u++) {
+        StreamTcpBenchScenario *sc = &bench_scenarios[u];
+        StreamTcpBenchResult result;
+        memset(&result, 0x00, sizeof(result));
+
+        uint64_t allocated = StreamTcpBenchPoolAllocated();
+        for (s = 0; s < sessions; s++) {
+            if (StreamTcpBenchRunSession(&tv, ra_ctx, sc, size, &result) != 1) {
+                printf("scenario %s failed: ", sc->name);
+                goto end;
+            }
+        }
+        result.pool_allocs = StreamTcpBenchPoolAllocated() - allocated;
+
+        uint64_t usecs = result.usecs ? result.usecs : 1;
+        uint64_t sps = result.segments * 1000000 / usecs;
+        uint64_t bps = result.bytes * 1000000 / usecs;
+        float hit_rate = result.segments ? 100.0 -
+            ((float)result.pool_allocs * 100.0 / (float)result.segments) : 0.0;
+
+        SCLogInfo("reassembly bench %-14s: %"PRIu64" segments, %"PRIu64" bytes "
+                "in %"PRIu64"us: %"PRIu64" segments/s, %"PRIu64" bytes/s, "
+                "peak memuse %"PRIu64", pool hit rate %.2f%%", sc->name,
+                result.segments, result.bytes, result.usecs, sps, bps,
+                result.peak_memuse, hit_rate);
+
+        if (baseline_fp == NULL)
+            continue;
+
+        if (baseline_write) {
+            fprintf(baseline_fp, "%s %"PRIu64"\n", sc->name, sps);
+            continue;
+        }
+
+        uint64_t base_sps = StreamTcpBenchBaselineGet(baseline_fp, sc->name);
+        if (base_sps == 0) {
+            SCLogInfo("reassembly bench %s: not in baseline %s", sc->name, baseline);
+            continue;
+        }
+        SCLogInfo("reassembly bench %-14s: baseline %"PRIu64" segments/s (%+.1f%%)",
+                sc->name, base_sps,
+                ((double)sps - (double)base_sps) * 100.0 / (double)base_sps);
+        if (sps * 100 < base_sps * (uint64_t)(100 - max_regression)) {
+            printf("scenario %s: %"PRIu64" segments/s is more than %"PRIdMAX"%% "
+                    "below the baseline of %"PRIu64": ", sc->name, sps,
+                    max_regression, base_sps);
+            goto end;
+        }
+    }
+
+    if (baseline_write)
+        SCLogInfo("reassembly bench: baseline written to %s", baseline);
+
+    ret = 1;
+end:
+    if (baseline_fp != NULL)
+        fclose(baseline_fp);
+    stream_config.reassembly_depth = orig_depth;
+    StreamTcpUTDeinit(ra_ctx);
+    return ret;
+}
+#endif /* ENABLE_REASSEMBLY_BENCH */
+
 #endif /* UNITTESTS */
 
 /** \brief  The Function Register the Unit tests to test the reassembly engine
@@ -8972,10 +9660,17 @@ void StreamTcpReassembleRegisterTests(void) {
 
     UtRegisterTest("StreamTcpReassembleInlineTest10 -- inline APP ra 10", StreamTcpReassembleInlineTest10, 1);
 
+    UtRegisterTest("StreamTcpReassembleInlineBypassTest01 -- inline low latency", StreamTcpReassembleInlineBypassTest01, 1);
+    UtRegisterTest("StreamTcpReassembleGapSackTest01 -- gap-policy sack", StreamTcpReassembleGapSackTest01, 1);
+
     UtRegisterTest("StreamTcpReassembleInsertTest01 -- insert with overlap", StreamTcpReassembleInsertTest01, 1);
     UtRegisterTest("StreamTcpReassembleInsertTest02 -- insert with overlap", StreamTcpReassembleInsertTest02, 1);
     UtRegisterTest("StreamTcpReassembleInsertTest03 -- insert with overlap", StreamTcpReassembleInsertTest03, 1);
 
+#ifdef ENABLE_REASSEMBLY_BENCH
+    UtRegisterTest("StreamTcpReassembleBench01 -- reassembly throughput", StreamTcpReassembleBench01, 1);
+#endif
+
     StreamTcpInlineRegisterTests();
     StreamTcpUtilRegisterTests();
 #endif /* UNITTESTS */
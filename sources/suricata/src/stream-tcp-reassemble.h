@@ -61,6 +61,10 @@ typedef struct TcpReassemblyThreadCtx_ {
     uint16_t counter_tcp_reass_memuse;
     /** count number of streams with a unrecoverable stream gap (missing pkts) */
     uint16_t counter_tcp_reass_gap;
+    /** count number of gaps that were declared permanent based on SACK */
+    uint16_t counter_tcp_reass_gap_sack;
+    /** count number of packets that skipped inline reassembly */
+    uint16_t counter_tcp_reass_inline_bypass;
     /** account memory usage by suricata to handle HTTP protocol (not counting
      * libhtp memory usage)*/
     uint16_t counter_htp_memuse;
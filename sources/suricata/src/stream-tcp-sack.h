@@ -54,6 +54,55 @@ static inline uint32_t StreamTcpSackedSize(TcpStream *stream) {
     }
 }
 
+/**
+ *  \brief Get the size of the SACKed ranges beyond a sequence number
+ *
+ *  \param stream Stream to get the size for.
+ *  \param seq sequence number to count from
+ *
+ *  \retval size the size
+ */
+static inline uint32_t StreamTcpSackedSizeBeyond(TcpStream *stream, uint32_t seq) {
+    if (likely(stream->sack_head == NULL)) {
+        SCReturnUInt(0U);
+    } else {
+        uint32_t size = 0;
+
+        StreamTcpSackRecord *rec = NULL;
+
+        for (rec = stream->sack_head; rec != NULL; rec = rec->next) {
+            if (SEQ_LEQ(rec->re, seq))
+                continue;
+            if (SEQ_LT(rec->le, seq))
+                size += (rec->re - seq);
+            else
+                size += (rec->re - rec->le);
+        }
+
+        SCReturnUInt(size);
+    }
+}
+
+/**
+ *  \brief Get the highest SACKed right edge
+ *
+ *  \param stream Stream to get the edge for.
+ *
+ *  \retval re right edge or stream->last_ack if that is higher
+ */
+static inline uint32_t StreamTcpSackedRightEdge(TcpStream *stream) {
+    uint32_t re = stream->last_ack;
+
+    StreamTcpSackRecord *rec = NULL;
+
+    for (rec = stream->sack_head; rec != NULL; rec = rec->next) {
+        if (SEQ_GT(rec->re, re))
+            re = rec->re;
+    }
+
+    SCReturnUInt(re);
+}
+
 int StreamTcpSackUpdatePacket(TcpStream *, Packet *);
 void StreamTcpSackPruneList(TcpStream *);
 void StreamTcpSackFreeList(TcpStream *);
@@ -32,6 +32,7 @@
 #include "decode.h"
 #include "debug.h"
 #include "detect.h"
+#include "detect-engine-mpm.h"
 
 #include "flow.h"
 #include "flow-util.h"
@@ -82,6 +83,7 @@
 #define STREAMTCP_DEFAULT_TOSERVER_CHUNK_SIZE   2560
 #define STREAMTCP_DEFAULT_TOCLIENT_CHUNK_SIZE   2560
 #define STREAMTCP_DEFAULT_MAX_SYNACK_QUEUED     5
+#define STREAMTCP_DEFAULT_GAP_SACK_SIZE         (64 * 1024)
 
 #define STREAMTCP_NEW_TIMEOUT                   60
 #define STREAMTCP_EST_TIMEOUT                   3600
@@ -136,11 +138,39 @@ void StreamTcpIncrMemuse(uint64_t size) {
     return;
 }
 
+/**
+ *  \brief See if raw stream mpm should only scan data that wasn't
+ *         scanned before (plus a look-back for patterns crossing chunks).
+ *
+ *  \retval 0 no
+ *  \retval 1 yes
+ */
+int StreamTcpRawSlidingWindowMode(void) {
+    return (stream_config.flags & STREAMTCP_INIT_FLAG_RAW_SLIDING_WINDOW) ? 1 : 0;
+}
+
 void StreamTcpDecrMemuse(uint64_t size) {
     (void) SC_ATOMIC_SUB(st_memuse, size);
     return;
 }
 
+/** \internal
+ *  \brief free the raw stream mpm windows of a session, see
+ *         SigMatchSignaturesGetMpmWindow */
+static void StreamTcpSessionFreeMpmWindows(TcpSession *ssn)
+{
+    if (ssn->toserver_mpm_window != NULL) {
+        SCFree(ssn->toserver_mpm_window);
+        ssn->toserver_mpm_window = NULL;
+        StreamTcpDecrMemuse((uint64_t)sizeof(StreamMpmWindow));
+    }
+    if (ssn->toclient_mpm_window != NULL) {
+        SCFree(ssn->toclient_mpm_window);
+        ssn->toclient_mpm_window = NULL;
+        StreamTcpDecrMemuse((uint64_t)sizeof(StreamMpmWindow));
+    }
+}
+
 void StreamTcpMemuseCounter(ThreadVars *tv, StreamTcpThread *stt) {
     uint64_t memusecopy = SC_ATOMIC_GET(st_memuse);
     SCPerfCounterSetUI64(stt->counter_tcp_memuse, tv->sc_perf_pca, memusecopy);
@@ -210,6 +240,8 @@ void StreamTcpSessionClear(void *ssnptr)
     }
     ssn->toclient_smsg_head = NULL;
 
+    StreamTcpSessionFreeMpmWindows(ssn);
+
     q = ssn->queue;
     while (q != NULL) {
         q_next = q->next;
@@ -220,7 +252,11 @@ void StreamTcpSessionClear(void *ssnptr)
     ssn->queue = NULL;
     ssn->queue_len = 0;
 
+    /* keep the pool reservation so the session goes back to the
+     * pool of the thread that allocated it */
+    PoolThreadReserved res = ssn->res;
     memset(ssn, 0, sizeof(TcpSession));
+    ssn->res = res;
     PoolThreadReturn(ssn_pool, ssn);
 #ifdef DEBUG
     SCMutexLock(&ssn_pool_mutex);
@@ -318,6 +354,8 @@ void StreamTcpSessionPoolCleanup(void *s)
     }
     ssn->toclient_smsg_head = NULL;
 
+    StreamTcpSessionFreeMpmWindows(ssn);
+
     q = ssn->queue;
     while (q != NULL) {
         q_next = q->next;
@@ -438,6 +476,17 @@ void StreamTcpInitConfig(char quiet)
         SCLogInfo("stream.\"inline\": %s", stream_inline ? "enabled" : "disabled");
     }
 
+    int low_latency = 0;
+    if (ConfGetBool("stream.inline-low-latency", &low_latency) == 1) {
+        if (low_latency)
+            stream_config.flags |= STREAMTCP_INIT_FLAG_INLINE_LOW_LATENCY;
+    }
+    if (!quiet && stream_inline) {
+        SCLogInfo("stream.\"inline-low-latency\": %s",
+                stream_config.flags & STREAMTCP_INIT_FLAG_INLINE_LOW_LATENCY ?
+                "enabled" : "disabled");
+    }
+
     if ((ConfGetInt("stream.max-synack-queued", &value)) == 1) {
         if (value >= 0 && value <= 255) {
             stream_config.max_synack_queued = (uint8_t)value;
@@ -584,6 +633,54 @@ void StreamTcpInitConfig(char quiet)
     if (!quiet)
         SCLogInfo("stream.reassembly.raw: %s", enable_raw ? "enabled" : "disabled");
 
+    int raw_window = 0;
+    if (ConfGetBool("stream.reassembly.raw-sliding-window", &raw_window) == 1) {
+        if (raw_window)
+            stream_config.flags |= STREAMTCP_INIT_FLAG_RAW_SLIDING_WINDOW;
+    }
+    if (!quiet) {
+        SCLogInfo("stream.reassembly \"raw-sliding-window\": %s",
+                stream_config.flags & STREAMTCP_INIT_FLAG_RAW_SLIDING_WINDOW ?
+                "enabled" : "disabled");
+    }
+
+    char *temp_gap_policy;
+    if (ConfGet("stream.reassembly.gap-policy", &temp_gap_policy) == 1) {
+        if (strcasecmp(temp_gap_policy, "sack") == 0) {
+            stream_config.flags |= STREAMTCP_INIT_FLAG_GAP_POLICY_SACK;
+        } else if (strcasecmp(temp_gap_policy, "wait") != 0) {
+            SCLogError(SC_ERR_INVALID_VALUE, "Invalid value for "
+                    "stream.reassembly.gap-policy: %s. Valid values are "
+                    "\"wait\" and \"sack\".  Killing engine",
+                    temp_gap_policy);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    char *temp_gap_sack_size;
+    if (ConfGet("stream.reassembly.gap-sack-size", &temp_gap_sack_size) == 1) {
+        if (ParseSizeStringU32(temp_gap_sack_size,
+                               &stream_config.reassembly_gap_sack_size) < 0) {
+            SCLogError(SC_ERR_SIZE_PARSE, "Error parsing "
+                       "stream.reassembly.gap-sack-size "
+                       "from conf file - %s.  Killing engine",
+                       temp_gap_sack_size);
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        stream_config.reassembly_gap_sack_size = STREAMTCP_DEFAULT_GAP_SACK_SIZE;
+    }
+
+    if (!quiet) {
+        SCLogInfo("stream.reassembly \"gap-policy\": %s",
+                stream_config.flags & STREAMTCP_INIT_FLAG_GAP_POLICY_SACK ?
+                "sack" : "wait");
+        if (stream_config.flags & STREAMTCP_INIT_FLAG_GAP_POLICY_SACK) {
+            SCLogInfo("stream.reassembly \"gap-sack-size\": %"PRIu32,
+                    stream_config.reassembly_gap_sack_size);
+        }
+    }
+
     /* init the memcap/use tracking */
     SC_ATOMIC_INIT(st_memuse);
 
@@ -4754,6 +4851,12 @@ TmEcode StreamTcpThreadInit(ThreadVars *tv, void *initdata, void **data)
     stt->ra_ctx->counter_tcp_reass_gap = SCPerfTVRegisterCounter("tcp.reassembly_gap", tv,
                                                         SC_PERF_TYPE_UINT64,
                                                         "NULL");
+    stt->ra_ctx->counter_tcp_reass_gap_sack = SCPerfTVRegisterCounter("tcp.reassembly_gap_sack", tv,
+                                                        SC_PERF_TYPE_UINT64,
+                                                        "NULL");
+    stt->ra_ctx->counter_tcp_reass_inline_bypass = SCPerfTVRegisterCounter("tcp.reassembly_inline_bypass", tv,
+                                                        SC_PERF_TYPE_UINT64,
+                                                        "NULL");
     /** \fixme Find a better place in 2.1 as it is linked with app layer */
     stt->ra_ctx->counter_htp_memuse = SCPerfTVRegisterCounter("http.memuse", tv,
                                                         SC_PERF_TYPE_UINT64,
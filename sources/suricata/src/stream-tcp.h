@@ -38,6 +38,13 @@
 /* Flag to indicate that the checksum validation for the stream engine
    has been enabled */
 #define STREAMTCP_INIT_FLAG_CHECKSUM_VALIDATION    0x01
+/* Flag to indicate that raw stream mpm only scans data not scanned before */
+#define STREAMTCP_INIT_FLAG_RAW_SLIDING_WINDOW     0x02
+/* Flag to indicate that SACK info is used to give up on gaps early */
+#define STREAMTCP_INIT_FLAG_GAP_POLICY_SACK        0x04
+/* Flag to indicate that inline mode skips reassembly for packets that
+ * don't need it */
+#define STREAMTCP_INIT_FLAG_INLINE_LOW_LATENCY     0x08
 
 /*global flow data*/
 typedef struct TcpStreamCnf_ {
@@ -66,6 +73,10 @@ typedef struct TcpStreamCnf_ {
      *  sliding window size for raw stream reassembly
      */
     uint32_t reassembly_inline_window;
+
+    /** gap-policy sack: bytes SACK'd beyond a gap after which we consider
+     *  the gap permanent */
+    uint32_t reassembly_gap_sack_size;
     uint8_t flags;
     uint8_t max_synack_queued;
 } TcpStreamCnf;
@@ -122,6 +133,7 @@ int StreamTcpSegmentForEach(const Packet *p, uint8_t flag,
                         StreamSegmentCallback CallbackFunc,
                         void *data);
 void StreamTcpReassembleConfigEnableOverlapCheck(void);
+int StreamTcpRawSlidingWindowMode(void);
 
 /** ------- Inline functions: ------ */
 
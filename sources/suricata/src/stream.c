@@ -100,6 +100,8 @@ StreamMsg *StreamMsgGetFromPool(void)
     SCMutexLock(&stream_msg_pool_mutex);
     StreamMsg *s = (StreamMsg *)PoolGet(stream_msg_pool);
     SCMutexUnlock(&stream_msg_pool_mutex);
+    if (s != NULL)
+        s->new_data_offset = 0;
     return s;
 }
 
@@ -41,7 +41,10 @@ typedef struct StreamMsg_ {
     struct StreamMsg_ *prev;
 
     uint32_t seq;                   /**< sequence number */
-    uint32_t data_len;              /**< length of the data */
+    uint16_t data_len;              /**< length of the data */
+    uint16_t new_data_offset;       /**< offset in data where the data starts
+                                         that was not part of a previous smsg.
+                                         Only set by inline raw reassembly. */
     uint8_t data[MSG_DATA_SIZE];    /**< reassembled data */
 } StreamMsg;
 
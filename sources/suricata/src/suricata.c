@@ -62,6 +62,7 @@
 #include "detect-engine-address.h"
 #include "detect-engine-port.h"
 #include "detect-engine-mpm.h"
+#include "detect-engine-candidates.h"
 
 #include "tm-queuehandlers.h"
 #include "tm-queues.h"
@@ -2059,7 +2060,6 @@ static int PostConfLoadedSetup(SCInstance *suri)
     SCProtoNameInit();
 
     TagInitCtx();
-    ThresholdInit();
 
     if (DetectAddressTestConfVars() < 0) {
         SCLogError(SC_ERR_INVALID_YAML_CONF_ENTRY,
@@ -2179,6 +2179,9 @@ int main(int argc, char **argv)
     SCPrintVersion();
 
     UtilCpuPrintSummary();
+    DetectSimdSetup();
+    DetectCandidatesSetup();
+    SpmSimdSetup();
 
     if (suri.run_mode == RUNMODE_DUMP_CONFIG) {
         ConfDump();
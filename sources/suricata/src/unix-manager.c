@@ -25,6 +25,8 @@
 #include "suricata.h"
 #include "unix-manager.h"
 #include "detect-engine.h"
+#include "detect-engine-rule-sample.h"
+#include "detect-pcre.h"
 #include "tm-threads.h"
 #include "runmodes.h"
 #include "conf.h"
@@ -860,6 +862,9 @@ void *UnixManagerThread(void *td)
     UnixManagerRegisterCommand("capture-mode", UnixManagerCaptureModeCommand, &command, 0);
     UnixManagerRegisterCommand("conf-get", UnixManagerConfGetCommand, &command, UNIX_CMD_TAKE_ARGS);
     UnixManagerRegisterCommand("dump-counters", SCPerfOutputCounterSocket, NULL, 0);
+    UnixManagerRegisterCommand("rule-sample-top", DetectRuleSampleTopCommand, NULL, UNIX_CMD_TAKE_ARGS);
+    UnixManagerRegisterCommand("rule-sample-reset", DetectRuleSampleResetCommand, NULL, 0);
+    UnixManagerRegisterCommand("pcre-stats", DetectPcreStatsCommand, NULL, UNIX_CMD_TAKE_ARGS);
 #if 0
     UnixManagerRegisterCommand("reload-rules", UnixManagerReloadRules, NULL, 0);
 #endif
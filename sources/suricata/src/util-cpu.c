@@ -26,6 +26,7 @@
 #include "util-error.h"
 #include "util-debug.h"
 #include "suricata-common.h"
+#include "util-cpu.h"
 
 /**
  * Ok, if they should use sysconf, check that they have the macro's
@@ -155,6 +156,84 @@ uint16_t UtilCpuGetNumProcessorsMax()
 #endif
 }
 
+/** cpu feature flags, set once by UtilCpuGetFeatures() */
+static uint32_t cpu_features = 0;
+static int cpu_features_detected = 0;
+
+#if defined(__GNUC__) && (defined(__x86_64) || defined(_X86_64_))
+static void UtilCpuCpuid(uint32_t leaf, uint32_t subleaf,
+        uint32_t *a, uint32_t *b, uint32_t *c, uint32_t *d)
+{
+    __asm__ __volatile__ ("cpuid"
+            : "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d)
+            : "a" (leaf), "c" (subleaf));
+}
+
+/** \brief read XCR0 to see which register states the OS saves for us */
+static uint64_t UtilCpuXgetbv(void)
+{
+    uint32_t a, d;
+    __asm__ __volatile__ ("xgetbv" : "=a" (a), "=d" (d) : "c" (0));
+    return ((uint64_t)a) | (((uint64_t)d) << 32);
+}
+#endif
+
+/**
+ * \brief Get the SIMD features of the CPU we're running on.
+ *
+ * Features are only reported if both the CPU and the OS support them,
+ * e.g. AVX2 needs the OS to save the YMM state on context switches.
+ *
+ * \retval features bitmask of UTIL_CPU_FEATURE_* flags
+ */
+uint32_t UtilCpuGetFeatures(void)
+{
+    if (cpu_features_detected)
+        return cpu_features;
+
+    uint32_t features = 0;
+#if defined(__GNUC__) && (defined(__x86_64) || defined(_X86_64_))
+    uint32_t a, b, c, d;
+    uint32_t max_leaf;
+    uint64_t xcr0 = 0;
+
+    UtilCpuCpuid(0, 0, &a, &b, &c, &d);
+    max_leaf = a;
+
+    if (max_leaf >= 1) {
+        UtilCpuCpuid(1, 0, &a, &b, &c, &d);
+        if (c & (1 << 0))
+            features |= UTIL_CPU_FEATURE_SSE3;
+        if (c & (1 << 9))
+            features |= UTIL_CPU_FEATURE_SSSE3;
+        if (c & (1 << 19))
+            features |= UTIL_CPU_FEATURE_SSE41;
+
+        /* OSXSAVE and AVX */
+        int ymm_ok = 0, zmm_ok = 0;
+        if ((c & (1 << 27)) && (c & (1 << 28))) {
+            xcr0 = UtilCpuXgetbv();
+            /* SSE and AVX state */
+            ymm_ok = ((xcr0 & 0x06) == 0x06);
+            /* opmask, upper ZMM0-15 and ZMM16-31 state */
+            zmm_ok = ymm_ok && ((xcr0 & 0xe0) == 0xe0);
+        }
+
+        if (max_leaf >= 7) {
+            UtilCpuCpuid(7, 0, &a, &b, &c, &d);
+            if (ymm_ok && (b & (1 << 5)))
+                features |= UTIL_CPU_FEATURE_AVX2;
+            /* AVX512F and AVX512BW */
+            if (zmm_ok && (b & (1 << 16)) && (b & (1 << 30)))
+                features |= UTIL_CPU_FEATURE_AVX512BW;
+        }
+    }
+#endif
+    cpu_features = features;
+    cpu_features_detected = 1;
+    return cpu_features;
+}
+
 /**
  * \brief Print a summary of CPUs detected (configured and online)
  */
@@ -171,6 +250,15 @@ void UtilCpuPrintSummary()
     if (cpus_online == 0 && cpus_conf == 0)
         SCLogInfo("Couldn't retireve any information of CPU's, please, send your operating "
                   "system info and check util-cpu.{c,h}");
+
+    uint32_t features = UtilCpuGetFeatures();
+    SCLogInfo("CPU SIMD features:%s%s%s%s%s%s",
+            (features & UTIL_CPU_FEATURE_SSE3) ? " sse3" : "",
+            (features & UTIL_CPU_FEATURE_SSSE3) ? " ssse3" : "",
+            (features & UTIL_CPU_FEATURE_SSE41) ? " sse4.1" : "",
+            (features & UTIL_CPU_FEATURE_AVX2) ? " avx2" : "",
+            (features & UTIL_CPU_FEATURE_AVX512BW) ? " avx512bw" : "",
+            features == 0 ? " none" : "");
 }
 
 /**
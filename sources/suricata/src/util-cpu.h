@@ -34,6 +34,24 @@ uint16_t UtilCpuGetNumProcessorsMax();
 
 void UtilCpuPrintSummary();
 
+/* SIMD features, see UtilCpuGetFeatures() */
+#define UTIL_CPU_FEATURE_SSE3       0x01
+#define UTIL_CPU_FEATURE_AVX2       0x02
+#define UTIL_CPU_FEATURE_AVX512BW   0x04
+#define UTIL_CPU_FEATURE_SSSE3      0x08
+#define UTIL_CPU_FEATURE_SSE41      0x10
+
+/* compilers that can build single functions for SIMD extensions not
+ * enabled on the command line, using __attribute__((target(...))). Code
+ * built this way must only be called if UtilCpuGetFeatures() reports
+ * the extension. */
+#if (defined(__x86_64) || defined(_X86_64_)) && \
+    (defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 5))
+#define UTIL_CPU_TARGET_ATTR 1
+#endif
+
+uint32_t UtilCpuGetFeatures(void);
+
 uint64_t UtilCpuGetTicks(void);
 
 #endif /* __UTIL_CPU_H__ */
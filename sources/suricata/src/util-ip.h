@@ -29,4 +29,15 @@ struct in_addr *ValidateIPV4Address(const char *);
 struct in6_addr *ValidateIPV6Address(const char *);
 void MaskIPNetblock(uint8_t *, int, int);
 
+/** \brief compare two ipv6 addresses in host order words, like memcmp */
+static inline int IPv6HostOrderCmp(const uint32_t *a, const uint32_t *b)
+{
+    int i;
+    for (i = 0; i < 4; i++) {
+        if (a[i] != b[i])
+            return a[i] < b[i] ? -1 : 1;
+    }
+    return 0;
+}
+
 #endif /* __UTIL_IP_H__ */
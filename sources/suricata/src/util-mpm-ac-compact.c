@@ -0,0 +1,1228 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Aho-corasick with a compact state table.
+ *
+ * "ac" gives every state a row of 256 next states, which for big rulesets
+ * is hundreds of MB that don't fit in any cache. This version shrinks the
+ * table in two ways:
+ *
+ * - Alphabet compression: only the (lowercased) bytes that appear in the
+ *   patterns get their own class, all other bytes share class 0. Rows are
+ *   class_cnt wide instead of 256. The input is lowercased by the same
+ *   byte to class lookup.
+ * - Sparse rows: only the states up to SC_AC_COMPACT_DENSE_DEPTH from the
+ *   root, where most of the scanning happens, get a full row of next
+ *   states. The deeper states only store a bitmap of the classes they
+ *   have a goto transition for, the targets of those transitions packed
+ *   in class order (indexed by the popcount of the lower bits) and their
+ *   failure state. On a miss the failure states are followed until a
+ *   state with the transition or a dense state is found.
+ *
+ * Matches are reported exactly like "ac": same output table, same case
+ * sensitive confirmation.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+
+#include "conf.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+#include "util-memcmp.h"
+#include "util-mpm-ac.h"
+#include "util-mpm-ac-compact.h"
+#include "util-memcpy.h"
+#include "util-cpu.h"
+
+void SCACCompactInitCtx(MpmCtx *);
+void SCACCompactInitThreadCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+void SCACCompactDestroyCtx(MpmCtx *);
+void SCACCompactDestroyThreadCtx(MpmCtx *, MpmThreadCtx *);
+int SCACCompactAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                            uint32_t, uint32_t, uint8_t);
+int SCACCompactAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                            uint32_t, uint32_t, uint8_t);
+int SCACCompactPreparePatterns(MpmCtx *mpm_ctx);
+uint32_t SCACCompactSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                           PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+void SCACCompactPrintInfo(MpmCtx *mpm_ctx);
+void SCACCompactPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
+void SCACCompactRegisterTests(void);
+
+/* a placeholder to denote a failure transition in the goto table */
+#define SC_AC_COMPACT_FAIL (-1)
+/* size of the hash table used to speed up pattern insertions initially */
+#define INIT_HASH_SIZE 65536
+
+/**
+ * \internal
+ * \brief Creates a hash of the pattern.  We use it for the hashing process
+ *        during the initial pattern insertion time, to cull duplicate sigs.
+ *
+ * \param pat    Pointer to the pattern.
+ * \param patlen Pattern length.
+ *
+ * \retval hash A 32 bit unsigned hash.
+ */
+static inline uint32_t SCACCompactInitHashRaw(uint8_t *pat, uint16_t patlen)
+{
+    uint32_t hash = patlen * pat[0];
+    if (patlen > 1)
+        hash += pat[1];
+
+    return (hash % INIT_HASH_SIZE);
+}
+
+/**
+ * \internal
+ * \brief Looks up a pattern.  We use it for the hashing process during the
+ *        the initial pattern insertion time, to cull duplicate sigs.
+ *
+ * \param ctx    Pointer to the AC ctx.
+ * \param pat    Pointer to the pattern.
+ * \param patlen Pattern length.
+ * \param pid    Pattern id.
+ *
+ * \retval p The pattern, or NULL if we don't have it yet.
+ */
+static inline SCACCompactPattern *SCACCompactInitHashLookup(SCACCompactCtx *ctx,
+        uint8_t *pat, uint16_t patlen, uint32_t pid)
+{
+    uint32_t hash = SCACCompactInitHashRaw(pat, patlen);
+
+    if (ctx->init_hash == NULL) {
+        return NULL;
+    }
+
+    SCACCompactPattern *t = ctx->init_hash[hash];
+    for ( ; t != NULL; t = t->next) {
+        if (t->id == pid)
+            return t;
+    }
+
+    return NULL;
+}
+
+static inline SCACCompactPattern *SCACCompactAllocPattern(MpmCtx *mpm_ctx)
+{
+    SCACCompactPattern *p = SCMalloc(sizeof(SCACCompactPattern));
+    if (unlikely(p == NULL)) {
+        exit(EXIT_FAILURE);
+    }
+    memset(p, 0, sizeof(SCACCompactPattern));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCACCompactPattern);
+
+    return p;
+}
+
+static inline void SCACCompactFreePattern(MpmCtx *mpm_ctx, SCACCompactPattern *p)
+{
+    if (p != NULL && p->cs != NULL && p->cs != p->ci) {
+        SCFree(p->cs);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p != NULL && p->ci != NULL) {
+        SCFree(p->ci);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p != NULL && p->original_pat != NULL) {
+        SCFree(p->original_pat);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p != NULL) {
+        SCFree(p);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= sizeof(SCACCompactPattern);
+    }
+    return;
+}
+
+static inline int SCACCompactInitHashAdd(SCACCompactCtx *ctx, SCACCompactPattern *p)
+{
+    uint32_t hash = SCACCompactInitHashRaw(p->original_pat, p->len);
+
+    if (ctx->init_hash == NULL) {
+        return 0;
+    }
+
+    if (ctx->init_hash[hash] == NULL) {
+        ctx->init_hash[hash] = p;
+        return 0;
+    }
+
+    SCACCompactPattern *tt = NULL;
+    SCACCompactPattern *t = ctx->init_hash[hash];
+
+    /* get the list tail */
+    do {
+        tt = t;
+        t = t->next;
+    } while (t != NULL);
+
+    tt->next = p;
+
+    return 0;
+}
+
+/**
+ * \internal
+ * \brief Add a pattern to the mpm-ac-compact context.
+ *
+ * \param mpm_ctx Mpm context.
+ * \param pat     Pointer to the pattern.
+ * \param patlen  Length of the pattern.
+ * \param pid     Pattern id
+ * \param sid     Signature id (internal id).
+ * \param flags   Pattern's MPM_PATTERN_* flags.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SCACCompactAddPattern(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                                 uint16_t offset, uint16_t depth, uint32_t pid,
+                                 uint32_t sid, uint8_t flags)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+
+    SCLogDebug("Adding pattern for ctx %p, patlen %"PRIu16" and pid %" PRIu32,
+               ctx, patlen, pid);
+
+    if (patlen == 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "pattern length 0");
+        return 0;
+    }
+
+    /* check if we have already inserted this pattern */
+    SCACCompactPattern *p = SCACCompactInitHashLookup(ctx, pat, patlen, pid);
+    if (p == NULL) {
+        SCLogDebug("Allocing new pattern");
+
+        /* p will never be NULL */
+        p = SCACCompactAllocPattern(mpm_ctx);
+
+        p->len = patlen;
+        p->flags = flags;
+        p->id = pid;
+
+        p->original_pat = SCMalloc(patlen);
+        if (p->original_pat == NULL)
+            goto error;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += patlen;
+        memcpy(p->original_pat, pat, patlen);
+
+        p->ci = SCMalloc(patlen);
+        if (p->ci == NULL)
+            goto error;
+        mpm_ctx->memory_cnt++;
+        mpm_ctx->memory_size += patlen;
+        memcpy_tolower(p->ci, pat, patlen);
+
+        /* setup the case sensitive part of the pattern */
+        if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+            /* nocase means no difference between cs and ci */
+            p->cs = p->ci;
+        } else {
+            if (memcmp(p->ci, pat, p->len) == 0) {
+                /* no diff between cs and ci: pat is lowercase */
+                p->cs = p->ci;
+            } else {
+                p->cs = SCMalloc(patlen);
+                if (p->cs == NULL)
+                    goto error;
+                mpm_ctx->memory_cnt++;
+                mpm_ctx->memory_size += patlen;
+                memcpy(p->cs, pat, patlen);
+            }
+        }
+
+        /* put in the pattern hash */
+        SCACCompactInitHashAdd(ctx, p);
+
+        mpm_ctx->pattern_cnt++;
+
+        if (mpm_ctx->maxlen < patlen)
+            mpm_ctx->maxlen = patlen;
+
+        if (mpm_ctx->minlen == 0) {
+            mpm_ctx->minlen = patlen;
+        } else {
+            if (mpm_ctx->minlen > patlen)
+                mpm_ctx->minlen = patlen;
+        }
+
+        /* we need the max pat id */
+        if (pid > ctx->max_pat_id)
+            ctx->max_pat_id = pid;
+    }
+
+    return 0;
+
+error:
+    SCACCompactFreePattern(mpm_ctx, p);
+    return -1;
+}
+
+/**
+ * \internal
+ * \brief Trie the compact tables are built from. Rows are class_cnt wide.
+ */
+typedef struct SCACCompactBuild_ {
+    int32_t *goto_table;
+    int32_t *failure_table;
+    uint16_t *depth;
+    SCACCompactOutputTable *output_table;
+    uint32_t state_count;
+    uint32_t state_size;
+    uint16_t class_cnt;
+} SCACCompactBuild;
+
+static int32_t SCACCompactBuildNewState(SCACCompactBuild *b, uint16_t depth)
+{
+    uint32_t c;
+
+    if (b->state_count == b->state_size) {
+        uint32_t size = b->state_size ? b->state_size * 2 : 256;
+        void *ptmp;
+
+        ptmp = SCRealloc(b->goto_table, (size_t)size * b->class_cnt * sizeof(int32_t));
+        if (ptmp == NULL)
+            goto error;
+        b->goto_table = ptmp;
+        ptmp = SCRealloc(b->depth, size * sizeof(uint16_t));
+        if (ptmp == NULL)
+            goto error;
+        b->depth = ptmp;
+        ptmp = SCRealloc(b->output_table, size * sizeof(SCACCompactOutputTable));
+        if (ptmp == NULL)
+            goto error;
+        b->output_table = ptmp;
+        b->state_size = size;
+    }
+
+    for (c = 0; c < b->class_cnt; c++)
+        b->goto_table[(size_t)b->state_count * b->class_cnt + c] = SC_AC_COMPACT_FAIL;
+    b->depth[b->state_count] = depth;
+    memset(&b->output_table[b->state_count], 0, sizeof(SCACCompactOutputTable));
+
+    return b->state_count++;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \internal
+ * \brief Add a pid to the output of a state, if it's not there yet.
+ */
+static void SCACCompactSetOutputState(SCACCompactOutputTable *output_state,
+                                      uint32_t pid)
+{
+    uint32_t i;
+    void *ptmp;
+
+    for (i = 0; i < output_state->no_of_entries; i++) {
+        if (output_state->pids[i] == pid)
+            return;
+    }
+
+    ptmp = SCRealloc(output_state->pids,
+                     (output_state->no_of_entries + 1) * sizeof(uint32_t));
+    if (ptmp == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    output_state->pids = ptmp;
+    output_state->pids[output_state->no_of_entries++] = pid;
+}
+
+/**
+ * \internal
+ * \brief Set up the byte to class map from the patterns.
+ *
+ *        In a trie two different bytes never lead to the same state, so
+ *        the only bytes with identical goto columns are the ones that no
+ *        pattern uses. These all go to class 0, every used byte gets its
+ *        own class.
+ */
+static void SCACCompactBuildAlphabet(MpmCtx *mpm_ctx)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    uint8_t used[256];
+    uint8_t class_of[256];
+    uint32_t i, u;
+
+    memset(used, 0, sizeof(used));
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        for (u = 0; u < ctx->parray[i]->len; u++)
+            used[ctx->parray[i]->ci[u]] = 1;
+    }
+
+    ctx->class_cnt = 1;
+    for (u = 0; u < 256; u++)
+        class_of[u] = used[u] ? ctx->class_cnt++ : 0;
+
+    /* the input is lowercased through the map */
+    for (u = 0; u < 256; u++)
+        ctx->xlate[u] = class_of[u8_tolower(u)];
+
+    ctx->bitmap_words = (ctx->class_cnt + 63) / 64;
+}
+
+/**
+ * \internal
+ * \brief Build the trie with failure links and clubbed outputs.
+ *
+ * \param order Filled with the states in breadth first order.
+ */
+static void SCACCompactBuildTrie(MpmCtx *mpm_ctx, SCACCompactBuild *b,
+                                 uint32_t **order)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    uint32_t i, head, tail, c;
+
+    b->class_cnt = ctx->class_cnt;
+    SCACCompactBuildNewState(b, 0);
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        SCACCompactPattern *p = ctx->parray[i];
+        int32_t state = 0;
+        uint16_t u;
+
+        for (u = 0; u < p->len; u++) {
+            size_t idx = (size_t)state * b->class_cnt + ctx->xlate[p->ci[u]];
+            if (b->goto_table[idx] == SC_AC_COMPACT_FAIL) {
+                int32_t newstate = SCACCompactBuildNewState(b, u + 1);
+                /* the table may have moved */
+                b->goto_table[idx] = newstate;
+            }
+            state = b->goto_table[idx];
+        }
+        SCACCompactSetOutputState(&b->output_table[state], p->id);
+    }
+
+    b->failure_table = SCMalloc(b->state_count * sizeof(int32_t));
+    *order = SCMalloc(b->state_count * sizeof(uint32_t));
+    if (b->failure_table == NULL || *order == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(b->failure_table, 0, b->state_count * sizeof(int32_t));
+
+    /* breadth first: the failure state of a state is always shallower, so
+     * it's complete (outputs included) when we get to the state */
+    head = tail = 0;
+    (*order)[tail++] = 0;
+    while (head < tail) {
+        uint32_t r = (*order)[head++];
+
+        for (c = 0; c < b->class_cnt; c++) {
+            int32_t t = b->goto_table[(size_t)r * b->class_cnt + c];
+            if (t == SC_AC_COMPACT_FAIL)
+                continue;
+            (*order)[tail++] = t;
+
+            if (r == 0) {
+                b->failure_table[t] = 0;
+                continue;
+            }
+
+            int32_t f = b->failure_table[r];
+            while (f != 0 &&
+                   b->goto_table[(size_t)f * b->class_cnt + c] == SC_AC_COMPACT_FAIL)
+                f = b->failure_table[f];
+            int32_t g = b->goto_table[(size_t)f * b->class_cnt + c];
+            b->failure_table[t] = (g == SC_AC_COMPACT_FAIL) ? 0 : g;
+
+            SCACCompactOutputTable *src = &b->output_table[b->failure_table[t]];
+            uint32_t k;
+            for (k = 0; k < src->no_of_entries; k++)
+                SCACCompactSetOutputState(&b->output_table[t], src->pids[k]);
+        }
+    }
+}
+
+/**
+ * \internal
+ * \brief Turn the trie into the dense and sparse tables, renumbering the
+ *        states breadth first.
+ */
+static void SCACCompactBuildTables(MpmCtx *mpm_ctx, SCACCompactBuild *b,
+                                   uint32_t *order)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    uint32_t *newid = NULL;
+    uint32_t i, c, k;
+
+    newid = SCMalloc(b->state_count * sizeof(uint32_t));
+    if (newid == NULL)
+        goto error;
+
+    ctx->state_count = b->state_count;
+    ctx->dense_cnt = 0;
+    for (i = 0; i < b->state_count; i++) {
+        newid[order[i]] = i;
+        if (b->depth[order[i]] <= SC_AC_COMPACT_DENSE_DEPTH)
+            ctx->dense_cnt++;
+    }
+    /* only trie edges are stored for the sparse states */
+    ctx->targets_cnt = 0;
+    for (i = ctx->dense_cnt; i < ctx->state_count; i++) {
+        for (c = 0; c < ctx->class_cnt; c++) {
+            if (b->goto_table[(size_t)order[i] * ctx->class_cnt + c] != SC_AC_COMPACT_FAIL)
+                ctx->targets_cnt++;
+        }
+    }
+
+#define SC_AC_COMPACT_ENC(s) \
+    (newid[(s)] | (b->output_table[(s)].no_of_entries ? SC_AC_COMPACT_OUTPUT : 0))
+
+    uint32_t sparse_cnt = ctx->state_count - ctx->dense_cnt;
+    ctx->dense = SCMalloc((size_t)ctx->dense_cnt * ctx->class_cnt * sizeof(uint32_t));
+    ctx->output_table = SCMalloc(ctx->state_count * sizeof(SCACCompactOutputTable));
+    if (ctx->dense == NULL || ctx->output_table == NULL)
+        goto error;
+    if (sparse_cnt > 0) {
+        ctx->sparse = SCMalloc(sparse_cnt * sizeof(SCACCompactSparseState));
+        ctx->bitmaps = SCMalloc((size_t)sparse_cnt * ctx->bitmap_words * sizeof(uint64_t));
+        /* the deepest states have no edges at all */
+        if (ctx->targets_cnt > 0)
+            ctx->targets = SCMalloc(ctx->targets_cnt * sizeof(uint32_t));
+        if (ctx->sparse == NULL || ctx->bitmaps == NULL ||
+            (ctx->targets_cnt > 0 && ctx->targets == NULL))
+            goto error;
+        memset(ctx->bitmaps, 0, (size_t)sparse_cnt * ctx->bitmap_words * sizeof(uint64_t));
+    }
+
+    /* dense rows: the full delta function. The failure state of a dense
+     * state is shallower, so its row is already complete */
+    for (i = 0; i < ctx->dense_cnt; i++) {
+        uint32_t s = order[i];
+        uint32_t *row = &ctx->dense[(size_t)i * ctx->class_cnt];
+
+        for (c = 0; c < ctx->class_cnt; c++) {
+            int32_t g = b->goto_table[(size_t)s * ctx->class_cnt + c];
+            if (g != SC_AC_COMPACT_FAIL)
+                row[c] = SC_AC_COMPACT_ENC(g);
+            else if (s == 0)
+                row[c] = 0;
+            else
+                row[c] = ctx->dense[(size_t)newid[b->failure_table[s]] * ctx->class_cnt + c];
+        }
+    }
+
+    /* sparse rows: goto targets in class order plus the failure state */
+    uint32_t t = 0;
+    for (i = ctx->dense_cnt; i < ctx->state_count; i++) {
+        uint32_t s = order[i];
+        SCACCompactSparseState *ss = &ctx->sparse[i - ctx->dense_cnt];
+        uint64_t *bm = &ctx->bitmaps[(size_t)(i - ctx->dense_cnt) * ctx->bitmap_words];
+
+        ss->fail = newid[b->failure_table[s]];
+        ss->base = t;
+        for (c = 0; c < ctx->class_cnt; c++) {
+            int32_t g = b->goto_table[(size_t)s * ctx->class_cnt + c];
+            if (g == SC_AC_COMPACT_FAIL)
+                continue;
+            bm[c >> 6] |= (1ULL << (c & 63));
+            ctx->targets[t++] = SC_AC_COMPACT_ENC(g);
+        }
+    }
+#undef SC_AC_COMPACT_ENC
+
+    /* outputs, with the flag for the patterns that need a case sensitive
+     * check like in ac */
+    for (i = 0; i < ctx->state_count; i++) {
+        SCACCompactOutputTable *ot = &ctx->output_table[i];
+
+        *ot = b->output_table[order[i]];
+        for (k = 0; k < ot->no_of_entries; k++) {
+            if (ctx->pid_pat_list[ot->pids[k]].cs != NULL) {
+                ot->pids[k] &= 0x0000FFFF;
+                ot->pids[k] |= 1 << 16;
+            }
+        }
+    }
+    SCFree(b->output_table);
+    b->output_table = NULL;
+
+    mpm_ctx->memory_cnt += 5;
+    mpm_ctx->memory_size += (size_t)ctx->dense_cnt * ctx->class_cnt * sizeof(uint32_t) +
+        sparse_cnt * (sizeof(SCACCompactSparseState) + ctx->bitmap_words * sizeof(uint64_t)) +
+        ctx->targets_cnt * sizeof(uint32_t) +
+        ctx->state_count * sizeof(SCACCompactOutputTable);
+
+    SCFree(newid);
+    return;
+
+error:
+    SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+    exit(EXIT_FAILURE);
+}
+
+/**
+ * \brief Process the patterns added to the mpm, and create the internal tables.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+int SCACCompactPreparePatterns(MpmCtx *mpm_ctx)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    SCACCompactBuild b;
+    uint32_t *order = NULL;
+
+    if (mpm_ctx->pattern_cnt == 0 || ctx->init_hash == NULL) {
+        SCLogDebug("no patterns supplied to this mpm_ctx");
+        return 0;
+    }
+
+    /* alloc the pattern array */
+    ctx->parray = (SCACCompactPattern **)SCMalloc(mpm_ctx->pattern_cnt *
+                                                  sizeof(SCACCompactPattern *));
+    if (ctx->parray == NULL)
+        goto error;
+    memset(ctx->parray, 0, mpm_ctx->pattern_cnt * sizeof(SCACCompactPattern *));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(SCACCompactPattern *));
+
+    /* populate it with the patterns in the hash */
+    uint32_t i = 0, p = 0;
+    for (i = 0; i < INIT_HASH_SIZE; i++) {
+        SCACCompactPattern *node = ctx->init_hash[i], *nnode = NULL;
+        while(node != NULL) {
+            nnode = node->next;
+            node->next = NULL;
+            ctx->parray[p++] = node;
+            node = nnode;
+        }
+    }
+
+    /* we no longer need the hash, so free it's memory */
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    /* handle no case patterns */
+    ctx->pid_pat_list = SCMalloc((ctx->max_pat_id + 1)* sizeof(SCACCompactPatternList));
+    if (ctx->pid_pat_list == NULL) {
+        SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->pid_pat_list, 0, (ctx->max_pat_id + 1) * sizeof(SCACCompactPatternList));
+
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (!(ctx->parray[i]->flags & MPM_PATTERN_FLAG_NOCASE)) {
+            ctx->pid_pat_list[ctx->parray[i]->id].cs = SCMalloc(ctx->parray[i]->len);
+            if (ctx->pid_pat_list[ctx->parray[i]->id].cs == NULL) {
+                SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+                exit(EXIT_FAILURE);
+            }
+            memcpy(ctx->pid_pat_list[ctx->parray[i]->id].cs,
+                   ctx->parray[i]->original_pat, ctx->parray[i]->len);
+            ctx->pid_pat_list[ctx->parray[i]->id].patlen = ctx->parray[i]->len;
+        }
+    }
+
+    SCACCompactBuildAlphabet(mpm_ctx);
+
+    memset(&b, 0, sizeof(b));
+    SCACCompactBuildTrie(mpm_ctx, &b, &order);
+    SCACCompactBuildTables(mpm_ctx, &b, order);
+
+    SCLogDebug("%"PRIu32" patterns: %"PRIu32" states (%"PRIu32" dense), "
+               "%"PRIu16" classes", mpm_ctx->pattern_cnt, ctx->state_count,
+               ctx->dense_cnt, ctx->class_cnt);
+
+    /* we don't need these anymore */
+    SCFree(b.goto_table);
+    SCFree(b.failure_table);
+    SCFree(b.depth);
+    SCFree(order);
+
+    /* free all the stored patterns */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (ctx->parray[i] != NULL) {
+            SCACCompactFreePattern(mpm_ctx, ctx->parray[i]);
+        }
+    }
+    SCFree(ctx->parray);
+    ctx->parray = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACCompactPattern *));
+
+    return 0;
+
+error:
+    return -1;
+}
+
+/**
+ * \brief Init the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param matchsize      We don't need this.
+ */
+void SCACCompactInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                              uint32_t matchsize)
+{
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+
+    mpm_thread_ctx->ctx = SCMalloc(sizeof(SCACCompactThreadCtx));
+    if (mpm_thread_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_thread_ctx->ctx, 0, sizeof(SCACCompactThreadCtx));
+    mpm_thread_ctx->memory_cnt++;
+    mpm_thread_ctx->memory_size += sizeof(SCACCompactThreadCtx);
+
+    return;
+}
+
+/**
+ * \brief Initialize the AC context.
+ *
+ * \param mpm_ctx       Mpm context.
+ */
+void SCACCompactInitCtx(MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx->ctx != NULL)
+        return;
+
+    mpm_ctx->ctx = SCMalloc(sizeof(SCACCompactCtx));
+    if (mpm_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->ctx, 0, sizeof(SCACCompactCtx));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCACCompactCtx);
+
+    /* initialize the hash we use to speed up pattern insertions */
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    ctx->init_hash = SCMalloc(sizeof(SCACCompactPattern *) * INIT_HASH_SIZE);
+    if (ctx->init_hash == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->init_hash, 0, sizeof(SCACCompactPattern *) * INIT_HASH_SIZE);
+
+    SCReturn;
+}
+
+/**
+ * \brief Destroy the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCACCompactDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+    SCACCompactPrintSearchStats(mpm_thread_ctx);
+
+    if (mpm_thread_ctx->ctx != NULL) {
+        SCFree(mpm_thread_ctx->ctx);
+        mpm_thread_ctx->ctx = NULL;
+        mpm_thread_ctx->memory_cnt--;
+        mpm_thread_ctx->memory_size -= sizeof(SCACCompactThreadCtx);
+    }
+
+    return;
+}
+
+/**
+ * \brief Destroy the mpm context.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+void SCACCompactDestroyCtx(MpmCtx *mpm_ctx)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    if (ctx == NULL)
+        return;
+
+    if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            SCACCompactPattern *node = ctx->init_hash[i], *nnode = NULL;
+            while (node != NULL) {
+                nnode = node->next;
+                SCACCompactFreePattern(mpm_ctx, node);
+                node = nnode;
+            }
+        }
+        SCFree(ctx->init_hash);
+        ctx->init_hash = NULL;
+    }
+
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            if (ctx->parray[i] != NULL) {
+                SCACCompactFreePattern(mpm_ctx, ctx->parray[i]);
+            }
+        }
+
+        SCFree(ctx->parray);
+        ctx->parray = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCACCompactPattern *));
+    }
+
+    if (ctx->dense != NULL)
+        SCFree(ctx->dense);
+    if (ctx->sparse != NULL)
+        SCFree(ctx->sparse);
+    if (ctx->bitmaps != NULL)
+        SCFree(ctx->bitmaps);
+    if (ctx->targets != NULL)
+        SCFree(ctx->targets);
+
+    if (ctx->output_table != NULL) {
+        for (i = 0; i < ctx->state_count; i++) {
+            if (ctx->output_table[i].pids != NULL)
+                SCFree(ctx->output_table[i].pids);
+        }
+        SCFree(ctx->output_table);
+    }
+
+    if (ctx->pid_pat_list != NULL) {
+        for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++) {
+            if (ctx->pid_pat_list[i].cs != NULL)
+                SCFree(ctx->pid_pat_list[i].cs);
+        }
+        SCFree(ctx->pid_pat_list);
+    }
+
+    SCFree(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCACCompactCtx);
+
+    return;
+}
+
+/**
+ * \internal
+ * \brief Next state for input class c. Dense states have it in their row,
+ *        sparse states either have a goto transition for c or defer to
+ *        their failure state.
+ */
+static inline uint32_t SCACCompactNext(const SCACCompactCtx *ctx, uint32_t state,
+                                       uint8_t c)
+{
+    state &= SC_AC_COMPACT_STATE_MASK;
+
+    while (state >= ctx->dense_cnt) {
+        uint32_t idx = state - ctx->dense_cnt;
+        const uint64_t *bm = &ctx->bitmaps[(size_t)idx * ctx->bitmap_words];
+        uint64_t bit = 1ULL << (c & 63);
+        uint32_t w = c >> 6;
+
+        if (bm[w] & bit) {
+            uint32_t rank = __builtin_popcountll(bm[w] & (bit - 1));
+            uint32_t i;
+            for (i = 0; i < w; i++)
+                rank += __builtin_popcountll(bm[i]);
+            return ctx->targets[ctx->sparse[idx].base + rank];
+        }
+        state = ctx->sparse[idx].fail;
+    }
+
+    return ctx->dense[(size_t)state * ctx->class_cnt + c];
+}
+
+/**
+ * \brief The aho corasick search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCACCompactSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                           PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    const SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+    const SCACCompactPatternList *pid_pat_list = ctx->pid_pat_list;
+    uint32_t state = 0;
+    int matches = 0;
+    int i;
+
+    if (ctx->state_count == 0)
+        return 0;
+
+    for (i = 0; i < buflen; i++) {
+        state = SCACCompactNext(ctx, state, ctx->xlate[buf[i]]);
+        if (!(state & SC_AC_COMPACT_OUTPUT))
+            continue;
+
+        const SCACCompactOutputTable *ot =
+            &ctx->output_table[state & SC_AC_COMPACT_STATE_MASK];
+        uint32_t k;
+        for (k = 0; k < ot->no_of_entries; k++) {
+            uint32_t pid = ot->pids[k] & 0x0000FFFF;
+
+            if (ot->pids[k] & 0xFFFF0000) {
+                if (SCMemcmp(pid_pat_list[pid].cs,
+                             buf + i - pid_pat_list[pid].patlen + 1,
+                             pid_pat_list[pid].patlen) != 0) {
+                    continue;
+                }
+            }
+            if (!(pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8)))) {
+                pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+                pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pid;
+            }
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \brief Add a case insensitive pattern.  Although we have different calls for
+ *        adding case sensitive and insensitive patterns, we make a single call
+ *        for either case.  No special treatment for either case.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCACCompactAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                            uint16_t offset, uint16_t depth, uint32_t pid,
+                            uint32_t sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return SCACCompactAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/**
+ * \brief Add a case sensitive pattern.  Although we have different calls for
+ *        adding case sensitive and insensitive patterns, we make a single call
+ *        for either case.  No special treatment for either case.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCACCompactAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                            uint16_t offset, uint16_t depth, uint32_t pid,
+                            uint32_t sid, uint8_t flags)
+{
+    return SCACCompactAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+void SCACCompactPrintSearchStats(MpmThreadCtx *mpm_thread_ctx)
+{
+
+#ifdef SC_AC_COMPACT_COUNTERS
+    SCACCompactThreadCtx *ctx = (SCACCompactThreadCtx *)mpm_thread_ctx->ctx;
+    printf("AC Compact Thread Search stats (ctx %p)\n", ctx);
+    printf("Total calls: %" PRIu32 "\n", ctx->total_calls);
+    printf("Total matches: %" PRIu64 "\n", ctx->total_matches);
+#endif /* SC_AC_COMPACT_COUNTERS */
+
+    return;
+}
+
+void SCACCompactPrintInfo(MpmCtx *mpm_ctx)
+{
+    SCACCompactCtx *ctx = (SCACCompactCtx *)mpm_ctx->ctx;
+
+    printf("MPM AC Compact Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf(" Sizeof:\n");
+    printf("  MpmCtx               %" PRIuMAX "\n", (uintmax_t)sizeof(MpmCtx));
+    printf("  SCACCompactCtx:      %" PRIuMAX "\n", (uintmax_t)sizeof(SCACCompactCtx));
+    printf("  SCACCompactPattern   %" PRIuMAX "\n", (uintmax_t)sizeof(SCACCompactPattern));
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Alphabet classes: %" PRIu16 "\n", ctx->class_cnt);
+    printf("Total states:    %" PRIu32 " (%" PRIu32 " dense)\n",
+           ctx->state_count, ctx->dense_cnt);
+    printf("\n");
+
+    return;
+}
+
+/************************** Mpm Registration ***************************/
+
+/**
+ * \brief Register the compact aho-corasick mpm.
+ */
+void MpmACCompactRegister(void)
+{
+    mpm_table[MPM_AC_COMPACT].name = "ac-compact";
+    mpm_table[MPM_AC_COMPACT].max_pattern_length = 0;
+
+    mpm_table[MPM_AC_COMPACT].InitCtx = SCACCompactInitCtx;
+    mpm_table[MPM_AC_COMPACT].InitThreadCtx = SCACCompactInitThreadCtx;
+    mpm_table[MPM_AC_COMPACT].DestroyCtx = SCACCompactDestroyCtx;
+    mpm_table[MPM_AC_COMPACT].DestroyThreadCtx = SCACCompactDestroyThreadCtx;
+    mpm_table[MPM_AC_COMPACT].AddPattern = SCACCompactAddPatternCS;
+    mpm_table[MPM_AC_COMPACT].AddPatternNocase = SCACCompactAddPatternCI;
+    mpm_table[MPM_AC_COMPACT].Prepare = SCACCompactPreparePatterns;
+    mpm_table[MPM_AC_COMPACT].Search = SCACCompactSearch;
+    mpm_table[MPM_AC_COMPACT].Cleanup = NULL;
+    mpm_table[MPM_AC_COMPACT].PrintCtx = SCACCompactPrintInfo;
+    mpm_table[MPM_AC_COMPACT].PrintThreadCtx = SCACCompactPrintSearchStats;
+    mpm_table[MPM_AC_COMPACT].RegisterUnittests = SCACCompactRegisterTests;
+
+    return;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/** \test the ac matcher tests against ac-compact */
+static int SCACCompactTest01(void)
+{
+    return SCACRunMatcherTests(MPM_AC_COMPACT);
+}
+
+/** \internal \brief set up a ctx of the given type with random patterns */
+static void SCACCompactTestSetup(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+        uint16_t mpm_type, uint32_t patterns, uint16_t maxlen,
+        const uint8_t *buf, uint32_t buflen, const char *alphabet,
+        unsigned int seed)
+{
+    uint8_t pat[64];
+    size_t alen = strlen(alphabet);
+    uint32_t i;
+
+    memset(mpm_ctx, 0, sizeof(MpmCtx));
+    MpmInitCtx(mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(mpm_ctx, mpm_thread_ctx, 0);
+
+    for (i = 0; i < patterns; i++) {
+        uint16_t len = 1 + rand_r(&seed) % maxlen;
+        uint16_t j;
+        /* take most patterns from the buffer, so that they match */
+        if (i % 4 != 0) {
+            uint32_t off = rand_r(&seed) % (buflen - len);
+            memcpy(pat, buf + off, len);
+        } else {
+            for (j = 0; j < len; j++)
+                pat[j] = alphabet[rand_r(&seed) % alen];
+        }
+        /* flip the case of some so only the nocase ones match */
+        if (i % 5 == 0)
+            pat[0] = isupper(pat[0]) ? tolower(pat[0]) : toupper(pat[0]);
+
+        if (i % 3 == 0)
+            MpmAddPatternCI(mpm_ctx, pat, len, 0, 0, i, 0, 0);
+        else
+            MpmAddPatternCS(mpm_ctx, pat, len, 0, 0, i, 0, 0);
+    }
+    mpm_table[mpm_type].Prepare(mpm_ctx);
+}
+
+/**
+ * \test Compare against ac with random patterns, with short patterns (all
+ *       states dense) and long ones (mostly sparse states, long failure
+ *       chains), and an alphabet that needs more than one bitmap word.
+ */
+static int SCACCompactTest02(void)
+{
+    const char *alphabets[] = { "abcAB01", "abcdefghijklmnopqrstuvwxyz"
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789!@#$%^&*()-_=+[]{};:,.<>/?~" };
+    uint16_t maxlens[] = { 2, 12, 40 };
+    uint32_t sets[] = { 20, 500 };
+    unsigned int seed = 4321;
+    uint8_t buf[2048];
+    uint32_t a, s, l, i;
+
+    for (a = 0; a < sizeof(alphabets) / sizeof(alphabets[0]); a++) {
+        size_t alen = strlen(alphabets[a]);
+        for (i = 0; i < sizeof(buf); i++)
+            buf[i] = alphabets[a][rand_r(&seed) % alen];
+
+        for (s = 0; s < sizeof(sets) / sizeof(sets[0]); s++) {
+            for (l = 0; l < sizeof(maxlens) / sizeof(maxlens[0]); l++) {
+                MpmCtx ac_ctx, compact_ctx;
+                MpmThreadCtx ac_tctx, compact_tctx;
+                PatternMatcherQueue ac_pmq, compact_pmq;
+                int ok = 1;
+
+                SCACCompactTestSetup(&ac_ctx, &ac_tctx, MPM_AC, sets[s],
+                        maxlens[l], buf, sizeof(buf), alphabets[a], seed + s);
+                SCACCompactTestSetup(&compact_ctx, &compact_tctx, MPM_AC_COMPACT,
+                        sets[s], maxlens[l], buf, sizeof(buf), alphabets[a], seed + s);
+                PmqSetup(&ac_pmq, sets[s]);
+                PmqSetup(&compact_pmq, sets[s]);
+
+                uint32_t ac_cnt = mpm_table[MPM_AC].Search(&ac_ctx, &ac_tctx,
+                        &ac_pmq, buf, sizeof(buf));
+                uint32_t compact_cnt = SCACCompactSearch(&compact_ctx,
+                        &compact_tctx, &compact_pmq, buf, sizeof(buf));
+                if (ac_cnt != compact_cnt ||
+                    ac_pmq.pattern_id_array_cnt != compact_pmq.pattern_id_array_cnt ||
+                    memcmp(ac_pmq.pattern_id_bitarray, compact_pmq.pattern_id_bitarray,
+                           ac_pmq.pattern_id_bitarray_size) != 0) {
+                    printf("alphabet %"PRIu32" set %"PRIu32" maxlen %u: ac %"PRIu32
+                           " matches, ac-compact %"PRIu32": ", a, sets[s],
+                           maxlens[l], ac_cnt, compact_cnt);
+                    ok = 0;
+                }
+
+                mpm_table[MPM_AC].DestroyCtx(&ac_ctx);
+                mpm_table[MPM_AC].DestroyThreadCtx(&ac_ctx, &ac_tctx);
+                SCACCompactDestroyCtx(&compact_ctx);
+                SCACCompactDestroyThreadCtx(&compact_ctx, &compact_tctx);
+                PmqFree(&ac_pmq);
+                PmqFree(&compact_pmq);
+                if (!ok)
+                    return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+/** Comment out this if you want the ac-compact benchmark
+ *  #define ENABLE_AC_COMPACT_BENCH 1
+ */
+
+#ifdef ENABLE_AC_COMPACT_BENCH
+/* ac-compact benchmark
+ *
+ * Builds ac, ac-bs and ac-compact from the same random patterns and reports
+ * the memory used by each ctx and the cpu ticks per scanned byte. Build
+ * with ENABLE_AC_COMPACT_BENCH and run it using:
+ *
+ *   suricata -u -U SCACCompactBench
+ *
+ * The number of patterns and the size of the scanned buffer can be set with:
+ *
+ *   --set unittests.ac-compact-bench.patterns=<num> (default 1000)
+ *   --set unittests.ac-compact-bench.bytes=<num> (default 1048576)
+ */
+
+#define AC_COMPACT_BENCH_DEFAULT_PATTERNS   1000
+#define AC_COMPACT_BENCH_DEFAULT_BYTES      1048576
+#define AC_COMPACT_BENCH_BUFLEN             1500
+
+static int SCACCompactBench01(void)
+{
+    uint16_t types[] = { MPM_AC, MPM_AC_BS, MPM_AC_COMPACT };
+    const char *alphabet = "abcdefghijklmnopqrstuvwxyz0123456789 /.:=";
+    uint8_t buf[AC_COMPACT_BENCH_BUFLEN];
+    intmax_t patterns = 0, bytes = 0;
+    unsigned int seed = 1234;
+    uint32_t i, t;
+    intmax_t n;
+
+    if (ConfGetInt("unittests.ac-compact-bench.patterns", &patterns) != 1 ||
+        patterns <= 0 || patterns > 65535)
+        patterns = AC_COMPACT_BENCH_DEFAULT_PATTERNS;
+    if (ConfGetInt("unittests.ac-compact-bench.bytes", &bytes) != 1 ||
+        bytes <= 0)
+        bytes = AC_COMPACT_BENCH_DEFAULT_BYTES;
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = alphabet[rand_r(&seed) % strlen(alphabet)];
+
+    printf("\n");
+    for (t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+        MpmCtx mpm_ctx;
+        MpmThreadCtx mpm_thread_ctx;
+        PatternMatcherQueue pmq;
+        uint64_t matches = 0;
+
+        SCACCompactTestSetup(&mpm_ctx, &mpm_thread_ctx, types[t],
+                (uint32_t)patterns, 32, buf, sizeof(buf), alphabet, seed);
+        PmqSetup(&pmq, (uint32_t)patterns);
+
+        uint64_t start = UtilCpuGetTicks();
+        for (n = 0; n < bytes; n += sizeof(buf)) {
+            PmqReset(&pmq);
+            matches += mpm_table[types[t]].Search(&mpm_ctx, &mpm_thread_ctx,
+                    &pmq, buf, sizeof(buf));
+        }
+        uint64_t ticks = UtilCpuGetTicks() - start;
+
+        printf("%-10s %6"PRIuMAX" patterns %10"PRIu32" bytes %8.2f ticks/byte "
+               "%"PRIu64" matches\n", mpm_table[types[t]].name,
+               (uintmax_t)mpm_ctx.pattern_cnt, mpm_ctx.memory_size,
+               (double)ticks / (double)bytes, matches);
+
+        mpm_table[types[t]].DestroyCtx(&mpm_ctx);
+        mpm_table[types[t]].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+        PmqFree(&pmq);
+    }
+
+    return 1;
+}
+#endif /* ENABLE_AC_COMPACT_BENCH */
+
+#endif /* UNITTESTS */
+
+void SCACCompactRegisterTests(void)
+{
+
+#ifdef UNITTESTS
+    UtRegisterTest("SCACCompactTest01", SCACCompactTest01, 1);
+    UtRegisterTest("SCACCompactTest02", SCACCompactTest02, 1);
+#ifdef ENABLE_AC_COMPACT_BENCH
+    UtRegisterTest("SCACCompactBench01", SCACCompactBench01, 1);
+#endif
+#endif /* UNITTESTS */
+
+    return;
+}
@@ -0,0 +1,115 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Aho-corasick with a compressed alphabet and bitmap compressed rows for
+ * the deeper states.
+ */
+
+#ifndef __UTIL_MPM_AC_COMPACT__H__
+#define __UTIL_MPM_AC_COMPACT__H__
+
+/** states up to this depth get a full row, the others a sparse one */
+#define SC_AC_COMPACT_DENSE_DEPTH   2
+
+/** set in a state id if the state has output */
+#define SC_AC_COMPACT_OUTPUT        0x80000000
+#define SC_AC_COMPACT_STATE_MASK    0x7FFFFFFF
+
+typedef struct SCACCompactPattern_ {
+    /* length of the pattern */
+    uint16_t len;
+    /* flags decribing the pattern */
+    uint8_t flags;
+    /* holds the original pattern that was added */
+    uint8_t *original_pat;
+    /* case sensitive */
+    uint8_t *cs;
+    /* case INsensitive */
+    uint8_t *ci;
+    /* pattern id */
+    uint32_t id;
+
+    struct SCACCompactPattern_ *next;
+} SCACCompactPattern;
+
+typedef struct SCACCompactPatternList_ {
+    uint8_t *cs;
+    uint16_t patlen;
+} SCACCompactPatternList;
+
+typedef struct SCACCompactOutputTable_ {
+    /* list of pattern sids */
+    uint32_t *pids;
+    /* no of entries we have in pids */
+    uint32_t no_of_entries;
+} SCACCompactOutputTable;
+
+typedef struct SCACCompactSparseState_ {
+    /* failure state, always closer to the root */
+    uint32_t fail;
+    /* index in targets of the goto target for the lowest class in the
+     * bitmap */
+    uint32_t base;
+} SCACCompactSparseState;
+
+typedef struct SCACCompactCtx_ {
+    /* hash used during ctx initialization */
+    SCACCompactPattern **init_hash;
+
+    /* pattern arrays.  We need this only during the goto table creation phase */
+    SCACCompactPattern **parray;
+
+    /* byte to alphabet class, the input is lowercased through it as well.
+     * Class 0 is for the bytes that aren't in any pattern. */
+    uint8_t xlate[256];
+    uint16_t class_cnt;
+    /* number of 64 bit words in a sparse state's bitmap */
+    uint16_t bitmap_words;
+
+    /* no of states used by ac. States are numbered breadth first, so the
+     * first dense_cnt states are the ones with a dense row */
+    uint32_t state_count;
+    uint32_t dense_cnt;
+
+    /* dense_cnt rows of class_cnt next states */
+    uint32_t *dense;
+    /* per sparse state: the failure state and the goto targets of the
+     * classes set in its bitmap */
+    SCACCompactSparseState *sparse;
+    uint64_t *bitmaps;
+    uint32_t *targets;
+    uint32_t targets_cnt;
+
+    SCACCompactOutputTable *output_table;
+    SCACCompactPatternList *pid_pat_list;
+
+    uint16_t max_pat_id;
+} SCACCompactCtx;
+
+typedef struct SCACCompactThreadCtx_ {
+    /* the total calls we make to the search function */
+    uint32_t total_calls;
+    /* the total patterns that we ended up matching against */
+    uint64_t total_matches;
+} SCACCompactThreadCtx;
+
+void MpmACCompactRegister(void);
+
+#endif /* __UTIL_MPM_AC_COMPACT__H__ */
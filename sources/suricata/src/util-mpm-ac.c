@@ -58,8 +58,12 @@
 #include "util-unittest-helper.h"
 #include "util-memcmp.h"
 #include "util-mpm-ac.h"
+#include "util-mpm-cache.h"
 #include "util-memcpy.h"
 
+#include <sys/mman.h>
+#include <dirent.h>
+
 #ifdef __SC_CUDA_SUPPORT__
 
 #include "util-mpm.h"
@@ -83,6 +87,8 @@ uint32_t SCACSearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
 void SCACPrintInfo(MpmCtx *mpm_ctx);
 void SCACPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
 void SCACRegisterTests(void);
+static int SCACCacheSave(MpmCtx *, FILE *);
+static int SCACCacheLoad(MpmCtx *, uint8_t *, size_t, size_t);
 
 /* a placeholder to denote a failure transition in the goto table */
 #define SC_AC_FAIL (-1)
@@ -1040,6 +1046,214 @@ error:
     return -1;
 }
 
+/* state tables in cache files start at a page boundary so they can be used
+ * straight from the map */
+#define SC_AC_CACHE_TABLE_ALIGN 4096
+
+/** \brief start of the AC payload of a mpm cache file. It's followed by the
+ *         output table, the case sensitive patterns and the state table. */
+typedef struct SCACCacheInfo_ {
+    uint32_t state_count;
+    uint16_t max_pat_id;
+    /* size of a state table entry in bytes */
+    uint16_t state_size;
+    /* file offset of the state table */
+    uint64_t table_off;
+} SCACCacheInfo;
+
+/**
+ * \brief Write the tables of a prepared ctx to a mpm cache file.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param fp      Cache file, positioned after the generic part.
+ *
+ * \retval 0 on success, -1 on error.
+ */
+static int SCACCacheSave(MpmCtx *mpm_ctx, FILE *fp)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    SCACCacheInfo info;
+    void *table = NULL;
+    uint32_t i;
+
+    if (ctx->state_count == 0 || ctx->output_table == NULL ||
+        ctx->pid_pat_list == NULL)
+        return -1;
+
+    memset(&info, 0, sizeof(info));
+    info.state_count = ctx->state_count;
+    info.max_pat_id = ctx->max_pat_id;
+    /* only the table used by SCACSearch is stored */
+    if (ctx->state_count < 32767) {
+        table = ctx->state_table_u16;
+        info.state_size = sizeof(SC_AC_STATE_TYPE_U16);
+    } else {
+        table = ctx->state_table_u32;
+        info.state_size = sizeof(SC_AC_STATE_TYPE_U32);
+    }
+    if (table == NULL)
+        return -1;
+
+    long pos = ftell(fp);
+    if (pos < 0)
+        return -1;
+    uint64_t len = sizeof(info);
+    for (i = 0; i < ctx->state_count; i++)
+        len += sizeof(uint32_t) * (1 + ctx->output_table[i].no_of_entries);
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++)
+        len += sizeof(uint16_t) + ctx->pid_pat_list[i].patlen;
+    info.table_off = (pos + len + SC_AC_CACHE_TABLE_ALIGN - 1) /
+                     SC_AC_CACHE_TABLE_ALIGN * SC_AC_CACHE_TABLE_ALIGN;
+
+    if (fwrite(&info, sizeof(info), 1, fp) != 1)
+        return -1;
+    for (i = 0; i < ctx->state_count; i++) {
+        SCACOutputTable *ot = &ctx->output_table[i];
+        if (fwrite(&ot->no_of_entries, sizeof(uint32_t), 1, fp) != 1 ||
+            fwrite(ot->pids, sizeof(uint32_t), ot->no_of_entries, fp) != ot->no_of_entries)
+            return -1;
+    }
+    for (i = 0; i < (uint32_t)ctx->max_pat_id + 1; i++) {
+        SCACPatternList *pl = &ctx->pid_pat_list[i];
+        if (fwrite(&pl->patlen, sizeof(uint16_t), 1, fp) != 1 ||
+            fwrite(pl->cs, 1, pl->patlen, fp) != pl->patlen)
+            return -1;
+    }
+
+    if (MpmCacheWritePad(fp, SC_AC_CACHE_TABLE_ALIGN) != 0 ||
+        ftell(fp) != (long)info.table_off)
+        return -1;
+    if (fwrite(table, (size_t)info.state_size * 256, ctx->state_count, fp) !=
+        ctx->state_count)
+        return -1;
+
+    return 0;
+}
+
+/**
+ * \brief Set up an unprepared ctx from a mapped mpm cache file. The output
+ *        table and the patterns are copied, the state table is used in
+ *        place.
+ *
+ * \param mpm_ctx Pointer to the mpm context, with all patterns added.
+ * \param map     Read only map of the cache file.
+ * \param map_len Length of the map.
+ * \param off     Offset of the AC payload in the map.
+ *
+ * \retval 0 on success, the ctx owns the map. -1 on error, the ctx is
+ *         unchanged.
+ */
+static int SCACCacheLoad(MpmCtx *mpm_ctx, uint8_t *map, size_t map_len, size_t off)
+{
+    SCACCtx *ctx = (SCACCtx *)mpm_ctx->ctx;
+    SCACOutputTable *output_table = NULL;
+    SCACPatternList *pid_pat_list = NULL;
+    SCACCacheInfo info;
+    uint32_t i;
+
+    if (ctx->init_hash == NULL || off > map_len || map_len - off < sizeof(info))
+        return -1;
+    memcpy(&info, map + off, sizeof(info));
+    uint8_t *p = map + off + sizeof(info);
+
+    if (info.state_count == 0 || info.max_pat_id != ctx->max_pat_id)
+        return -1;
+    if (info.state_size != (info.state_count < 32767 ?
+                sizeof(SC_AC_STATE_TYPE_U16) : sizeof(SC_AC_STATE_TYPE_U32)))
+        return -1;
+    uint64_t table_len = (uint64_t)info.state_count * info.state_size * 256;
+    if (info.table_off % SC_AC_CACHE_TABLE_ALIGN != 0 ||
+        info.table_off > map_len || map_len - info.table_off < table_len)
+        return -1;
+    uint8_t *end = map + info.table_off;
+
+    output_table = SCMalloc(info.state_count * sizeof(SCACOutputTable));
+    pid_pat_list = SCMalloc((info.max_pat_id + 1) * sizeof(SCACPatternList));
+    if (output_table == NULL || pid_pat_list == NULL)
+        goto error;
+    memset(output_table, 0, info.state_count * sizeof(SCACOutputTable));
+    memset(pid_pat_list, 0, (info.max_pat_id + 1) * sizeof(SCACPatternList));
+
+    for (i = 0; i < info.state_count; i++) {
+        uint32_t n;
+        if (p > end || (size_t)(end - p) < sizeof(n))
+            goto error;
+        memcpy(&n, p, sizeof(n));
+        p += sizeof(n);
+        if (n == 0)
+            continue;
+        if ((size_t)(end - p) / sizeof(uint32_t) < n)
+            goto error;
+        output_table[i].pids = SCMalloc(n * sizeof(uint32_t));
+        if (output_table[i].pids == NULL)
+            goto error;
+        memcpy(output_table[i].pids, p, n * sizeof(uint32_t));
+        output_table[i].no_of_entries = n;
+        p += n * sizeof(uint32_t);
+    }
+    for (i = 0; i < (uint32_t)info.max_pat_id + 1; i++) {
+        uint16_t patlen;
+        if (p > end || (size_t)(end - p) < sizeof(patlen))
+            goto error;
+        memcpy(&patlen, p, sizeof(patlen));
+        p += sizeof(patlen);
+        if (patlen == 0)
+            continue;
+        if ((size_t)(end - p) < patlen)
+            goto error;
+        pid_pat_list[i].cs = SCMalloc(patlen);
+        if (pid_pat_list[i].cs == NULL)
+            goto error;
+        memcpy(pid_pat_list[i].cs, p, patlen);
+        pid_pat_list[i].patlen = patlen;
+        p += patlen;
+    }
+
+    /* the patterns were only needed to build the tables */
+    for (i = 0; i < INIT_HASH_SIZE; i++) {
+        SCACPattern *node = ctx->init_hash[i], *nnode = NULL;
+        while (node != NULL) {
+            nnode = node->next;
+            SCACFreePattern(mpm_ctx, node);
+            node = nnode;
+        }
+    }
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    ctx->single_state_size = sizeof(int32_t) * 256;
+    ctx->state_count = info.state_count;
+    ctx->output_table = output_table;
+    ctx->pid_pat_list = pid_pat_list;
+    if (info.state_size == sizeof(SC_AC_STATE_TYPE_U16))
+        ctx->state_table_u16 = (void *)(map + info.table_off);
+    else
+        ctx->state_table_u32 = (void *)(map + info.table_off);
+    ctx->cache_map = map;
+    ctx->cache_map_len = map_len;
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += table_len;
+    return 0;
+
+error:
+    if (output_table != NULL) {
+        for (i = 0; i < info.state_count; i++) {
+            if (output_table[i].pids != NULL)
+                SCFree(output_table[i].pids);
+        }
+        SCFree(output_table);
+    }
+    if (pid_pat_list != NULL) {
+        for (i = 0; i < (uint32_t)info.max_pat_id + 1; i++) {
+            if (pid_pat_list[i].cs != NULL)
+                SCFree(pid_pat_list[i].cs);
+        }
+        SCFree(pid_pat_list);
+    }
+    return -1;
+}
+
 /**
  * \brief Init the mpm thread context.
  *
@@ -1149,7 +1363,8 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
     }
 
     if (ctx->state_table_u16 != NULL) {
-        SCFree(ctx->state_table_u16);
+        if (ctx->cache_map == NULL)
+            SCFree(ctx->state_table_u16);
         ctx->state_table_u16 = NULL;
 
         mpm_ctx->memory_cnt++;
@@ -1157,7 +1372,8 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
                                  sizeof(SC_AC_STATE_TYPE_U16) * 256);
     }
     if (ctx->state_table_u32 != NULL) {
-        SCFree(ctx->state_table_u32);
+        if (ctx->cache_map == NULL)
+            SCFree(ctx->state_table_u32);
         ctx->state_table_u32 = NULL;
 
         mpm_ctx->memory_cnt++;
@@ -1184,6 +1400,11 @@ void SCACDestroyCtx(MpmCtx *mpm_ctx)
         SCFree(ctx->pid_pat_list);
     }
 
+    if (ctx->cache_map != NULL) {
+        munmap(ctx->cache_map, ctx->cache_map_len);
+        ctx->cache_map = NULL;
+    }
+
     SCFree(mpm_ctx->ctx);
     mpm_ctx->memory_cnt--;
     mpm_ctx->memory_size -= sizeof(SCACCtx);
@@ -1941,6 +2162,7 @@ uint32_t SCACCudaPacketResultsProcessing(Packet *p, MpmCtx *mpm_ctx,
                     ;
                 } else {
                     pmq->pattern_id_bitarray[(pids[k] & 0x0000FFFF) / 8] |= (1 << ((pids[k] & 0x0000FFFF) % 8));
+                    pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k] & 0x0000FFFF;
                 }
                 matches++;
             } else {
@@ -1948,6 +2170,7 @@ uint32_t SCACCudaPacketResultsProcessing(Packet *p, MpmCtx *mpm_ctx,
                     ;
                 } else {
                     pmq->pattern_id_bitarray[pids[k] / 8] |= (1 << (pids[k] % 8));
+                    pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pids[k];
                 }
                 matches++;
             }
@@ -2110,6 +2333,8 @@ void MpmACRegister(void)
     mpm_table[MPM_AC].PrintCtx = SCACPrintInfo;
     mpm_table[MPM_AC].PrintThreadCtx = SCACPrintSearchStats;
     mpm_table[MPM_AC].RegisterUnittests = SCACRegisterTests;
+    mpm_table[MPM_AC].CacheSave = SCACCacheSave;
+    mpm_table[MPM_AC].CacheLoad = SCACCacheLoad;
 
     return;
 }
@@ -2137,6 +2362,8 @@ void MpmACCudaRegister(void)
     mpm_table[MPM_AC_CUDA].PrintCtx = SCACPrintInfo;
     mpm_table[MPM_AC_CUDA].PrintThreadCtx = SCACPrintSearchStats;
     mpm_table[MPM_AC_CUDA].RegisterUnittests = SCACRegisterTests;
+    /* prepare needs the cuda context of the calling thread */
+    mpm_table[MPM_AC_CUDA].flags = MPM_FLAG_PREPARE_NOT_THREADSAFE;
 
     return;
 }
@@ -2147,7 +2374,7 @@ void MpmACCudaRegister(void)
 
 #ifdef UNITTESTS
 
-static int SCACTest01(void)
+static int SCACMatcherTest01(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2156,32 +2383,32 @@ static int SCACTest01(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghjiklmnopqrstuvwxyz";
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest02(void)
+static int SCACMatcherTest02(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2190,31 +2417,31 @@ static int SCACTest02(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abce", 4, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghjiklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 0)
         result = 1;
     else
         printf("0 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest03(void)
+static int SCACMatcherTest03(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2223,8 +2450,8 @@ static int SCACTest03(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
@@ -2234,24 +2461,24 @@ static int SCACTest03(void)
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"fghj", 4, 0, 0, 2, 0, 0);
     PmqSetup(&pmq, 3);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghjiklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 3)
         result = 1;
     else
         printf("3 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest04(void)
+static int SCACMatcherTest04(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2260,32 +2487,32 @@ static int SCACTest04(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"bcdegh", 6, 0, 0, 1, 0, 0);
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"fghjxyz", 7, 0, 0, 2, 0, 0);
     PmqSetup(&pmq, 3);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghjiklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest05(void)
+static int SCACMatcherTest05(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2294,32 +2521,32 @@ static int SCACTest05(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 0, 0, 0);
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"bCdEfG", 6, 0, 0, 1, 0, 0);
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"fghJikl", 7, 0, 0, 2, 0, 0);
     PmqSetup(&pmq, 3);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghjiklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 3)
         result = 1;
     else
         printf("3 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest06(void)
+static int SCACMatcherTest06(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2328,30 +2555,30 @@ static int SCACTest06(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcd";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest07(void)
+static int SCACMatcherTest07(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2360,8 +2587,8 @@ static int SCACTest07(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* should match 30 times */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"A", 1, 0, 0, 0, 0, 0);
@@ -2379,24 +2606,24 @@ static int SCACTest07(void)
     PmqSetup(&pmq, 6);
     /* total matches: 135 */
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 135)
         result = 1;
     else
         printf("135 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest08(void)
+static int SCACMatcherTest08(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2405,30 +2632,30 @@ static int SCACTest08(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)"a", 1);
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)"a", 1);
 
     if (cnt == 0)
         result = 1;
     else
         printf("0 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest09(void)
+static int SCACMatcherTest09(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2437,30 +2664,30 @@ static int SCACTest09(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ab", 2, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)"ab", 2);
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)"ab", 2);
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest10(void)
+static int SCACMatcherTest10(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2469,35 +2696,35 @@ static int SCACTest10(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcdefgh", 8, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "01234567890123456789012345678901234567890123456789"
                 "01234567890123456789012345678901234567890123456789"
                 "abcdefgh"
                 "01234567890123456789012345678901234567890123456789"
                 "01234567890123456789012345678901234567890123456789";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest11(void)
+static int SCACMatcherTest11(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2506,8 +2733,8 @@ static int SCACTest11(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     if (MpmAddPatternCS(&mpm_ctx, (uint8_t *)"he", 2, 0, 0, 1, 0, 0) == -1)
         goto end;
@@ -2519,32 +2746,32 @@ static int SCACTest11(void)
         goto end;
     PmqSetup(&pmq, 5);
 
-    if (SCACPreparePatterns(&mpm_ctx) == -1)
+    if (mpm_table[mpm_type].Prepare(&mpm_ctx) == -1)
         goto end;
 
     result = 1;
 
     char *buf = "he";
-    result &= (SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq, (uint8_t *)buf,
-                          strlen(buf)) == 1);
+    result &= (mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            (uint8_t *)buf, strlen(buf)) == 1);
     buf = "she";
-    result &= (SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq, (uint8_t *)buf,
-                          strlen(buf)) == 2);
+    result &= (mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            (uint8_t *)buf, strlen(buf)) == 2);
     buf = "his";
-    result &= (SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq, (uint8_t *)buf,
-                          strlen(buf)) == 1);
+    result &= (mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            (uint8_t *)buf, strlen(buf)) == 1);
     buf = "hers";
-    result &= (SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq, (uint8_t *)buf,
-                          strlen(buf)) == 2);
+    result &= (mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx, &pmq,
+            (uint8_t *)buf, strlen(buf)) == 2);
 
  end:
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest12(void)
+static int SCACMatcherTest12(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2553,8 +2780,8 @@ static int SCACTest12(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"wxyz", 4, 0, 0, 0, 0, 0);
@@ -2562,24 +2789,24 @@ static int SCACTest12(void)
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"vwxyz", 5, 0, 0, 1, 0, 0);
     PmqSetup(&pmq, 2);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 2)
         result = 1;
     else
         printf("2 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest13(void)
+static int SCACMatcherTest13(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2588,32 +2815,32 @@ static int SCACTest13(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcdefghijklmnopqrstuvwxyzABCD";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyzABCD";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest14(void)
+static int SCACMatcherTest14(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2622,32 +2849,32 @@ static int SCACTest14(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcdefghijklmnopqrstuvwxyzABCDE";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyzABCDE";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest15(void)
+static int SCACMatcherTest15(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2656,32 +2883,32 @@ static int SCACTest15(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcdefghijklmnopqrstuvwxyzABCDEF";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyzABCDEF";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest16(void)
+static int SCACMatcherTest16(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2690,32 +2917,32 @@ static int SCACTest16(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcdefghijklmnopqrstuvwxyzABC";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyzABC";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest17(void)
+static int SCACMatcherTest17(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2724,32 +2951,32 @@ static int SCACTest17(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcdefghijklmnopqrstuvwxyzAB";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyzAB";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest18(void)
+static int SCACMatcherTest18(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2758,32 +2985,32 @@ static int SCACTest18(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     char *pat = "abcde""fghij""klmno""pqrst""uvwxy""z";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcde""fghij""klmno""pqrst""uvwxy""z";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest19(void)
+static int SCACMatcherTest19(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2792,32 +3019,32 @@ static int SCACTest19(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 */
     char *pat = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAA";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest20(void)
+static int SCACMatcherTest20(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2826,32 +3053,32 @@ static int SCACTest20(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 */
     char *pat = "AAAAA""AAAAA""AAAAA""AAAAA""AAAAA""AAAAA""AA";
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)pat, strlen(pat), 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "AAAAA""AAAAA""AAAAA""AAAAA""AAAAA""AAAAA""AA";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest21(void)
+static int SCACMatcherTest21(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2860,30 +3087,30 @@ static int SCACTest21(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"AA", 2, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                              (uint8_t *)"AA", 2);
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)"AA", 2);
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest22(void)
+static int SCACMatcherTest22(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2892,8 +3119,8 @@ static int SCACTest22(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
@@ -2901,24 +3128,24 @@ static int SCACTest22(void)
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"abcde", 5, 0, 0, 1, 0, 0);
     PmqSetup(&pmq, 2);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "abcdefghijklmnopqrstuvwxyz";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                              (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 2)
         result = 1;
     else
         printf("2 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest23(void)
+static int SCACMatcherTest23(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2927,30 +3154,30 @@ static int SCACTest23(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"AA", 2, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                              (uint8_t *)"aa", 2);
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)"aa", 2);
 
     if (cnt == 0)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest24(void)
+static int SCACMatcherTest24(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2959,30 +3186,30 @@ static int SCACTest24(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 1 */
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"AA", 2, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                              (uint8_t *)"aa", 2);
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)"aa", 2);
 
     if (cnt == 1)
         result = 1;
     else
         printf("1 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest25(void)
+static int SCACMatcherTest25(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -2991,32 +3218,32 @@ static int SCACTest25(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"ABCD", 4, 0, 0, 0, 0, 0);
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"bCdEfG", 6, 0, 0, 1, 0, 0);
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"fghiJkl", 7, 0, 0, 2, 0, 0);
     PmqSetup(&pmq, 3);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 3)
         result = 1;
     else
         printf("3 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest26(void)
+static int SCACMatcherTest26(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -3025,31 +3252,31 @@ static int SCACTest26(void)
 
     memset(&mpm_ctx, 0x00, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     MpmAddPatternCI(&mpm_ctx, (uint8_t *)"Works", 5, 0, 0, 0, 0, 0);
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"Works", 5, 0, 0, 1, 0, 0);
     PmqSetup(&pmq, 2);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "works";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 1)
         result = 1;
     else
         printf("3 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest27(void)
+static int SCACMatcherTest27(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -3058,31 +3285,31 @@ static int SCACTest27(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 0 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"ONE", 3, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "tone";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 0)
         result = 1;
     else
         printf("0 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
-static int SCACTest28(void)
+static int SCACMatcherTest28(uint16_t mpm_type)
 {
     int result = 0;
     MpmCtx mpm_ctx;
@@ -3091,30 +3318,94 @@ static int SCACTest28(void)
 
     memset(&mpm_ctx, 0, sizeof(MpmCtx));
     memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
-    MpmInitCtx(&mpm_ctx, MPM_AC);
-    SCACInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+    MpmInitCtx(&mpm_ctx, mpm_type);
+    mpm_table[mpm_type].InitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
 
     /* 0 match */
     MpmAddPatternCS(&mpm_ctx, (uint8_t *)"one", 3, 0, 0, 0, 0, 0);
     PmqSetup(&pmq, 1);
 
-    SCACPreparePatterns(&mpm_ctx);
+    mpm_table[mpm_type].Prepare(&mpm_ctx);
 
     char *buf = "tONE";
-    uint32_t cnt = SCACSearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
-                               (uint8_t *)buf, strlen(buf));
+    uint32_t cnt = mpm_table[mpm_type].Search(&mpm_ctx, &mpm_thread_ctx,
+            &pmq, (uint8_t *)buf, strlen(buf));
 
     if (cnt == 0)
         result = 1;
     else
         printf("0 != %" PRIu32 " ",cnt);
 
-    SCACDestroyCtx(&mpm_ctx);
-    SCACDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    mpm_table[mpm_type].DestroyCtx(&mpm_ctx);
+    mpm_table[mpm_type].DestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
     PmqFree(&pmq);
     return result;
 }
 
+/** \brief run the matcher tests above against an ac type matcher
+ *
+ *  \retval 1 all passed
+ *  \retval 0 a test failed
+ */
+int SCACRunMatcherTests(uint16_t mpm_type)
+{
+    static int (*tests[])(uint16_t) = {
+        SCACMatcherTest01, SCACMatcherTest02, SCACMatcherTest03,
+        SCACMatcherTest04, SCACMatcherTest05, SCACMatcherTest06,
+        SCACMatcherTest07, SCACMatcherTest08, SCACMatcherTest09,
+        SCACMatcherTest10, SCACMatcherTest11, SCACMatcherTest12,
+        SCACMatcherTest13, SCACMatcherTest14, SCACMatcherTest15,
+        SCACMatcherTest16, SCACMatcherTest17, SCACMatcherTest18,
+        SCACMatcherTest19, SCACMatcherTest20, SCACMatcherTest21,
+        SCACMatcherTest22, SCACMatcherTest23, SCACMatcherTest24,
+        SCACMatcherTest25, SCACMatcherTest26, SCACMatcherTest27,
+        SCACMatcherTest28,
+    };
+    uint32_t i;
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (tests[i](mpm_type) != 1) {
+            printf("SCACMatcherTest%02"PRIu32" failed for %s: ", i + 1,
+                   mpm_table[mpm_type].name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* the matcher tests registered for ac itself */
+#define SC_AC_TEST(n) \
+    static int SCACTest##n(void) { return SCACMatcherTest##n(MPM_AC); }
+SC_AC_TEST(01)
+SC_AC_TEST(02)
+SC_AC_TEST(03)
+SC_AC_TEST(04)
+SC_AC_TEST(05)
+SC_AC_TEST(06)
+SC_AC_TEST(07)
+SC_AC_TEST(08)
+SC_AC_TEST(09)
+SC_AC_TEST(10)
+SC_AC_TEST(11)
+SC_AC_TEST(12)
+SC_AC_TEST(13)
+SC_AC_TEST(14)
+SC_AC_TEST(15)
+SC_AC_TEST(16)
+SC_AC_TEST(17)
+SC_AC_TEST(18)
+SC_AC_TEST(19)
+SC_AC_TEST(20)
+SC_AC_TEST(21)
+SC_AC_TEST(22)
+SC_AC_TEST(23)
+SC_AC_TEST(24)
+SC_AC_TEST(25)
+SC_AC_TEST(26)
+SC_AC_TEST(27)
+SC_AC_TEST(28)
+#undef SC_AC_TEST
+
 static int SCACTest29(void)
 {
     uint8_t *buf = (uint8_t *)"onetwothreefourfivesixseveneightnine";
@@ -3169,6 +3460,109 @@ end:
     return result;
 }
 
+static void SCACTestCacheAddPatterns(MpmCtx *mpm_ctx, int extra)
+{
+    memset(mpm_ctx, 0, sizeof(MpmCtx));
+    MpmInitCtx(mpm_ctx, MPM_AC);
+    MpmCtxRecordPatternKeys(mpm_ctx);
+
+    MpmAddPatternCS(mpm_ctx, (uint8_t *)"abcd", 4, 0, 0, 0, 0, 0);
+    MpmAddPatternCI(mpm_ctx, (uint8_t *)"bCdEfG", 6, 0, 0, 1, 0, 0);
+    MpmAddPatternCS(mpm_ctx, (uint8_t *)"fghJikl", 7, 0, 0, 2, 0, 0);
+    if (extra)
+        MpmAddPatternCS(mpm_ctx, (uint8_t *)"xyz", 3, 0, 0, 3, 0, 0);
+}
+
+/** \brief remove a test mpm cache dir and the files in it */
+void SCACTestCacheClean(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d != NULL) {
+        struct dirent *de;
+        char path[PATH_MAX];
+        while ((de = readdir(d)) != NULL) {
+            if (de->d_name[0] == '.')
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+            unlink(path);
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+/** \test prepared ctx written to the mpm cache and loaded into a ctx with
+ *        the same patterns, but not into one with other patterns */
+static int SCACTest30(void)
+{
+    int result = 0;
+    char dir[] = "/tmp/suricata-ac-cache-XXXXXX";
+    MpmCtx mpm_ctx1, mpm_ctx2, mpm_ctx3;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    char *bufs[] = { "abcdefghjiklmnopqrstuvwxyz", "ABCDEFGHJIKLMN", "xbcdefgxabcdx" };
+    uint32_t i;
+
+    if (mkdtemp(dir) == NULL)
+        return 0;
+
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    SCACTestCacheAddPatterns(&mpm_ctx1, 0);
+    SCACTestCacheAddPatterns(&mpm_ctx2, 0);
+    SCACTestCacheAddPatterns(&mpm_ctx3, 1);
+    SCACInitThreadCtx(&mpm_ctx1, &mpm_thread_ctx, 0);
+    PmqSetup(&pmq, 4);
+
+    if (MpmCacheLoad(dir, &mpm_ctx1, mpm_ctx1.init_keys) == 0) {
+        printf("loaded from an empty cache: ");
+        goto end;
+    }
+    SCACPreparePatterns(&mpm_ctx1);
+    if (MpmCacheSave(dir, &mpm_ctx1, mpm_ctx1.init_keys) != 0) {
+        printf("save failed: ");
+        goto end;
+    }
+    if (MpmCacheLoad(dir, &mpm_ctx2, mpm_ctx2.init_keys) != 0) {
+        printf("load failed: ");
+        goto end;
+    }
+    if (((SCACCtx *)mpm_ctx2.ctx)->cache_map == NULL ||
+        ((SCACCtx *)mpm_ctx2.ctx)->init_hash != NULL) {
+        printf("ctx not set up from the map: ");
+        goto end;
+    }
+    if (MpmCacheLoad(dir, &mpm_ctx3, mpm_ctx3.init_keys) == 0) {
+        printf("loaded a ctx with other patterns: ");
+        goto end;
+    }
+
+    for (i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++) {
+        uint32_t cnt1 = SCACSearch(&mpm_ctx1, &mpm_thread_ctx, &pmq,
+                                   (uint8_t *)bufs[i], strlen(bufs[i]));
+        PmqReset(&pmq);
+        uint32_t cnt2 = SCACSearch(&mpm_ctx2, &mpm_thread_ctx, &pmq,
+                                   (uint8_t *)bufs[i], strlen(bufs[i]));
+        PmqReset(&pmq);
+        if (cnt1 != cnt2 || cnt1 == 0) {
+            printf("buf %"PRIu32": %"PRIu32" != %"PRIu32": ", i, cnt1, cnt2);
+            goto end;
+        }
+    }
+
+    result = 1;
+end:
+    SCACDestroyCtx(&mpm_ctx1);
+    SCACDestroyCtx(&mpm_ctx2);
+    SCACDestroyCtx(&mpm_ctx3);
+    MpmPatternKeyListFree(mpm_ctx1.init_keys);
+    MpmPatternKeyListFree(mpm_ctx2.init_keys);
+    MpmPatternKeyListFree(mpm_ctx3.init_keys);
+    SCACDestroyThreadCtx(&mpm_ctx1, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    SCACTestCacheClean(dir);
+    return result;
+}
+
 #endif /* UNITTESTS */
 
 void SCACRegisterTests(void)
@@ -3204,6 +3598,7 @@ void SCACRegisterTests(void)
     UtRegisterTest("SCACTest27", SCACTest27, 1);
     UtRegisterTest("SCACTest28", SCACTest28, 1);
     UtRegisterTest("SCACTest29", SCACTest29, 1);
+    UtRegisterTest("SCACTest30", SCACTest30, 1);
 #endif
 
     return;
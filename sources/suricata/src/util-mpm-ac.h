@@ -92,6 +92,11 @@ typedef struct SCACCtx_ {
     uint16_t single_state_size;
     uint16_t max_pat_id;
 
+    /* mapped cache file the state table points into, if it was loaded
+     * from the mpm cache instead of prepared */
+    void *cache_map;
+    size_t cache_map_len;
+
 #ifdef __SC_CUDA_SUPPORT__
     CUdeviceptr state_table_u16_cuda;
     CUdeviceptr state_table_u32_cuda;
@@ -107,6 +112,11 @@ typedef struct SCACThreadCtx_ {
 
 void MpmACRegister(void);
 
+#ifdef UNITTESTS
+void SCACTestCacheClean(const char *);
+int SCACRunMatcherTests(uint16_t);
+#endif
+
 
 #ifdef __SC_CUDA_SUPPORT__
 
@@ -101,6 +101,8 @@ void MpmB2gcRegister (void) {
     mpm_table[MPM_B2GC].PrintCtx = B2gcPrintInfo;
     mpm_table[MPM_B2GC].PrintThreadCtx = B2gcPrintSearchStats;
     mpm_table[MPM_B2GC].RegisterUnittests = B2gcRegisterTests;
+    /* B2gcHashPatternSortHash uses a static copy of ctx->m */
+    mpm_table[MPM_B2GC].flags = MPM_FLAG_PREPARE_NOT_THREADSAFE;
 }
 
 #ifdef PRINTMATCH
@@ -0,0 +1,312 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * On disk cache of prepared mpm ctxs.
+ *
+ * Preparing the mpm ctxs is the most expensive part of building the
+ * detection engine. A prepared ctx only depends on the matcher and on the
+ * set of patterns that was added to it, so the result of Prepare is written
+ * to "<dir>/<matcher>-<hash>.mpm" and mapped back in on the next start or
+ * rule reload instead of being built again.
+ *
+ * A file is the MpmCacheHeader, the pattern keys the ctx was built from and
+ * a matcher specific payload written by the matcher's CacheSave callback.
+ * The keys are compared one by one on load, so a hash collision can't make
+ * us use the wrong automaton. Files are written to a temp file first and
+ * renamed, so concurrent writers of the same file are harmless.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "util-mpm.h"
+#include "util-mpm-cache.h"
+#include "util-debug.h"
+
+#include <sys/mman.h>
+
+#define MPM_CACHE_FNV_OFFSET    0xcbf29ce484222325ULL
+#define MPM_CACHE_FNV_PRIME     0x100000001b3ULL
+
+/** on disk form of a MpmPatternKey, followed by the pattern bytes */
+typedef struct MpmCacheKey_ {
+    uint32_t pid;
+    uint16_t patlen;
+    uint16_t offset;
+    uint16_t depth;
+    uint8_t flags;
+    uint8_t pad;
+} MpmCacheKey;
+
+static uint64_t MpmCacheHashUpdate(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *d = (const uint8_t *)data;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= d[i];
+        hash *= MPM_CACHE_FNV_PRIME;
+    }
+    return hash;
+}
+
+static void MpmCacheKeySet(MpmCacheKey *ck, const MpmPatternKey *key)
+{
+    memset(ck, 0, sizeof(*ck));
+    ck->pid = key->pid;
+    ck->patlen = key->patlen;
+    ck->offset = key->offset;
+    ck->depth = key->depth;
+    ck->flags = key->flags;
+}
+
+/** \brief hash the matcher, the program version and the normalized keys */
+static uint64_t MpmCacheHash(const char *matcher, MpmPatternKeyList *keys)
+{
+    uint64_t hash = MPM_CACHE_FNV_OFFSET;
+    uint32_t version = MPM_CACHE_VERSION;
+    uint32_t i;
+
+    hash = MpmCacheHashUpdate(hash, &version, sizeof(version));
+    hash = MpmCacheHashUpdate(hash, PROG_VER, strlen(PROG_VER));
+    hash = MpmCacheHashUpdate(hash, matcher, strlen(matcher));
+
+    for (i = 0; i < keys->cnt; i++) {
+        MpmCacheKey ck;
+        MpmCacheKeySet(&ck, &keys->keys[i]);
+        hash = MpmCacheHashUpdate(hash, &ck, sizeof(ck));
+        hash = MpmCacheHashUpdate(hash, keys->keys[i].pat, keys->keys[i].patlen);
+    }
+    return hash;
+}
+
+static int MpmCacheFileName(const char *dir, const char *matcher, uint64_t hash,
+                            char *path, size_t size)
+{
+    int r = snprintf(path, size, "%s/%s-%016"PRIx64".mpm", dir, matcher, hash);
+    if (r < 0 || (size_t)r >= size)
+        return -1;
+    return 0;
+}
+
+/**
+ * \brief Pad the file with zeros up to the next multiple of align, so a
+ *        matcher can put its tables at an offset it can map directly.
+ *
+ * \retval 0 on success, -1 on write error
+ */
+int MpmCacheWritePad(FILE *fp, size_t align)
+{
+    long pos = ftell(fp);
+    if (pos < 0)
+        return -1;
+
+    size_t pad = (align - ((size_t)pos % align)) % align;
+    for ( ; pad > 0; pad--) {
+        if (fputc(0, fp) == EOF)
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ * \brief Check the header and the keys of a mapped cache file.
+ *
+ * \param off set to the offset of the matcher payload
+ *
+ * \retval 0 if the file was built from exactly these keys, -1 otherwise
+ */
+static int MpmCacheValidate(const uint8_t *map, size_t map_len, const char *matcher,
+                            uint64_t hash, const MpmCtx *mpm_ctx,
+                            const MpmPatternKeyList *keys, size_t *off)
+{
+    const MpmCacheHeader *hdr = (const MpmCacheHeader *)map;
+    uint32_t i;
+
+    if (map_len < sizeof(MpmCacheHeader))
+        return -1;
+    if (memcmp(hdr->magic, MPM_CACHE_MAGIC, sizeof(MPM_CACHE_MAGIC)) != 0 ||
+        hdr->version != MPM_CACHE_VERSION ||
+        hdr->byte_order != MPM_CACHE_BYTE_ORDER ||
+        hdr->hash != hash ||
+        strncmp(hdr->prog_version, PROG_VER, sizeof(hdr->prog_version)) != 0 ||
+        strncmp(hdr->matcher, matcher, sizeof(hdr->matcher)) != 0)
+        return -1;
+    if (hdr->keys_cnt != keys->cnt || hdr->pattern_cnt != mpm_ctx->pattern_cnt ||
+        hdr->minlen != mpm_ctx->minlen || hdr->maxlen != mpm_ctx->maxlen)
+        return -1;
+    if (hdr->keys_len > map_len - sizeof(MpmCacheHeader))
+        return -1;
+
+    const uint8_t *p = map + sizeof(MpmCacheHeader);
+    const uint8_t *end = p + hdr->keys_len;
+    for (i = 0; i < keys->cnt; i++) {
+        MpmCacheKey ck, want;
+
+        if ((size_t)(end - p) < sizeof(ck))
+            return -1;
+        memcpy(&ck, p, sizeof(ck));
+        p += sizeof(ck);
+
+        MpmCacheKeySet(&want, &keys->keys[i]);
+        if (memcmp(&ck, &want, sizeof(ck)) != 0)
+            return -1;
+        if ((size_t)(end - p) < ck.patlen ||
+            memcmp(p, keys->keys[i].pat, ck.patlen) != 0)
+            return -1;
+        p += ck.patlen;
+    }
+    if (p != end)
+        return -1;
+
+    *off = sizeof(MpmCacheHeader) + hdr->keys_len;
+    return 0;
+}
+
+/**
+ * \brief Set up a ctx from the cache instead of preparing it.
+ *
+ * \param dir     cache directory
+ * \param mpm_ctx ctx with all patterns added, but not prepared
+ * \param keys    keys of the patterns added to the ctx, normalized here
+ *
+ * \retval 0 if the ctx was loaded, -1 if it still needs to be prepared
+ */
+int MpmCacheLoad(const char *dir, MpmCtx *mpm_ctx, MpmPatternKeyList *keys)
+{
+    MpmTableElmt *m = &mpm_table[mpm_ctx->mpm_type];
+    char path[PATH_MAX];
+    struct stat st;
+    size_t off = 0;
+
+    if (m->CacheLoad == NULL || keys == NULL || keys->cnt == 0)
+        return -1;
+
+    MpmPatternKeyListNormalize(keys);
+    uint64_t hash = MpmCacheHash(m->name, keys);
+    if (MpmCacheFileName(dir, m->name, hash, path, sizeof(path)) != 0)
+        return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(MpmCacheHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    size_t map_len = (size_t)st.st_size;
+    uint8_t *map = mmap(NULL, map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return -1;
+
+    if (MpmCacheValidate(map, map_len, m->name, hash, mpm_ctx, keys, &off) != 0) {
+        SCLogDebug("ignoring stale mpm cache file %s", path);
+        munmap(map, map_len);
+        return -1;
+    }
+
+    /* on success the matcher owns the map */
+    if (m->CacheLoad(mpm_ctx, map, map_len, off) != 0) {
+        SCLogDebug("loading mpm cache file %s failed", path);
+        munmap(map, map_len);
+        return -1;
+    }
+
+    SCLogDebug("mpm ctx %p loaded from %s", mpm_ctx, path);
+    return 0;
+}
+
+/**
+ * \brief Write a prepared ctx to the cache.
+ *
+ * \param dir     cache directory
+ * \param mpm_ctx prepared ctx
+ * \param keys    keys of the patterns the ctx was prepared with
+ *
+ * \retval 0 on success, -1 if the ctx wasn't written
+ */
+int MpmCacheSave(const char *dir, MpmCtx *mpm_ctx, MpmPatternKeyList *keys)
+{
+    MpmTableElmt *m = &mpm_table[mpm_ctx->mpm_type];
+    char path[PATH_MAX];
+    char tmp[PATH_MAX];
+    MpmCacheHeader hdr;
+    uint32_t i;
+
+    if (m->CacheSave == NULL || keys == NULL || keys->cnt == 0)
+        return -1;
+
+    MpmPatternKeyListNormalize(keys);
+    uint64_t hash = MpmCacheHash(m->name, keys);
+    if (MpmCacheFileName(dir, m->name, hash, path, sizeof(path)) != 0)
+        return -1;
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp.XXXXXX", path) >= (int)sizeof(tmp))
+        return -1;
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        SCLogDebug("can't create %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+    FILE *fp = fdopen(fd, "w");
+    if (fp == NULL) {
+        close(fd);
+        unlink(tmp);
+        return -1;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, MPM_CACHE_MAGIC, sizeof(MPM_CACHE_MAGIC));
+    hdr.version = MPM_CACHE_VERSION;
+    hdr.byte_order = MPM_CACHE_BYTE_ORDER;
+    strlcpy(hdr.prog_version, PROG_VER, sizeof(hdr.prog_version));
+    strlcpy(hdr.matcher, m->name, sizeof(hdr.matcher));
+    hdr.hash = hash;
+    hdr.keys_cnt = keys->cnt;
+    hdr.pattern_cnt = mpm_ctx->pattern_cnt;
+    hdr.minlen = mpm_ctx->minlen;
+    hdr.maxlen = mpm_ctx->maxlen;
+    for (i = 0; i < keys->cnt; i++)
+        hdr.keys_len += sizeof(MpmCacheKey) + keys->keys[i].patlen;
+
+    int r = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1) ? 0 : -1;
+    for (i = 0; r == 0 && i < keys->cnt; i++) {
+        MpmCacheKey ck;
+        MpmCacheKeySet(&ck, &keys->keys[i]);
+        if (fwrite(&ck, sizeof(ck), 1, fp) != 1 ||
+            fwrite(keys->keys[i].pat, 1, ck.patlen, fp) != ck.patlen)
+            r = -1;
+    }
+    if (r == 0)
+        r = m->CacheSave(mpm_ctx, fp);
+    if (fclose(fp) != 0)
+        r = -1;
+
+    if (r != 0 || rename(tmp, path) != 0) {
+        SCLogDebug("writing mpm cache file %s failed", path);
+        unlink(tmp);
+        return -1;
+    }
+
+    SCLogDebug("mpm ctx %p written to %s", mpm_ctx, path);
+    return 0;
+}
@@ -0,0 +1,59 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * On disk cache of prepared mpm ctxs.
+ */
+
+#ifndef __UTIL_MPM_CACHE__H__
+#define __UTIL_MPM_CACHE__H__
+
+#include "util-mpm.h"
+
+/** bump when the layout of the file or of a matcher's payload changes */
+#define MPM_CACHE_VERSION   1
+
+#define MPM_CACHE_MAGIC     "SCMPMCH"
+/** files are only valid on hosts with the same byte order */
+#define MPM_CACHE_BYTE_ORDER 0x01020304
+
+typedef struct MpmCacheHeader_ {
+    char magic[8];
+    uint32_t version;
+    /** MPM_CACHE_BYTE_ORDER as written by the host that created the file */
+    uint32_t byte_order;
+    char prog_version[16];
+    char matcher[16];
+    uint64_t hash;
+
+    uint32_t keys_cnt;
+    uint32_t pattern_cnt;
+    uint16_t minlen;
+    uint16_t maxlen;
+    uint32_t pad;
+
+    /** bytes of key records following the header */
+    uint64_t keys_len;
+} MpmCacheHeader;
+
+int MpmCacheLoad(const char *, MpmCtx *, MpmPatternKeyList *);
+int MpmCacheSave(const char *, MpmCtx *, MpmPatternKeyList *);
+int MpmCacheWritePad(FILE *, size_t);
+
+#endif /* __UTIL_MPM_CACHE__H__ */
@@ -0,0 +1,1335 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Vectorized literal matcher modelled after the Teddy and FDR matchers of
+ * Intel's Hyperscan.
+ *
+ * Patterns are split in two sets:
+ *
+ * - Teddy: patterns of 1-3 bytes, or all patterns if the set is small.
+ *   The first (up to) 3 bytes of each pattern are put in one of 8 buckets.
+ *   For each position there is a 16 byte mask for the low and for the high
+ *   nibble of the input byte. PSHUFB looks these up for 16 (SSSE3) or 32
+ *   (AVX2) input bytes at once; ANDing the results for the positions gives
+ *   per input byte the buckets that may have a pattern starting there.
+ *
+ * - FDR: the other patterns. Shift-or over a 64 bit state, 8 buckets times
+ *   the last (up to) 8 bytes of the patterns. The reach table is indexed by
+ *   the input byte and the low nibble of the byte before it, which cuts the
+ *   false positive rate a lot compared to single bytes while keeping the
+ *   table at 32k.
+ *
+ * Both are prefilters: candidates are confirmed against the patterns in
+ * the buckets that fired. Case insensitive patterns put both cases in the
+ * masks, so the input is never converted.
+ *
+ * The SIMD Teddy versions are built through target attributes and picked
+ * at runtime, falling back to a table driven scalar version.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "detect.h"
+#include "detect-parse.h"
+#include "detect-engine.h"
+#include "util-mpm-teddy.h"
+
+#include "conf.h"
+#include "util-cpu.h"
+#include "util-debug.h"
+#include "util-unittest.h"
+#include "util-unittest-helper.h"
+#include "util-memcmp.h"
+#include "util-memcpy.h"
+#include "util-mpm-ac.h"
+
+#ifdef UTIL_CPU_TARGET_ATTR
+#include <immintrin.h>
+#endif
+
+void SCTeddyInitCtx(MpmCtx *);
+void SCTeddyInitThreadCtx(MpmCtx *, MpmThreadCtx *, uint32_t);
+void SCTeddyDestroyCtx(MpmCtx *);
+void SCTeddyDestroyThreadCtx(MpmCtx *, MpmThreadCtx *);
+int SCTeddyAddPatternCI(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, uint32_t, uint8_t);
+int SCTeddyAddPatternCS(MpmCtx *, uint8_t *, uint16_t, uint16_t, uint16_t,
+                        uint32_t, uint32_t, uint8_t);
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx);
+uint32_t SCTeddySearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen);
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx);
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx);
+void SCTeddyRegisterTests(void);
+
+/* size of the hash table used to speed up pattern insertions initially */
+#define INIT_HASH_SIZE 65536
+
+/** sets up to this size are handled by Teddy only */
+#define SC_TEDDY_SMALL_SET 32
+/** in larger sets, patterns up to this length go to Teddy */
+#define SC_TEDDY_SHORT_MAXLEN 3
+
+typedef uint32_t (*SCTeddyScanFunc)(const SCTeddyCtx *, PatternMatcherQueue *,
+        const uint8_t *, uint16_t);
+
+static uint32_t SCTeddyScanScalar(const SCTeddyCtx *, PatternMatcherQueue *,
+        const uint8_t *, uint16_t);
+
+/** Teddy implementation to use, set by MpmTeddyRegister() */
+static SCTeddyScanFunc SCTeddyScan = SCTeddyScanScalar;
+
+static inline uint32_t SCTeddyInitHashRaw(uint8_t *pat, uint16_t patlen)
+{
+    uint32_t hash = patlen * pat[0];
+    if (patlen > 1)
+        hash += pat[1];
+
+    return (hash % INIT_HASH_SIZE);
+}
+
+static inline SCTeddyPattern *SCTeddyInitHashLookup(SCTeddyCtx *ctx, uint8_t *pat,
+                                                    uint16_t patlen, uint32_t pid)
+{
+    uint32_t hash = SCTeddyInitHashRaw(pat, patlen);
+
+    if (ctx->init_hash == NULL) {
+        return NULL;
+    }
+
+    SCTeddyPattern *t = ctx->init_hash[hash];
+    for ( ; t != NULL; t = t->next) {
+        if (t->id == pid)
+            return t;
+    }
+
+    return NULL;
+}
+
+static inline void SCTeddyFreePattern(MpmCtx *mpm_ctx, SCTeddyPattern *p)
+{
+    if (p == NULL)
+        return;
+
+    if (p->ci != NULL) {
+        SCFree(p->ci);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    if (p->original_pat != NULL) {
+        SCFree(p->original_pat);
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= p->len;
+    }
+
+    SCFree(p);
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCTeddyPattern);
+}
+
+/**
+ * \internal
+ * \brief Add a pattern to the teddy context.
+ *
+ * \param mpm_ctx Mpm context.
+ * \param pat     Pointer to the pattern.
+ * \param patlen  Length of the pattern.
+ * \param pid     Pattern id
+ * \param sid     Signature id (internal id).
+ * \param flags   Pattern's MPM_PATTERN_* flags.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+static int SCTeddyAddPattern(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                             uint16_t offset, uint16_t depth, uint32_t pid,
+                             uint32_t sid, uint8_t flags)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    SCLogDebug("Adding pattern for ctx %p, patlen %"PRIu16" and pid %" PRIu32,
+               ctx, patlen, pid);
+
+    if (patlen == 0) {
+        SCLogWarning(SC_ERR_INVALID_ARGUMENTS, "pattern length 0");
+        return 0;
+    }
+
+    /* check if we have already inserted this pattern */
+    if (SCTeddyInitHashLookup(ctx, pat, patlen, pid) != NULL)
+        return 0;
+
+    SCTeddyPattern *p = SCMalloc(sizeof(SCTeddyPattern));
+    if (unlikely(p == NULL))
+        return -1;
+    memset(p, 0, sizeof(SCTeddyPattern));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCTeddyPattern);
+
+    p->len = patlen;
+    p->flags = flags;
+    p->id = pid;
+
+    p->original_pat = SCMalloc(patlen);
+    if (p->original_pat == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += patlen;
+    memcpy(p->original_pat, pat, patlen);
+
+    p->ci = SCMalloc(patlen);
+    if (p->ci == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += patlen;
+    memcpy_tolower(p->ci, pat, patlen);
+
+    /* put in the pattern hash */
+    uint32_t hash = SCTeddyInitHashRaw(pat, patlen);
+    p->next = ctx->init_hash[hash];
+    ctx->init_hash[hash] = p;
+
+    mpm_ctx->pattern_cnt++;
+
+    if (mpm_ctx->maxlen < patlen)
+        mpm_ctx->maxlen = patlen;
+
+    if (mpm_ctx->minlen == 0) {
+        mpm_ctx->minlen = patlen;
+    } else {
+        if (mpm_ctx->minlen > patlen)
+            mpm_ctx->minlen = patlen;
+    }
+
+    return 0;
+
+error:
+    SCTeddyFreePattern(mpm_ctx, p);
+    return -1;
+}
+
+/**
+ * \internal
+ * \brief Add the pattern id to the pmq, once.
+ */
+static inline void SCTeddyMatch(PatternMatcherQueue *pmq, uint32_t pid)
+{
+    if (!(pmq->pattern_id_bitarray[pid / 8] & (1 << (pid % 8)))) {
+        pmq->pattern_id_bitarray[pid / 8] |= (1 << (pid % 8));
+        pmq->pattern_id_array[pmq->pattern_id_array_cnt++] = pid;
+    }
+}
+
+/**
+ * \internal
+ * \brief Check a candidate.
+ *
+ * \retval 1 pattern p is at buf
+ * \retval 0 it's not
+ */
+static inline int SCTeddyVerify(const SCTeddyPattern *p, const uint8_t *buf)
+{
+    if (p->flags & MPM_PATTERN_FLAG_NOCASE)
+        return (SCMemcmpLowercase(p->ci, buf, p->len) == 0);
+
+    return (SCMemcmp(p->original_pat, buf, p->len) == 0);
+}
+
+/**
+ * \internal
+ * \brief Confirm the Teddy candidates starting at pos.
+ *
+ * \param buckets bitmask of the buckets that may match
+ */
+static inline uint32_t SCTeddyConfirm(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen, uint32_t pos, uint32_t buckets)
+{
+    uint32_t matches = 0;
+
+    while (buckets) {
+        uint32_t b = (uint32_t)__builtin_ctz(buckets);
+        uint32_t k;
+
+        buckets &= buckets - 1;
+        for (k = ctx->short_bucket[b]; k < ctx->short_bucket[b + 1]; k++) {
+            const SCTeddyPattern *p = ctx->short_array[k];
+            if (pos + p->len > buflen)
+                continue;
+            if (SCTeddyVerify(p, buf + pos)) {
+                SCTeddyMatch(pmq, p->id);
+                matches++;
+            }
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \internal
+ * \brief Table driven Teddy, also handles the tail of the SIMD versions.
+ *
+ * \param i position to start at
+ */
+static uint32_t SCTeddyScanFrom(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen, uint32_t i)
+{
+    const uint32_t m = ctx->short_m;
+    uint32_t matches = 0;
+
+    for ( ; i + m <= buflen; i++) {
+        uint32_t r = ctx->short_byte[0][buf[i]];
+        if (likely(r == 0))
+            continue;
+        if (m > 1) {
+            r &= ctx->short_byte[1][buf[i + 1]];
+            if (m > 2)
+                r &= ctx->short_byte[2][buf[i + 2]];
+        }
+        if (r != 0)
+            matches += SCTeddyConfirm(ctx, pmq, buf, buflen, i, r);
+    }
+
+    return matches;
+}
+
+static uint32_t SCTeddyScanScalar(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen)
+{
+    return SCTeddyScanFrom(ctx, pmq, buf, buflen, 0);
+}
+
+#ifdef UTIL_CPU_TARGET_ATTR
+/**
+ * \internal
+ * \brief Look up the bucket masks for 16 input bytes.
+ */
+__attribute__((target("ssse3")))
+static inline __m128i SCTeddyShuffle128(const uint8_t *buf, __m128i lo, __m128i hi,
+        __m128i nib)
+{
+    __m128i v = _mm_loadu_si128((const __m128i *)buf);
+    return _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(v, nib)),
+            _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nib)));
+}
+
+__attribute__((target("ssse3")))
+static uint32_t SCTeddyScanSSSE3(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen)
+{
+    const uint32_t m = ctx->short_m;
+    const __m128i nib = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo0 = _mm_load_si128((const __m128i *)ctx->short_lo[0]);
+    const __m128i hi0 = _mm_load_si128((const __m128i *)ctx->short_hi[0]);
+    const __m128i lo1 = _mm_load_si128((const __m128i *)ctx->short_lo[1]);
+    const __m128i hi1 = _mm_load_si128((const __m128i *)ctx->short_hi[1]);
+    const __m128i lo2 = _mm_load_si128((const __m128i *)ctx->short_lo[2]);
+    const __m128i hi2 = _mm_load_si128((const __m128i *)ctx->short_hi[2]);
+    uint8_t res[16] __attribute__((aligned(16)));
+    uint32_t matches = 0;
+    uint32_t i = 0;
+
+    /* the load for the last position reads up to i + 15 + m - 1 */
+    for ( ; i + 16 + m - 1 <= buflen; i += 16) {
+        __m128i r = SCTeddyShuffle128(buf + i, lo0, hi0, nib);
+        if (m > 1) {
+            r = _mm_and_si128(r, SCTeddyShuffle128(buf + i + 1, lo1, hi1, nib));
+            if (m > 2)
+                r = _mm_and_si128(r, SCTeddyShuffle128(buf + i + 2, lo2, hi2, nib));
+        }
+
+        uint32_t bm = ~(uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(r, zero)) & 0xffff;
+        if (likely(bm == 0))
+            continue;
+
+        _mm_store_si128((__m128i *)res, r);
+        while (bm) {
+            uint32_t k = (uint32_t)__builtin_ctz(bm);
+            bm &= bm - 1;
+            matches += SCTeddyConfirm(ctx, pmq, buf, buflen, i + k, res[k]);
+        }
+    }
+
+    return matches + SCTeddyScanFrom(ctx, pmq, buf, buflen, i);
+}
+
+/**
+ * \internal
+ * \brief Look up the bucket masks for 32 input bytes. PSHUFB works per
+ *        128 bit lane, so the masks are in both lanes.
+ */
+__attribute__((target("avx2")))
+static inline __m256i SCTeddyShuffle256(const uint8_t *buf, __m256i lo, __m256i hi,
+        __m256i nib)
+{
+    __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+    return _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(v, nib)),
+            _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)));
+}
+
+__attribute__((target("avx2")))
+static uint32_t SCTeddyScanAVX2(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen)
+{
+    const uint32_t m = ctx->short_m;
+    const __m256i nib = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lo0 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_lo[0]));
+    const __m256i hi0 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_hi[0]));
+    const __m256i lo1 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_lo[1]));
+    const __m256i hi1 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_hi[1]));
+    const __m256i lo2 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_lo[2]));
+    const __m256i hi2 = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)ctx->short_hi[2]));
+    uint8_t res[32] __attribute__((aligned(32)));
+    uint32_t matches = 0;
+    uint32_t i = 0;
+
+    for ( ; i + 32 + m - 1 <= buflen; i += 32) {
+        __m256i r = SCTeddyShuffle256(buf + i, lo0, hi0, nib);
+        if (m > 1) {
+            r = _mm256_and_si256(r, SCTeddyShuffle256(buf + i + 1, lo1, hi1, nib));
+            if (m > 2)
+                r = _mm256_and_si256(r, SCTeddyShuffle256(buf + i + 2, lo2, hi2, nib));
+        }
+
+        uint32_t bm = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(r, zero));
+        if (likely(bm == 0))
+            continue;
+
+        _mm256_store_si256((__m256i *)res, r);
+        while (bm) {
+            uint32_t k = (uint32_t)__builtin_ctz(bm);
+            bm &= bm - 1;
+            matches += SCTeddyConfirm(ctx, pmq, buf, buflen, i + k, res[k]);
+        }
+    }
+
+    return matches + SCTeddyScanFrom(ctx, pmq, buf, buflen, i);
+}
+#endif /* UTIL_CPU_TARGET_ATTR */
+
+/** \internal \brief FDR confirm key, the lowercased last 4 bytes */
+static inline uint32_t SCTeddyFdrKey(const uint8_t *s)
+{
+    return ((uint32_t)u8_tolower(s[0]) << 24) | ((uint32_t)u8_tolower(s[1]) << 16) |
+           ((uint32_t)u8_tolower(s[2]) << 8) | (uint32_t)u8_tolower(s[3]);
+}
+
+static inline uint32_t SCTeddyFdrHash(const SCTeddyCtx *ctx, uint32_t key)
+{
+    return ((key * 2654435761U) >> 16) & ctx->fdr_hash_mask;
+}
+
+/**
+ * \internal
+ * \brief Confirm the FDR candidates ending at end.
+ */
+static uint32_t SCTeddyFdrConfirm(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint32_t end)
+{
+    /* the window is at least 4 bytes, so end >= 3 */
+    uint32_t key = SCTeddyFdrKey(buf + end - 3);
+    const SCTeddyPattern *p = ctx->fdr_hash[SCTeddyFdrHash(ctx, key)];
+    uint32_t matches = 0;
+
+    for ( ; p != NULL; p = p->next) {
+        if (p->key != key || p->len > end + 1)
+            continue;
+        if (SCTeddyVerify(p, buf + end + 1 - p->len)) {
+            SCTeddyMatch(pmq, p->id);
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+/**
+ * \internal
+ * \brief FDR style shift-or scan.
+ *
+ * State bit (pos * 8 + bucket) is cleared while the input seen so far can
+ * be the first pos + 1 window bytes of a pattern in that bucket. So after
+ * window size bytes, the top used byte holds the candidate buckets.
+ */
+static uint32_t SCTeddyFdrScan(const SCTeddyCtx *ctx, PatternMatcherQueue *pmq,
+        const uint8_t *buf, uint16_t buflen)
+{
+    const uint64_t *reach = ctx->fdr_reach;
+    const uint32_t shift = 8 * (ctx->fdr_window - 1);
+    uint64_t state = ~0ULL;
+    uint32_t prev = 0;
+    uint32_t matches = 0;
+    uint32_t i;
+
+    for (i = 0; i < buflen; i++) {
+        uint32_t c = buf[i];
+        state = (state << 8) | reach[((prev & 0x0f) << 8) | c];
+        prev = c;
+        if (unlikely(((~state) >> shift) & 0xff))
+            matches += SCTeddyFdrConfirm(ctx, pmq, buf, i);
+    }
+
+    return matches;
+}
+
+/** \internal \brief sort on the pattern, Teddy looks at the start */
+static int SCTeddyPatternCmpPrefix(const void *a, const void *b)
+{
+    const SCTeddyPattern *p1 = *(SCTeddyPattern * const *)a;
+    const SCTeddyPattern *p2 = *(SCTeddyPattern * const *)b;
+    int r = memcmp(p1->ci, p2->ci, p1->len < p2->len ? p1->len : p2->len);
+
+    if (r != 0)
+        return r;
+    return (int)p1->len - (int)p2->len;
+}
+
+/** \internal \brief sort on the reversed pattern, FDR looks at the end */
+static int SCTeddyPatternCmpSuffix(const void *a, const void *b)
+{
+    const SCTeddyPattern *p1 = *(SCTeddyPattern * const *)a;
+    const SCTeddyPattern *p2 = *(SCTeddyPattern * const *)b;
+    uint16_t i;
+
+    for (i = 1; i <= p1->len && i <= p2->len; i++) {
+        int r = (int)p1->ci[p1->len - i] - (int)p2->ci[p2->len - i];
+        if (r != 0)
+            return r;
+    }
+    return (int)p1->len - (int)p2->len;
+}
+
+/**
+ * \internal
+ * \brief Assign sorted patterns to buckets so that similar patterns share
+ *        a bucket, which keeps the bucket masks tight.
+ */
+static inline uint8_t SCTeddyBucket(uint32_t idx, uint32_t cnt)
+{
+    return (uint8_t)(((uint64_t)idx * SC_TEDDY_BUCKETS) / cnt);
+}
+
+static void SCTeddyShortSet(SCTeddyCtx *ctx, uint32_t pos, uint8_t c, uint8_t bucket)
+{
+    ctx->short_lo[pos][c & 0x0f] |= (1 << bucket);
+    ctx->short_hi[pos][c >> 4] |= (1 << bucket);
+    ctx->short_byte[pos][c] |= (1 << bucket);
+}
+
+static int SCTeddyPrepareShort(MpmCtx *mpm_ctx, SCTeddyCtx *ctx)
+{
+    uint32_t k, j;
+
+    qsort(ctx->short_array, ctx->short_cnt, sizeof(SCTeddyPattern *),
+          SCTeddyPatternCmpPrefix);
+
+    ctx->short_m = SC_TEDDY_MAX_M;
+    for (k = 0; k < ctx->short_cnt; k++) {
+        if (ctx->short_array[k]->len < ctx->short_m)
+            ctx->short_m = ctx->short_array[k]->len;
+    }
+
+    memset(ctx->short_bucket, 0, sizeof(ctx->short_bucket));
+    for (k = 0; k < ctx->short_cnt; k++) {
+        SCTeddyPattern *p = ctx->short_array[k];
+
+        p->bucket = SCTeddyBucket(k, ctx->short_cnt);
+        ctx->short_bucket[p->bucket + 1] = k + 1;
+
+        for (j = 0; j < ctx->short_m; j++) {
+            if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                SCTeddyShortSet(ctx, j, p->ci[j], p->bucket);
+                SCTeddyShortSet(ctx, j, toupper(p->ci[j]), p->bucket);
+            } else {
+                SCTeddyShortSet(ctx, j, p->original_pat[j], p->bucket);
+            }
+        }
+    }
+    /* empty buckets end where the previous one ended */
+    for (k = 1; k <= SC_TEDDY_BUCKETS; k++) {
+        if (ctx->short_bucket[k] < ctx->short_bucket[k - 1])
+            ctx->short_bucket[k] = ctx->short_bucket[k - 1];
+    }
+
+    SCLogDebug("teddy: %"PRIu32" patterns, %"PRIu8" byte masks",
+               ctx->short_cnt, ctx->short_m);
+    return 0;
+}
+
+static int SCTeddyPrepareFdr(MpmCtx *mpm_ctx, SCTeddyCtx *ctx,
+                             SCTeddyPattern **fdr_array)
+{
+    uint32_t k, j, n, hash_size;
+
+    qsort(fdr_array, ctx->fdr_cnt, sizeof(SCTeddyPattern *),
+          SCTeddyPatternCmpSuffix);
+
+    ctx->fdr_window = SC_TEDDY_FDR_MAX_WINDOW;
+    for (k = 0; k < ctx->fdr_cnt; k++) {
+        if (fdr_array[k]->len < ctx->fdr_window)
+            ctx->fdr_window = fdr_array[k]->len;
+    }
+    BUG_ON(ctx->fdr_window < 4);
+
+    ctx->fdr_reach = SCMalloc(SC_TEDDY_FDR_DOMAIN * sizeof(uint64_t));
+    if (ctx->fdr_reach == NULL)
+        return -1;
+    memset(ctx->fdr_reach, 0xff, SC_TEDDY_FDR_DOMAIN * sizeof(uint64_t));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += SC_TEDDY_FDR_DOMAIN * sizeof(uint64_t);
+
+    hash_size = 256;
+    while (hash_size < 2 * ctx->fdr_cnt && hash_size < 65536)
+        hash_size <<= 1;
+    ctx->fdr_hash = SCMalloc(hash_size * sizeof(SCTeddyPattern *));
+    if (ctx->fdr_hash == NULL)
+        return -1;
+    memset(ctx->fdr_hash, 0, hash_size * sizeof(SCTeddyPattern *));
+    ctx->fdr_hash_mask = hash_size - 1;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += hash_size * sizeof(SCTeddyPattern *);
+
+    for (k = 0; k < ctx->fdr_cnt; k++) {
+        SCTeddyPattern *p = fdr_array[k];
+
+        p->bucket = SCTeddyBucket(k, ctx->fdr_cnt);
+
+        for (j = 0; j < ctx->fdr_window; j++) {
+            uint32_t q = p->len - ctx->fdr_window + j;
+            uint64_t bit = ~(1ULL << (j * 8 + p->bucket));
+            uint8_t cur[2];
+            uint32_t ncur = 1;
+
+            if (p->flags & MPM_PATTERN_FLAG_NOCASE) {
+                cur[0] = p->ci[q];
+                cur[1] = toupper(p->ci[q]);
+                if (cur[1] != cur[0])
+                    ncur = 2;
+            } else {
+                cur[0] = p->original_pat[q];
+            }
+
+            /* the low nibble is the same for both cases, if there is no
+             * byte before the window any nibble will do */
+            for (n = 0; n < 16; n++) {
+                if (q > 0 && n != (uint32_t)(p->ci[q - 1] & 0x0f))
+                    continue;
+                ctx->fdr_reach[(n << 8) | cur[0]] &= bit;
+                if (ncur == 2)
+                    ctx->fdr_reach[(n << 8) | cur[1]] &= bit;
+            }
+        }
+
+        p->key = SCTeddyFdrKey(p->ci + p->len - 4);
+        uint32_t h = SCTeddyFdrHash(ctx, p->key);
+        p->next = ctx->fdr_hash[h];
+        ctx->fdr_hash[h] = p;
+    }
+
+    SCLogDebug("fdr: %"PRIu32" patterns, window %"PRIu8", hash size %"PRIu32,
+               ctx->fdr_cnt, ctx->fdr_window, hash_size);
+    return 0;
+}
+
+/**
+ * \brief Process the patterns added to the mpm, and create the internal tables.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+int SCTeddyPreparePatterns(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    SCTeddyPattern **fdr_array = NULL;
+    uint32_t i, p = 0;
+
+    if (mpm_ctx->pattern_cnt == 0 || ctx->init_hash == NULL) {
+        SCLogDebug("no patterns supplied to this mpm_ctx");
+        return 0;
+    }
+
+    /* alloc the pattern array */
+    ctx->parray = (SCTeddyPattern **)SCMalloc(mpm_ctx->pattern_cnt *
+                                              sizeof(SCTeddyPattern *));
+    if (ctx->parray == NULL)
+        goto error;
+    memset(ctx->parray, 0, mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+
+    /* populate it with the patterns in the hash */
+    for (i = 0; i < INIT_HASH_SIZE; i++) {
+        SCTeddyPattern *node = ctx->init_hash[i], *nnode = NULL;
+        while (node != NULL) {
+            nnode = node->next;
+            node->next = NULL;
+            ctx->parray[p++] = node;
+            node = nnode;
+        }
+    }
+
+    /* we no longer need the hash, so free it's memory */
+    SCFree(ctx->init_hash);
+    ctx->init_hash = NULL;
+
+    ctx->short_array = SCMalloc(mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    fdr_array = SCMalloc(mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    if (ctx->short_array == NULL || fdr_array == NULL)
+        goto error;
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += (mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+
+    /* Teddy does best on few patterns, FDR needs 4+ bytes for its window
+     * and confirm key */
+    for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+        if (mpm_ctx->pattern_cnt <= SC_TEDDY_SMALL_SET ||
+            ctx->parray[i]->len <= SC_TEDDY_SHORT_MAXLEN)
+            ctx->short_array[ctx->short_cnt++] = ctx->parray[i];
+        else
+            fdr_array[ctx->fdr_cnt++] = ctx->parray[i];
+    }
+
+    if (ctx->short_cnt > 0 && SCTeddyPrepareShort(mpm_ctx, ctx) < 0)
+        goto error;
+    if (ctx->fdr_cnt > 0 && SCTeddyPrepareFdr(mpm_ctx, ctx, fdr_array) < 0)
+        goto error;
+
+    SCFree(fdr_array);
+    return 0;
+
+error:
+    if (fdr_array != NULL)
+        SCFree(fdr_array);
+    return -1;
+}
+
+/**
+ * \brief Init the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param matchsize      We don't need this.
+ */
+void SCTeddyInitThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx, uint32_t matchsize)
+{
+    memset(mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+
+    mpm_thread_ctx->ctx = SCMalloc(sizeof(SCTeddyThreadCtx));
+    if (mpm_thread_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_thread_ctx->ctx, 0, sizeof(SCTeddyThreadCtx));
+    mpm_thread_ctx->memory_cnt++;
+    mpm_thread_ctx->memory_size += sizeof(SCTeddyThreadCtx);
+
+    return;
+}
+
+/**
+ * \brief Initialize the teddy context.
+ *
+ * \param mpm_ctx       Mpm context.
+ */
+void SCTeddyInitCtx(MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx->ctx != NULL)
+        return;
+
+    mpm_ctx->ctx = SCMallocAligned(sizeof(SCTeddyCtx), 16);
+    if (mpm_ctx->ctx == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(mpm_ctx->ctx, 0, sizeof(SCTeddyCtx));
+
+    mpm_ctx->memory_cnt++;
+    mpm_ctx->memory_size += sizeof(SCTeddyCtx);
+
+    /* initialize the hash we use to speed up pattern insertions */
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    ctx->init_hash = SCMalloc(sizeof(SCTeddyPattern *) * INIT_HASH_SIZE);
+    if (ctx->init_hash == NULL) {
+        exit(EXIT_FAILURE);
+    }
+    memset(ctx->init_hash, 0, sizeof(SCTeddyPattern *) * INIT_HASH_SIZE);
+
+    SCReturn;
+}
+
+/**
+ * \brief Destroy the mpm thread context.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ */
+void SCTeddyDestroyThreadCtx(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx)
+{
+    SCTeddyPrintSearchStats(mpm_thread_ctx);
+
+    if (mpm_thread_ctx->ctx != NULL) {
+        SCFree(mpm_thread_ctx->ctx);
+        mpm_thread_ctx->ctx = NULL;
+        mpm_thread_ctx->memory_cnt--;
+        mpm_thread_ctx->memory_size -= sizeof(SCTeddyThreadCtx);
+    }
+
+    return;
+}
+
+/**
+ * \brief Destroy the mpm context.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ */
+void SCTeddyDestroyCtx(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    uint32_t i;
+
+    if (ctx == NULL)
+        return;
+
+    /* patterns are either still in the hash, or in the array */
+    if (ctx->init_hash != NULL) {
+        for (i = 0; i < INIT_HASH_SIZE; i++) {
+            SCTeddyPattern *node = ctx->init_hash[i], *nnode = NULL;
+            while (node != NULL) {
+                nnode = node->next;
+                SCTeddyFreePattern(mpm_ctx, node);
+                node = nnode;
+            }
+        }
+        SCFree(ctx->init_hash);
+        ctx->init_hash = NULL;
+    }
+
+    if (ctx->parray != NULL) {
+        for (i = 0; i < mpm_ctx->pattern_cnt; i++) {
+            SCTeddyFreePattern(mpm_ctx, ctx->parray[i]);
+        }
+
+        SCFree(ctx->parray);
+        ctx->parray = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    }
+
+    if (ctx->short_array != NULL) {
+        SCFree(ctx->short_array);
+        ctx->short_array = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (mpm_ctx->pattern_cnt * sizeof(SCTeddyPattern *));
+    }
+
+    if (ctx->fdr_reach != NULL) {
+        SCFree(ctx->fdr_reach);
+        ctx->fdr_reach = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= SC_TEDDY_FDR_DOMAIN * sizeof(uint64_t);
+    }
+
+    if (ctx->fdr_hash != NULL) {
+        SCFree(ctx->fdr_hash);
+        ctx->fdr_hash = NULL;
+        mpm_ctx->memory_cnt--;
+        mpm_ctx->memory_size -= (ctx->fdr_hash_mask + 1) * sizeof(SCTeddyPattern *);
+    }
+
+    SCFreeAligned(mpm_ctx->ctx);
+    mpm_ctx->ctx = NULL;
+    mpm_ctx->memory_cnt--;
+    mpm_ctx->memory_size -= sizeof(SCTeddyCtx);
+
+    return;
+}
+
+/**
+ * \brief The teddy search function.
+ *
+ * \param mpm_ctx        Pointer to the mpm context.
+ * \param mpm_thread_ctx Pointer to the mpm thread context.
+ * \param pmq            Pointer to the Pattern Matcher Queue to hold
+ *                       search matches.
+ * \param buf            Buffer to be searched.
+ * \param buflen         Buffer length.
+ *
+ * \retval matches Match count.
+ */
+uint32_t SCTeddySearch(MpmCtx *mpm_ctx, MpmThreadCtx *mpm_thread_ctx,
+                       PatternMatcherQueue *pmq, uint8_t *buf, uint16_t buflen)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+    uint32_t matches = 0;
+
+    if (ctx->short_cnt > 0)
+        matches += SCTeddyScan(ctx, pmq, buf, buflen);
+    if (ctx->fdr_cnt > 0)
+        matches += SCTeddyFdrScan(ctx, pmq, buf, buflen);
+
+#ifdef SC_TEDDY_COUNTERS
+    SCTeddyThreadCtx *tctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+    tctx->total_calls++;
+    tctx->total_matches += matches;
+#endif
+    return matches;
+}
+
+/**
+ * \brief Add a case insensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCI(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        uint32_t sid, uint8_t flags)
+{
+    flags |= MPM_PATTERN_FLAG_NOCASE;
+    return SCTeddyAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+/**
+ * \brief Add a case sensitive pattern.
+ *
+ * \param mpm_ctx Pointer to the mpm context.
+ * \param pat     The pattern to add.
+ * \param patnen  The pattern length.
+ * \param offset  Ignored.
+ * \param depth   Ignored.
+ * \param pid     The pattern id.
+ * \param sid     Ignored.
+ * \param flags   Flags associated with this pattern.
+ *
+ * \retval  0 On success.
+ * \retval -1 On failure.
+ */
+int SCTeddyAddPatternCS(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                        uint16_t offset, uint16_t depth, uint32_t pid,
+                        uint32_t sid, uint8_t flags)
+{
+    return SCTeddyAddPattern(mpm_ctx, pat, patlen, offset, depth, pid, sid, flags);
+}
+
+void SCTeddyPrintSearchStats(MpmThreadCtx *mpm_thread_ctx)
+{
+
+#ifdef SC_TEDDY_COUNTERS
+    SCTeddyThreadCtx *ctx = (SCTeddyThreadCtx *)mpm_thread_ctx->ctx;
+    printf("Teddy Thread Search stats (ctx %p)\n", ctx);
+    printf("Total calls: %" PRIu32 "\n", ctx->total_calls);
+    printf("Total matches: %" PRIu64 "\n", ctx->total_matches);
+#endif /* SC_TEDDY_COUNTERS */
+
+    return;
+}
+
+void SCTeddyPrintInfo(MpmCtx *mpm_ctx)
+{
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx->ctx;
+
+    printf("MPM Teddy Information:\n");
+    printf("Memory allocs:   %" PRIu32 "\n", mpm_ctx->memory_cnt);
+    printf("Memory alloced:  %" PRIu32 "\n", mpm_ctx->memory_size);
+    printf(" Sizeof:\n");
+    printf("  MpmCtx         %" PRIuMAX "\n", (uintmax_t)sizeof(MpmCtx));
+    printf("  SCTeddyCtx:    %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyCtx));
+    printf("  SCTeddyPattern %" PRIuMAX "\n", (uintmax_t)sizeof(SCTeddyPattern));
+    printf("Unique Patterns: %" PRIu32 "\n", mpm_ctx->pattern_cnt);
+    printf("Smallest:        %" PRIu32 "\n", mpm_ctx->minlen);
+    printf("Largest:         %" PRIu32 "\n", mpm_ctx->maxlen);
+    printf("Teddy patterns:  %" PRIu32 " (%" PRIu8 " byte masks)\n",
+           ctx->short_cnt, ctx->short_m);
+    printf("FDR patterns:    %" PRIu32 " (window %" PRIu8 ")\n",
+           ctx->fdr_cnt, ctx->fdr_window);
+    printf("\n");
+
+    return;
+}
+
+/************************** Mpm Registration ***************************/
+
+/**
+ * \brief Register the teddy mpm.
+ */
+void MpmTeddyRegister(void)
+{
+    mpm_table[MPM_TEDDY].name = "teddy";
+    mpm_table[MPM_TEDDY].max_pattern_length = 0;
+
+    mpm_table[MPM_TEDDY].InitCtx = SCTeddyInitCtx;
+    mpm_table[MPM_TEDDY].InitThreadCtx = SCTeddyInitThreadCtx;
+    mpm_table[MPM_TEDDY].DestroyCtx = SCTeddyDestroyCtx;
+    mpm_table[MPM_TEDDY].DestroyThreadCtx = SCTeddyDestroyThreadCtx;
+    mpm_table[MPM_TEDDY].AddPattern = SCTeddyAddPatternCS;
+    mpm_table[MPM_TEDDY].AddPatternNocase = SCTeddyAddPatternCI;
+    mpm_table[MPM_TEDDY].Prepare = SCTeddyPreparePatterns;
+    mpm_table[MPM_TEDDY].Search = SCTeddySearch;
+    mpm_table[MPM_TEDDY].Cleanup = NULL;
+    mpm_table[MPM_TEDDY].PrintCtx = SCTeddyPrintInfo;
+    mpm_table[MPM_TEDDY].PrintThreadCtx = SCTeddyPrintSearchStats;
+    mpm_table[MPM_TEDDY].RegisterUnittests = SCTeddyRegisterTests;
+
+    SCTeddyScan = SCTeddyScanScalar;
+#ifdef UTIL_CPU_TARGET_ATTR
+    uint32_t features = UtilCpuGetFeatures();
+    if (features & UTIL_CPU_FEATURE_AVX2)
+        SCTeddyScan = SCTeddyScanAVX2;
+    else if (features & UTIL_CPU_FEATURE_SSSE3)
+        SCTeddyScan = SCTeddyScanSSSE3;
+#endif
+
+    return;
+}
+
+/*************************************Unittests********************************/
+
+#ifdef UNITTESTS
+
+/** \internal \brief get the Teddy versions the cpu can run
+ *  \retval number of versions in scans */
+static int SCTeddyTestScans(SCTeddyScanFunc *scans)
+{
+    int nscans = 0;
+
+    scans[nscans++] = SCTeddyScanScalar;
+#ifdef UTIL_CPU_TARGET_ATTR
+    if (UtilCpuGetFeatures() & UTIL_CPU_FEATURE_SSSE3)
+        scans[nscans++] = SCTeddyScanSSSE3;
+    if (UtilCpuGetFeatures() & UTIL_CPU_FEATURE_AVX2)
+        scans[nscans++] = SCTeddyScanAVX2;
+#endif
+    return nscans;
+}
+
+/** \test the ac matcher tests against each Teddy version */
+static int SCTeddyTest01(void)
+{
+    SCTeddyScanFunc scans[3];
+    SCTeddyScanFunc saved = SCTeddyScan;
+    int nscans = SCTeddyTestScans(scans);
+    int result = 1;
+    int f;
+
+    for (f = 0; f < nscans && result == 1; f++) {
+        SCTeddyScan = scans[f];
+        if (SCACRunMatcherTests(MPM_TEDDY) == 0) {
+            printf("scan %d: ", f);
+            result = 0;
+        }
+    }
+
+    SCTeddyScan = saved;
+    return result;
+}
+
+static int SCTeddyTest02(void)
+{
+    uint8_t *buf = (uint8_t *)"onetwothreefourfivesixseveneightnine";
+    uint16_t buflen = strlen((char *)buf);
+    Packet *p = NULL;
+    ThreadVars th_v;
+    DetectEngineThreadCtx *det_ctx = NULL;
+    int result = 0;
+
+    memset(&th_v, 0, sizeof(th_v));
+    p = UTHBuildPacket(buf, buflen, IPPROTO_TCP);
+
+    DetectEngineCtx *de_ctx = DetectEngineCtxInit();
+    if (de_ctx == NULL)
+        goto end;
+    de_ctx->mpm_matcher = MPM_TEDDY;
+
+    de_ctx->flags |= DE_QUIET;
+
+    de_ctx->sig_list = SigInit(de_ctx, "alert tcp any any -> any any "
+                               "(content:\"onetwothreefourfivesixseveneightnine\"; sid:1;)");
+    if (de_ctx->sig_list == NULL)
+        goto end;
+    de_ctx->sig_list->next = SigInit(de_ctx, "alert tcp any any -> any any "
+                               "(content:\"onetwothreefourfivesixseveneightnine\"; fast_pattern:3,3; sid:2;)");
+    if (de_ctx->sig_list->next == NULL)
+        goto end;
+
+    SigGroupBuild(de_ctx);
+    DetectEngineThreadCtxInit(&th_v, (void *)de_ctx, (void *)&det_ctx);
+
+    SigMatchSignatures(&th_v, de_ctx, det_ctx, p);
+    if (PacketAlertCheck(p, 1) != 1) {
+        printf("if (PacketAlertCheck(p, 1) != 1) failure\n");
+        goto end;
+    }
+    if (PacketAlertCheck(p, 2) != 1) {
+        printf("if (PacketAlertCheck(p, 1) != 2) failure\n");
+        goto end;
+    }
+
+    result = 1;
+end:
+    if (de_ctx != NULL) {
+        SigGroupCleanup(de_ctx);
+        SigCleanSignatures(de_ctx);
+
+        DetectEngineThreadCtxDeinit(&th_v, (void *)det_ctx);
+        DetectEngineCtxFree(de_ctx);
+    }
+
+    UTHFreePackets(&p, 1);
+    return result;
+}
+
+/** \internal \brief run ac and teddy over buf, compare the results */
+static int SCTeddyTestCompareAC(MpmCtx *ac_ctx, MpmThreadCtx *ac_tctx,
+        PatternMatcherQueue *ac_pmq, MpmCtx *teddy_ctx, MpmThreadCtx *teddy_tctx,
+        PatternMatcherQueue *teddy_pmq, uint8_t *buf, uint16_t buflen)
+{
+    PmqReset(ac_pmq);
+    PmqReset(teddy_pmq);
+
+    uint32_t ac_cnt = mpm_table[MPM_AC].Search(ac_ctx, ac_tctx, ac_pmq, buf, buflen);
+    uint32_t teddy_cnt = SCTeddySearch(teddy_ctx, teddy_tctx, teddy_pmq, buf, buflen);
+
+    if (ac_cnt != teddy_cnt) {
+        printf("buflen %u: ac %"PRIu32" != teddy %"PRIu32" matches: ",
+               buflen, ac_cnt, teddy_cnt);
+        return 0;
+    }
+    if (ac_pmq->pattern_id_array_cnt != teddy_pmq->pattern_id_array_cnt ||
+        memcmp(ac_pmq->pattern_id_bitarray, teddy_pmq->pattern_id_bitarray,
+               ac_pmq->pattern_id_bitarray_size) != 0) {
+        printf("buflen %u: ac and teddy matched different patterns: ", buflen);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * \test Compare against ac with random patterns, for a small set (Teddy
+ *       only) and a large one (Teddy + FDR), using each Teddy version
+ *       the cpu can run and buffer lengths around the vector sizes.
+ */
+static int SCTeddyTest03(void)
+{
+    const char alphabet[] = "abcAB01";
+    uint16_t buflens[] = { 0, 1, 2, 15, 16, 17, 18, 31, 32, 33, 34, 100, 2048 };
+    SCTeddyScanFunc scans[3];
+    int nscans;
+    uint32_t sets[] = { 20, 500 };
+    SCTeddyScanFunc saved = SCTeddyScan;
+    unsigned int seed = 1234;
+    uint8_t buf[2048];
+    int result = 0;
+    uint32_t s, i;
+    int f;
+
+    nscans = SCTeddyTestScans(scans);
+
+    for (i = 0; i < sizeof(buf); i++)
+        buf[i] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+
+    for (s = 0; s < sizeof(sets) / sizeof(sets[0]); s++) {
+        MpmCtx ac_ctx, teddy_ctx;
+        MpmThreadCtx ac_tctx, teddy_tctx;
+        PatternMatcherQueue ac_pmq, teddy_pmq;
+        uint8_t pat[12];
+
+        memset(&ac_ctx, 0, sizeof(MpmCtx));
+        memset(&teddy_ctx, 0, sizeof(MpmCtx));
+        MpmInitCtx(&ac_ctx, MPM_AC);
+        MpmInitCtx(&teddy_ctx, MPM_TEDDY);
+        mpm_table[MPM_AC].InitThreadCtx(&ac_ctx, &ac_tctx, 0);
+        SCTeddyInitThreadCtx(&teddy_ctx, &teddy_tctx, 0);
+
+        for (i = 0; i < sets[s]; i++) {
+            uint16_t len = 1 + rand_r(&seed) % sizeof(pat);
+            uint16_t j;
+            /* take most patterns from the buffer, so that they match */
+            if (i % 4 != 0) {
+                uint32_t off = rand_r(&seed) % (sizeof(buf) - len);
+                memcpy(pat, buf + off, len);
+            } else {
+                for (j = 0; j < len; j++)
+                    pat[j] = alphabet[rand_r(&seed) % (sizeof(alphabet) - 1)];
+            }
+            /* flip the case of some so only the nocase ones match */
+            if (i % 5 == 0)
+                pat[0] = isupper(pat[0]) ? tolower(pat[0]) : toupper(pat[0]);
+
+            if (i % 3 == 0) {
+                MpmAddPatternCI(&ac_ctx, pat, len, 0, 0, i, 0, 0);
+                MpmAddPatternCI(&teddy_ctx, pat, len, 0, 0, i, 0, 0);
+            } else {
+                MpmAddPatternCS(&ac_ctx, pat, len, 0, 0, i, 0, 0);
+                MpmAddPatternCS(&teddy_ctx, pat, len, 0, 0, i, 0, 0);
+            }
+        }
+        PmqSetup(&ac_pmq, sets[s]);
+        PmqSetup(&teddy_pmq, sets[s]);
+        mpm_table[MPM_AC].Prepare(&ac_ctx);
+        SCTeddyPreparePatterns(&teddy_ctx);
+
+        SCTeddyCtx *ctx = (SCTeddyCtx *)teddy_ctx.ctx;
+        if (s == 1 && ctx->fdr_cnt == 0) {
+            printf("large set should use fdr: ");
+            goto cleanup;
+        }
+
+        for (f = 0; f < nscans; f++) {
+            SCTeddyScan = scans[f];
+            for (i = 0; i < sizeof(buflens) / sizeof(buflens[0]); i++) {
+                /* search at an odd offset too, for the unaligned loads */
+                if (SCTeddyTestCompareAC(&ac_ctx, &ac_tctx, &ac_pmq, &teddy_ctx,
+                            &teddy_tctx, &teddy_pmq, buf, buflens[i]) == 0 ||
+                    (buflens[i] < sizeof(buf) &&
+                     SCTeddyTestCompareAC(&ac_ctx, &ac_tctx, &ac_pmq, &teddy_ctx,
+                            &teddy_tctx, &teddy_pmq, buf + 1, buflens[i]) == 0)) {
+                    printf("set %"PRIu32", scan %d: ", sets[s], f);
+                    goto cleanup;
+                }
+            }
+        }
+        result++;
+cleanup:
+        mpm_table[MPM_AC].DestroyCtx(&ac_ctx);
+        mpm_table[MPM_AC].DestroyThreadCtx(&ac_ctx, &ac_tctx);
+        SCTeddyDestroyCtx(&teddy_ctx);
+        SCTeddyDestroyThreadCtx(&teddy_ctx, &teddy_tctx);
+        PmqFree(&ac_pmq);
+        PmqFree(&teddy_pmq);
+        if (result != (int)s + 1)
+            break;
+    }
+
+    SCTeddyScan = saved;
+    return (result == (int)(sizeof(sets) / sizeof(sets[0])));
+}
+
+/**
+ * \test bucket and nibble mask edge cases: patterns that share a bucket
+ *       set the nibbles of each other's bytes in the masks, so mixed
+ *       nibbles and mixed positions must be rejected by the confirm.
+ *       More patterns than buckets, nocase only differing in the case
+ *       bit, and matches in the last bytes of a vector or the buffer.
+ */
+static int SCTeddyTest04(void)
+{
+    struct {
+        const char *buf;
+        uint16_t buflen;
+        uint32_t cnt;
+    } tests[] = {
+        /* lo nibble of \x12 with hi of \x34, and the reverse */
+        { "\x14\x32\x14\x32", 4, 0 },
+        { "\x12", 1, 1 },
+        { "\x34", 1, 1 },
+        /* 'ab' and 'cd' share a bucket, 'ad' and 'cb' don't exist */
+        { "adcbadcbadcbadcbadcbadcb", 24, 0 },
+        { "xxxxxxxxxxxxxxab", 16, 1 },
+        { "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxcd", 32, 1 },
+        { "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxcd", 33, 1 },
+        /* pattern split over the 16 and 32 byte vector boundaries, QRS
+         * and nocase qrS both match */
+        { "xxxxxxxxxxxxxxxQRS", 18, 2 },
+        { "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxQRS", 34, 2 },
+        /* only nocase qrS matches */
+        { "qrs", 3, 1 },
+        { "QRs", 3, 1 },
+        /* 'Q' and 'q' are in the masks, '1' has the same low nibble */
+        { "1RS", 3, 0 },
+        { "\x12\x34" "abcdQRSqrs", 12, 7 },
+    };
+    /* more patterns than buckets, so buckets are shared */
+    const char *pats[] = { "\x12", "\x34", "ab", "cd", "QRS", "ef", "gh",
+        "ij", "kl", "mn", "op", NULL };
+    SCTeddyScanFunc scans[3];
+    SCTeddyScanFunc saved = SCTeddyScan;
+    int nscans = SCTeddyTestScans(scans);
+    MpmCtx mpm_ctx;
+    MpmThreadCtx mpm_thread_ctx;
+    PatternMatcherQueue pmq;
+    int result = 0;
+    uint32_t i;
+    int f;
+
+    memset(&mpm_ctx, 0, sizeof(MpmCtx));
+    memset(&mpm_thread_ctx, 0, sizeof(MpmThreadCtx));
+    MpmInitCtx(&mpm_ctx, MPM_TEDDY);
+    SCTeddyInitThreadCtx(&mpm_ctx, &mpm_thread_ctx, 0);
+
+    for (i = 0; pats[i] != NULL; i++)
+        MpmAddPatternCS(&mpm_ctx, (uint8_t *)pats[i], strlen(pats[i]), 0, 0, i, 0, 0);
+    MpmAddPatternCI(&mpm_ctx, (uint8_t *)"qrS", 3, 0, 0, i, 0, 0);
+    PmqSetup(&pmq, i + 1);
+
+    SCTeddyPreparePatterns(&mpm_ctx);
+
+    SCTeddyCtx *ctx = (SCTeddyCtx *)mpm_ctx.ctx;
+    if (ctx->short_cnt != i + 1 || ctx->fdr_cnt != 0) {
+        printf("expected all %"PRIu32" patterns in teddy: ", i + 1);
+        goto end;
+    }
+
+    for (f = 0; f < nscans; f++) {
+        SCTeddyScan = scans[f];
+        for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+            PmqReset(&pmq);
+            uint32_t cnt = SCTeddySearch(&mpm_ctx, &mpm_thread_ctx, &pmq,
+                    (uint8_t *)tests[i].buf, tests[i].buflen);
+            if (cnt != tests[i].cnt) {
+                printf("scan %d, buf %"PRIu32": %"PRIu32" != %"PRIu32": ",
+                       f, i, tests[i].cnt, cnt);
+                goto end;
+            }
+        }
+    }
+
+    result = 1;
+end:
+    SCTeddyScan = saved;
+    SCTeddyDestroyCtx(&mpm_ctx);
+    SCTeddyDestroyThreadCtx(&mpm_ctx, &mpm_thread_ctx);
+    PmqFree(&pmq);
+    return result;
+}
+
+#endif /* UNITTESTS */
+
+void SCTeddyRegisterTests(void)
+{
+
+#ifdef UNITTESTS
+    UtRegisterTest("SCTeddyTest01", SCTeddyTest01, 1);
+    UtRegisterTest("SCTeddyTest02", SCTeddyTest02, 1);
+    UtRegisterTest("SCTeddyTest03", SCTeddyTest03, 1);
+    UtRegisterTest("SCTeddyTest04", SCTeddyTest04, 1);
+#endif
+
+    return;
+}
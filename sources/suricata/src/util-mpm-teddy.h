@@ -0,0 +1,97 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Vectorized literal matcher: Teddy for short patterns and small pattern
+ * sets, FDR style shift-or for the rest.
+ */
+
+#ifndef __UTIL_MPM_TEDDY__H__
+#define __UTIL_MPM_TEDDY__H__
+
+/** Teddy bucket masks cover at most this many leading pattern bytes */
+#define SC_TEDDY_MAX_M          3
+/** Teddy and FDR both spread the patterns over 8 buckets, one bit each */
+#define SC_TEDDY_BUCKETS        8
+/** FDR reach table index: current byte and low nibble of the previous */
+#define SC_TEDDY_FDR_DOMAIN     (1 << 12)
+/** FDR looks at the last (up to) 8 bytes of each pattern */
+#define SC_TEDDY_FDR_MAX_WINDOW 8
+
+typedef struct SCTeddyPattern_ {
+    /* length of the pattern */
+    uint16_t len;
+    /* flags decribing the pattern */
+    uint8_t flags;
+    /* bucket the pattern is in */
+    uint8_t bucket;
+    /* holds the original pattern that was added */
+    uint8_t *original_pat;
+    /* case INsensitive */
+    uint8_t *ci;
+    /* pattern id */
+    uint32_t id;
+    /* FDR confirm key: lowercase last 4 bytes */
+    uint32_t key;
+
+    /* init hash chain, FDR confirm hash chain after preparing */
+    struct SCTeddyPattern_ *next;
+} SCTeddyPattern;
+
+typedef struct SCTeddyCtx_ {
+    /* hash used during ctx initialization */
+    SCTeddyPattern **init_hash;
+
+    /* all patterns, owned by the ctx */
+    SCTeddyPattern **parray;
+
+    /* Teddy: patterns sorted by bucket, bucket b is
+     * short_array[short_bucket[b]] up to short_array[short_bucket[b + 1]] */
+    SCTeddyPattern **short_array;
+    uint32_t short_cnt;
+    uint32_t short_bucket[SC_TEDDY_BUCKETS + 1];
+    /* number of leading pattern bytes in the masks */
+    uint8_t short_m;
+    /* per position nibble masks for the shuffle, bit b is set if a pattern
+     * in bucket b may have a byte with this low/high nibble there */
+    uint8_t short_lo[SC_TEDDY_MAX_M][16] __attribute__((aligned(16)));
+    uint8_t short_hi[SC_TEDDY_MAX_M][16] __attribute__((aligned(16)));
+    /* exact per position byte masks for the scalar search and tail */
+    uint8_t short_byte[SC_TEDDY_MAX_M][256];
+
+    /* FDR: reach[domain] has bit (pos * 8 + bucket) cleared if a pattern in
+     * bucket can have that domain value at window pos */
+    uint64_t *fdr_reach;
+    uint32_t fdr_cnt;
+    uint8_t fdr_window;
+    /* confirm hash on the last 4 bytes */
+    SCTeddyPattern **fdr_hash;
+    uint32_t fdr_hash_mask;
+} SCTeddyCtx;
+
+typedef struct SCTeddyThreadCtx_ {
+    /* the total calls we make to the search function */
+    uint32_t total_calls;
+    /* the total patterns that we ended up matching against */
+    uint64_t total_matches;
+} SCTeddyThreadCtx;
+
+void MpmTeddyRegister(void);
+
+#endif /* __UTIL_MPM_TEDDY__H__ */
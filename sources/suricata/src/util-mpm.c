@@ -37,6 +37,8 @@
 #include "util-mpm-ac-gfbs.h"
 #include "util-mpm-ac-bs.h"
 #include "util-mpm-ac-tile.h"
+#include "util-mpm-teddy.h"
+#include "util-mpm-ac-compact.h"
 #include "util-hashlist.h"
 
 #include "detect-engine.h"
@@ -217,6 +219,13 @@ MpmCtx *MpmFactoryGetMpmCtxForProfile(DetectEngineCtx *de_ctx, int32_t id, int d
             exit(EXIT_FAILURE);
         }
         memset(mpm_ctx, 0, sizeof(MpmCtx));
+
+        /* unique ctxs remember their patterns so that ctxs with the same
+         * pattern set can be shared between sig group heads */
+        if (MpmCtxRecordPatternKeys(mpm_ctx) != 0) {
+            SCLogError(SC_ERR_MEM_ALLOC, "Error allocating memory");
+            exit(EXIT_FAILURE);
+        }
         return mpm_ctx;
     } else if (id < -1) {
         SCLogError(SC_ERR_INVALID_ARGUMENTS, "Invalid argument - %d\n", id);
@@ -239,12 +248,107 @@ void MpmFactoryReClaimMpmCtx(DetectEngineCtx *de_ctx, MpmCtx *mpm_ctx)
     if (!MpmFactoryIsMpmCtxAvailable(de_ctx, mpm_ctx)) {
         if (mpm_ctx->mpm_type != MPM_NOTSET)
             mpm_table[mpm_ctx->mpm_type].DestroyCtx(mpm_ctx);
+        MpmPatternKeyListFree(mpm_ctx->init_keys);
         SCFree(mpm_ctx);
     }
 
     return;
 }
 
+/**
+ * \brief Make the ctx remember the patterns added to it from now on.
+ *
+ * \retval 0 on success, -1 on allocation failure
+ */
+int MpmCtxRecordPatternKeys(MpmCtx *mpm_ctx)
+{
+    if (mpm_ctx->init_keys != NULL)
+        return 0;
+
+    mpm_ctx->init_keys = SCMalloc(sizeof(MpmPatternKeyList));
+    if (unlikely(mpm_ctx->init_keys == NULL))
+        return -1;
+    memset(mpm_ctx->init_keys, 0, sizeof(MpmPatternKeyList));
+    return 0;
+}
+
+void MpmPatternKeyListFree(MpmPatternKeyList *list)
+{
+    if (list == NULL)
+        return;
+
+    if (list->keys != NULL)
+        SCFree(list->keys);
+    SCFree(list);
+}
+
+int MpmPatternKeyCompare(const void *a, const void *b)
+{
+    const MpmPatternKey *k1 = (const MpmPatternKey *)a;
+    const MpmPatternKey *k2 = (const MpmPatternKey *)b;
+
+    if (k1->pid != k2->pid)
+        return k1->pid < k2->pid ? -1 : 1;
+    if (k1->flags != k2->flags)
+        return k1->flags < k2->flags ? -1 : 1;
+    if (k1->patlen != k2->patlen)
+        return k1->patlen < k2->patlen ? -1 : 1;
+    if (k1->offset != k2->offset)
+        return k1->offset < k2->offset ? -1 : 1;
+    if (k1->depth != k2->depth)
+        return k1->depth < k2->depth ? -1 : 1;
+    return memcmp(k1->pat, k2->pat, k1->patlen);
+}
+
+/** \brief sort the keys and remove the duplicates that are the result of
+ *         multiple sigs adding the same pattern */
+void MpmPatternKeyListNormalize(MpmPatternKeyList *list)
+{
+    uint32_t i, u = 0;
+
+    qsort(list->keys, list->cnt, sizeof(MpmPatternKey), MpmPatternKeyCompare);
+
+    for (i = 0; i < list->cnt; i++) {
+        if (u > 0 && MpmPatternKeyCompare(&list->keys[u - 1], &list->keys[i]) == 0)
+            continue;
+        list->keys[u++] = list->keys[i];
+    }
+    list->cnt = u;
+}
+
+/**
+ * \brief Remember a pattern added to a ctx that keeps its pattern keys.
+ *
+ *        On allocation failure the list is dropped, which just means the
+ *        ctx won't be considered for sharing.
+ */
+static void MpmPatternKeyListAdd(MpmCtx *mpm_ctx, uint8_t *pat, uint16_t patlen,
+                                 uint16_t offset, uint16_t depth,
+                                 uint32_t pid, uint8_t flags)
+{
+    MpmPatternKeyList *list = mpm_ctx->init_keys;
+
+    if (list->cnt == list->size) {
+        uint32_t size = list->size ? list->size * 2 : 16;
+        MpmPatternKey *keys = SCRealloc(list->keys, size * sizeof(MpmPatternKey));
+        if (unlikely(keys == NULL)) {
+            MpmPatternKeyListFree(list);
+            mpm_ctx->init_keys = NULL;
+            return;
+        }
+        list->keys = keys;
+        list->size = size;
+    }
+
+    MpmPatternKey *key = &list->keys[list->cnt++];
+    key->pid = pid;
+    key->patlen = patlen;
+    key->offset = offset;
+    key->depth = depth;
+    key->flags = flags;
+    key->pat = pat;
+}
+
 void MpmFactoryDeRegisterAllMpmCtxProfiles(DetectEngineCtx *de_ctx)
 {
     if (de_ctx->mpm_ctx_factory_container == NULL)
@@ -258,11 +362,13 @@ void MpmFactoryDeRegisterAllMpmCtxProfiles(DetectEngineCtx *de_ctx)
         if (items[i].mpm_ctx_ts != NULL) {
             if (items[i].mpm_ctx_ts->mpm_type != MPM_NOTSET)
                 mpm_table[items[i].mpm_ctx_ts->mpm_type].DestroyCtx(items[i].mpm_ctx_ts);
+            MpmPatternKeyListFree(items[i].mpm_ctx_ts->init_keys);
             SCFree(items[i].mpm_ctx_ts);
         }
         if (items[i].mpm_ctx_tc != NULL) {
             if (items[i].mpm_ctx_tc->mpm_type != MPM_NOTSET)
                 mpm_table[items[i].mpm_ctx_tc->mpm_type].DestroyCtx(items[i].mpm_ctx_tc);
+            MpmPatternKeyListFree(items[i].mpm_ctx_tc->init_keys);
             SCFree(items[i].mpm_ctx_tc);
         }
     }
@@ -492,22 +598,34 @@ MpmVerifyMatch(MpmThreadCtx *thread_ctx, PatternMatcherQueue *pmq, uint32_t pati
 }
 
 /**
- *  \brief Merge two pmq's bitarrays
+ *  \brief Merge two pmq's
+ *
+ *  Both the bitarray and the array of pattern ids are merged, so that
+ *  the array keeps listing every pattern id set in the bitarray.
  *
  *  \param src source pmq
  *  \param dst destination pmq to merge into
  */
 void PmqMerge(PatternMatcherQueue *src, PatternMatcherQueue *dst) {
     uint32_t u;
+    uint32_t dst_max = dst->pattern_id_array_size / sizeof(uint32_t);
 
     if (src->pattern_id_array_cnt == 0)
         return;
 
-    for (u = 0; u < src->pattern_id_bitarray_size && u < dst->pattern_id_bitarray_size; u++) {
-        dst->pattern_id_bitarray[u] |= src->pattern_id_bitarray[u];
-    }
+    for (u = 0; u < src->pattern_id_array_cnt; u++) {
+        uint32_t id = src->pattern_id_array[u];
 
-    /** \todo now set merged flag? */
+        if (id / 8 >= dst->pattern_id_bitarray_size)
+            continue;
+        if (dst->pattern_id_bitarray[id / 8] & (1 << (id % 8)))
+            continue;
+
+        dst->pattern_id_bitarray[id / 8] |= (1 << (id % 8));
+        if (dst->pattern_id_array_cnt < dst_max) {
+            dst->pattern_id_array[dst->pattern_id_array_cnt++] = id;
+        }
+    }
 }
 
 /** \brief Reset a Pmq for reusage. Meant to be called after a single search.
@@ -582,6 +700,8 @@ void MpmTableSetup(void) {
     MpmACBSRegister();
     MpmACGfbsRegister();
     MpmACTileRegister();
+    MpmTeddyRegister();
+    MpmACCompactRegister();
 #ifdef __SC_CUDA_SUPPORT__
     MpmACCudaRegister();
 #endif /* __SC_CUDA_SUPPORT__ */
@@ -647,6 +767,9 @@ int MpmAddPatternCS(struct MpmCtx_ *mpm_ctx, uint8_t *pat, uint16_t patlen,
                     uint16_t offset, uint16_t depth,
                     uint32_t pid, uint32_t sid, uint8_t flags)
 {
+    if (mpm_ctx->init_keys != NULL)
+        MpmPatternKeyListAdd(mpm_ctx, pat, patlen, offset, depth, pid, flags);
+
     return mpm_table[mpm_ctx->mpm_type].AddPattern(mpm_ctx, pat, patlen,
                                                    offset, depth,
                                                    pid, sid, flags);
@@ -656,6 +779,10 @@ int MpmAddPatternCI(struct MpmCtx_ *mpm_ctx, uint8_t *pat, uint16_t patlen,
                     uint16_t offset, uint16_t depth,
                     uint32_t pid, uint32_t sid, uint8_t flags)
 {
+    if (mpm_ctx->init_keys != NULL)
+        MpmPatternKeyListAdd(mpm_ctx, pat, patlen, offset, depth, pid,
+                             flags | MPM_PATTERN_FLAG_NOCASE);
+
     return mpm_table[mpm_ctx->mpm_type].AddPatternNocase(mpm_ctx, pat, patlen,
                                                          offset, depth,
                                                          pid, sid, flags);
@@ -72,6 +72,10 @@ enum {
     MPM_AC_GFBS,
     MPM_AC_BS,
     MPM_AC_TILE,
+    /* teddy/fdr vectorized literal matcher */
+    MPM_TEDDY,
+    /* aho-corasick with compressed alphabet and sparse deep states */
+    MPM_AC_COMPACT,
     /* table size */
     MPM_TABLE_SIZE,
 };
@@ -108,14 +112,34 @@ typedef struct PatternMatcherQueue_ {
     uint32_t pattern_id_bitarray_size; /**< size in bytes */
 } PatternMatcherQueue;
 
+/** \brief pattern as it was added to a mpm ctx, used to find ctxs that
+ *         were given an identical pattern set */
+typedef struct MpmPatternKey_ {
+    uint32_t pid;
+    uint16_t patlen;
+    uint16_t offset;
+    uint16_t depth;
+    uint8_t flags;
+    /* not owned, points into the signature's content */
+    uint8_t *pat;
+} MpmPatternKey;
+
+typedef struct MpmPatternKeyList_ {
+    MpmPatternKey *keys;
+    uint32_t cnt;
+    uint32_t size;
+} MpmPatternKeyList;
+
 typedef struct MpmCtx_ {
     void *ctx;
     uint16_t mpm_type;
 
     /* Indicates if this a global mpm_ctx.  Global mpm_ctx is the one that
      * is instantiated when we use "single".  Non-global is "full", i.e.
-     * one per sgh.  We are using a uint16_t here to avoiding using a pad.
-     * You can use a uint8_t here as well. */
+     * one per sgh.  Ctxs shared between sghs by the detection engine's mpm
+     * store are marked global as well, as the store owns them.  We are using
+     * a uint16_t here to avoiding using a pad.  You can use a uint8_t here
+     * as well. */
     uint16_t global;
 
     /* unique patterns */
@@ -126,6 +150,11 @@ typedef struct MpmCtx_ {
 
     uint32_t memory_cnt;
     uint32_t memory_size;
+
+    /* patterns added so far, only kept for the unique (per sgh) ctxs so the
+     * detection engine can share ctxs with an identical pattern set. Handed
+     * over to the engine's mpm store when the ctx is prepared. */
+    MpmPatternKeyList *init_keys;
 } MpmCtx;
 
 /* if we want to retrieve an unique mpm context from the mpm context factory
@@ -158,6 +187,10 @@ typedef struct MpmCtxFactoryContainer_ {
 /** one byte pattern (used in b2g) */
 #define MPM_PATTERN_ONE_BYTE        0x10
 
+/** Prepare uses state shared between ctxs, so ctxs of this type can't be
+ *  prepared concurrently by the detection engine build threads */
+#define MPM_FLAG_PREPARE_NOT_THREADSAFE 0x01
+
 typedef struct MpmTableElmt_ {
     char *name;
     uint8_t max_pattern_length;
@@ -185,6 +218,14 @@ typedef struct MpmTableElmt_ {
     void (*PrintCtx)(struct MpmCtx_ *);
     void (*PrintThreadCtx)(struct MpmThreadCtx_ *);
     void (*RegisterUnittests)(void);
+
+    /** optional, write the payload of a prepared ctx to a cache file.
+     *  Returns 0 on success. See util-mpm-cache.c */
+    int  (*CacheSave)(struct MpmCtx_ *, FILE *);
+    /** optional, set up an unprepared ctx from the payload at offset off of
+     *  a read only mapped cache file. On success the ctx owns the map and
+     *  unmaps it when it's destroyed. Returns 0 on success. */
+    int  (*CacheLoad)(struct MpmCtx_ *, uint8_t *, size_t, size_t);
     uint8_t flags;
 } MpmTableElmt;
 
@@ -233,6 +274,10 @@ void MpmFactoryReClaimMpmCtx(struct DetectEngineCtx_ *, MpmCtx *);
 MpmCtx *MpmFactoryGetMpmCtxForProfile(struct DetectEngineCtx_ *, int32_t, int);
 void MpmFactoryDeRegisterAllMpmCtxProfiles(struct DetectEngineCtx_ *);
 int32_t MpmFactoryIsMpmCtxAvailable(struct DetectEngineCtx_ *, MpmCtx *);
+void MpmPatternKeyListFree(MpmPatternKeyList *);
+int MpmCtxRecordPatternKeys(MpmCtx *);
+int MpmPatternKeyCompare(const void *, const void *);
+void MpmPatternKeyListNormalize(MpmPatternKeyList *);
 
 int PmqSetup(PatternMatcherQueue *, uint32_t);
 void PmqMerge(PatternMatcherQueue *src, PatternMatcherQueue *dst);
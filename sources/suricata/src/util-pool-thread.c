@@ -63,6 +63,7 @@ PoolThread *PoolThreadInit(int threads, uint32_t size, uint32_t prealloc_size, u
         PoolThreadElement *e = &pt->array[i];
 
         SCMutexInit(&e->lock, NULL);
+        SC_ATOMIC_INIT(e->return_stack);
         SCMutexLock(&e->lock);
 //        SCLogDebug("size %u prealloc_size %u elt_size %u Alloc %p Init %p InitData %p Cleanup %p Free %p",
 //                size, prealloc_size, elt_size,
@@ -112,6 +113,7 @@ int PoolThreadGrow(PoolThread *pt, uint32_t size, uint32_t prealloc_size, uint32
     e = &pt->array[newsize - 1];
     memset(e, 0x00, sizeof(*e));
     SCMutexInit(&e->lock, NULL);
+    SC_ATOMIC_INIT(e->return_stack);
     SCMutexLock(&e->lock);
     e->pool = PoolInit(size, prealloc_size, elt_size, Alloc, Init, InitData, Cleanup, Free);
     SCMutexUnlock(&e->lock);
@@ -129,6 +131,33 @@ int PoolThreadSize(PoolThread *pt) {
     return (int)pt->size;
 }
 
+/**
+ *  \brief hand all data on the return stack of an element back to its pool
+ *
+ *  The whole stack is detached with a single CAS, so pushes by other
+ *  threads can continue while we walk it.
+ *
+ *  \param e pool element, must be called by the owner or under e->lock
+ */
+static void PoolThreadDrain(PoolThreadElement *e) {
+    void *data;
+
+    do {
+        data = SC_ATOMIC_GET(e->return_stack);
+        if (data == NULL)
+            return;
+    } while (SC_ATOMIC_CAS(&e->return_stack, data, NULL) == 0);
+
+    while (data != NULL) {
+        PoolThreadReserved *res = data;
+        void *next = res->next;
+
+        res->next = NULL;
+        PoolReturn(e->pool, data);
+        data = next;
+    }
+}
+
 void PoolThreadFree(PoolThread *pt) {
     int i;
 
@@ -139,8 +168,12 @@ void PoolThreadFree(PoolThread *pt) {
         for (i = 0; i < (int)pt->size; i++) {
             PoolThreadElement *e = &pt->array[i];
             SCMutexLock(&e->lock);
-            PoolFree(e->pool);
+            if (e->pool != NULL) {
+                PoolThreadDrain(e);
+                PoolFree(e->pool);
+            }
             SCMutexUnlock(&e->lock);
+            SC_ATOMIC_DESTROY(e->return_stack);
             SCMutexDestroy(&e->lock);
         }
         SCFree(pt->array);
@@ -155,29 +188,35 @@ void *PoolThreadGetById(PoolThread *pt, uint16_t id) {
         return NULL;
 
     PoolThreadElement *e = &pt->array[id];
-    SCMutexLock(&e->lock);
+    /* only the owner gets here, so no locking is needed to touch the
+     * pool. First take back what other threads have returned. */
+    if (SC_ATOMIC_GET(e->return_stack) != NULL)
+        PoolThreadDrain(e);
+
     data = PoolGet(e->pool);
-    SCMutexUnlock(&e->lock);
     if (data) {
-        PoolThreadReserved *did = data;
-        *did = id;
+        PoolThreadReserved *res = data;
+        res->id = id;
+        res->next = NULL;
     }
 
     return data;
 }
 
 void PoolThreadReturn(PoolThread *pt, void *data) {
-    PoolThreadReserved *id = data;
+    PoolThreadReserved *res = data;
+    void *head;
 
-    if (pt == NULL || *id >= pt->size)
+    if (pt == NULL || res->id >= pt->size)
         return;
 
-    SCLogDebug("returning to id %u", *id);
+    SCLogDebug("returning to id %u", res->id);
 
-    PoolThreadElement *e = &pt->array[*id];
-    SCMutexLock(&e->lock);
-    PoolReturn(e->pool, data);
-    SCMutexUnlock(&e->lock);
+    PoolThreadElement *e = &pt->array[res->id];
+    do {
+        head = SC_ATOMIC_GET(e->return_stack);
+        res->next = head;
+    } while (SC_ATOMIC_CAS(&e->return_stack, head, data) == 0);
 }
 
 #ifdef UNITTESTS
@@ -208,7 +247,7 @@ void PoolThreadTestFree(void *data) {
 
 static int PoolThreadTestInit01(void) {
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
     if (pt == NULL)
         return 0;
 
@@ -220,7 +259,7 @@ static int PoolThreadTestInit02(void) {
     int i = 123;
 
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
     if (pt == NULL)
         return 0;
 
@@ -231,7 +270,7 @@ static int PoolThreadTestInit02(void) {
 static int PoolThreadTestGet01(void) {
     int result = 0;
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
     if (pt == NULL)
         return 0;
 
@@ -242,8 +281,8 @@ static int PoolThreadTestGet01(void) {
     }
 
     struct PoolThreadTestData *pdata = data;
-    if (pdata->res != 3) {
-        printf("res != 3, but %d: ", pdata->res);
+    if (pdata->res.id != 3) {
+        printf("res != 3, but %d: ", pdata->res.id);
         goto end;
     }
 
@@ -258,7 +297,7 @@ static int PoolThreadTestGet02(void) {
     int result = 0;
 
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
     if (pt == NULL)
         return 0;
 
@@ -269,8 +308,8 @@ static int PoolThreadTestGet02(void) {
     }
 
     struct PoolThreadTestData *pdata = data;
-    if (pdata->res != 3) {
-        printf("res != 3, but %d: ", pdata->res);
+    if (pdata->res.id != 3) {
+        printf("res != 3, but %d: ", pdata->res.id);
         goto end;
     }
 
@@ -290,7 +329,7 @@ static int PoolThreadTestReturn01(void) {
     int result = 0;
 
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
     if (pt == NULL)
         return 0;
 
@@ -301,8 +340,8 @@ static int PoolThreadTestReturn01(void) {
     }
 
     struct PoolThreadTestData *pdata = data;
-    if (pdata->res != 3) {
-        printf("res != 3, but %d: ", pdata->res);
+    if (pdata->res.id != 3) {
+        printf("res != 3, but %d: ", pdata->res.id);
         goto end;
     }
 
@@ -319,12 +358,84 @@ static int PoolThreadTestReturn01(void) {
 
     PoolThreadReturn(pt, data);
 
-    if (pt->array[3].pool->outstanding != 0) {
+    /* return is deferred until the owner gets data again */
+    if (pt->array[3].pool->outstanding != 1 ||
+        SC_ATOMIC_GET(pt->array[3].return_stack) != data) {
+        printf("data not on return stack: ");
+        goto end;
+    }
+
+    if (PoolThreadGetById(pt, 3) != data) {
+        printf("returned data not reused: ");
+        goto end;
+    }
+
+    if (pt->array[3].pool->outstanding != 1 ||
+        SC_ATOMIC_GET(pt->array[3].return_stack) != NULL) {
         printf("pool outstanding count wrong %u: ",
                 pt->array[3].pool->outstanding);
         goto end;
     }
 
+    PoolThreadReturn(pt, data);
+
+
+    result = 1;
+end:
+    PoolThreadFree(pt);
+    return result;
+}
+
+/** \test returns are batched on the return stack until the owner gets */
+static int PoolThreadTestReturn02(void) {
+    int i = 123;
+    int result = 0;
+    void *data[3];
+    int n;
+
+    PoolThread *pt = PoolThreadInit(2, /* threads */
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+    if (pt == NULL)
+        return 0;
+
+    for (n = 0; n < 3; n++) {
+        data[n] = PoolThreadGetById(pt, 1);
+        if (data[n] == NULL) {
+            printf("data[%d] == NULL: ", n);
+            goto end;
+        }
+    }
+
+    for (n = 0; n < 3; n++)
+        PoolThreadReturn(pt, data[n]);
+
+    if (pt->array[1].pool->outstanding != 3) {
+        printf("pool outstanding count wrong %u: ",
+                pt->array[1].pool->outstanding);
+        goto end;
+    }
+
+    if (pt->array[0].pool->outstanding != 0 ||
+        SC_ATOMIC_GET(pt->array[0].return_stack) != NULL) {
+        printf("data returned to wrong element: ");
+        goto end;
+    }
+
+    void *d = PoolThreadGetById(pt, 1);
+    if (d == NULL) {
+        printf("d == NULL: ");
+        goto end;
+    }
+
+    if (pt->array[1].pool->outstanding != 1 ||
+        SC_ATOMIC_GET(pt->array[1].return_stack) != NULL) {
+        printf("pool outstanding count wrong %u: ",
+                pt->array[1].pool->outstanding);
+        goto end;
+    }
+
+    /* leave it on the return stack, PoolThreadFree has to clean it up */
+    PoolThreadReturn(pt, d);
 
     result = 1;
 end:
@@ -334,12 +445,12 @@ end:
 
 static int PoolThreadTestGrow01(void) {
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, NULL, NULL, NULL, NULL);
     if (pt == NULL)
         return 0;
 
     if (PoolThreadGrow(pt,
-                       10, 5, 10, PoolThreadTestAlloc, NULL, NULL, NULL, NULL) < 0) {
+                       10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, NULL, NULL, NULL, NULL) < 0) {
         PoolThreadFree(pt);
         return 0;
     }
@@ -352,12 +463,12 @@ static int PoolThreadTestGrow02(void) {
     int i = 123;
 
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
     if (pt == NULL)
         return 0;
 
     if (PoolThreadGrow(pt,
-                       10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL) < 0) {
+                       10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL) < 0) {
         PoolThreadFree(pt);
         return 0;
     }
@@ -371,12 +482,12 @@ static int PoolThreadTestGrow03(void) {
     int result = 0;
 
     PoolThread *pt = PoolThreadInit(4, /* threads */
-                                    10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
+                                    10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL);
     if (pt == NULL)
         return 0;
 
     if (PoolThreadGrow(pt,
-                       10, 5, 10, PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL) < 0) {
+                       10, 5, sizeof(struct PoolThreadTestData), PoolThreadTestAlloc, PoolThreadTestInit, &i, PoolThreadTestFree, NULL) < 0) {
         PoolThreadFree(pt);
         return 0;
     }
@@ -388,8 +499,8 @@ static int PoolThreadTestGrow03(void) {
     }
 
     struct PoolThreadTestData *pdata = data;
-    if (pdata->res != 4) {
-        printf("res != 5, but %d: ", pdata->res);
+    if (pdata->res.id != 4) {
+        printf("res != 5, but %d: ", pdata->res.id);
         goto end;
     }
 
@@ -406,12 +517,27 @@ static int PoolThreadTestGrow03(void) {
 
     PoolThreadReturn(pt, data);
 
-    if (pt->array[4].pool->outstanding != 0) {
+    /* return is deferred until the owner gets data again */
+    if (pt->array[4].pool->outstanding != 1 ||
+        SC_ATOMIC_GET(pt->array[4].return_stack) != data) {
+        printf("data not on return stack: ");
+        goto end;
+    }
+
+    if (PoolThreadGetById(pt, 4) != data) {
+        printf("returned data not reused: ");
+        goto end;
+    }
+
+    if (pt->array[4].pool->outstanding != 1 ||
+        SC_ATOMIC_GET(pt->array[4].return_stack) != NULL) {
         printf("pool outstanding count wrong %u: ",
                 pt->array[4].pool->outstanding);
         goto end;
     }
 
+    PoolThreadReturn(pt, data);
+
 
     result = 1;
 end:
@@ -430,6 +556,7 @@ void PoolThreadRegisterTests(void) {
     UtRegisterTest("PoolThreadTestGet02", PoolThreadTestGet02, 1);
 
     UtRegisterTest("PoolThreadTestReturn01", PoolThreadTestReturn01, 1);
+    UtRegisterTest("PoolThreadTestReturn02", PoolThreadTestReturn02, 1);
 
     UtRegisterTest("PoolThreadTestGrow01", PoolThreadTestGrow01, 1);
     UtRegisterTest("PoolThreadTestGrow02", PoolThreadTestGrow02, 1);
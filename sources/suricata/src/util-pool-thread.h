@@ -34,14 +34,22 @@
  *
  *  It's purpose is to make sure thread X can return data to a pool
  *  from thread Y.
+ *
+ *  Each pool element is owned by a single thread: only the owner may call
+ *  PoolThreadGetById() for its id, which is lock free. Any thread can call
+ *  PoolThreadReturn(). Returned data is pushed onto a lock free return
+ *  stack of the owning element and handed back to the pool in a batch
+ *  the next time the owner gets data.
  */
 
 #ifndef __UTIL_POOL_THREAD_H__
 #define __UTIL_POOL_THREAD_H__
 
 struct PoolThreadElement_ {
-    SCMutex lock;                   /**< lock, should have low contention */
-    Pool *pool;                     /**< actual pool */
+    SCMutex lock;                   /**< lock, protects pool setup and teardown */
+    Pool *pool;                     /**< actual pool, only touched by the owner */
+    /** lock free stack of returned data, drained by the owner */
+    SC_ATOMIC_DECLARE(void *, return_stack);
 };
 // __attribute__((aligned(CLS))); <- VJ: breaks on clang 32bit, segv in PoolThreadTestGrow01
 
@@ -53,8 +61,11 @@ typedef struct PoolThread_ {
 } PoolThread;
 
 /** per data item reserved data containing the
- *  thread pool id */
-typedef uint16_t PoolThreadReserved;
+ *  thread pool id and the return stack link */
+typedef struct PoolThreadReserved_ {
+    void *next;                     /**< next item in the return stack */
+    uint16_t id;                    /**< id of the owning pool element */
+} PoolThreadReserved;
 
 void PoolThreadRegisterTests(void);
 
@@ -77,13 +88,14 @@ void PoolThreadFree(PoolThread *pt);
 
 /** \brief get data from thread pool by thread id
  *  \note wrapper around PoolGet()
+ *  \note lock free, so must only be called by the thread owning 'id'
  *  \param pt thread pool
  *  \param id thread id
  *  \retval ptr data or NULL */
 void *PoolThreadGetById(PoolThread *pt, uint16_t id);
 
 /** \brief return data to thread pool
- *  \note wrapper around PoolReturn()
+ *  \note lock free, the data is handed to PoolReturn() by the owner
  *  \param pt thread pool
  *  \param data memory block to return, with PoolThreadReserved as it's first member */
 void PoolThreadReturn(PoolThread *pt, void *data);
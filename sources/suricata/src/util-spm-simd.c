@@ -0,0 +1,374 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Single pattern search for short patterns.
+ *
+ * For each position the first byte of the pattern is compared to the
+ * text at that position and the last byte to the text at position +
+ * pattern length - 1. Only positions where both are equal are compared
+ * in full. Comparing two bytes filters out nearly all positions of real
+ * traffic, and it is done for 16 (SSE2) or 32 (AVX2) positions at once.
+ * Unlike Boyer Moore there are no tables to set up and no data dependent
+ * branches in the filter loop.
+ *
+ * Case insensitive search sets bit 0x20 of the text bytes compared to a
+ * letter, which lowercases letters, so the compare needs no case table.
+ *
+ * The AVX2 version is built through target attributes and picked at
+ * runtime, falling back to SSE2 and then to a memchr based scalar
+ * version.
+ */
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+#include "util-spm-simd.h"
+#include "util-cpu.h"
+#include "util-debug.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef UTIL_CPU_TARGET_ATTR
+#include <immintrin.h>
+#endif
+
+typedef uint8_t *(*SpmSimdSearchFunc)(const uint8_t *, uint32_t, const uint8_t *, uint16_t);
+
+/** \internal
+ *  \brief bit to set in a text byte before comparing it to pattern byte c */
+static inline uint8_t SpmSimdFold(uint8_t c)
+{
+    return isalpha(c) ? 0x20 : 0x00;
+}
+
+/** \internal
+ *  \brief compare the bytes between the first and the last of a pattern */
+static inline int SpmSimdInnerEq(const uint8_t *t, const uint8_t *needle,
+                                 uint16_t needlelen)
+{
+    if (needlelen <= 2)
+        return 1;
+    return (memcmp(t + 1, needle + 1, needlelen - 2) == 0);
+}
+
+static inline int SpmSimdInnerEqNocase(const uint8_t *t, const uint8_t *needle,
+                                       uint16_t needlelen)
+{
+    uint16_t i;
+    for (i = 1; i + 1 < needlelen; i++) {
+        if (u8_tolower(t[i]) != u8_tolower(needle[i]))
+            return 0;
+    }
+    return 1;
+}
+
+/** \internal
+ *  \brief check the positions from 'pos' to 'last_pos' one by one */
+static inline uint8_t *SpmSimdSearchTail(const uint8_t *text, uint32_t pos,
+        uint32_t last_pos, const uint8_t *needle, uint16_t needlelen)
+{
+    for ( ; pos <= last_pos; pos++) {
+        if (text[pos] == needle[0] &&
+            text[pos + needlelen - 1] == needle[needlelen - 1] &&
+            SpmSimdInnerEq(text + pos, needle, needlelen))
+            return (uint8_t *)text + pos;
+    }
+    return NULL;
+}
+
+static inline uint8_t *SpmSimdNocaseSearchTail(const uint8_t *text, uint32_t pos,
+        uint32_t last_pos, const uint8_t *needle, uint16_t needlelen)
+{
+    uint8_t ff = SpmSimdFold(needle[0]);
+    uint8_t fv = u8_tolower(needle[0]);
+    uint8_t lf = SpmSimdFold(needle[needlelen - 1]);
+    uint8_t lv = u8_tolower(needle[needlelen - 1]);
+
+    for ( ; pos <= last_pos; pos++) {
+        if ((text[pos] | ff) == fv &&
+            (text[pos + needlelen - 1] | lf) == lv &&
+            SpmSimdInnerEqNocase(text + pos, needle, needlelen))
+            return (uint8_t *)text + pos;
+    }
+    return NULL;
+}
+
+static uint8_t *SimdSearchScalar(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    const uint8_t *t = text;
+    const uint8_t *end = text + (textlen - needlelen) + 1;
+
+    while (t < end) {
+        t = memchr(t, needle[0], end - t);
+        if (t == NULL)
+            return NULL;
+        if (t[needlelen - 1] == needle[needlelen - 1] &&
+            SpmSimdInnerEq(t, needle, needlelen))
+            return (uint8_t *)t;
+        t++;
+    }
+    return NULL;
+}
+
+static uint8_t *SimdNocaseSearchScalar(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    return SpmSimdNocaseSearchTail(text, 0, textlen - needlelen, needle, needlelen);
+}
+
+#if defined(__SSE2__)
+static uint8_t *SimdSearchSSE2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    uint32_t last_pos = textlen - needlelen;
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[needlelen - 1]);
+    uint32_t pos = 0;
+
+    /* the last load ends at text + last_pos + needlelen - 1 */
+    for ( ; pos + 16 <= last_pos + 1; pos += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(text + pos + needlelen - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+
+        while (mask != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctz(mask);
+            if (SpmSimdInnerEq(text + pos + bit, needle, needlelen))
+                return (uint8_t *)text + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return SpmSimdSearchTail(text, pos, last_pos, needle, needlelen);
+}
+
+static uint8_t *SimdNocaseSearchSSE2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    uint32_t last_pos = textlen - needlelen;
+    const __m128i ff = _mm_set1_epi8((char)SpmSimdFold(needle[0]));
+    const __m128i fv = _mm_set1_epi8((char)u8_tolower(needle[0]));
+    const __m128i lf = _mm_set1_epi8((char)SpmSimdFold(needle[needlelen - 1]));
+    const __m128i lv = _mm_set1_epi8((char)u8_tolower(needle[needlelen - 1]));
+    uint32_t pos = 0;
+
+    for ( ; pos + 16 <= last_pos + 1; pos += 16) {
+        __m128i bf = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i bl = _mm_loadu_si128((const __m128i *)(text + pos + needlelen - 1));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(
+                _mm_and_si128(_mm_cmpeq_epi8(_mm_or_si128(bf, ff), fv),
+                              _mm_cmpeq_epi8(_mm_or_si128(bl, lf), lv)));
+
+        while (mask != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctz(mask);
+            if (SpmSimdInnerEqNocase(text + pos + bit, needle, needlelen))
+                return (uint8_t *)text + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return SpmSimdNocaseSearchTail(text, pos, last_pos, needle, needlelen);
+}
+#endif /* __SSE2__ */
+
+#ifdef UTIL_CPU_TARGET_ATTR
+__attribute__((target("avx2")))
+static uint8_t *SimdSearchAVX2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    uint32_t last_pos = textlen - needlelen;
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[needlelen - 1]);
+    uint32_t pos = 0;
+
+    for ( ; pos + 32 <= last_pos + 1; pos += 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)(text + pos));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(text + pos + needlelen - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(bf, first),
+                                 _mm256_cmpeq_epi8(bl, last)));
+
+        while (mask != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctz(mask);
+            if (SpmSimdInnerEq(text + pos + bit, needle, needlelen))
+                return (uint8_t *)text + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return SpmSimdSearchTail(text, pos, last_pos, needle, needlelen);
+}
+
+__attribute__((target("avx2")))
+static uint8_t *SimdNocaseSearchAVX2(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    if (needlelen == 0 || needlelen > textlen)
+        return NULL;
+
+    uint32_t last_pos = textlen - needlelen;
+    const __m256i ff = _mm256_set1_epi8((char)SpmSimdFold(needle[0]));
+    const __m256i fv = _mm256_set1_epi8((char)u8_tolower(needle[0]));
+    const __m256i lf = _mm256_set1_epi8((char)SpmSimdFold(needle[needlelen - 1]));
+    const __m256i lv = _mm256_set1_epi8((char)u8_tolower(needle[needlelen - 1]));
+    uint32_t pos = 0;
+
+    for ( ; pos + 32 <= last_pos + 1; pos += 32) {
+        __m256i bf = _mm256_loadu_si256((const __m256i *)(text + pos));
+        __m256i bl = _mm256_loadu_si256((const __m256i *)(text + pos + needlelen - 1));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(
+                _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(bf, ff), fv),
+                                 _mm256_cmpeq_epi8(_mm256_or_si256(bl, lf), lv)));
+
+        while (mask != 0) {
+            uint32_t bit = (uint32_t)__builtin_ctz(mask);
+            if (SpmSimdInnerEqNocase(text + pos + bit, needle, needlelen))
+                return (uint8_t *)text + pos + bit;
+            mask &= mask - 1;
+        }
+    }
+
+    return SpmSimdNocaseSearchTail(text, pos, last_pos, needle, needlelen);
+}
+#endif /* UTIL_CPU_TARGET_ATTR */
+
+typedef struct SpmSimdVariant_ {
+    const char *name;
+    /** UTIL_CPU_FEATURE_* flags the cpu needs for this variant */
+    uint32_t cpu_features;
+    SpmSimdSearchFunc Search;
+    SpmSimdSearchFunc NocaseSearch;
+} SpmSimdVariant;
+
+/** implementations, ordered from least to most preferred */
+static SpmSimdVariant spm_simd_variants[] = {
+    { "scalar", 0, SimdSearchScalar, SimdNocaseSearchScalar },
+#if defined(__SSE2__)
+    { "sse2", 0, SimdSearchSSE2, SimdNocaseSearchSSE2 },
+#endif
+#ifdef UTIL_CPU_TARGET_ATTR
+    { "avx2", UTIL_CPU_FEATURE_AVX2, SimdSearchAVX2, SimdNocaseSearchAVX2 },
+#endif
+};
+
+#define SPM_SIMD_VARIANTS \
+    (int)(sizeof(spm_simd_variants) / sizeof(spm_simd_variants[0]))
+
+/* until SpmSimdSetup() runs, use the best compile time choice */
+#if defined(__SSE2__)
+static int spm_simd_selected = 1;
+#else
+static int spm_simd_selected = 0;
+#endif
+
+/**
+ *  \brief Select the search implementation for this cpu.
+ *
+ *  Called once at startup, before the packet threads run.
+ */
+void SpmSimdSetup(void)
+{
+    uint32_t features = UtilCpuGetFeatures();
+    int i;
+
+    for (i = 0; i < SPM_SIMD_VARIANTS; i++) {
+        if ((spm_simd_variants[i].cpu_features & features) ==
+                spm_simd_variants[i].cpu_features)
+            spm_simd_selected = i;
+    }
+
+    SCLogInfo("using %s single pattern search for patterns up to %d bytes",
+            spm_simd_variants[spm_simd_selected].name, SPM_SIMD_MAX_LEN);
+}
+
+/** \brief name of the selected implementation */
+const char *SpmSimdName(void)
+{
+    return spm_simd_variants[spm_simd_selected].name;
+}
+
+/**
+ *  \brief Search a pattern in a text.
+ *
+ *  \param text the text to search in
+ *  \param textlen length of the text
+ *  \param needle the pattern
+ *  \param needlelen length of the pattern
+ *
+ *  \retval ptr to the first match in text
+ *  \retval NULL no match
+ */
+uint8_t *SimdSearch(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    return spm_simd_variants[spm_simd_selected].Search(text, textlen,
+            needle, needlelen);
+}
+
+/**
+ *  \brief Search a pattern in a text, ignoring case.
+ *
+ *  \retval ptr to the first match in text
+ *  \retval NULL no match
+ */
+uint8_t *SimdNocaseSearch(const uint8_t *text, uint32_t textlen,
+        const uint8_t *needle, uint16_t needlelen)
+{
+    return spm_simd_variants[spm_simd_selected].NocaseSearch(text, textlen,
+            needle, needlelen);
+}
+
+#ifdef UNITTESTS
+/** \brief select an implementation by name, for the unittests
+ *  \retval 1 selected, 0 not available on this build or cpu */
+int SpmSimdSelect(const char *name)
+{
+    uint32_t features = UtilCpuGetFeatures();
+    int i;
+
+    for (i = 0; i < SPM_SIMD_VARIANTS; i++) {
+        if (strcmp(spm_simd_variants[i].name, name) == 0 &&
+            (spm_simd_variants[i].cpu_features & features) ==
+                spm_simd_variants[i].cpu_features) {
+            spm_simd_selected = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,43 @@
+/* Copyright (C) 2015 Open Information Security Foundation
+ *
+ * You can copy, redistribute or modify this Program under the terms of
+ * the GNU General Public License version 2 as published by the Free
+ * Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * version 2 along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+/**
+ * \file
+ *
+ * Single pattern search filtering on the first and last byte of the
+ * pattern, 16 or 32 positions at a time.
+ */
+
+#ifndef __UTIL_SPM_SIMD__
+#define __UTIL_SPM_SIMD__
+
+#include "suricata-common.h"
+#include "suricata.h"
+
+/** patterns up to this length are searched with SimdSearch instead of
+ *  Boyer Moore, whose skips only pay off for longer patterns */
+#define SPM_SIMD_MAX_LEN    32
+
+uint8_t *SimdSearch(const uint8_t *, uint32_t, const uint8_t *, uint16_t);
+uint8_t *SimdNocaseSearch(const uint8_t *, uint32_t, const uint8_t *, uint16_t);
+void SpmSimdSetup(void);
+const char *SpmSimdName(void);
+#ifdef UNITTESTS
+int SpmSimdSelect(const char *);
+#endif
+
+#endif /* __UTIL_SPM_SIMD__ */
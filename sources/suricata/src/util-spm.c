@@ -2333,6 +2333,167 @@ int UtilSpmNocaseSearchStatsTest07()
     return 1;
 }
 
+/**
+ * \test Compare every simd search variant the cpu supports against
+ *       BasicSearch on pseudo random texts and needles, matches at all
+ *       offsets, both ends of the vector loops and the scalar tails.
+ */
+int UtilSpmSimdSearchTest01()
+{
+    const char *variants[] = { "scalar", "sse2", "avx2", NULL };
+    const char *orig = SpmSimdName();
+    uint8_t text[256];
+    uint8_t needle[48];
+    uint32_t seed = 1;
+    int result = 0;
+    int v, n, i;
+
+    for (v = 0; variants[v] != NULL; v++) {
+        if (SpmSimdSelect(variants[v]) == 0)
+            continue;
+
+        for (n = 0; n < 4000; n++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t textlen = (seed >> 8) % 200;
+            seed = seed * 1103515245 + 12345;
+            uint16_t needlelen = 1 + (seed >> 8) % 40;
+
+            /* small alphabet so partial matches are common */
+            for (i = 0; i < (int)textlen; i++) {
+                seed = seed * 1103515245 + 12345;
+                text[i] = "abcAB-"[(seed >> 8) % 6];
+            }
+            seed = seed * 1103515245 + 12345;
+            if (textlen >= needlelen && (seed >> 8) % 4 != 0) {
+                uint32_t off = (seed >> 12) % (textlen - needlelen + 1);
+                memcpy(needle, text + off, needlelen);
+                /* flip the case of one byte to exercise nocase */
+                if ((seed >> 4) & 1)
+                    needle[(seed >> 16) % needlelen] ^= 0x20;
+            } else {
+                for (i = 0; i < needlelen; i++) {
+                    seed = seed * 1103515245 + 12345;
+                    needle[i] = "abcAB-"[(seed >> 8) % 6];
+                }
+            }
+
+            if (SimdSearch(text, textlen, needle, needlelen) !=
+                    BasicSearch(text, textlen, needle, needlelen)) {
+                printf("%s: case search mismatch, textlen %u needlelen %u: ",
+                        variants[v], textlen, needlelen);
+                goto end;
+            }
+            if (SimdNocaseSearch(text, textlen, needle, needlelen) !=
+                    BasicSearchNocase(text, textlen, needle, needlelen)) {
+                printf("%s: nocase search mismatch, textlen %u needlelen %u: ",
+                        variants[v], textlen, needlelen);
+                goto end;
+            }
+        }
+    }
+
+    result = 1;
+end:
+    SpmSimdSelect(orig);
+    return result;
+}
+
+/**
+ * \brief Unittest helper function wrappers for the simd search
+ * \param text pointer to the buffer to search in
+ * \param needle pointer to the pattern to search for
+ * \param times If you are testing performance, se the numebr of times
+ *              that you want to repeat the search
+ */
+uint8_t *SimdSearchWrapper(uint8_t *text, uint8_t *needle, int times)
+{
+    uint32_t textlen = strlen((char *)text);
+    uint16_t needlelen = strlen((char *)needle);
+
+    uint8_t *ret = NULL;
+    int i = 0;
+
+    CLOCK_INIT;
+    if (times > 1) CLOCK_START;
+    for (i = 0; i < times; i++) {
+        ret = SimdSearch(text, textlen, needle, needlelen);
+    }
+    if (times > 1) { CLOCK_END; CLOCK_PRINT_SEC; };
+    return ret;
+}
+
+uint8_t *SimdNocaseSearchWrapper(uint8_t *text, uint8_t *needle, int times)
+{
+    uint32_t textlen = strlen((char *)text);
+    uint16_t needlelen = strlen((char *)needle);
+
+    uint8_t *ret = NULL;
+    int i = 0;
+
+    CLOCK_INIT;
+    if (times > 1) CLOCK_START;
+    for (i = 0; i < times; i++) {
+        ret = SimdNocaseSearch(text, textlen, needle, needlelen);
+    }
+    if (times > 1) { CLOCK_END; CLOCK_PRINT_SEC; };
+    return ret;
+}
+
+/**
+ * \test Give some stats comparing Boyer Moore with a prepared context
+ *       against the simd search, which is used for patterns up to
+ *       SPM_SIMD_MAX_LEN bytes
+ */
+int UtilSpmSimdSearchStatsTest01()
+{
+    uint8_t text[1501];
+    uint8_t needle[65];
+    int lens[] = { 2, 4, 8, 16, 24, 32, 48, 64 };
+    int i, j;
+    uint8_t *found = NULL;
+
+    /* a realistic-ish payload: the pattern tail only at the very end */
+    for (i = 0; i < 1500; i++)
+        text[i] = "GET /index.html HTTP/1.1 Host: example.com "[i % 43];
+    text[1500] = '\0';
+
+    printf("\nStats for simd search (%s) vs prepared Boyer Moore:\n",
+            SpmSimdName());
+    for (j = 0; j < (int)(sizeof(lens) / sizeof(lens[0])); j++) {
+        for (i = 0; i < lens[j]; i++)
+            needle[i] = 'a' + (i % 26);
+        needle[lens[j]] = '\0';
+        memcpy(text + 1500 - lens[j], needle, lens[j]);
+
+        printf("Pattern length %d with BoyerMooreSearch:", lens[j]);
+        found = BoyerMooreCtxWrapper(text, needle, STATS_TIMES / 10);
+        if (found == NULL) {
+            printf("Error1 searching for %s\n", needle);
+            return 0;
+        }
+        printf("Pattern length %d with SimdSearch:", lens[j]);
+        found = SimdSearchWrapper(text, needle, STATS_TIMES / 10);
+        if (found == NULL) {
+            printf("Error2 searching for %s\n", needle);
+            return 0;
+        }
+        printf("Pattern length %d with BoyerMooreNocaseSearch:", lens[j]);
+        found = BoyerMooreNocaseCtxWrapper(text, needle, STATS_TIMES / 10);
+        if (found == NULL) {
+            printf("Error3 searching for %s\n", needle);
+            return 0;
+        }
+        printf("Pattern length %d with SimdNocaseSearch:", lens[j]);
+        found = SimdNocaseSearchWrapper(text, needle, STATS_TIMES / 10);
+        if (found == NULL) {
+            printf("Error4 searching for %s\n", needle);
+            return 0;
+        }
+        printf("\n");
+    }
+    return 1;
+}
+
 #endif
 
 /* Register unittests */
@@ -2362,6 +2523,8 @@ void UtilSpmSearchRegistertests(void) {
     UtRegisterTest("UtilSpmSearchOffsetsTest01", UtilSpmSearchOffsetsTest01, 1);
     UtRegisterTest("UtilSpmSearchOffsetsNocaseTest01", UtilSpmSearchOffsetsNocaseTest01, 1);
 
+    UtRegisterTest("UtilSpmSimdSearchTest01", UtilSpmSimdSearchTest01, 1);
+
 #ifdef ENABLE_SEARCH_STATS
     /* Give some stats searching given a prepared context (look at the wrappers) */
     UtRegisterTest("UtilSpmSearchStatsTest01", UtilSpmSearchStatsTest01, 1);
@@ -2383,6 +2546,8 @@ void UtilSpmSearchRegistertests(void) {
     UtRegisterTest("UtilSpmNocaseSearchStatsTest06", UtilSpmNocaseSearchStatsTest06, 1);
     UtRegisterTest("UtilSpmNocaseSearchStatsTest07", UtilSpmNocaseSearchStatsTest07, 1);
 
+    UtRegisterTest("UtilSpmSimdSearchStatsTest01", UtilSpmSimdSearchStatsTest01, 1);
+
 #endif
 #endif
 }
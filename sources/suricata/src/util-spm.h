@@ -27,6 +27,7 @@
 #include "util-spm-bs.h"
 #include "util-spm-bs2bm.h"
 #include "util-spm-bm.h"
+#include "util-spm-simd.h"
 
 /** Default algorithm to use: Boyer Moore */
 uint8_t *Bs2bmSearch(uint8_t *text, uint32_t textlen, uint8_t *needle, uint16_t needlelen);
@@ -37,10 +38,8 @@ uint8_t *BoyerMooreNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle
 /* Macros for automatic algorithm selection (use them only when you can't store the context) */
 #define SpmSearch(text, textlen, needle, needlelen) ({\
     uint8_t *mfound; \
-    if (needlelen < 4 && textlen < 512) \
-          mfound = BasicSearch(text, textlen, needle, needlelen); \
-    else if (needlelen < 4) \
-          mfound = BasicSearch(text, textlen, needle, needlelen); \
+    if (needlelen <= SPM_SIMD_MAX_LEN) \
+          mfound = SimdSearch(text, textlen, needle, needlelen); \
     else \
           mfound = BoyerMooreSearch(text, textlen, needle, needlelen); \
     mfound; \
@@ -48,14 +47,31 @@ uint8_t *BoyerMooreNocaseSearch(uint8_t *text, uint32_t textlen, uint8_t *needle
 
 #define SpmNocaseSearch(text, textlen, needle, needlelen) ({\
     uint8_t *mfound; \
-    if (needlelen < 4 && textlen < 512) \
-          mfound = BasicSearchNocase(text, textlen, needle, needlelen); \
-    else if (needlelen < 4) \
-          mfound = BasicSearchNocase(text, textlen, needle, needlelen); \
+    if (needlelen <= SPM_SIMD_MAX_LEN) \
+          mfound = SimdNocaseSearch(text, textlen, needle, needlelen); \
     else \
           mfound = BoyerMooreNocaseSearch(text, textlen, needle, needlelen); \
     mfound; \
     })
 
+/**
+ * \brief Search a pattern that has a Boyer Moore context, like a content.
+ *        Short patterns are searched with SimdSearch instead.
+ *
+ * \param nocase search case insensitive, the context must be set up for it
+ */
+static inline uint8_t *SpmBmCtxSearch(uint8_t *text, uint32_t textlen,
+        uint8_t *needle, uint16_t needlelen, BmCtx *bm_ctx, int nocase)
+{
+    if (needlelen <= SPM_SIMD_MAX_LEN) {
+        if (nocase)
+            return SimdNocaseSearch(text, textlen, needle, needlelen);
+        return SimdSearch(text, textlen, needle, needlelen);
+    }
+    if (nocase)
+        return BoyerMooreNocase(needle, needlelen, text, textlen, bm_ctx->bmGs, bm_ctx->bmBc);
+    return BoyerMoore(needle, needlelen, text, textlen, bm_ctx->bmGs, bm_ctx->bmBc);
+}
+
 void UtilSpmSearchRegistertests(void);
 #endif /* __UTIL_SPM_H__ */
@@ -110,6 +110,7 @@ int VariableNameInitHash(DetectEngineCtx *de_ctx) {
         return -1;
 
     de_ctx->variable_names_idx = 0;
+    de_ctx->variable_flowbits_idx = 0;
     return 0;
 }
 
@@ -146,9 +147,13 @@ uint16_t VariableNameGetIdx(DetectEngineCtx *de_ctx, char *name, uint8_t type) {
 
     VariableName *lookup_fn = (VariableName *)HashListTableLookup(de_ctx->variable_names, (void *)fn, 0);
     if (lookup_fn == NULL) {
-        de_ctx->variable_names_idx++;
+        if (type == DETECT_FLOWBITS) {
+            idx = fn->idx = ++de_ctx->variable_flowbits_idx;
+        } else {
+            de_ctx->variable_names_idx++;
 
-        idx = fn->idx = de_ctx->variable_names_idx;
+            idx = fn->idx = de_ctx->variable_names_idx;
+        }
         HashListTableAdd(de_ctx->variable_names, (void *)fn, 0);
         HashListTableAdd(de_ctx->variable_idxs, (void *)fn, 0);
     } else {